@@ -7,19 +7,38 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <pthread.h>
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
 
 // ==================== 随机数生成器（基于种子）====================
 
-static long currentSeed = 0;
-
 // 线性同余生成器（LCG）
-static long lcgNext(void) {
-    currentSeed = (currentSeed * 1103515245 + 12345) & 0x7fffffff;
-    return currentSeed;
+// 状态保存在各自的World中，多个世界（如多个区块）可以交错或并发生成而互不影响
+static long lcgNext(World* world) {
+    world->rngState = (world->rngState * 1103515245 + 12345) & 0x7fffffff;
+    return world->rngState;
 }
 
-static void setSeed(long seed) {
-    currentSeed = seed;
+// 64位混合函数（splitmix64终结步骤），用于从坐标派生独立的确定性种子
+static unsigned long long mixHash64(unsigned long long x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
 }
 
 // ==================== 内部工具：安全缓冲区追加 ====================
@@ -38,15 +57,10 @@ static int bufAppend(char* buffer, size_t bufferSize, int* pos, const char* fmt,
     return 0;
 }
 
+// 清空连接表（节点在世界内存池中，随内存池重置或世界销毁一起回收）
 static void clearAllConnections(World* world) {
     if (!world) return;
     for (int i = 0; i < MAX_ROOMS; i++) {
-        RoomConnection* conn = world->connections[i];
-        while (conn) {
-            RoomConnection* next = conn->next;
-            free(conn);
-            conn = next;
-        }
         world->connections[i] = NULL;
     }
 }
@@ -198,12 +212,719 @@ bool isValidPosition(World* world, int x, int y) {
 }
 
 int getRandom(World* world, int min, int max) {
-    (void)world;  // 参数未使用，但保留以保持接口一致性
     if (min >= max) return min;
-    long r = lcgNext();
+    long r = lcgNext(world);
     return min + (int)(r % (max - min + 1));
 }
 
+// ==================== 并行与计时工具 ====================
+
+typedef struct ParallelThreadArg {
+    ParallelTask task;
+    void* context;
+    int threadIndex;
+} ParallelThreadArg;
+
+#ifdef _WIN32
+static DWORD WINAPI parallelThreadMain(LPVOID param) {
+    ParallelThreadArg* arg = (ParallelThreadArg*)param;
+    arg->task(arg->context, arg->threadIndex);
+    return 0;
+}
+#else
+static void* parallelThreadMain(void* param) {
+    ParallelThreadArg* arg = (ParallelThreadArg*)param;
+    arg->task(arg->context, arg->threadIndex);
+    return NULL;
+}
+#endif
+
+int runParallel(int threadCount, ParallelTask task, void* context) {
+    if (!task) return 0;
+    if (threadCount < 1) threadCount = 1;
+    if (threadCount > MAX_THREADS) threadCount = MAX_THREADS;
+
+    ParallelThreadArg args[MAX_THREADS];
+#ifdef _WIN32
+    HANDLE threads[MAX_THREADS];
+#else
+    pthread_t threads[MAX_THREADS];
+#endif
+    bool started[MAX_THREADS] = {false};
+
+    // 线程0由调用者自己执行；创建失败的线程也在调用者上补做，保证每个序号都执行一次
+    for (int i = 0; i < threadCount; i++) {
+        args[i].task = task;
+        args[i].context = context;
+        args[i].threadIndex = i;
+        if (i == 0) continue;
+#ifdef _WIN32
+        threads[i] = CreateThread(NULL, 0, parallelThreadMain, &args[i], 0, NULL);
+        started[i] = (threads[i] != NULL);
+#else
+        started[i] = (pthread_create(&threads[i], NULL, parallelThreadMain, &args[i]) == 0);
+#endif
+    }
+
+    for (int i = 0; i < threadCount; i++) {
+        if (!started[i]) task(context, i);
+    }
+
+    for (int i = 1; i < threadCount; i++) {
+        if (!started[i]) continue;
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+    return threadCount;
+}
+
+int getCpuCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+}
+
+double getMonotonicTime(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+struct Mutex {
+#ifdef _WIN32
+    CRITICAL_SECTION section;
+#else
+    pthread_mutex_t mutex;
+#endif
+};
+
+struct Thread {
+    ThreadFunc func;
+    void* context;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+};
+
+Mutex* createMutex(void) {
+    Mutex* mutex = (Mutex*)malloc(sizeof(Mutex));
+    if (!mutex) return NULL;
+#ifdef _WIN32
+    InitializeCriticalSection(&mutex->section);
+#else
+    if (pthread_mutex_init(&mutex->mutex, NULL) != 0) {
+        free(mutex);
+        return NULL;
+    }
+#endif
+    return mutex;
+}
+
+void destroyMutex(Mutex* mutex) {
+    if (!mutex) return;
+#ifdef _WIN32
+    DeleteCriticalSection(&mutex->section);
+#else
+    pthread_mutex_destroy(&mutex->mutex);
+#endif
+    free(mutex);
+}
+
+void lockMutex(Mutex* mutex) {
+#ifdef _WIN32
+    EnterCriticalSection(&mutex->section);
+#else
+    pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+void unlockMutex(Mutex* mutex) {
+#ifdef _WIN32
+    LeaveCriticalSection(&mutex->section);
+#else
+    pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+#ifdef _WIN32
+static DWORD WINAPI threadMain(LPVOID param) {
+    Thread* thread = (Thread*)param;
+    thread->func(thread->context);
+    return 0;
+}
+#else
+static void* threadMain(void* param) {
+    Thread* thread = (Thread*)param;
+    thread->func(thread->context);
+    return NULL;
+}
+#endif
+
+Thread* startThread(ThreadFunc func, void* context) {
+    if (!func) return NULL;
+    Thread* thread = (Thread*)malloc(sizeof(Thread));
+    if (!thread) return NULL;
+    thread->func = func;
+    thread->context = context;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, threadMain, thread, 0, NULL);
+    if (!thread->handle) {
+        free(thread);
+        return NULL;
+    }
+#else
+    if (pthread_create(&thread->handle, NULL, threadMain, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+#endif
+    return thread;
+}
+
+void joinThread(Thread* thread) {
+    if (!thread) return;
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    free(thread);
+}
+
+// ==================== 性能追踪 ====================
+// 每个线程第一次记录时领取一个环形缓冲区（只有该线程写入），线程退出时归还，
+// 之后的线程接着使用同一个缓冲区（tid相同）。导出时按写入计数复制，复制期间被覆盖的事件丢弃
+
+typedef struct TraceEvent {
+    const char* name;    // 区间名（静态字符串）
+    long long start;     // 开始时间（纳秒）
+    long long duration;  // 持续时间（纳秒）
+} TraceEvent;
+
+typedef struct TraceRing {
+    atomic_llong head;       // 已写入的事件总数，下一个事件写到events[head % TRACE_RING_SIZE]
+    atomic_llong clearedAt;  // clearTrace时的head，之前的事件不再导出
+    atomic_bool inUse;       // 是否有线程正在使用
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+static atomic_bool traceEnabled = false;
+static TraceRing* traceRings[TRACE_MAX_THREADS];
+static atomic_int traceRingCount = 0;
+static atomic_flag traceClaimLock = ATOMIC_FLAG_INIT;
+static bool traceKeyCreated = false;
+#ifdef _WIN32
+static DWORD traceKey;
+#else
+static pthread_key_t traceKey;
+#endif
+
+static THREAD_LOCAL TraceRing* traceLocalRing = NULL;
+static THREAD_LOCAL bool traceLocalRefused = false;  // 缓冲区已用完，本线程不再尝试领取
+
+static long long getMonotonicNanos(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (long long)((double)counter.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+// 线程退出时归还缓冲区（已记录的事件保留）
+#ifdef _WIN32
+static void WINAPI releaseTraceRing(void* ring) {
+#else
+static void releaseTraceRing(void* ring) {
+#endif
+    if (ring) atomic_store(&((TraceRing*)ring)->inUse, false);
+}
+
+static TraceRing* claimTraceRing(void) {
+    while (atomic_flag_test_and_set(&traceClaimLock)) {
+    }
+
+    if (!traceKeyCreated) {
+#ifdef _WIN32
+        traceKey = FlsAlloc(releaseTraceRing);
+        traceKeyCreated = (traceKey != FLS_OUT_OF_INDEXES);
+#else
+        traceKeyCreated = (pthread_key_create(&traceKey, releaseTraceRing) == 0);
+#endif
+    }
+
+    // 没有线程退出通知时不复用，避免两个线程写同一个缓冲区
+    TraceRing* ring = NULL;
+    int count = atomic_load(&traceRingCount);
+    for (int i = 0; traceKeyCreated && i < count && !ring; i++) {
+        if (!atomic_load(&traceRings[i]->inUse)) ring = traceRings[i];
+    }
+    if (!ring && count < TRACE_MAX_THREADS) {
+        ring = (TraceRing*)malloc(sizeof(TraceRing));
+        if (ring) {
+            atomic_init(&ring->head, 0);
+            atomic_init(&ring->clearedAt, 0);
+            atomic_init(&ring->inUse, false);
+            traceRings[count] = ring;
+            atomic_store(&traceRingCount, count + 1);
+        }
+    }
+
+    if (ring) {
+        atomic_store(&ring->inUse, true);
+        if (traceKeyCreated) {
+#ifdef _WIN32
+            FlsSetValue(traceKey, ring);
+#else
+            pthread_setspecific(traceKey, ring);
+#endif
+        }
+    }
+    atomic_flag_clear(&traceClaimLock);
+    return ring;
+}
+
+void setTraceEnabled(bool enabled) {
+    atomic_store(&traceEnabled, enabled);
+}
+
+bool isTraceEnabled(void) {
+    return atomic_load(&traceEnabled);
+}
+
+long long traceTimestamp(void) {
+    if (!atomic_load_explicit(&traceEnabled, memory_order_relaxed)) return 0;
+    return getMonotonicNanos();
+}
+
+void traceRecord(const char* name, long long start) {
+    if (start == 0 || !name) return;
+    long long end = getMonotonicNanos();
+
+    TraceRing* ring = traceLocalRing;
+    if (!ring) {
+        if (traceLocalRefused) return;
+        ring = traceLocalRing = claimTraceRing();
+        if (!ring) {
+            traceLocalRefused = true;
+            return;
+        }
+    }
+
+    long long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    TraceEvent* event = &ring->events[head % TRACE_RING_SIZE];
+    event->name = name;
+    event->start = start;
+    event->duration = end - start;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// 复制一个缓冲区中仍然有效的事件，返回事件数
+static int snapshotTraceRing(TraceRing* ring, TraceEvent* out) {
+    long long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    long long first = atomic_load(&ring->clearedAt);
+    if (first < head - TRACE_RING_SIZE) first = head - TRACE_RING_SIZE;
+
+    int count = 0;
+    for (long long i = first; i < head; i++) {
+        out[count++] = ring->events[i % TRACE_RING_SIZE];
+    }
+
+    // 复制期间写入线程可能已覆盖（或正在覆盖）最早的几个槽位
+    atomic_thread_fence(memory_order_acquire);
+    long long after = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    long long valid = after + 1 - TRACE_RING_SIZE;
+    int skip = valid > first ? (int)(valid - first) : 0;
+    if (skip >= count) return 0;
+    if (skip > 0) memmove(out, out + skip, (size_t)(count - skip) * sizeof(TraceEvent));
+    return count - skip;
+}
+
+char* getTraceJSON(void) {
+    int ringCount = atomic_load(&traceRingCount);
+    TraceEvent* events = (TraceEvent*)malloc((size_t)(ringCount > 0 ? ringCount : 1) *
+                                             TRACE_RING_SIZE * sizeof(TraceEvent));
+    int counts[TRACE_MAX_THREADS];
+    if (!events) return NULL;
+
+    // 名字都是代码中的标识符，不需要转义
+    size_t size = 64 + (size_t)ringCount * 96;
+    for (int r = 0; r < ringCount; r++) {
+        TraceEvent* ringEvents = events + (size_t)r * TRACE_RING_SIZE;
+        counts[r] = snapshotTraceRing(traceRings[r], ringEvents);
+        for (int i = 0; i < counts[r]; i++) {
+            size += strlen(ringEvents[i].name) + 128;
+        }
+    }
+
+    char* json = (char*)malloc(size);
+    if (!json) {
+        free(events);
+        return NULL;
+    }
+
+    int pos = 0;
+    bool first = true;
+    bool ok = bufAppend(json, size, &pos, "{\"traceEvents\":[") == 0;
+    for (int r = 0; r < ringCount && ok; r++) {
+        ok = bufAppend(json, size, &pos,
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+            first ? "" : ",", r, r) == 0;
+        first = false;
+
+        TraceEvent* ringEvents = events + (size_t)r * TRACE_RING_SIZE;
+        for (int i = 0; i < counts[r] && ok; i++) {
+            TraceEvent* event = &ringEvents[i];
+            ok = bufAppend(json, size, &pos,
+                ",{\"name\":\"%s\",\"cat\":\"byow\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                "\"ts\":%lld.%03lld,\"dur\":%lld.%03lld}",
+                event->name, r, event->start / 1000, event->start % 1000,
+                event->duration / 1000, event->duration % 1000) == 0;
+        }
+    }
+    if (ok) ok = bufAppend(json, size, &pos, "],\"displayTimeUnit\":\"ms\"}") == 0;
+
+    free(events);
+    if (!ok) {
+        free(json);
+        return NULL;
+    }
+    return json;
+}
+
+int writeTraceFile(const char* path) {
+    if (!path) return -1;
+    char* json = getTraceJSON();
+    if (!json) return -1;
+    int result = writeFileAtomic(path, json, strlen(json));
+    free(json);
+    return result;
+}
+
+void clearTrace(void) {
+    int ringCount = atomic_load(&traceRingCount);
+    for (int r = 0; r < ringCount; r++) {
+        atomic_store(&traceRings[r]->clearedAt, atomic_load(&traceRings[r]->head));
+    }
+}
+
+// ==================== 延迟直方图 ====================
+// 写入线程唯一，计数用relaxed的读后写而不是原子加法；读取方看到的各桶可能相差几次记录
+
+static int getLatencyBucket(long long micros) {
+    if (micros < LATENCY_SUB_BUCKETS) return (int)micros;
+    if (micros >= (1LL << LATENCY_MAX_BITS)) return LATENCY_BUCKETS - 1;
+
+    int shift = 1;
+    while ((micros >> shift) >= LATENCY_SUB_BUCKETS) shift++;
+    int sub = (int)(micros >> shift);  // LATENCY_SUB_BUCKETS/2 .. LATENCY_SUB_BUCKETS-1
+    return LATENCY_SUB_BUCKETS + (shift - 1) * (LATENCY_SUB_BUCKETS / 2) + sub - LATENCY_SUB_BUCKETS / 2;
+}
+
+// 桶内的最大值
+static long long getLatencyBucketLimit(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) return bucket;
+    int offset = bucket - LATENCY_SUB_BUCKETS;
+    int shift = offset / (LATENCY_SUB_BUCKETS / 2) + 1;
+    long long sub = LATENCY_SUB_BUCKETS / 2 + offset % (LATENCY_SUB_BUCKETS / 2);
+    return ((sub + 1) << shift) - 1;
+}
+
+static void addRelaxed(atomic_llong* counter, long long value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+void resetLatencyHistogram(LatencyHistogram* histogram) {
+    if (!histogram) return;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        atomic_store_explicit(&histogram->counts[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&histogram->total, 0, memory_order_relaxed);
+    atomic_store_explicit(&histogram->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&histogram->max, 0, memory_order_relaxed);
+}
+
+void recordLatency(LatencyHistogram* histogram, long long micros) {
+    if (!histogram) return;
+    if (micros < 0) micros = 0;
+    addRelaxed(&histogram->counts[getLatencyBucket(micros)], 1);
+    addRelaxed(&histogram->total, 1);
+    addRelaxed(&histogram->sum, micros);
+    if (micros > atomic_load_explicit(&histogram->max, memory_order_relaxed)) {
+        atomic_store_explicit(&histogram->max, micros, memory_order_relaxed);
+    }
+}
+
+void mergeLatencyHistogram(LatencyHistogram* dst, const LatencyHistogram* src) {
+    if (!dst || !src) return;
+    long long total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        long long count = atomic_load_explicit(&src->counts[i], memory_order_relaxed);
+        if (count == 0) continue;
+        addRelaxed(&dst->counts[i], count);
+        total += count;
+    }
+    // 总数取各桶之和，与分位数计算保持一致
+    addRelaxed(&dst->total, total);
+    addRelaxed(&dst->sum, atomic_load_explicit(&src->sum, memory_order_relaxed));
+    long long max = atomic_load_explicit(&src->max, memory_order_relaxed);
+    if (max > atomic_load_explicit(&dst->max, memory_order_relaxed)) {
+        atomic_store_explicit(&dst->max, max, memory_order_relaxed);
+    }
+}
+
+long long getLatencyPercentile(const LatencyHistogram* histogram, double percentile) {
+    if (!histogram) return 0;
+    long long total = atomic_load_explicit(&histogram->total, memory_order_relaxed);
+    if (total <= 0) return 0;
+    if (percentile < 0) percentile = 0;
+    if (percentile > 100) percentile = 100;
+
+    long long rank = (long long)ceil(percentile / 100.0 * (double)total);
+    if (rank < 1) rank = 1;
+    long long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    long long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+        if (seen >= rank) {
+            long long limit = getLatencyBucketLimit(i);
+            return limit < max ? limit : max;
+        }
+    }
+    return max;
+}
+
+long long countLatencyAtMost(const LatencyHistogram* histogram, long long micros) {
+    if (!histogram || micros < 0) return 0;
+    long long count = 0;
+    for (int i = 0; i < LATENCY_BUCKETS && getLatencyBucketLimit(i) <= micros; i++) {
+        count += atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+    }
+    return count;
+}
+
+// ==================== 栅格化（按行跨度写瓦片）====================
+// 房间和走廊段都是矩形：先裁剪到世界范围内一次，再逐行整段写入，
+// 不再对每个格子做边界检查和分支
+
+// 把一行中连续count个墙壁改为走廊（掩码写入：只有等于TILE_WALL的字节被替换）
+static void carveRowSpan(unsigned char* row, int count) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i wall = _mm_set1_epi8(TILE_WALL);
+    const __m128i corridor = _mm_set1_epi8(TILE_CORRIDOR);
+    for (; i + 16 <= count; i += 16) {
+        __m128i tiles = _mm_loadu_si128((const __m128i*)(row + i));
+        __m128i mask = _mm_cmpeq_epi8(tiles, wall);
+        tiles = _mm_or_si128(_mm_andnot_si128(mask, tiles), _mm_and_si128(mask, corridor));
+        _mm_storeu_si128((__m128i*)(row + i), tiles);
+    }
+#endif
+    for (; i < count; i++) {
+        unsigned char tile = row[i];
+        row[i] = (tile == TILE_WALL) ? TILE_CORRIDOR : tile;
+    }
+}
+
+// 把一行中连续count个无归属的格子归给owner（已属于房间或更早走廊的格子保持不变）
+static void claimRowSpan(short* row, int count, short owner) {
+    for (int i = 0; i < count; i++) {
+        if (row[i] == OWNER_NONE) row[i] = owner;
+    }
+}
+
+// 把矩形[x0,x1]x[y0,y1]（含端点）裁剪到世界范围，裁剪后为空返回false
+static bool clipRect(World* world, int* x0, int* y0, int* x1, int* y1) {
+    if (*x0 < 0) *x0 = 0;
+    if (*y0 < 0) *y0 = 0;
+    if (*x1 >= world->width) *x1 = world->width - 1;
+    if (*y1 >= world->height) *y1 = world->height - 1;
+    return *x0 <= *x1 && *y0 <= *y1;
+}
+
+// 用tile填满矩形（房间），并把矩形归给owner
+static void rasterFillRect(World* world, int x, int y, int w, int h, unsigned char tile, short owner) {
+    int x0 = x, y0 = y, x1 = x + w - 1, y1 = y + h - 1;
+    if (!clipRect(world, &x0, &y0, &x1, &y1)) return;
+
+    for (int row = y0; row <= y1; row++) {
+        memset(&world->tiles[row][x0], tile, (size_t)(x1 - x0 + 1));
+        for (int col = x0; col <= x1; col++) {
+            world->owner[row][col] = owner;
+        }
+    }
+}
+
+// 把矩形（含端点）内的墙壁改为走廊，其中无归属的格子归给owner（OWNER_NONE时不记录）
+static void rasterCarveRect(World* world, int x0, int y0, int x1, int y1, short owner) {
+    if (x0 > x1) { int t = x0; x0 = x1; x1 = t; }
+    if (y0 > y1) { int t = y0; y0 = y1; y1 = t; }
+    if (!clipRect(world, &x0, &y0, &x1, &y1)) return;
+
+    for (int row = y0; row <= y1; row++) {
+        carveRowSpan(&world->tiles[row][x0], x1 - x0 + 1);
+        if (owner != OWNER_NONE) claimRowSpan(&world->owner[row][x0], x1 - x0 + 1, owner);
+    }
+}
+
+// ==================== 世界内存池 ====================
+// 顺序切分：分配只移动块内偏移。当前块放不下时换到下一块（之前回退或重置后留下的空闲块，
+// 容量够就复用），都不够才向系统申请新块并插在当前块之后。
+// 临时缓冲区用arenaMark/arenaRelease成对回退，重置时回到第一块，所有块保留
+
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_BLOCK_HEADER ARENA_ROUND(sizeof(ArenaBlock))
+#define WORLD_ALLOC_HEADER ARENA_ROUND(sizeof(World))
+
+// 回退点：回退后该点之后的分配全部作废
+typedef struct ArenaMark {
+    ArenaBlock* block;
+    size_t used;
+} ArenaMark;
+
+static void initArena(Arena* arena, void* memory, size_t size) {
+    ArenaBlock* block = (ArenaBlock*)memory;
+    block->next = NULL;
+    block->capacity = size - ARENA_BLOCK_HEADER;
+    block->used = 0;
+
+    arena->first = block;
+    arena->current = block;
+    arena->used = 0;
+    arena->peak = 0;
+    arena->allocations = 0;
+    arena->systemAllocations = 0;
+    arena->resets = 0;
+}
+
+static void* arenaAlloc(Arena* arena, size_t size) {
+    size = ARENA_ROUND(size);
+    ArenaBlock* block = arena->current;
+
+    if (block->capacity - block->used < size) {
+        ArenaBlock* next = block->next;
+        if (!next || next->capacity < size) {
+            size_t capacity = size > WORLD_ARENA_SIZE ? size : WORLD_ARENA_SIZE;
+            ArenaBlock* fresh = (ArenaBlock*)malloc(ARENA_BLOCK_HEADER + capacity);
+            if (!fresh) return NULL;
+            fresh->capacity = capacity;
+            fresh->used = 0;
+            fresh->next = next;
+            block->next = fresh;
+            next = fresh;
+            arena->systemAllocations++;
+        }
+        block = next;
+        arena->current = block;
+    }
+
+    void* memory = (unsigned char*)block + ARENA_BLOCK_HEADER + block->used;
+    block->used += size;
+    arena->used += size;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    arena->allocations++;
+    return memory;
+}
+
+static ArenaMark arenaMark(Arena* arena) {
+    ArenaMark mark;
+    mark.block = arena->current;
+    mark.used = arena->current->used;
+    return mark;
+}
+
+static void arenaRelease(Arena* arena, ArenaMark mark) {
+    for (ArenaBlock* block = mark.block->next; block; block = block->next) {
+        block->used = 0;
+    }
+    mark.block->used = mark.used;
+    arena->current = mark.block;
+
+    arena->used = 0;
+    for (ArenaBlock* block = arena->first; block != mark.block; block = block->next) {
+        arena->used += block->used;
+    }
+    arena->used += mark.used;
+}
+
+static void resetArena(Arena* arena) {
+    for (ArenaBlock* block = arena->first; block; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->first;
+    arena->used = 0;
+    arena->resets++;
+}
+
+// 释放向系统申请的块（第一块属于World本身）
+static void freeArenaBlocks(Arena* arena) {
+    ArenaBlock* block = arena->first->next;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first->next = NULL;
+}
+
+void getWorldArenaStats(World* world, ArenaStats* stats) {
+    if (!world || !stats) return;
+    memset(stats, 0, sizeof(*stats));
+    for (ArenaBlock* block = world->arena.first; block; block = block->next) {
+        stats->capacity += block->capacity;
+        stats->blocks++;
+    }
+    stats->used = world->arena.used;
+    stats->peak = world->arena.peak;
+    stats->allocations = world->arena.allocations;
+    stats->systemAllocations = world->arena.systemAllocations;
+    stats->resets = world->arena.resets;
+}
+
+static RoomConnection* allocConnection(World* world, int roomId, RoomConnection* next) {
+    RoomConnection* conn = world->freeConnections;
+    if (conn) {
+        world->freeConnections = conn->next;
+    } else {
+        conn = (RoomConnection*)arenaAlloc(&world->arena, sizeof(RoomConnection));
+    }
+    if (!conn) return NULL;
+    conn->roomId = roomId;
+    conn->next = next;
+    return conn;
+}
+
+// 节点放回空闲链表（内存池不能单独释放，反复增删走廊时靠它复用）
+static void releaseConnection(World* world, RoomConnection* conn) {
+    conn->next = world->freeConnections;
+    world->freeConnections = conn;
+}
+
 // ==================== 世界创建和销毁 ====================
 
 static void ensureAtLeastOneRoom(World* world) {
@@ -234,42 +955,42 @@ static void ensureAtLeastOneRoom(World* world) {
     world->rooms[0] = r;
     world->roomCount = 1;
 
-    for (int ry = y; ry < y + h; ry++) {
-        for (int rx = x; rx < x + w; rx++) {
-            if (isValidPosition(world, rx, ry)) {
-                world->tiles[ry][rx] = TILE_ROOM;
-            }
-        }
-    }
+    rasterFillRect(world, x, y, w, h, TILE_ROOM, 0);
 }
 
-World* createWorld(long seed, int width, int height) {
+// 校验并夹紧世界尺寸
+static bool normalizeWorldSize(int* width, int* height) {
     // 过小尺寸：连最小房间+边界都放不下，直接失败更合理
     // （min room 3x3，四周留1格墙 => 至少 5x5）
-    if (width < 5 || height < 5) return NULL;
+    if (*width < 5 || *height < 5) return false;
 
     // 超限：不直接失败，夹紧到最大值，避免前端输入导致“生成世界失败”
-    if (width > MAX_WORLD_WIDTH) width = MAX_WORLD_WIDTH;
-    if (height > MAX_WORLD_HEIGHT) height = MAX_WORLD_HEIGHT;
-
-    World* world = (World*)malloc(sizeof(World));
-    if (!world) return NULL;
+    if (*width > MAX_WORLD_WIDTH) *width = MAX_WORLD_WIDTH;
+    if (*height > MAX_WORLD_HEIGHT) *height = MAX_WORLD_HEIGHT;
+    return true;
+}
 
+// 把世界恢复为全是墙的初始状态（内存池须已重置）
+static void initWorld(World* world, long seed, int width, int height) {
     // 设置种子
-    setSeed(seed);
     world->seed = seed;
+    world->rngState = seed;
     world->width = width;
     world->height = height;
     world->roomCount = 0;
     world->corridorCount = 0;
+    world->mode = GEN_MODE_ROOMS;
+    world->corridorWidth = 1;
+    world->corridorStyle = CORRIDOR_STYLE_HV;
     world->initialized = false;
+    world->version = 0;
+    world->dirtyCount = 0;
+    world->connectivity = NULL;
+    world->freeConnections = NULL;
 
-    // 初始化地图为墙壁
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            world->tiles[y][x] = TILE_WALL;
-        }
-    }
+    // 初始化地图为墙壁，所有格子无归属（OWNER_NONE的每个字节都是0xFF）
+    memset(world->tiles, TILE_WALL, sizeof(world->tiles));
+    memset(world->owner, 0xFF, sizeof(world->owner));
 
     // 初始化房间数组
     for (int i = 0; i < MAX_ROOMS; i++) {
@@ -277,41 +998,35 @@ World* createWorld(long seed, int width, int height) {
         world->connections[i] = NULL;
     }
 
-    // 初始化并查集
-    world->disjointSet = (DisjointSet*)malloc(sizeof(DisjointSet));
-    if (!world->disjointSet) {
-        free(world);
-        return NULL;
-    }
+    // 初始化并查集（第一块总能容纳，不会失败）
+    world->disjointSet = (DisjointSet*)arenaAlloc(&world->arena, sizeof(DisjointSet));
     initDisjointSet(world->disjointSet, MAX_ROOMS);
+}
+
+World* createWorld(long seed, int width, int height) {
+    if (!normalizeWorldSize(&width, &height)) return NULL;
 
+    // World和内存池第一块一次分配
+    World* world = (World*)malloc(WORLD_ALLOC_HEADER + WORLD_ARENA_SIZE);
+    if (!world) return NULL;
+
+    initArena(&world->arena, (unsigned char*)world + WORLD_ALLOC_HEADER, WORLD_ARENA_SIZE);
+    initWorld(world, seed, width, height);
     return world;
 }
 
 void destroyWorld(World* world) {
     if (!world) return;
 
-    // 释放所有连接
-    for (int i = 0; i < MAX_ROOMS; i++) {
-        RoomConnection* conn = world->connections[i];
-        while (conn) {
-            RoomConnection* next = conn->next;
-            free(conn);
-            conn = next;
-        }
-    }
-
-    // 释放并查集
-    if (world->disjointSet) {
-        free(world->disjointSet);
-    }
-
+    // 连接表和并查集都在内存池里，不需要逐个释放
+    freeArenaBlocks(&world->arena);
     free(world);
 }
 
 // ==================== 房间生成实现 ====================
 
 int generateRooms(World* world, int minSize, int maxSize, int maxRooms) {
+    TRACE_BEGIN(span);
     int attempts = 0;
     int maxAttempts = maxRooms * 5;  // 尝试次数
 
@@ -346,61 +1061,210 @@ int generateRooms(World* world, int minSize, int maxSize, int maxRooms) {
             world->rooms[world->roomCount] = newRoom;
 
             // 在地图上绘制房间
-            for (int ry = y; ry < y + h; ry++) {
-                for (int rx = x; rx < x + w; rx++) {
-                    if (isValidPosition(world, rx, ry)) {
-                        world->tiles[ry][rx] = TILE_ROOM;
-                    }
-                }
-            }
+            rasterFillRect(world, x, y, w, h, TILE_ROOM, (short)newRoom.id);
 
             world->roomCount++;
         }
     }
 
+    TRACE_END(span, "generateRooms");
     return 0;
 }
 
-// ==================== 走廊生成实现 ====================
+// ==================== 二叉空间划分房间生成 ====================
+// 按层序（先进先出）切分矩形：每次切分使叶子数加一，直到达到房间上限或无法再切；
+// 叶子之间互不重叠，房间放在叶子内部并留出一格边距，因此不需要任何重叠检测
+
+typedef struct BSPNode {
+    int x, y;
+    int width, height;
+} BSPNode;
+
+static void placeBSPRoom(World* world, BSPNode* leaf, int minSize, int maxSize) {
+    // 叶子四周各留一格墙
+    int maxW = leaf->width - 2 < maxSize ? leaf->width - 2 : maxSize;
+    int maxH = leaf->height - 2 < maxSize ? leaf->height - 2 : maxSize;
+    int w = getRandom(world, minSize, maxW);
+    int h = getRandom(world, minSize, maxH);
+    int x = getRandom(world, leaf->x + 1, leaf->x + leaf->width - 1 - w);
+    int y = getRandom(world, leaf->y + 1, leaf->y + leaf->height - 1 - h);
+
+    Room newRoom;
+    newRoom.id = world->roomCount;
+    newRoom.x = x;
+    newRoom.y = y;
+    newRoom.width = w;
+    newRoom.height = h;
+    newRoom.exists = true;
+    world->rooms[world->roomCount] = newRoom;
+    rasterFillRect(world, x, y, w, h, TILE_ROOM, (short)newRoom.id);
+
+    world->roomCount++;
+}
 
-void drawCorridor(World* world, Point start, Point end) {
-    // 绘制L型走廊
-    Point current = start;
+int generateRoomsBSP(World* world, int minSize, int maxSize, int maxRooms) {
+    if (!world || minSize < 1 || maxSize < minSize) return -1;
+    if (maxRooms > MAX_ROOMS) maxRooms = MAX_ROOMS;
+    if (maxRooms < 1) return -1;
+
+    // 叶子至少要容纳最小房间和两侧的墙
+    int minLeaf = minSize + 2;
+    if (world->width < minLeaf || world->height < minLeaf) return -1;
+
+    // 环形队列：队列中始终是当前的全部叶子
+    BSPNode queue[MAX_ROOMS];
+    int head = 0;
+    int size = 1;
+    queue[0].x = 0;
+    queue[0].y = 0;
+    queue[0].width = world->width;
+    queue[0].height = world->height;
+
+    // 从队首取叶子尝试切分，切不动的放回队尾；连续一轮都切不动时停止
+    int stuck = 0;
+    while (size < maxRooms && stuck < size) {
+        BSPNode node = queue[head];
+        head = (head + 1) % MAX_ROOMS;
+        size--;
+
+        bool canSplitX = node.width >= 2 * minLeaf;
+        bool canSplitY = node.height >= 2 * minLeaf;
+
+        if (!canSplitX && !canSplitY) {
+            queue[(head + size) % MAX_ROOMS] = node;
+            size++;
+            stuck++;
+            continue;
+        }
 
-    // 先水平移动
-    int stepX = (end.x > current.x) ? 1 : -1;
-    while (current.x != end.x) {
-        if (isValidPosition(world, current.x, current.y)) {
-            if (world->tiles[current.y][current.x] == TILE_WALL) {
-                world->tiles[current.y][current.x] = TILE_CORRIDOR;
+        // 优先切较长的一边，接近正方形时随机选择
+        bool splitX;
+        if (canSplitX && canSplitY) {
+            if (node.width * 4 > node.height * 5) {
+                splitX = true;
+            } else if (node.height * 4 > node.width * 5) {
+                splitX = false;
+            } else {
+                splitX = getRandom(world, 0, 1) == 0;
             }
+        } else {
+            splitX = canSplitX;
         }
-        current.x += stepX;
-    }
 
-    // 再垂直移动
-    int stepY = (end.y > current.y) ? 1 : -1;
-    while (current.y != end.y) {
-        if (isValidPosition(world, current.x, current.y)) {
-            if (world->tiles[current.y][current.x] == TILE_WALL) {
-                world->tiles[current.y][current.x] = TILE_CORRIDOR;
-            }
+        BSPNode a = node;
+        BSPNode b = node;
+        if (splitX) {
+            int cut = getRandom(world, minLeaf, node.width - minLeaf);
+            a.width = cut;
+            b.x = node.x + cut;
+            b.width = node.width - cut;
+        } else {
+            int cut = getRandom(world, minLeaf, node.height - minLeaf);
+            a.height = cut;
+            b.y = node.y + cut;
+            b.height = node.height - cut;
         }
-        current.y += stepY;
+
+        queue[(head + size) % MAX_ROOMS] = a;
+        size++;
+        queue[(head + size) % MAX_ROOMS] = b;
+        size++;
+        stuck = 0;
+    }
+
+    for (int i = 0; i < size; i++) {
+        placeBSPRoom(world, &queue[(head + i) % MAX_ROOMS], minSize, maxSize);
+    }
+
+    return 0;
+}
+
+// ==================== 走廊生成实现 ====================
+
+// 走廊的一段矩形（包含两端，未裁剪）
+typedef struct CorridorRect {
+    int x0, y0, x1, y1;
+} CorridorRect;
+
+// 沿行/列方向的一段走廊：centerline为中心线坐标，[from,to]为沿线范围，
+// 宽度向两侧展开（偶数宽度时多出的一格在正方向），两端也展开半个宽度以填满拐角
+static CorridorRect corridorSegmentRect(bool horizontal, int centerline, int from, int to, int width) {
+    int lo = (from < to ? from : to) - (width - 1) / 2;
+    int hi = (from < to ? to : from) + width / 2;
+    int side0 = centerline - (width - 1) / 2;
+    int side1 = centerline + width / 2;
+
+    CorridorRect rect;
+    if (horizontal) {
+        rect.x0 = lo;
+        rect.y0 = side0;
+        rect.x1 = hi;
+        rect.y1 = side1;
+    } else {
+        rect.x0 = side0;
+        rect.y0 = lo;
+        rect.x1 = side1;
+        rect.y1 = hi;
     }
+    return rect;
+}
 
-    // 确保终点也是走廊
-    if (isValidPosition(world, end.x, end.y)) {
-        if (world->tiles[end.y][end.x] == TILE_WALL) {
-            world->tiles[end.y][end.x] = TILE_CORRIDOR;
+// 走廊按宽度和样式展开成的矩形（L型两段，Z型三段），返回段数。
+// 绘制、归属认领和删除时释放的范围都按这里的形状，三者始终一致
+static int getCorridorRects(Point start, Point end, int width, int style, CorridorRect rects[3]) {
+    switch (style) {
+        case CORRIDOR_STYLE_VH:
+            rects[0] = corridorSegmentRect(false, start.x, start.y, end.y, width);
+            rects[1] = corridorSegmentRect(true, end.y, start.x, end.x, width);
+            return 2;
+        case CORRIDOR_STYLE_Z: {
+            int midX = (start.x + end.x) / 2;
+            rects[0] = corridorSegmentRect(true, start.y, start.x, midX, width);
+            rects[1] = corridorSegmentRect(false, midX, start.y, end.y, width);
+            rects[2] = corridorSegmentRect(true, end.y, midX, end.x, width);
+            return 3;
         }
+        case CORRIDOR_STYLE_HV:
+        default:
+            rects[0] = corridorSegmentRect(true, start.y, start.x, end.x, width);
+            rects[1] = corridorSegmentRect(false, end.x, start.y, end.y, width);
+            return 2;
+    }
+}
+
+static void carveCorridor(World* world, Point start, Point end, int width, int style, short owner) {
+    TRACE_BEGIN(span);
+    // 走廊等于各段矩形的并集；逐格绘制时的起止顺序不影响结果（只把墙改为走廊）
+    CorridorRect rects[3];
+    int count = getCorridorRects(start, end, width, style, rects);
+    for (int i = 0; i < count; i++) {
+        rasterCarveRect(world, rects[i].x0, rects[i].y0, rects[i].x1, rects[i].y1, owner);
     }
+    TRACE_END(span, "drawCorridor");
+}
+
+void drawCorridorStyled(World* world, Point start, Point end, int width, int style) {
+    if (!world) return;
+    if (width < 1) width = 1;
+    carveCorridor(world, start, end, width, style, OWNER_NONE);
+}
+
+void drawCorridor(World* world, Point start, Point end) {
+    // 绘制L型走廊：先水平移动，再垂直移动
+    drawCorridorStyled(world, start, end, 1, CORRIDOR_STYLE_HV);
+}
+
+// 绘制登记在world->corridors[corridorIndex]的走廊（按世界的走廊宽度和样式），并记录归属
+static void drawOwnedCorridor(World* world, Point start, Point end, int corridorIndex) {
+    carveCorridor(world, start, end, world->corridorWidth, world->corridorStyle,
+                  (short)(OWNER_CORRIDOR_BASE + corridorIndex));
 }
 
 int generateCorridors(World* world) {
     if (world->roomCount < 2) return -1;
 
     world->corridorCount = 0;
+    world->connectivity = NULL;  // 走廊整体重建，动态连通性在下次使用时重新建立
 
     // 为每对相邻房间生成走廊
     for (int i = 0; i < world->roomCount - 1; i++) {
@@ -438,22 +1302,19 @@ int generateCorridors(World* world) {
             corridor.start = start;
             corridor.end = end;
             corridor.isTurning = (start.x != end.x && start.y != end.y);
+            corridor.exists = true;
 
             world->corridors[world->corridorCount] = corridor;
             world->corridorCount++;
 
             // 绘制走廊
-            drawCorridor(world, start, end);
+            drawOwnedCorridor(world, start, end, corridor.id);
 
             // 添加到图的连接中
-            RoomConnection* conn1 = (RoomConnection*)malloc(sizeof(RoomConnection));
-            conn1->roomId = nearestRoomId;
-            conn1->next = world->connections[i];
+            RoomConnection* conn1 = allocConnection(world, nearestRoomId, world->connections[i]);
+            RoomConnection* conn2 = allocConnection(world, i, world->connections[nearestRoomId]);
+            if (!conn1 || !conn2) return -1;
             world->connections[i] = conn1;
-
-            RoomConnection* conn2 = (RoomConnection*)malloc(sizeof(RoomConnection));
-            conn2->roomId = i;
-            conn2->next = world->connections[nearestRoomId];
             world->connections[nearestRoomId] = conn2;
 
             // 合并并查集
@@ -466,12 +1327,21 @@ int generateCorridors(World* world) {
 
 // ==================== 最小生成树连接 ====================
 
-int connectRoomsWithMST(World* world) {
+// 两个锚点之间的距离（与roomDistance对房间中心的计算方式一致）
+static int anchorDistance(Point a, Point b) {
+    int dx = a.x - b.x;
+    int dy = a.y - b.y;
+    return (int)sqrt(dx * dx + dy * dy);
+}
+
+// Kruskal：以anchors[i]作为房间i的走廊端点，按距离从小到大连接所有房间
+static int connectAnchorsWithMST(World* world, const Point* anchors) {
     if (!world) return -1;
     if (world->roomCount < 2) return -1;
 
-    // 如果被重复调用，先清理旧邻接表，避免内存泄漏/重复边
+    // 如果被重复调用，先清理旧邻接表，避免重复边
     clearAllConnections(world);
+    world->connectivity = NULL;
 
     // 重新初始化并查集
     initDisjointSet(world->disjointSet, world->roomCount);
@@ -490,7 +1360,7 @@ int connectRoomsWithMST(World* world) {
             if (world->rooms[i].exists && world->rooms[j].exists) {
                 edges[edgeCount].room1 = i;
                 edges[edgeCount].room2 = j;
-                edges[edgeCount].distance = roomDistance(&world->rooms[i], &world->rooms[j]);
+                edges[edgeCount].distance = anchorDistance(anchors[i], anchors[j]);
                 edgeCount++;
             }
         }
@@ -515,16 +1385,8 @@ int connectRoomsWithMST(World* world) {
 
         if (!isConnected(world->disjointSet, room1, room2)) {
             // 连接这两个房间
-            Room* r1 = &world->rooms[room1];
-            Room* r2 = &world->rooms[room2];
-
-            int centerX1 = r1->x + r1->width / 2;
-            int centerY1 = r1->y + r1->height / 2;
-            int centerX2 = r2->x + r2->width / 2;
-            int centerY2 = r2->y + r2->height / 2;
-
-            Point start = {centerX1, centerY1};
-            Point end = {centerX2, centerY2};
+            Point start = anchors[room1];
+            Point end = anchors[room2];
 
             // 创建走廊
             if (corridorIndex < MAX_CORRIDORS) {
@@ -533,22 +1395,22 @@ int connectRoomsWithMST(World* world) {
                 corridor.start = start;
                 corridor.end = end;
                 corridor.isTurning = (start.x != end.x && start.y != end.y);
+                corridor.exists = true;
 
                 world->corridors[corridorIndex] = corridor;
                 corridorIndex++;
 
                 // 绘制走廊
-                drawCorridor(world, start, end);
+                drawOwnedCorridor(world, start, end, corridor.id);
 
                 // 添加到图的连接中
-                RoomConnection* conn1 = (RoomConnection*)malloc(sizeof(RoomConnection));
-                conn1->roomId = room2;
-                conn1->next = world->connections[room1];
+                RoomConnection* conn1 = allocConnection(world, room2, world->connections[room1]);
+                RoomConnection* conn2 = allocConnection(world, room1, world->connections[room2]);
+                if (!conn1 || !conn2) {
+                    world->corridorCount = corridorIndex;
+                    return -1;
+                }
                 world->connections[room1] = conn1;
-
-                RoomConnection* conn2 = (RoomConnection*)malloc(sizeof(RoomConnection));
-                conn2->roomId = room1;
-                conn2->next = world->connections[room2];
                 world->connections[room2] = conn2;
 
                 // 合并并查集
@@ -561,29 +1423,3170 @@ int connectRoomsWithMST(World* world) {
     return 0;
 }
 
-// ==================== 世界生成主函数 ====================
-
-World* generateWorldFromSeed(long seed, int width, int height) {
-    World* world = createWorld(seed, width, height);
-    if (!world) return NULL;
+int connectRoomsWithMST(World* world) {
+    if (!world) return -1;
+    if (world->roomCount < 2) return -1;
 
-    // 生成房间（更小的房间，更多数量，更像地牢风格）
-    // 房间尺寸：最小3x3，最大6x6，生成25个房间
-    generateRooms(world, 3, 6, 25);
+    Point centers[MAX_ROOMS];
+    for (int i = 0; i < world->roomCount; i++) {
+        Room* room = &world->rooms[i];
+        centers[i].x = room->x + room->width / 2;
+        centers[i].y = room->y + room->height / 2;
+    }
 
-    // 若随机生成一个都没有，放置保底房间
-    ensureAtLeastOneRoom(world);
+    TRACE_BEGIN(span);
+    int result = connectAnchorsWithMST(world, centers);
+    TRACE_END(span, "connectRoomsWithMST");
+    return result;
+}
 
-    // 使用MST连接所有房间（房间数<2时函数会返回-1，这里保持原逻辑）
-    connectRoomsWithMST(world);
+// ==================== 元胞自动机洞穴 ====================
+// 洞穴位图每行存成若干64位字，位为1表示墙。一步迭代对每个字做移位得到8个方向的邻居，
+// 再用位切片加法器把8个1位输入加成4位计数（每一位平面一个字），64个格子同时完成
 
-    world->initialized = true;
-    return world;
+static unsigned long long cavePadMask(const CaveGrid* grid) {
+    int validBits = grid->width - 64 * (grid->wordsPerRow - 1);
+    if (validBits >= 64) return 0;
+    return ~((1ULL << validBits) - 1);
+}
+
+CaveGrid* createCaveGrid(int width, int height) {
+    if (width < 1 || height < 1) return NULL;
+
+    CaveGrid* grid = (CaveGrid*)malloc(sizeof(CaveGrid));
+    if (!grid) return NULL;
+
+    grid->width = width;
+    grid->height = height;
+    grid->wordsPerRow = (width + 63) / 64;
+
+    size_t words = (size_t)grid->wordsPerRow * height;
+    grid->bits = (unsigned long long*)malloc(words * sizeof(unsigned long long));
+    grid->scratch = (unsigned long long*)malloc(words * sizeof(unsigned long long));
+    if (!grid->bits || !grid->scratch) {
+        destroyCaveGrid(grid);
+        return NULL;
+    }
+
+    memset(grid->bits, 0xff, words * sizeof(unsigned long long));
+    return grid;
+}
+
+void destroyCaveGrid(CaveGrid* grid) {
+    if (!grid) return;
+    free(grid->bits);
+    free(grid->scratch);
+    free(grid);
+}
+
+void seedCaveGrid(CaveGrid* grid, long seed, int fillPercent) {
+    if (!grid) return;
+    if (fillPercent < 0) fillPercent = 0;
+    if (fillPercent > 100) fillPercent = 100;
+
+    // 概率按8位二进制小数表示：从最低位到最高位，位为1则与随机字取或，为0则取与，
+    // 最终每一位为1的概率恰好是 p / 256
+    int p = fillPercent * 256 / 100;
+    unsigned long long state = mixHash64((unsigned long long)seed);
+    unsigned long long padMask = cavePadMask(grid);
+
+    for (int y = 0; y < grid->height; y++) {
+        unsigned long long* row = &grid->bits[(size_t)y * grid->wordsPerRow];
+        for (int w = 0; w < grid->wordsPerRow; w++) {
+            unsigned long long acc = 0;
+            if (p >= 256) {
+                acc = ~0ULL;
+            } else {
+                for (int bit = 0; bit < 8; bit++) {
+                    state += 0x9E3779B97F4A7C15ULL;
+                    unsigned long long r = mixHash64(state);
+                    acc = ((p >> bit) & 1) ? (acc | r) : (acc & r);
+                }
+            }
+            row[w] = acc;
+        }
+        row[grid->wordsPerRow - 1] |= padMask;
+    }
+}
+
+// 全加器：三个位平面相加，得到本位和进位
+static inline void caveFullAdd(unsigned long long a, unsigned long long b, unsigned long long c,
+                               unsigned long long* sum, unsigned long long* carry) {
+    unsigned long long t = a ^ b;
+    *sum = t ^ c;
+    *carry = (a & b) | (t & c);
+}
+
+void stepCaveGrid(CaveGrid* grid) {
+    if (!grid) return;
+
+    const unsigned long long ones = ~0ULL;
+    const int words = grid->wordsPerRow;
+    const unsigned long long padMask = cavePadMask(grid);
+
+    for (int y = 0; y < grid->height; y++) {
+        const unsigned long long* up = y > 0 ? &grid->bits[(size_t)(y - 1) * words] : NULL;
+        const unsigned long long* mid = &grid->bits[(size_t)y * words];
+        const unsigned long long* down = y + 1 < grid->height ? &grid->bits[(size_t)(y + 1) * words] : NULL;
+        unsigned long long* out = &grid->scratch[(size_t)y * words];
+
+        for (int w = 0; w < words; w++) {
+            // 越界（上下行之外、左右字之外）一律视为墙
+            unsigned long long upCur = up ? up[w] : ones;
+            unsigned long long upPrev = (up && w > 0) ? up[w - 1] : ones;
+            unsigned long long upNext = (up && w + 1 < words) ? up[w + 1] : ones;
+            unsigned long long midCur = mid[w];
+            unsigned long long midPrev = w > 0 ? mid[w - 1] : ones;
+            unsigned long long midNext = w + 1 < words ? mid[w + 1] : ones;
+            unsigned long long downCur = down ? down[w] : ones;
+            unsigned long long downPrev = (down && w > 0) ? down[w - 1] : ones;
+            unsigned long long downNext = (down && w + 1 < words) ? down[w + 1] : ones;
+
+            // 位i对应x = 64w + i：左邻居左移一位，右邻居右移一位，跨字部分由相邻字补齐
+            unsigned long long n0 = (upCur << 1) | (upPrev >> 63);
+            unsigned long long n1 = upCur;
+            unsigned long long n2 = (upCur >> 1) | (upNext << 63);
+            unsigned long long n3 = (midCur << 1) | (midPrev >> 63);
+            unsigned long long n4 = (midCur >> 1) | (midNext << 63);
+            unsigned long long n5 = (downCur << 1) | (downPrev >> 63);
+            unsigned long long n6 = downCur;
+            unsigned long long n7 = (downCur >> 1) | (downNext << 63);
+
+            // 8个输入加成4位计数 b3 b2 b1 b0
+            unsigned long long s0, c0, s1, c1, b0, c2, t, c3;
+            caveFullAdd(n0, n1, n2, &s0, &c0);
+            caveFullAdd(n3, n4, n5, &s1, &c1);
+            unsigned long long s2 = n6 ^ n7;
+            unsigned long long c4 = n6 & n7;
+            caveFullAdd(s0, s1, s2, &b0, &c2);
+            caveFullAdd(c0, c1, c4, &t, &c3);
+            unsigned long long b1 = t ^ c2;
+            unsigned long long c5 = t & c2;
+            unsigned long long b2 = c3 ^ c5;
+            unsigned long long b3 = c3 & c5;
+
+            unsigned long long atLeast4 = b3 | b2;
+            unsigned long long atLeast5 = b3 | (b2 & (b1 | b0));
+            out[w] = (midCur & atLeast4) | (~midCur & atLeast5);
+        }
+        out[words - 1] |= padMask;
+    }
+
+    unsigned long long* temp = grid->bits;
+    grid->bits = grid->scratch;
+    grid->scratch = temp;
+}
+
+bool isCaveWall(CaveGrid* grid, int x, int y) {
+    if (!grid || x < 0 || x >= grid->width || y < 0 || y >= grid->height) return true;
+    unsigned long long word = grid->bits[(size_t)y * grid->wordsPerRow + x / 64];
+    return (word >> (x % 64)) & 1;
+}
+
+typedef struct CaveRegion {
+    int size;                 // 格子数
+    int minX, minY;           // 外接矩形
+    int maxX, maxY;
+    long sumX, sumY;          // 坐标和（求重心）
+    int roomId;               // 登记的房间ID，-1表示被填平
+    Point anchor;             // 离重心最近的格子，作为走廊端点
+    int anchorDist;
+} CaveRegion;
+
+// 区域按面积从大到小排序，面积相同按发现顺序
+typedef struct CaveRegionRank {
+    int size;
+    int index;
+} CaveRegionRank;
+
+static int compareCaveRegionRanks(const void* a, const void* b) {
+    const CaveRegionRank* ra = (const CaveRegionRank*)a;
+    const CaveRegionRank* rb = (const CaveRegionRank*)b;
+    if (ra->size != rb->size) return rb->size - ra->size;
+    return ra->index - rb->index;
+}
+
+static int connectOpenRegions(World* world);
+
+int generateCave(World* world, int fillPercent, int steps) {
+    if (!world) return -1;
+
+    const int width = world->width;
+    const int height = world->height;
+
+    CaveGrid* grid = createCaveGrid(width, height);
+    if (!grid) return -1;
+
+    seedCaveGrid(grid, lcgNext(world), fillPercent);
+    for (int i = 0; i < steps; i++) {
+        stepCaveGrid(grid);
+    }
+
+    // 写入瓦片：地图边界保持为墙
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            bool border = (x == 0 || y == 0 || x == width - 1 || y == height - 1);
+            world->tiles[y][x] = (border || isCaveWall(grid, x, y)) ? TILE_WALL : TILE_FLOOR;
+        }
+    }
+    destroyCaveGrid(grid);
+
+    return connectOpenRegions(world);
+}
+
+// 标记所有非墙格子组成的4连通区域，填平过小的区域，把其余区域登记为房间（外接矩形），
+// 再以区域内离重心最近的格子为端点，用并查集（Kruskal）和L型走廊把它们连起来
+static int connectOpenRegions(World* world) {
+    const int width = world->width;
+    const int height = world->height;
+
+    // BFS标记4连通区域
+    static const int dx[4] = {1, -1, 0, 0};
+    static const int dy[4] = {0, 0, 1, -1};
+    int labels[MAX_WORLD_HEIGHT][MAX_WORLD_WIDTH];
+    int queue[MAX_WORLD_WIDTH * MAX_WORLD_HEIGHT];
+    // 区域表只在本函数内使用：从内存池临时切分，连接走廊之前回退
+    ArenaMark scratch = arenaMark(&world->arena);
+    CaveRegion* regions = (CaveRegion*)arenaAlloc(&world->arena, sizeof(CaveRegion) * width * height);
+    if (!regions) return -1;
+    int regionCount = 0;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            labels[y][x] = -1;
+        }
+    }
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (world->tiles[y][x] == TILE_WALL || labels[y][x] >= 0) continue;
+
+            CaveRegion* region = &regions[regionCount];
+            region->size = 0;
+            region->minX = region->maxX = x;
+            region->minY = region->maxY = y;
+            region->sumX = region->sumY = 0;
+            region->roomId = -1;
+
+            int head = 0, tail = 0;
+            labels[y][x] = regionCount;
+            queue[tail++] = y * width + x;
+
+            while (head < tail) {
+                int cx = queue[head] % width;
+                int cy = queue[head] / width;
+                head++;
+
+                region->size++;
+                region->sumX += cx;
+                region->sumY += cy;
+                if (cx < region->minX) region->minX = cx;
+                if (cx > region->maxX) region->maxX = cx;
+                if (cy < region->minY) region->minY = cy;
+                if (cy > region->maxY) region->maxY = cy;
+
+                for (int d = 0; d < 4; d++) {
+                    int nx = cx + dx[d];
+                    int ny = cy + dy[d];
+                    if (!isValidPosition(world, nx, ny)) continue;
+                    if (world->tiles[ny][nx] == TILE_WALL || labels[ny][nx] >= 0) continue;
+                    labels[ny][nx] = regionCount;
+                    queue[tail++] = ny * width + nx;
+                }
+            }
+            regionCount++;
+        }
+    }
+
+    // 保留面积最大的至多MAX_ROOMS个区域，按发现顺序登记为房间
+    CaveRegionRank* ranks = (CaveRegionRank*)arenaAlloc(&world->arena,
+                                                        sizeof(CaveRegionRank) * (regionCount > 0 ? regionCount : 1));
+    if (!ranks) {
+        arenaRelease(&world->arena, scratch);
+        return -1;
+    }
+    for (int i = 0; i < regionCount; i++) {
+        ranks[i].size = regions[i].size;
+        ranks[i].index = i;
+    }
+    qsort(ranks, regionCount, sizeof(CaveRegionRank), compareCaveRegionRanks);
+
+    for (int i = 0; i < regionCount && i < MAX_ROOMS; i++) {
+        if (ranks[i].size < CAVE_MIN_REGION) break;
+        regions[ranks[i].index].roomId = 0;
+    }
+
+    world->roomCount = 0;
+    for (int i = 0; i < regionCount; i++) {
+        CaveRegion* region = &regions[i];
+        if (region->roomId < 0) continue;
+
+        region->roomId = world->roomCount;
+        region->anchorDist = INT_MAX;
+
+        Room room;
+        room.id = world->roomCount;
+        room.x = region->minX;
+        room.y = region->minY;
+        room.width = region->maxX - region->minX + 1;
+        room.height = region->maxY - region->minY + 1;
+        room.exists = true;
+        world->rooms[world->roomCount++] = room;
+    }
+
+    // 填平小区域，并为保留的区域找离重心最近的格子
+    Point anchors[MAX_ROOMS];
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (labels[y][x] < 0) continue;
+            CaveRegion* region = &regions[labels[y][x]];
+            if (region->roomId < 0) {
+                world->tiles[y][x] = TILE_WALL;
+                continue;
+            }
+            world->owner[y][x] = (short)region->roomId;
+            int ddx = x * region->size - (int)region->sumX;
+            int ddy = y * region->size - (int)region->sumY;
+            int dist = abs(ddx) + abs(ddy);
+            if (dist < region->anchorDist) {
+                region->anchorDist = dist;
+                region->anchor.x = x;
+                region->anchor.y = y;
+            }
+        }
+    }
+    for (int i = 0; i < regionCount; i++) {
+        if (regions[i].roomId >= 0) anchors[regions[i].roomId] = regions[i].anchor;
+    }
+    arenaRelease(&world->arena, scratch);
+
+    // 用并查集（Kruskal）和L型走廊把区域连起来
+    if (world->roomCount >= 2) {
+        connectAnchorsWithMST(world, anchors);
+    }
+    return 0;
+}
+
+// ==================== 波函数坍缩（WFC）====================
+// 重叠模型（N=2）：样例中的每个2x2窗口是一个图案，输出格子取其图案的左上角瓦片。
+// 每个格子的可能图案集合是一个64位掩码；传播时邻居允许的图案用按字节查表求并，
+// 每个方向8次查表即可。最小熵格子由带位置索引的二叉堆维护（内存O(格子数)）。
+// 每次修改掩码前把旧值记入撤销日志，观测时记下日志位置作为决策点；发生矛盾时撤销到
+// 最近的决策点并排除当时选择的图案。日志有容量上限，超出时放弃最早一半决策点的回溯能力；
+// 无处可退或回溯次数超过WFC_MAX_BACKTRACKS时整体重启
+
+// 内置样例：'#'墙，'.'房间，'+'走廊
+static const char* wfcDefaultSample[] = {
+    "####################",
+    "#.....##############",
+    "#.....++++++++######",
+    "#.....#######+######",
+    "###+#########+######",
+    "###+#########+######",
+    "###+#####.......####",
+    "###+#####.......####",
+    "###++++++.......+++#",
+    "#########.......##+#",
+    "#########+########+#",
+    "#########+########+#",
+    "####.....+###.....+#",
+    "####.....####.....##",
+    "####.....++++.....##",
+    "####################",
+};
+
+// 方向：0右 1下 2左 3上
+static const int wfcDx[4] = {1, 0, -1, 0};
+static const int wfcDy[4] = {0, 1, 0, -1};
+
+int learnWfcRules(WfcRules* rules, const unsigned char* sample, int width, int height) {
+    if (!rules || !sample || width < 1 || height < 1) return -1;
+
+    unsigned char cells[WFC_MAX_PATTERNS][4];  // 左上、右上、左下、右下
+    rules->patternCount = 0;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            unsigned char block[4];
+            block[0] = sample[y * width + x];
+            block[1] = sample[y * width + (x + 1) % width];
+            block[2] = sample[((y + 1) % height) * width + x];
+            block[3] = sample[((y + 1) % height) * width + (x + 1) % width];
+
+            int found = -1;
+            for (int p = 0; p < rules->patternCount; p++) {
+                if (memcmp(cells[p], block, 4) == 0) {
+                    found = p;
+                    break;
+                }
+            }
+            if (found < 0) {
+                if (rules->patternCount >= WFC_MAX_PATTERNS) return -1;
+                found = rules->patternCount++;
+                memcpy(cells[found], block, 4);
+                rules->patternTile[found] = block[0];
+                rules->weights[found] = 0.0;
+            }
+            rules->weights[found] += 1.0;
+        }
+    }
+
+    // 右邻居：A的右列等于B的左列；下邻居：A的下行等于B的上行；左/上是对称关系
+    memset(rules->compatible, 0, sizeof(rules->compatible));
+    for (int a = 0; a < rules->patternCount; a++) {
+        for (int b = 0; b < rules->patternCount; b++) {
+            if (cells[a][1] == cells[b][0] && cells[a][3] == cells[b][2]) {
+                rules->compatible[0][a] |= 1ULL << b;
+                rules->compatible[2][b] |= 1ULL << a;
+            }
+            if (cells[a][2] == cells[b][0] && cells[a][3] == cells[b][1]) {
+                rules->compatible[1][a] |= 1ULL << b;
+                rules->compatible[3][b] |= 1ULL << a;
+            }
+        }
+    }
+
+    for (int dir = 0; dir < 4; dir++) {
+        for (int byteIndex = 0; byteIndex < 8; byteIndex++) {
+            rules->support[dir][byteIndex][0] = 0;
+            for (int value = 1; value < 256; value++) {
+                // 去掉最低位后的结果已经算好，再并上最低位对应图案
+                int low = __builtin_ctz(value);
+                int p = byteIndex * 8 + low;
+                unsigned long long bit = p < rules->patternCount ? rules->compatible[dir][p] : 0;
+                rules->support[dir][byteIndex][value] =
+                    rules->support[dir][byteIndex][value & (value - 1)] | bit;
+            }
+        }
+    }
+    return 0;
+}
+
+int loadDefaultWfcRules(WfcRules* rules) {
+    const int height = (int)(sizeof(wfcDefaultSample) / sizeof(wfcDefaultSample[0]));
+    const int width = (int)strlen(wfcDefaultSample[0]);
+    unsigned char sample[sizeof(wfcDefaultSample) / sizeof(wfcDefaultSample[0])][32];
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            char c = wfcDefaultSample[y][x];
+            sample[y][x] = (c == '.') ? TILE_ROOM : (c == '+') ? TILE_CORRIDOR : TILE_WALL;
+        }
+    }
+
+    unsigned char packed[sizeof(sample)];
+    for (int y = 0; y < height; y++) {
+        memcpy(&packed[y * width], sample[y], (size_t)width);
+    }
+    return learnWfcRules(rules, packed, width, height);
+}
+
+typedef struct WfcTrailEntry {
+    int cell;
+    unsigned long long oldMask;
+} WfcTrailEntry;
+
+typedef struct WfcDecision {
+    int cell;
+    int pattern;
+    int trailPos;  // 观测前的日志长度
+} WfcDecision;
+
+typedef struct WfcState {
+    const WfcRules* rules;
+    int width, height, cellCount;
+    unsigned long long* masks;  // 每个格子的可能图案
+    double* sumWeight;          // 可能图案的权重和
+    double* sumWeightLog;       // 可能图案的 w*log(w) 之和
+    double* noise;              // 熵的微小扰动，打破平局
+    double* key;                // 堆键：熵 + 扰动
+    int* heap;                  // 未坍缩格子的最小堆
+    int* heapPos;               // 格子在堆中的位置，-1表示不在堆中
+    int heapSize;
+    int* stack;                 // 待传播的格子
+    unsigned char* inStack;     // 格子是否已在传播栈中（栈大小不超过格子数）
+    int stackSize;
+    WfcTrailEntry* trail;       // 撤销日志
+    int trailSize, trailCap;
+    WfcDecision* decisions;     // 决策点
+    int decisionCount, decisionCap;
+    int backtracks;             // 本次尝试已回溯的次数
+    double weightLog[WFC_MAX_PATTERNS];
+    unsigned long long rng;
+} WfcState;
+
+static unsigned long long wfcRandom(WfcState* st) {
+    st->rng += 0x9E3779B97F4A7C15ULL;
+    return mixHash64(st->rng);
+}
+
+static void wfcHeapSwap(WfcState* st, int i, int j) {
+    int a = st->heap[i];
+    int b = st->heap[j];
+    st->heap[i] = b;
+    st->heap[j] = a;
+    st->heapPos[b] = i;
+    st->heapPos[a] = j;
+}
+
+static void wfcHeapSiftUp(WfcState* st, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (st->key[st->heap[parent]] <= st->key[st->heap[i]]) break;
+        wfcHeapSwap(st, i, parent);
+        i = parent;
+    }
+}
+
+static void wfcHeapSiftDown(WfcState* st, int i) {
+    for (;;) {
+        int left = 2 * i + 1;
+        int right = left + 1;
+        int smallest = i;
+        if (left < st->heapSize && st->key[st->heap[left]] < st->key[st->heap[smallest]]) smallest = left;
+        if (right < st->heapSize && st->key[st->heap[right]] < st->key[st->heap[smallest]]) smallest = right;
+        if (smallest == i) break;
+        wfcHeapSwap(st, i, smallest);
+        i = smallest;
+    }
+}
+
+static void wfcHeapRemove(WfcState* st, int cell) {
+    int i = st->heapPos[cell];
+    if (i < 0) return;
+    st->heapSize--;
+    if (i != st->heapSize) {
+        wfcHeapSwap(st, i, st->heapSize);
+        wfcHeapSiftUp(st, i);
+        wfcHeapSiftDown(st, i);
+    }
+    st->heapPos[cell] = -1;
+}
+
+// 按当前掩码重算熵并维护堆：已坍缩（只剩一个图案）的格子移出堆
+static void wfcRefresh(WfcState* st, int cell) {
+    unsigned long long mask = st->masks[cell];
+    double sw = 0.0, swl = 0.0;
+    while (mask) {
+        int p = __builtin_ctzll(mask);
+        mask &= mask - 1;
+        sw += st->rules->weights[p];
+        swl += st->rules->weights[p] * st->weightLog[p];
+    }
+    st->sumWeight[cell] = sw;
+    st->sumWeightLog[cell] = swl;
+
+    if (__builtin_popcountll(st->masks[cell]) <= 1) {
+        wfcHeapRemove(st, cell);
+        return;
+    }
+
+    st->key[cell] = log(sw) - swl / sw + st->noise[cell];
+    int i = st->heapPos[cell];
+    if (i < 0) {
+        i = st->heapSize++;
+        st->heap[i] = cell;
+        st->heapPos[cell] = i;
+    }
+    wfcHeapSiftUp(st, i);
+    wfcHeapSiftDown(st, st->heapPos[cell]);
+}
+
+// 日志满时放弃最早一半决策点：之前的修改不再能撤销
+static void wfcTrimTrail(WfcState* st) {
+    // 每个决策点至少产生一条日志，所以第二个及以后的决策点位置都大于0
+    int keepFrom = st->decisionCount > 1 ? st->decisionCount / 2 : st->decisionCount;
+    int cut = keepFrom < st->decisionCount ? st->decisions[keepFrom].trailPos : st->trailSize;
+
+    memmove(st->trail, st->trail + cut, sizeof(WfcTrailEntry) * (size_t)(st->trailSize - cut));
+    st->trailSize -= cut;
+
+    memmove(st->decisions, st->decisions + keepFrom,
+            sizeof(WfcDecision) * (size_t)(st->decisionCount - keepFrom));
+    st->decisionCount -= keepFrom;
+    for (int i = 0; i < st->decisionCount; i++) {
+        st->decisions[i].trailPos -= cut;
+    }
+}
+
+static void wfcSetMask(WfcState* st, int cell, unsigned long long mask) {
+    if (st->trailSize >= st->trailCap) wfcTrimTrail(st);
+    st->trail[st->trailSize].cell = cell;
+    st->trail[st->trailSize].oldMask = st->masks[cell];
+    st->trailSize++;
+
+    st->masks[cell] = mask;
+    wfcRefresh(st, cell);
+    if (!st->inStack[cell]) {
+        st->inStack[cell] = 1;
+        st->stack[st->stackSize++] = cell;
+    }
+}
+
+static void wfcClearStack(WfcState* st) {
+    while (st->stackSize > 0) {
+        st->inStack[st->stack[--st->stackSize]] = 0;
+    }
+}
+
+// 传播约束，出现空掩码返回false
+static bool wfcPropagate(WfcState* st) {
+    while (st->stackSize > 0) {
+        int cell = st->stack[--st->stackSize];
+        st->inStack[cell] = 0;
+        int x = cell % st->width;
+        int y = cell / st->width;
+        unsigned long long mask = st->masks[cell];
+
+        for (int dir = 0; dir < 4; dir++) {
+            int nx = x + wfcDx[dir];
+            int ny = y + wfcDy[dir];
+            if (nx < 0 || nx >= st->width || ny < 0 || ny >= st->height) continue;
+
+            unsigned long long allowed = 0;
+            for (int byteIndex = 0; byteIndex < 8; byteIndex++) {
+                allowed |= st->rules->support[dir][byteIndex][(mask >> (byteIndex * 8)) & 0xff];
+            }
+
+            int neighbor = ny * st->width + nx;
+            unsigned long long narrowed = st->masks[neighbor] & allowed;
+            if (narrowed == st->masks[neighbor]) continue;
+            if (narrowed == 0) {
+                wfcClearStack(st);
+                return false;
+            }
+            wfcSetMask(st, neighbor, narrowed);
+        }
+    }
+    return true;
+}
+
+static void wfcReset(WfcState* st) {
+    unsigned long long all = st->rules->patternCount >= 64
+        ? ~0ULL : ((1ULL << st->rules->patternCount) - 1);
+
+    st->heapSize = 0;
+    wfcClearStack(st);
+    st->trailSize = 0;
+    st->decisionCount = 0;
+    st->backtracks = 0;
+    for (int i = 0; i < st->cellCount; i++) {
+        st->masks[i] = all;
+        st->noise[i] = (double)(wfcRandom(st) >> 11) / 9007199254740992.0 * 1e-6;
+        st->heapPos[i] = -1;
+        st->inStack[i] = 0;
+    }
+    for (int i = 0; i < st->cellCount; i++) {
+        wfcRefresh(st, i);
+    }
+}
+
+// 撤销到最近的决策点并排除当时的选择；没有决策点可退或回溯次数用尽时返回false
+static bool wfcBacktrack(WfcState* st) {
+    while (st->decisionCount > 0 && st->backtracks < WFC_MAX_BACKTRACKS) {
+        st->backtracks++;
+        WfcDecision decision = st->decisions[--st->decisionCount];
+
+        while (st->trailSize > decision.trailPos) {
+            WfcTrailEntry* entry = &st->trail[--st->trailSize];
+            st->masks[entry->cell] = entry->oldMask;
+            wfcRefresh(st, entry->cell);
+        }
+
+        unsigned long long remaining = st->masks[decision.cell] & ~(1ULL << decision.pattern);
+        if (remaining == 0) continue;
+
+        wfcSetMask(st, decision.cell, remaining);
+        if (wfcPropagate(st)) return true;
+    }
+    return false;
+}
+
+// 按权重在掩码中随机选一个图案
+static int wfcChoosePattern(WfcState* st, int cell) {
+    unsigned long long mask = st->masks[cell];
+    double target = (double)(wfcRandom(st) >> 11) / 9007199254740992.0 * st->sumWeight[cell];
+    int last = 0;
+    while (mask) {
+        int p = __builtin_ctzll(mask);
+        mask &= mask - 1;
+        target -= st->rules->weights[p];
+        last = p;
+        if (target < 0) break;
+    }
+    return last;
+}
+
+int runWfc(const WfcRules* rules, long seed, int width, int height, unsigned char* out) {
+    if (!rules || !out || rules->patternCount < 1) return -1;
+    if (width < 1 || height < 1 || width > WFC_MAX_SIZE || height > WFC_MAX_SIZE) return -1;
+
+    WfcState st;
+    memset(&st, 0, sizeof(st));
+    st.rules = rules;
+    st.width = width;
+    st.height = height;
+    st.cellCount = width * height;
+    st.rng = mixHash64((unsigned long long)seed);
+    // 日志容量与格子数成正比（每个格子平均可被记录2次）
+    st.trailCap = 2 * st.cellCount + 64;
+    st.decisionCap = st.cellCount;
+
+    size_t n = (size_t)st.cellCount;
+    st.masks = (unsigned long long*)malloc(n * sizeof(unsigned long long));
+    st.sumWeight = (double*)malloc(n * sizeof(double));
+    st.sumWeightLog = (double*)malloc(n * sizeof(double));
+    st.noise = (double*)malloc(n * sizeof(double));
+    st.key = (double*)malloc(n * sizeof(double));
+    st.heap = (int*)malloc(n * sizeof(int));
+    st.heapPos = (int*)malloc(n * sizeof(int));
+    st.stack = (int*)malloc(n * sizeof(int));
+    st.inStack = (unsigned char*)calloc(n, 1);
+    st.trail = (WfcTrailEntry*)malloc((size_t)st.trailCap * sizeof(WfcTrailEntry));
+    st.decisions = (WfcDecision*)malloc((size_t)st.decisionCap * sizeof(WfcDecision));
+
+    int result = -1;
+    if (st.masks && st.sumWeight && st.sumWeightLog && st.noise && st.key &&
+        st.heap && st.heapPos && st.stack && st.inStack && st.trail && st.decisions) {
+        for (int p = 0; p < rules->patternCount; p++) {
+            st.weightLog[p] = log(rules->weights[p]);
+        }
+
+        for (int attempt = 0; attempt <= WFC_MAX_RESTARTS && result != 0; attempt++) {
+            wfcReset(&st);
+            bool failed = false;
+
+            while (st.heapSize > 0) {
+                int cell = st.heap[0];
+                int pattern = wfcChoosePattern(&st, cell);
+
+                if (st.decisionCount >= st.decisionCap) wfcTrimTrail(&st);
+                st.decisions[st.decisionCount].cell = cell;
+                st.decisions[st.decisionCount].pattern = pattern;
+                st.decisions[st.decisionCount].trailPos = st.trailSize;
+                st.decisionCount++;
+
+                wfcSetMask(&st, cell, 1ULL << pattern);
+                if (!wfcPropagate(&st) && !wfcBacktrack(&st)) {
+                    failed = true;
+                    break;
+                }
+            }
+
+            if (!failed) {
+                for (int i = 0; i < st.cellCount; i++) {
+                    out[i] = rules->patternTile[__builtin_ctzll(st.masks[i])];
+                }
+                result = 0;
+            }
+        }
+    }
+
+    free(st.masks);
+    free(st.sumWeight);
+    free(st.sumWeightLog);
+    free(st.noise);
+    free(st.key);
+    free(st.heap);
+    free(st.heapPos);
+    free(st.stack);
+    free(st.inStack);
+    free(st.trail);
+    free(st.decisions);
+    return result;
+}
+
+int generateWfc(World* world) {
+    if (!world) return -1;
+
+    // 规则表和输出缓冲区从内存池临时切分，写入瓦片后立即回退，之后再连接区域
+    ArenaMark scratch = arenaMark(&world->arena);
+    WfcRules* rules = (WfcRules*)arenaAlloc(&world->arena, sizeof(WfcRules));
+    unsigned char* out = (unsigned char*)arenaAlloc(&world->arena, (size_t)world->width * world->height);
+    bool collapsed = rules && out && loadDefaultWfcRules(rules) == 0 &&
+                     runWfc(rules, lcgNext(world), world->width, world->height, out) == 0;
+
+    if (collapsed) {
+        // 写入瓦片：地图边界保持为墙
+        for (int y = 0; y < world->height; y++) {
+            for (int x = 0; x < world->width; x++) {
+                bool border = (x == 0 || y == 0 || x == world->width - 1 || y == world->height - 1);
+                world->tiles[y][x] = border ? TILE_WALL : out[y * world->width + x];
+            }
+        }
+    }
+    arenaRelease(&world->arena, scratch);
+
+    return collapsed ? connectOpenRegions(world) : -1;
+}
+
+// ==================== 世界生成主函数 ====================
+
+World* generateWorldFromSeed(long seed, int width, int height) {
+    return generateWorldFromSeedWithMode(seed, width, height, GEN_MODE_ROOMS);
+}
+
+// 在刚初始化的世界上按模式生成房间并连通
+static void populateWorld(World* world, int mode) {
+    world->mode = mode;
+
+    // 生成房间（更小的房间，更多数量，更像地牢风格）
+    // 房间尺寸：最小3x3，最大6x6，生成25个房间
+    switch (mode) {
+        case GEN_MODE_BSP: {
+            TRACE_BEGIN(span);
+            generateRoomsBSP(world, 3, 6, 25);
+            TRACE_END(span, "generateRoomsBSP");
+            break;
+        }
+        case GEN_MODE_CAVE: {
+            // 洞穴自行完成区域连通（走廊端点取在区域内部的格子上）
+            TRACE_BEGIN(span);
+            generateCave(world, CAVE_FILL_PERCENT, CAVE_STEPS);
+            TRACE_END(span, "generateCave");
+            break;
+        }
+        case GEN_MODE_WFC: {
+            TRACE_BEGIN(span);
+            generateWfc(world);
+            TRACE_END(span, "generateWfc");
+            break;
+        }
+        case GEN_MODE_ROOMS:
+        default:
+            world->mode = GEN_MODE_ROOMS;
+            generateRooms(world, 3, 6, 25);
+            break;
+    }
+
+    // 若随机生成一个都没有，放置保底房间
+    ensureAtLeastOneRoom(world);
+
+    // 使用MST连接所有房间（房间数<2时函数会返回-1，这里保持原逻辑）
+    if (world->mode != GEN_MODE_CAVE && world->mode != GEN_MODE_WFC) {
+        connectRoomsWithMST(world);
+    }
+
+    world->initialized = true;
+}
+
+World* generateWorldFromSeedWithMode(long seed, int width, int height, int mode) {
+    return generateWorldWithCorridors(seed, width, height, mode, 1, CORRIDOR_STYLE_HV);
+}
+
+static bool isValidCorridorShape(int corridorWidth, int corridorStyle) {
+    return corridorWidth >= 1 && corridorWidth <= MAX_CORRIDOR_WIDTH &&
+           corridorStyle >= 0 && corridorStyle < CORRIDOR_STYLE_COUNT;
+}
+
+World* generateWorldWithCorridors(long seed, int width, int height, int mode, int corridorWidth, int corridorStyle) {
+    if (!isValidCorridorShape(corridorWidth, corridorStyle)) return NULL;
+
+    TRACE_BEGIN(span);
+    World* world = createWorld(seed, width, height);
+    if (!world) return NULL;
+    world->corridorWidth = corridorWidth;
+    world->corridorStyle = corridorStyle;
+    populateWorld(world, mode);
+    TRACE_END(span, "generateWorldFromSeed");
+    return world;
+}
+
+int regenerateWorld(World* world, long seed, int width, int height, int mode) {
+    return regenerateWorldWithCorridors(world, seed, width, height, mode, 1, CORRIDOR_STYLE_HV);
+}
+
+int regenerateWorldWithCorridors(World* world, long seed, int width, int height, int mode,
+                                 int corridorWidth, int corridorStyle) {
+    if (!world || !normalizeWorldSize(&width, &height)) return -1;
+    if (!isValidCorridorShape(corridorWidth, corridorStyle)) return -1;
+
+    TRACE_BEGIN(span);
+    resetArena(&world->arena);
+    initWorld(world, seed, width, height);
+    world->corridorWidth = corridorWidth;
+    world->corridorStyle = corridorStyle;
+    populateWorld(world, mode);
+    TRACE_END(span, "regenerateWorld");
+    return 0;
+}
+
+static const char* generatorModeNames[] = {"rooms", "bsp", "cave", "wfc"};
+#define GEN_MODE_COUNT ((int)(sizeof(generatorModeNames) / sizeof(generatorModeNames[0])))
+
+int parseGeneratorMode(const char* name) {
+    if (!name) return -1;
+    for (int i = 0; i < GEN_MODE_COUNT; i++) {
+        if (strcmp(name, generatorModeNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char* getGeneratorModeName(int mode) {
+    if (mode < 0 || mode >= GEN_MODE_COUNT) return generatorModeNames[GEN_MODE_ROOMS];
+    return generatorModeNames[mode];
+}
+
+static const char* corridorStyleNames[CORRIDOR_STYLE_COUNT] = {"hv", "vh", "z"};
+
+int parseCorridorStyle(const char* name) {
+    if (!name) return -1;
+    for (int i = 0; i < CORRIDOR_STYLE_COUNT; i++) {
+        if (strcmp(name, corridorStyleNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char* getCorridorStyleName(int style) {
+    if (style < 0 || style >= CORRIDOR_STYLE_COUNT) return corridorStyleNames[CORRIDOR_STYLE_HV];
+    return corridorStyleNames[style];
+}
+
+// ==================== 无限区块世界 ====================
+// 每个区块只由(seed, chunkX, chunkY)决定，按需生成，生成代价与可见区域成正比；
+// 相邻区块在共享边上由同一哈希得到门户位置，各自把走廊连到门户即可无缝拼接
+
+long getChunkSeed(long seed, int chunkX, int chunkY) {
+    unsigned long long h = mixHash64((unsigned long long)seed);
+    h = mixHash64(h ^ (unsigned int)chunkX);
+    h = mixHash64(h ^ ((unsigned long long)(unsigned int)chunkY << 32));
+    return (long)(h & 0x7fffffff);
+}
+
+// 共享边上的门户偏移：竖直边以其右侧区块标识，水平边以其下方区块标识
+static int chunkEdgeOffset(long seed, int edgeX, int edgeY, bool vertical) {
+    unsigned long long h = (unsigned long long)getChunkSeed(seed, edgeX, edgeY);
+    h = mixHash64(h ^ (vertical ? 0x56ULL : 0x48ULL));
+    // 避开角落，保证门户两侧都有墙
+    return 2 + (int)(h % (CHUNK_SIZE - 4));
+}
+
+Point getChunkPortal(long seed, int chunkX, int chunkY, int edge) {
+    Point p = {0, 0};
+    switch (edge) {
+        case CHUNK_EDGE_NORTH:
+            p.x = chunkEdgeOffset(seed, chunkX, chunkY, false);
+            p.y = 0;
+            break;
+        case CHUNK_EDGE_SOUTH:
+            p.x = chunkEdgeOffset(seed, chunkX, chunkY + 1, false);
+            p.y = CHUNK_SIZE - 1;
+            break;
+        case CHUNK_EDGE_WEST:
+            p.x = 0;
+            p.y = chunkEdgeOffset(seed, chunkX, chunkY, true);
+            break;
+        case CHUNK_EDGE_EAST:
+            p.x = CHUNK_SIZE - 1;
+            p.y = chunkEdgeOffset(seed, chunkX + 1, chunkY, true);
+            break;
+        default:
+            break;
+    }
+    return p;
+}
+
+// 用走廊把离门户最近的房间连到门户
+static void connectPortal(World* world, Point portal, int edge) {
+    int nearest = -1;
+    int minDist = INT_MAX;
+    for (int i = 0; i < world->roomCount; i++) {
+        if (!world->rooms[i].exists) continue;
+        int dx = world->rooms[i].x + world->rooms[i].width / 2 - portal.x;
+        int dy = world->rooms[i].y + world->rooms[i].height / 2 - portal.y;
+        int dist = dx * dx + dy * dy;
+        if (dist < minDist) {
+            minDist = dist;
+            nearest = i;
+        }
+    }
+    if (nearest < 0) return;
+
+    Room* room = &world->rooms[nearest];
+    Point center = {room->x + room->width / 2, room->y + room->height / 2};
+
+    // drawCorridor先水平后垂直：东西门户从门户出发，南北门户以门户为终点，
+    // 这样靠近边界的一段总是垂直于边界，不会沿边界延伸
+    Point start = center;
+    Point end = portal;
+    if (edge == CHUNK_EDGE_EAST || edge == CHUNK_EDGE_WEST) {
+        start = portal;
+        end = center;
+    }
+    if (world->corridorCount >= MAX_CORRIDORS) {
+        drawCorridor(world, start, end);
+        return;
+    }
+    drawOwnedCorridor(world, start, end, world->corridorCount);
+
+    Corridor corridor;
+    corridor.id = world->corridorCount;
+    corridor.start = start;
+    corridor.end = end;
+    corridor.isTurning = (start.x != end.x && start.y != end.y);
+    corridor.exists = true;
+    world->corridors[world->corridorCount] = corridor;
+    world->corridorCount++;
+}
+
+World* generateChunk(long seed, int chunkX, int chunkY) {
+    World* world = createWorld(getChunkSeed(seed, chunkX, chunkY), CHUNK_SIZE, CHUNK_SIZE);
+    if (!world) return NULL;
+
+    // 与generateWorldFromSeed保持相同的房间参数
+    generateRooms(world, 3, 6, 25);
+    ensureAtLeastOneRoom(world);
+    connectRoomsWithMST(world);
+
+    for (int edge = 0; edge < 4; edge++) {
+        connectPortal(world, getChunkPortal(seed, chunkX, chunkY, edge), edge);
+    }
+
+    world->initialized = true;
+    return world;
+}
+
+// ==================== 区块缓存 ====================
+
+ChunkCache* createChunkCache(long seed, int viewRadius) {
+    ChunkCache* cache = (ChunkCache*)malloc(sizeof(ChunkCache));
+    if (!cache) return NULL;
+
+    cache->seed = seed;
+    cache->count = 0;
+    cache->centerX = 0;
+    cache->centerY = 0;
+    cache->viewRadius = viewRadius > 0 ? viewRadius : CHUNK_VIEW_RADIUS;
+    for (int i = 0; i < CHUNK_CACHE_CAPACITY; i++) {
+        cache->entries[i].used = false;
+        cache->entries[i].world = NULL;
+    }
+    return cache;
+}
+
+static void evictChunk(ChunkCache* cache, ChunkEntry* entry) {
+    destroyWorld(entry->world);
+    entry->world = NULL;
+    entry->used = false;
+    cache->count--;
+}
+
+void destroyChunkCache(ChunkCache* cache) {
+    if (!cache) return;
+
+    for (int i = 0; i < CHUNK_CACHE_CAPACITY; i++) {
+        if (cache->entries[i].used) {
+            evictChunk(cache, &cache->entries[i]);
+        }
+    }
+    free(cache);
+}
+
+// 区块到玩家所在区块的切比雪夫距离
+static int chunkDistance(ChunkCache* cache, int chunkX, int chunkY) {
+    int dx = abs(chunkX - cache->centerX);
+    int dy = abs(chunkY - cache->centerY);
+    return dx > dy ? dx : dy;
+}
+
+ChunkEntry* getChunk(ChunkCache* cache, int chunkX, int chunkY) {
+    if (!cache) return NULL;
+
+    ChunkEntry* slot = NULL;
+    for (int i = 0; i < CHUNK_CACHE_CAPACITY; i++) {
+        ChunkEntry* entry = &cache->entries[i];
+        if (entry->used) {
+            if (entry->chunkX == chunkX && entry->chunkY == chunkY) return entry;
+        } else if (!slot) {
+            slot = entry;
+        }
+    }
+
+    // 缓存已满：淘汰离玩家最远的区块
+    if (!slot) {
+        int maxDist = -1;
+        for (int i = 0; i < CHUNK_CACHE_CAPACITY; i++) {
+            ChunkEntry* entry = &cache->entries[i];
+            int dist = chunkDistance(cache, entry->chunkX, entry->chunkY);
+            if (dist > maxDist) {
+                maxDist = dist;
+                slot = entry;
+            }
+        }
+        evictChunk(cache, slot);
+    }
+
+    World* world = generateChunk(cache->seed, chunkX, chunkY);
+    if (!world) return NULL;
+
+    slot->chunkX = chunkX;
+    slot->chunkY = chunkY;
+    slot->world = world;
+    for (int edge = 0; edge < 4; edge++) {
+        slot->portals[edge] = getChunkPortal(cache->seed, chunkX, chunkY, edge);
+    }
+    slot->used = true;
+    cache->count++;
+    return slot;
+}
+
+int updateChunkCenter(ChunkCache* cache, int chunkX, int chunkY) {
+    if (!cache) return 0;
+
+    cache->centerX = chunkX;
+    cache->centerY = chunkY;
+
+    int evicted = 0;
+    for (int i = 0; i < CHUNK_CACHE_CAPACITY; i++) {
+        ChunkEntry* entry = &cache->entries[i];
+        if (entry->used && chunkDistance(cache, entry->chunkX, entry->chunkY) > cache->viewRadius) {
+            evictChunk(cache, entry);
+            evicted++;
+        }
+    }
+    return evicted;
+}
+
+// ==================== 分区并行生成 ====================
+// 地图被切成互不重叠的分区，每个分区用(seed, 分区坐标)派生的随机数流独立生成房间和局部MST，
+// 只写自己的瓦片区域，因此可以任意分配给线程；跨分区的全局MST在所有分区完成后顺序构建，
+// 整个结果只由种子决定，与线程数无关
+
+typedef struct TiledJob {
+    TiledWorld* world;
+    TiledLink* candidates;   // 每个分区两条候选连接：[2i]向右，[2i+1]向下
+    atomic_int nextRegion;   // 下一个待领取的分区
+} TiledJob;
+
+// 在原始瓦片数组上绘制L型走廊（与drawCorridor一致：先水平后垂直，只覆盖墙壁），
+// 端点都在世界内部，无需裁剪
+static void drawTiledCorridor(TiledWorld* world, Point start, Point end) {
+    int x0 = start.x < end.x ? start.x : end.x;
+    int x1 = start.x < end.x ? end.x : start.x;
+    carveRowSpan(&world->tiles[(size_t)start.y * world->width + x0], x1 - x0 + 1);
+
+    int y0 = start.y < end.y ? start.y : end.y;
+    int y1 = start.y < end.y ? end.y : start.y;
+    for (int y = y0; y <= y1; y++) {
+        unsigned char* tile = &world->tiles[(size_t)y * world->width + end.x];
+        if (*tile == TILE_WALL) *tile = TILE_CORRIDOR;
+    }
+}
+
+static void generateRegion(TiledWorld* world, int index) {
+    TiledRegion* region = &world->regions[index];
+    int regionX = index % world->regionsX;
+    int regionY = index / world->regionsX;
+
+    region->roomCount = 0;
+    World* local = createWorld(getChunkSeed(world->seed, regionX, regionY),
+                               region->width, region->height);
+    if (!local) return;
+
+    generateRooms(local, 3, 6, REGION_ROOMS);
+    ensureAtLeastOneRoom(local);
+    connectRoomsWithMST(local);
+
+    for (int y = 0; y < region->height; y++) {
+        memcpy(&world->tiles[(size_t)(region->y + y) * world->width + region->x],
+               local->tiles[y], (size_t)region->width);
+    }
+
+    for (int i = 0; i < local->roomCount; i++) {
+        if (!local->rooms[i].exists) continue;
+        Room room = local->rooms[i];
+        room.id = region->roomCount;
+        room.x += region->x;
+        room.y += region->y;
+        region->rooms[region->roomCount++] = room;
+    }
+
+    destroyWorld(local);
+}
+
+// 两个相邻分区之间距离最近的一对房间
+static void findRegionLink(TiledWorld* world, int regionA, int regionB, TiledLink* link) {
+    TiledRegion* a = &world->regions[regionA];
+    TiledRegion* b = &world->regions[regionB];
+
+    link->regionA = regionA;
+    link->regionB = regionB;
+    link->roomA = -1;
+    link->roomB = -1;
+    link->distance = INT_MAX;
+
+    for (int i = 0; i < a->roomCount; i++) {
+        for (int j = 0; j < b->roomCount; j++) {
+            int dist = roomDistance(&a->rooms[i], &b->rooms[j]);
+            if (dist < link->distance) {
+                link->distance = dist;
+                link->roomA = i;
+                link->roomB = j;
+            }
+        }
+    }
+}
+
+static void tiledRegionTask(void* context, int threadIndex) {
+    (void)threadIndex;
+    TiledJob* job = (TiledJob*)context;
+    TiledWorld* world = job->world;
+    int regionCount = world->regionsX * world->regionsY;
+
+    for (;;) {
+        int index = atomic_fetch_add(&job->nextRegion, 1);
+        if (index >= regionCount) break;
+        generateRegion(world, index);
+    }
+}
+
+static void tiledLinkTask(void* context, int threadIndex) {
+    (void)threadIndex;
+    TiledJob* job = (TiledJob*)context;
+    TiledWorld* world = job->world;
+    int regionCount = world->regionsX * world->regionsY;
+
+    for (;;) {
+        int index = atomic_fetch_add(&job->nextRegion, 1);
+        if (index >= regionCount) break;
+
+        TiledLink* right = &job->candidates[2 * index];
+        TiledLink* down = &job->candidates[2 * index + 1];
+        right->distance = INT_MAX;
+        down->distance = INT_MAX;
+
+        if (index % world->regionsX + 1 < world->regionsX) {
+            findRegionLink(world, index, index + 1, right);
+        }
+        if (index / world->regionsX + 1 < world->regionsY) {
+            findRegionLink(world, index, index + world->regionsX, down);
+        }
+        right->order = 2 * index;
+        down->order = 2 * index + 1;
+    }
+}
+
+static int compareTiledLinks(const void* a, const void* b) {
+    const TiledLink* la = (const TiledLink*)a;
+    const TiledLink* lb = (const TiledLink*)b;
+    if (la->distance != lb->distance) return la->distance < lb->distance ? -1 : 1;
+    return la->order - lb->order;
+}
+
+// 分区级并查集（分区数量远超MAX_ROOMS，不能直接用DisjointSet）
+static int findRegionRoot(int* parent, int x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];  // 路径减半
+        x = parent[x];
+    }
+    return x;
+}
+
+// 把世界尺寸均分成不超过REGION_SIZE的若干段
+static int regionStart(int total, int parts, int index) {
+    return (int)((long long)total * index / parts);
+}
+
+TiledWorld* generateTiledWorld(long seed, int width, int height, int threadCount) {
+    if (width < 5 || height < 5) return NULL;
+    if (width > MAX_TILED_WORLD_SIZE) width = MAX_TILED_WORLD_SIZE;
+    if (height > MAX_TILED_WORLD_SIZE) height = MAX_TILED_WORLD_SIZE;
+    if (threadCount <= 0) threadCount = getCpuCount();
+
+    TiledWorld* world = (TiledWorld*)calloc(1, sizeof(TiledWorld));
+    if (!world) return NULL;
+
+    world->seed = seed;
+    world->width = width;
+    world->height = height;
+    world->regionsX = (width + REGION_SIZE - 1) / REGION_SIZE;
+    world->regionsY = (height + REGION_SIZE - 1) / REGION_SIZE;
+    int regionCount = world->regionsX * world->regionsY;
+
+    world->tiles = (unsigned char*)malloc((size_t)width * height);
+    world->regions = (TiledRegion*)malloc(sizeof(TiledRegion) * regionCount);
+    TiledJob job;
+    job.world = world;
+    job.candidates = (TiledLink*)malloc(sizeof(TiledLink) * 2 * regionCount);
+    int* parent = (int*)malloc(sizeof(int) * regionCount);
+    if (!world->tiles || !world->regions || !job.candidates || !parent) {
+        free(job.candidates);
+        free(parent);
+        destroyTiledWorld(world);
+        return NULL;
+    }
+
+    for (int ry = 0; ry < world->regionsY; ry++) {
+        for (int rx = 0; rx < world->regionsX; rx++) {
+            TiledRegion* region = &world->regions[ry * world->regionsX + rx];
+            region->x = regionStart(width, world->regionsX, rx);
+            region->y = regionStart(height, world->regionsY, ry);
+            region->width = regionStart(width, world->regionsX, rx + 1) - region->x;
+            region->height = regionStart(height, world->regionsY, ry + 1) - region->y;
+            region->roomCount = 0;
+        }
+    }
+
+    // 阶段1：各分区并行生成房间与局部MST
+    atomic_init(&job.nextRegion, 0);
+    runParallel(threadCount, tiledRegionTask, &job);
+
+    // 阶段2：并行计算相邻分区间的候选连接
+    atomic_init(&job.nextRegion, 0);
+    runParallel(threadCount, tiledLinkTask, &job);
+
+    // 阶段3：对候选连接做Kruskal，得到连接所有分区的全局MST
+    int candidateCount = 0;
+    for (int i = 0; i < 2 * regionCount; i++) {
+        if (job.candidates[i].distance != INT_MAX) {
+            job.candidates[candidateCount++] = job.candidates[i];
+        }
+    }
+    qsort(job.candidates, candidateCount, sizeof(TiledLink), compareTiledLinks);
+
+    for (int i = 0; i < regionCount; i++) parent[i] = i;
+
+    world->links = (TiledLink*)malloc(sizeof(TiledLink) * (regionCount > 1 ? regionCount - 1 : 1));
+    if (!world->links) {
+        free(job.candidates);
+        free(parent);
+        destroyTiledWorld(world);
+        return NULL;
+    }
+
+    for (int i = 0; i < candidateCount && world->linkCount < regionCount - 1; i++) {
+        TiledLink* link = &job.candidates[i];
+        int rootA = findRegionRoot(parent, link->regionA);
+        int rootB = findRegionRoot(parent, link->regionB);
+        if (rootA == rootB) continue;
+        parent[rootA] = rootB;
+
+        Room* a = &world->regions[link->regionA].rooms[link->roomA];
+        Room* b = &world->regions[link->regionB].rooms[link->roomB];
+        Point start = {a->x + a->width / 2, a->y + a->height / 2};
+        Point end = {b->x + b->width / 2, b->y + b->height / 2};
+        drawTiledCorridor(world, start, end);
+
+        world->links[world->linkCount++] = *link;
+    }
+
+    free(job.candidates);
+    free(parent);
+    return world;
+}
+
+void destroyTiledWorld(TiledWorld* world) {
+    if (!world) return;
+    free(world->tiles);
+    free(world->regions);
+    free(world->links);
+    free(world);
+}
+
+int getTiledTile(TiledWorld* world, int x, int y) {
+    if (!world || x < 0 || x >= world->width || y < 0 || y >= world->height) {
+        return TILE_WALL;
+    }
+    return world->tiles[(size_t)y * world->width + x];
+}
+
+// ==================== 种子搜索 ====================
+// 线程按块领取连续的种子；每个线程内种子递增，因此各线程的匹配列表天然有序。
+// 某线程凑满K个匹配后把截止点压到它的第K个匹配：真正的前K个种子都不大于任何一个截止点，
+// 所以截止点之后的种子可以跳过，而合并各线程的列表取前K个就得到与线程数无关的结果
+
+#define SEARCH_GRID_CELLS (MAX_WORLD_WIDTH * MAX_WORLD_HEIGHT)
+
+// 房间内用作寻路起点的格子：优先取中心，中心不可走（洞穴区域的包围盒）时取房间内第一个可走格子
+static int roomAnchorCell(World* world, Room* room) {
+    int cx = room->x + room->width / 2;
+    int cy = room->y + room->height / 2;
+    if (isValidPosition(world, cx, cy) && world->tiles[cy][cx] != TILE_WALL) {
+        return cy * world->width + cx;
+    }
+    for (int y = room->y; y < room->y + room->height; y++) {
+        for (int x = room->x; x < room->x + room->width; x++) {
+            if (isValidPosition(world, x, y) && world->tiles[y][x] != TILE_WALL) {
+                return y * world->width + x;
+            }
+        }
+    }
+    return -1;
+}
+
+// 房间连接图的直径：从每个房间做一次BFS（房间数不超过MAX_ROOMS，代价可忽略）
+static int roomGraphDiameter(World* world) {
+    int dist[MAX_ROOMS];
+    int queue[MAX_ROOMS];
+    int diameter = 0;
+
+    for (int source = 0; source < world->roomCount; source++) {
+        for (int i = 0; i < world->roomCount; i++) dist[i] = -1;
+        int head = 0, tail = 0;
+        dist[source] = 0;
+        queue[tail++] = source;
+
+        while (head < tail) {
+            int room = queue[head++];
+            if (dist[room] > diameter) diameter = dist[room];
+            for (RoomConnection* conn = world->connections[room]; conn; conn = conn->next) {
+                if (conn->roomId < world->roomCount && dist[conn->roomId] < 0) {
+                    dist[conn->roomId] = dist[room] + 1;
+                    queue[tail++] = conn->roomId;
+                }
+            }
+        }
+    }
+    return diameter;
+}
+
+// 任意两个房间之间最短步行路径的最大值：从每个房间的起点格子做一次瓦片BFS。
+// scratch至少2 * SEARCH_GRID_CELLS个int
+static int longestRoomPath(World* world, int* scratch) {
+    int* dist = scratch;
+    int* queue = scratch + SEARCH_GRID_CELLS;
+    int anchors[MAX_ROOMS];
+    int cells = world->width * world->height;
+    int longest = 0;
+
+    for (int i = 0; i < world->roomCount; i++) {
+        anchors[i] = roomAnchorCell(world, &world->rooms[i]);
+    }
+
+    for (int source = 0; source + 1 < world->roomCount; source++) {
+        if (anchors[source] < 0) continue;
+        for (int i = 0; i < cells; i++) dist[i] = -1;
+        int head = 0, tail = 0;
+        dist[anchors[source]] = 0;
+        queue[tail++] = anchors[source];
+
+        while (head < tail) {
+            int cell = queue[head++];
+            int x = cell % world->width;
+            int y = cell / world->width;
+            int next[4] = {
+                x + 1 < world->width ? cell + 1 : -1,
+                x > 0 ? cell - 1 : -1,
+                y + 1 < world->height ? cell + world->width : -1,
+                y > 0 ? cell - world->width : -1
+            };
+            for (int d = 0; d < 4; d++) {
+                int n = next[d];
+                if (n < 0 || dist[n] >= 0) continue;
+                if (world->tiles[n / world->width][n % world->width] == TILE_WALL) continue;
+                dist[n] = dist[cell] + 1;
+                queue[tail++] = n;
+            }
+        }
+
+        for (int target = source + 1; target < world->roomCount; target++) {
+            if (anchors[target] >= 0 && dist[anchors[target]] > longest) {
+                longest = dist[anchors[target]];
+            }
+        }
+    }
+    return longest;
+}
+
+// scratch为NULL时跳过最长路径（longestPath置为-1）
+static void computeWorldStats(World* world, WorldStats* stats, int* scratch) {
+    stats->roomCount = world->roomCount;
+    stats->corridorCount = world->corridorCount;
+    stats->mstDiameter = roomGraphDiameter(world);
+    stats->longestPath = scratch ? longestRoomPath(world, scratch) : -1;
+}
+
+int getWorldStats(World* world, WorldStats* stats) {
+    if (!world || !stats) return -1;
+
+    int* scratch = (int*)malloc(2 * SEARCH_GRID_CELLS * sizeof(int));
+    if (!scratch) return -1;
+    computeWorldStats(world, stats, scratch);
+    free(scratch);
+    return 0;
+}
+
+void initSeedSearch(SeedSearch* search) {
+    if (!search) return;
+    memset(search, 0, sizeof(SeedSearch));
+    search->seedCount = 1000000;
+    search->width = 80;
+    search->height = 50;
+    search->mode = GEN_MODE_ROOMS;
+    search->maxRooms = INT_MAX;
+    search->maxCorridors = INT_MAX;
+    search->maxDiameter = INT_MAX;
+    search->maxLongestPath = INT_MAX;
+    search->maxResults = 10;
+}
+
+typedef struct SeedSearchJob {
+    SeedSearch* search;
+    bool needPaths;           // 约束中是否包含最长路径
+    long long* matches;       // 每个线程maxResults个槽位，存种子偏移
+    int* matchCounts;         // 每个线程的匹配数
+    int* scratch;             // 每个线程2 * SEARCH_GRID_CELLS个int（仅needPaths时分配）
+    atomic_llong nextOffset;  // 下一个待领取的种子偏移
+    atomic_llong cutoff;      // 偏移大于它的种子不必再扫描
+    atomic_llong scanned;     // 已扫描的种子数
+    atomic_int found;         // 已找到的匹配数（各线程之和，可能超过K）
+    double startTime;
+    double lastReport;
+} SeedSearchJob;
+
+// 先判断便宜的指标，不满足就不再计算后面的
+static bool seedMatches(SeedSearch* search, World* world, int* scratch) {
+    if (world->roomCount < search->minRooms || world->roomCount > search->maxRooms) return false;
+    if (world->corridorCount < search->minCorridors || world->corridorCount > search->maxCorridors) return false;
+
+    if (search->minDiameter > 0 || search->maxDiameter < INT_MAX) {
+        int diameter = roomGraphDiameter(world);
+        if (diameter < search->minDiameter || diameter > search->maxDiameter) return false;
+    }
+    if (scratch) {
+        int longest = longestRoomPath(world, scratch);
+        if (longest < search->minLongestPath || longest > search->maxLongestPath) return false;
+    }
+    return true;
+}
+
+static void lowerSearchCutoff(SeedSearchJob* job, long long offset) {
+    long long current = atomic_load(&job->cutoff);
+    while (offset < current && !atomic_compare_exchange_weak(&job->cutoff, &current, offset)) {
+    }
+}
+
+static void reportSearchProgress(SeedSearchJob* job, bool force) {
+    SeedSearch* search = job->search;
+    if (!search->progress) return;
+
+    double now = getMonotonicTime();
+    if (!force && now - job->lastReport < SEARCH_PROGRESS_INTERVAL) return;
+    job->lastReport = now;
+
+    long long scanned = atomic_load(&job->scanned);
+    double elapsed = now - job->startTime;
+    search->progress(scanned, elapsed > 0 ? (double)scanned / elapsed : 0.0,
+                     atomic_load(&job->found), search->progressContext);
+}
+
+static void seedSearchTask(void* context, int threadIndex) {
+    SeedSearchJob* job = (SeedSearchJob*)context;
+    SeedSearch* search = job->search;
+    long long* matches = job->matches + (size_t)threadIndex * search->maxResults;
+    int* scratch = job->needPaths ? job->scratch + (size_t)threadIndex * 2 * SEARCH_GRID_CELLS : NULL;
+    int count = 0;
+
+    // 每个线程只分配一个世界，逐个种子原地重新生成
+    World* world = createWorld(search->seedStart, search->width, search->height);
+
+    while (world && count < search->maxResults) {
+        long long start = atomic_fetch_add(&job->nextOffset, SEARCH_BLOCK_SIZE);
+        if (start >= search->seedCount || start > atomic_load(&job->cutoff)) break;
+        long long end = start + SEARCH_BLOCK_SIZE;
+        if (end > search->seedCount) end = search->seedCount;
+
+        long long scanned = 0;
+        for (long long offset = start; offset < end; offset++) {
+            if (offset > atomic_load_explicit(&job->cutoff, memory_order_relaxed)) break;
+
+            regenerateWorld(world, (long)(search->seedStart + offset), search->width, search->height, search->mode);
+            scanned++;
+            if (!seedMatches(search, world, scratch)) continue;
+
+            matches[count++] = offset;
+            atomic_fetch_add(&job->found, 1);
+            if (count == search->maxResults) {
+                lowerSearchCutoff(job, offset);
+                break;
+            }
+        }
+        atomic_fetch_add(&job->scanned, scanned);
+
+        if (threadIndex == 0) reportSearchProgress(job, false);
+    }
+    destroyWorld(world);
+    job->matchCounts[threadIndex] = count;
+}
+
+static int compareSearchOffsets(const void* a, const void* b) {
+    long long offsetA = *(const long long*)a;
+    long long offsetB = *(const long long*)b;
+    return (offsetA > offsetB) - (offsetA < offsetB);
+}
+
+int runSeedSearch(SeedSearch* search) {
+    if (!search || search->seedCount < 0) return -1;
+    if (search->maxResults < 1 || search->maxResults > SEARCH_MAX_RESULTS) return -1;
+
+    int threadCount = search->threadCount > 0 ? search->threadCount : getCpuCount();
+    if (threadCount > MAX_THREADS) threadCount = MAX_THREADS;
+
+    SeedSearchJob job;
+    job.search = search;
+    job.needPaths = search->minLongestPath > 0 || search->maxLongestPath < INT_MAX;
+    job.matches = (long long*)malloc((size_t)threadCount * search->maxResults * sizeof(long long));
+    job.matchCounts = (int*)calloc((size_t)threadCount, sizeof(int));
+    // 结果的完整统计总要计算最长路径，所以scratch至少给线程0一份
+    job.scratch = (int*)malloc((size_t)(job.needPaths ? threadCount : 1) * 2 * SEARCH_GRID_CELLS * sizeof(int));
+    if (!job.matches || !job.matchCounts || !job.scratch) {
+        free(job.matches);
+        free(job.matchCounts);
+        free(job.scratch);
+        return -1;
+    }
+    atomic_init(&job.nextOffset, 0);
+    atomic_init(&job.cutoff, LLONG_MAX);
+    atomic_init(&job.scanned, 0);
+    atomic_init(&job.found, 0);
+    job.startTime = getMonotonicTime();
+    job.lastReport = job.startTime;
+
+    runParallel(threadCount, seedSearchTask, &job);
+
+    // 各线程的列表已有序，合并后取前K个
+    int total = 0;
+    for (int t = 0; t < threadCount; t++) {
+        memmove(job.matches + total, job.matches + (size_t)t * search->maxResults,
+                (size_t)job.matchCounts[t] * sizeof(long long));
+        total += job.matchCounts[t];
+    }
+    qsort(job.matches, (size_t)total, sizeof(long long), compareSearchOffsets);
+    if (total > search->maxResults) total = search->maxResults;
+
+    // 只为最终结果重新生成一次并计算完整统计
+    search->resultCount = 0;
+    for (int i = 0; i < total; i++) {
+        long seed = (long)(search->seedStart + job.matches[i]);
+        World* world = generateWorldFromSeedWithMode(seed, search->width, search->height, search->mode);
+        if (!world) continue;
+        search->results[search->resultCount] = seed;
+        computeWorldStats(world, &search->resultStats[search->resultCount], job.scratch);
+        search->resultCount++;
+        destroyWorld(world);
+    }
+
+    search->scanned = atomic_load(&job.scanned);
+    search->elapsed = getMonotonicTime() - job.startTime;
+    reportSearchProgress(&job, true);
+
+    free(job.matches);
+    free(job.matchCounts);
+    free(job.scratch);
+    return search->resultCount;
+}
+
+// ==================== 文件工具 ====================
+
+const unsigned char* mapFileReadOnly(const char* path, size_t* size) {
+    if (!path || !size) return NULL;
+
+    const unsigned char* data = NULL;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+    // 映射建立后即可关闭文件和映射句柄，视图会保持它们有效
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return NULL;
+    data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data) return NULL;
+    *size = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    void* mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return NULL;
+    data = (const unsigned char*)mapped;
+    *size = (size_t)st.st_size;
+#endif
+    return data;
+}
+
+void unmapFile(const unsigned char* data, size_t size) {
+    if (!data) return;
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+// 64位文件定位（文件可能超过2GB）
+static int seekFile(FILE* file, long long offset, int origin) {
+#ifdef _WIN32
+    return _fseeki64(file, offset, origin);
+#else
+    return fseeko(file, (off_t)offset, origin);
+#endif
+}
+
+static long long tellFile(FILE* file) {
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return (long long)ftello(file);
+#endif
+}
+
+// 把缓冲区写出并同步到磁盘
+static bool syncFile(FILE* file) {
+    if (fflush(file) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+static bool truncateFile(FILE* file, long long size) {
+    if (fflush(file) != 0) return false;
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), size) == 0;
+#else
+    return ftruncate(fileno(file), (off_t)size) == 0;
+#endif
+}
+
+// 用已落盘的临时文件替换目标文件，并同步所在目录保证重命名本身落盘
+static bool replaceFileDurable(const char* tempPath, const char* path) {
+#ifdef _WIN32
+    return MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (rename(tempPath, path) != 0) return false;
+
+    char dirPath[1024];
+    const char* slash = strrchr(path, '/');
+    if (slash && slash != path) {
+        snprintf(dirPath, sizeof(dirPath), "%.*s", (int)(slash - path), path);
+    } else {
+        snprintf(dirPath, sizeof(dirPath), "%s", slash ? "/" : ".");
+    }
+    int dirFd = open(dirPath, O_RDONLY);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return true;
+#endif
+}
+
+int writeFileAtomic(const char* path, const void* data, size_t size) {
+    if (!path || (!data && size > 0)) return -1;
+
+    char tempPath[1024];
+    if (snprintf(tempPath, sizeof(tempPath), "%s.tmp", path) >= (int)sizeof(tempPath)) return -1;
+
+    FILE* file = fopen(tempPath, "wb");
+    if (!file) return -1;
+    bool ok = fwrite(data, 1, size, file) == size && syncFile(file);
+    if (fclose(file) != 0) ok = false;
+
+    if (!ok || !replaceFileDurable(tempPath, path)) {
+        remove(tempPath);
+        return -1;
+    }
+    return 0;
+}
+
+// ==================== 二进制序列化 ====================
+// 记录布局（整数小端）：
+//   [0,8) 种子  [8,10) 宽  [10,12) 高  [12] 模式  [13] 房间数  [14] 走廊数  [15] 标志（归属平面、走廊样式和宽度）
+//   瓦片（宽*高字节，按行）
+//   房间：每个5字节 x, y, 宽, 高, 是否存在
+//   走廊：每个5字节 起点x, 起点y, 终点x, 终点y, 标志（位0转弯，位1已删除）
+//   连接表：每个房间1字节邻居数，后跟邻居房间ID（保持链表顺序）
+//   归属平面（[15]位0置位时）：按行游程编码，每段2字节 归属（OWNER_NONE记为0xFF）, 长度(1~255)。
+//   有了它反序列化不必重新生成洞穴/WFC世界来还原不规则房间，没有它的旧记录仍按rebuildOwnership还原
+
+#define WORLD_RECORD_HAS_OWNER 1   // 记录头[15]的标志位：带归属平面（归属最大为MAX_ROOMS+MAX_CORRIDORS-1，一个字节放得下）
+#define WORLD_RECORD_STYLE_SHIFT 1 // 记录头[15]的第1-2位：走廊样式
+#define WORLD_RECORD_WIDTH_SHIFT 3 // 记录头[15]的第3-5位：走廊宽度减一（默认的宽度1、HV样式时整个字节与旧记录相同）
+
+// 归属平面游程编码的段数
+static size_t countOwnerRuns(World* world) {
+    size_t runs = 0;
+    int run = 0;
+    short last = OWNER_NONE;
+    for (int y = 0; y < world->height; y++) {
+        for (int x = 0; x < world->width; x++) {
+            short owner = world->owner[y][x];
+            if (run > 0 && owner == last && run < 255) {
+                run++;
+            } else {
+                runs++;
+                last = owner;
+                run = 1;
+            }
+        }
+    }
+    return runs;
+}
+
+static void putU16(unsigned char* p, unsigned int value) {
+    p[0] = (unsigned char)(value & 0xFF);
+    p[1] = (unsigned char)((value >> 8) & 0xFF);
+}
+
+static unsigned int getU16(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static void putU64(unsigned char* p, unsigned long long value) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static unsigned long long getU64(const unsigned char* p) {
+    unsigned long long value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (unsigned long long)p[i] << (8 * i);
+    }
+    return value;
+}
+
+int serializeWorld(World* world, unsigned char* buffer, size_t bufferSize) {
+    if (!world || !buffer) return -1;
+
+    size_t cells = (size_t)world->width * world->height;
+    size_t need = WORLD_RECORD_HEADER_SIZE + cells + (size_t)world->roomCount * 5 +
+                  (size_t)world->corridorCount * 5 + (size_t)world->roomCount + countOwnerRuns(world) * 2;
+    for (int i = 0; i < world->roomCount; i++) {
+        int degree = 0;
+        for (RoomConnection* conn = world->connections[i]; conn; conn = conn->next) degree++;
+        if (degree > 255) return -1;
+        need += (size_t)degree;
+    }
+    if (need > bufferSize) return -1;
+
+    unsigned char* p = buffer;
+    putU64(p, (unsigned long long)world->seed);
+    putU16(p + 8, (unsigned int)world->width);
+    putU16(p + 10, (unsigned int)world->height);
+    p[12] = (unsigned char)world->mode;
+    p[13] = (unsigned char)world->roomCount;
+    p[14] = (unsigned char)world->corridorCount;
+    p[15] = (unsigned char)(WORLD_RECORD_HAS_OWNER | (world->corridorStyle << WORLD_RECORD_STYLE_SHIFT) |
+                            ((world->corridorWidth - 1) << WORLD_RECORD_WIDTH_SHIFT));
+    p += WORLD_RECORD_HEADER_SIZE;
+
+    for (int y = 0; y < world->height; y++) {
+        memcpy(p, world->tiles[y], (size_t)world->width);
+        p += world->width;
+    }
+
+    for (int i = 0; i < world->roomCount; i++) {
+        Room* room = &world->rooms[i];
+        p[0] = (unsigned char)room->x;
+        p[1] = (unsigned char)room->y;
+        p[2] = (unsigned char)room->width;
+        p[3] = (unsigned char)room->height;
+        p[4] = room->exists ? 1 : 0;
+        p += 5;
+    }
+
+    for (int i = 0; i < world->corridorCount; i++) {
+        Corridor* corridor = &world->corridors[i];
+        p[0] = (unsigned char)corridor->start.x;
+        p[1] = (unsigned char)corridor->start.y;
+        p[2] = (unsigned char)corridor->end.x;
+        p[3] = (unsigned char)corridor->end.y;
+        p[4] = (unsigned char)((corridor->isTurning ? 1 : 0) | (corridor->exists ? 0 : 2));
+        p += 5;
+    }
+
+    for (int i = 0; i < world->roomCount; i++) {
+        unsigned char* degree = p++;
+        *degree = 0;
+        for (RoomConnection* conn = world->connections[i]; conn; conn = conn->next) {
+            *p++ = (unsigned char)conn->roomId;
+            (*degree)++;
+        }
+    }
+
+    int run = 0;
+    short last = OWNER_NONE;
+    for (int y = 0; y < world->height; y++) {
+        for (int x = 0; x < world->width; x++) {
+            short owner = world->owner[y][x];
+            if (run > 0 && owner == last && run < 255) {
+                p[-1] = (unsigned char)++run;
+            } else {
+                p[0] = owner == OWNER_NONE ? 0xFF : (unsigned char)owner;
+                p[1] = 1;
+                p += 2;
+                last = owner;
+                run = 1;
+            }
+        }
+    }
+
+    return (int)need;
+}
+
+// 解码归属平面，正好用完[p, end)且每个归属都指向已有的房间/走廊槽位才算成功
+static bool readOwnerRuns(World* world, const unsigned char* p, const unsigned char* end) {
+    int cell = 0;
+    int cells = world->width * world->height;
+    while (p + 2 <= end && cell < cells) {
+        int value = p[0];
+        int run = p[1];
+        p += 2;
+        if (run == 0 || run > cells - cell) return false;
+        if (value != 0xFF && (value >= OWNER_CORRIDOR_BASE + world->corridorCount ||
+                              (value < OWNER_CORRIDOR_BASE && value >= world->roomCount))) {
+            return false;
+        }
+        short owner = value == 0xFF ? OWNER_NONE : (short)value;
+        for (; run > 0; run--, cell++) {
+            world->owner[cell / world->width][cell % world->width] = owner;
+        }
+    }
+    return cell == cells && p == end;
+}
+
+World* deserializeWorld(const unsigned char* data, size_t size) {
+    if (!data || size < WORLD_RECORD_HEADER_SIZE) return NULL;
+
+    int width = (int)getU16(data + 8);
+    int height = (int)getU16(data + 10);
+    int roomCount = data[13];
+    int corridorCount = data[14];
+    if (width > MAX_WORLD_WIDTH || height > MAX_WORLD_HEIGHT) return NULL;
+    if (roomCount > MAX_ROOMS || corridorCount > MAX_CORRIDORS) return NULL;
+
+    size_t fixed = WORLD_RECORD_HEADER_SIZE + (size_t)width * height +
+                   (size_t)roomCount * 5 + (size_t)corridorCount * 5 + (size_t)roomCount;
+    if (size < fixed) return NULL;
+
+    int corridorStyle = (data[15] >> WORLD_RECORD_STYLE_SHIFT) & 3;
+    int corridorWidth = ((data[15] >> WORLD_RECORD_WIDTH_SHIFT) & 7) + 1;
+    if (!isValidCorridorShape(corridorWidth, corridorStyle)) return NULL;
+
+    World* world = createWorld((long)getU64(data), width, height);
+    if (!world) return NULL;
+    world->mode = data[12];
+    world->corridorWidth = corridorWidth;
+    world->corridorStyle = corridorStyle;
+    world->roomCount = roomCount;
+    world->corridorCount = corridorCount;
+
+    const unsigned char* p = data + WORLD_RECORD_HEADER_SIZE;
+    for (int y = 0; y < height; y++) {
+        memcpy(world->tiles[y], p, (size_t)width);
+        p += width;
+    }
+
+    for (int i = 0; i < roomCount; i++) {
+        Room* room = &world->rooms[i];
+        room->id = i;
+        room->x = p[0];
+        room->y = p[1];
+        room->width = p[2];
+        room->height = p[3];
+        room->exists = p[4] != 0;
+        p += 5;
+    }
+
+    for (int i = 0; i < corridorCount; i++) {
+        Corridor* corridor = &world->corridors[i];
+        corridor->id = i;
+        corridor->start.x = p[0];
+        corridor->start.y = p[1];
+        corridor->end.x = p[2];
+        corridor->end.y = p[3];
+        corridor->isTurning = (p[4] & 1) != 0;
+        corridor->exists = (p[4] & 2) == 0;
+        p += 5;
+    }
+
+    // 按原顺序在链表尾部追加，还原后的连接表与序列化前完全一致
+    const unsigned char* end = data + size;
+    for (int i = 0; i < roomCount; i++) {
+        if (p >= end) break;
+        int degree = *p++;
+        if (end - p < degree) break;
+
+        RoomConnection** tail = &world->connections[i];
+        for (int k = 0; k < degree; k++) {
+            int neighbor = *p++;
+            if (neighbor >= roomCount) {
+                destroyWorld(world);
+                return NULL;
+            }
+            RoomConnection* conn = allocConnection(world, neighbor, NULL);
+            if (!conn) {
+                destroyWorld(world);
+                return NULL;
+            }
+            *tail = conn;
+            tail = &conn->next;
+            unionSets(world->disjointSet, i, neighbor);
+        }
+    }
+    bool ok = (data[15] & WORLD_RECORD_HAS_OWNER) ? readOwnerRuns(world, p, end)
+                                                   : p == end && rebuildOwnership(world) == 0;
+    if (!ok) {
+        destroyWorld(world);
+        return NULL;
+    }
+
+    world->initialized = true;
+    return world;
+}
+
+// ==================== 二进制数据集 ====================
+// 文件布局：16字节文件头（"BYOWDSET"、版本号），然后是只追加的记录，
+// 关闭写入器时追加8字节对齐的索引（DatasetIndexEntry数组，按种子排序）和24字节尾部
+// （"BYOWIDX1"、索引偏移、记录数）。读取时只看最后一个尾部，之前的索引成为无用数据。
+// 索引按本机字节序直接写出，读取端映射后直接当数组使用（小端平台）
+
+#define DATASET_HEADER_SIZE 16
+#define DATASET_TRAILER_SIZE 24
+#define DATASET_VERSION 2   // 版本2的记录带归属平面，读取时两种记录都接受
+
+// 校验尾部，成功时给出索引偏移和记录数
+static bool parseDatasetTrailer(const unsigned char* trailer, unsigned long long fileSize,
+                                unsigned long long* indexOffset, long long* count) {
+    if (memcmp(trailer, "BYOWIDX1", 8) != 0) return false;
+
+    unsigned long long offset = getU64(trailer + 8);
+    unsigned long long entries = getU64(trailer + 16);
+    if (offset < DATASET_HEADER_SIZE || offset % 8 != 0) return false;
+    if (entries > (fileSize - offset) / sizeof(DatasetIndexEntry)) return false;
+    if (offset + entries * sizeof(DatasetIndexEntry) + DATASET_TRAILER_SIZE != fileSize) return false;
+
+    *indexOffset = offset;
+    *count = (long long)entries;
+    return true;
+}
+
+// 把已有数据集的索引读入写入器；文件为空时返回0且不载入任何记录
+static int loadDatasetIndex(DatasetWriter* writer, FILE* file) {
+    if (seekFile(file, 0, SEEK_END) != 0) return -1;
+    long long fileSize = tellFile(file);
+    if (fileSize < 0) return -1;
+    writer->fileSize = (unsigned long long)fileSize;
+    if (fileSize == 0) return 0;
+    if (fileSize < DATASET_HEADER_SIZE + DATASET_TRAILER_SIZE) return -1;
+
+    unsigned char header[DATASET_HEADER_SIZE];
+    unsigned char trailer[DATASET_TRAILER_SIZE];
+    if (seekFile(file, 0, SEEK_SET) != 0 || fread(header, 1, sizeof(header), file) != sizeof(header)) return -1;
+    if (memcmp(header, "BYOWDSET", 8) != 0) return -1;
+    if (seekFile(file, fileSize - DATASET_TRAILER_SIZE, SEEK_SET) != 0 ||
+        fread(trailer, 1, sizeof(trailer), file) != sizeof(trailer)) return -1;
+
+    unsigned long long indexOffset;
+    long long count;
+    if (!parseDatasetTrailer(trailer, (unsigned long long)fileSize, &indexOffset, &count)) return -1;
+
+    long long capacity = count > 1024 ? count : 1024;
+    writer->index = (DatasetIndexEntry*)malloc((size_t)capacity * sizeof(DatasetIndexEntry));
+    if (!writer->index) return -1;
+    writer->capacity = capacity;
+    if (seekFile(file, (long long)indexOffset, SEEK_SET) != 0 ||
+        fread(writer->index, sizeof(DatasetIndexEntry), (size_t)count, file) != (size_t)count) return -1;
+    writer->count = count;
+    return 0;
+}
+
+static int flushDatasetBuffer(DatasetWriter* writer) {
+    if (writer->bufferUsed == 0) return 0;
+    size_t written = fwrite(writer->buffer, 1, writer->bufferUsed, writer->file);
+    if (written != writer->bufferUsed) return -1;
+    writer->bufferUsed = 0;
+    return 0;
+}
+
+// 经缓冲区写入；超过缓冲区大小的数据直接写文件
+static int writeDataset(DatasetWriter* writer, const void* data, size_t size) {
+    if (writer->bufferUsed + size > DATASET_WRITE_BUFFER) {
+        if (flushDatasetBuffer(writer) != 0) return -1;
+    }
+    if (size > DATASET_WRITE_BUFFER) {
+        if (fwrite(data, 1, size, writer->file) != size) return -1;
+    } else {
+        memcpy(writer->buffer + writer->bufferUsed, data, size);
+        writer->bufferUsed += size;
+    }
+    writer->fileSize += size;
+    return 0;
+}
+
+DatasetWriter* openDatasetWriter(const char* path) {
+    if (!path) return NULL;
+
+    DatasetWriter* writer = (DatasetWriter*)calloc(1, sizeof(DatasetWriter));
+    if (!writer) return NULL;
+    writer->buffer = (unsigned char*)malloc(DATASET_WRITE_BUFFER);
+    if (!writer->buffer) {
+        free(writer);
+        return NULL;
+    }
+
+    FILE* existing = fopen(path, "rb");
+    if (existing) {
+        int status = loadDatasetIndex(writer, existing);
+        fclose(existing);
+        if (status != 0) {
+            free(writer->index);
+            free(writer->buffer);
+            free(writer);
+            return NULL;
+        }
+    }
+
+    writer->file = fopen(path, "ab");
+    if (!writer->file) {
+        free(writer->index);
+        free(writer->buffer);
+        free(writer);
+        return NULL;
+    }
+
+    if (writer->fileSize == 0) {
+        unsigned char header[DATASET_HEADER_SIZE] = {0};
+        memcpy(header, "BYOWDSET", 8);
+        header[8] = DATASET_VERSION;
+        writeDataset(writer, header, sizeof(header));
+    }
+    return writer;
+}
+
+int appendDatasetRecord(DatasetWriter* writer, long long seed, const unsigned char* data, size_t size) {
+    if (!writer || !data || size == 0 || size > 0xFFFFFFFFu) return -1;
+
+    if (writer->count == writer->capacity) {
+        long long capacity = writer->capacity > 0 ? writer->capacity * 2 : 1024;
+        DatasetIndexEntry* index = (DatasetIndexEntry*)realloc(writer->index,
+                                                               (size_t)capacity * sizeof(DatasetIndexEntry));
+        if (!index) return -1;
+        writer->index = index;
+        writer->capacity = capacity;
+    }
+
+    DatasetIndexEntry* entry = &writer->index[writer->count];
+    entry->seed = seed;
+    entry->offset = writer->fileSize;
+    entry->size = (unsigned int)size;
+    entry->reserved = 0;
+    if (writeDataset(writer, data, size) != 0) return -1;
+
+    writer->count++;
+    return 0;
+}
+
+// 种子相同时按偏移排序，查找时取最后一条即最新写入的记录
+static int compareDatasetEntries(const void* a, const void* b) {
+    const DatasetIndexEntry* entryA = (const DatasetIndexEntry*)a;
+    const DatasetIndexEntry* entryB = (const DatasetIndexEntry*)b;
+    if (entryA->seed != entryB->seed) return entryA->seed < entryB->seed ? -1 : 1;
+    return (entryA->offset > entryB->offset) - (entryA->offset < entryB->offset);
+}
+
+int closeDatasetWriter(DatasetWriter* writer) {
+    if (!writer) return -1;
+
+    int status = 0;
+    if (writer->count > 0) {
+        qsort(writer->index, (size_t)writer->count, sizeof(DatasetIndexEntry), compareDatasetEntries);
+    }
+
+    // 索引按8字节对齐，映射后可以直接当数组访问
+    static const unsigned char padding[8] = {0};
+    size_t pad = (size_t)((8 - writer->fileSize % 8) % 8);
+    unsigned long long indexOffset = writer->fileSize + pad;
+
+    unsigned char trailer[DATASET_TRAILER_SIZE];
+    memcpy(trailer, "BYOWIDX1", 8);
+    putU64(trailer + 8, indexOffset);
+    putU64(trailer + 16, (unsigned long long)writer->count);
+
+    if (writeDataset(writer, padding, pad) != 0 ||
+        (writer->count > 0 &&
+         writeDataset(writer, writer->index, (size_t)writer->count * sizeof(DatasetIndexEntry)) != 0) ||
+        writeDataset(writer, trailer, sizeof(trailer)) != 0 ||
+        flushDatasetBuffer(writer) != 0) {
+        status = -1;
+    }
+    if (fclose(writer->file) != 0) status = -1;
+
+    free(writer->index);
+    free(writer->buffer);
+    free(writer);
+    return status;
+}
+
+DatasetReader* openDatasetReader(const char* path) {
+    size_t size = 0;
+    const unsigned char* data = mapFileReadOnly(path, &size);
+    if (!data) return NULL;
+
+    DatasetReader* reader = (DatasetReader*)malloc(sizeof(DatasetReader));
+    unsigned long long indexOffset;
+    long long count;
+    if (!reader || size < DATASET_HEADER_SIZE + DATASET_TRAILER_SIZE ||
+        memcmp(data, "BYOWDSET", 8) != 0 ||
+        !parseDatasetTrailer(data + size - DATASET_TRAILER_SIZE, size, &indexOffset, &count)) {
+        free(reader);
+        unmapFile(data, size);
+        return NULL;
+    }
+
+    reader->data = data;
+    reader->size = size;
+    reader->index = (const DatasetIndexEntry*)(data + indexOffset);
+    reader->count = count;
+    return reader;
+}
+
+void closeDatasetReader(DatasetReader* reader) {
+    if (!reader) return;
+    unmapFile(reader->data, reader->size);
+    free(reader);
+}
+
+const unsigned char* findDatasetRecord(DatasetReader* reader, long long seed, size_t* size) {
+    if (!reader) return NULL;
+
+    // 找最后一个种子<=seed的索引项
+    long long lo = 0, hi = reader->count;
+    while (lo < hi) {
+        long long mid = lo + (hi - lo) / 2;
+        if (reader->index[mid].seed <= seed) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0 || reader->index[lo - 1].seed != seed) return NULL;
+
+    const DatasetIndexEntry* entry = &reader->index[lo - 1];
+    unsigned long long indexOffset = (unsigned long long)((const unsigned char*)reader->index - reader->data);
+    if (entry->offset < DATASET_HEADER_SIZE || entry->offset + entry->size > indexOffset) return NULL;
+
+    if (size) *size = entry->size;
+    return reader->data + entry->offset;
+}
+
+World* loadDatasetWorld(DatasetReader* reader, long long seed) {
+    size_t size = 0;
+    const unsigned char* record = findDatasetRecord(reader, seed, &size);
+    if (!record) return NULL;
+    return deserializeWorld(record, size);
+}
+
+// ==================== 存档存储 ====================
+// 日志只追加，每条记录为 [键长u32][数据长u32][校验和u32][键][数据]（整数小端）。
+// 打开时顺序重放日志建立内存索引（键 -> 最新记录位置），遇到残缺或校验失败的尾部就截断。
+// putSave只追加到内存缓冲区，flushSaveStore一次写出所有待写记录并只fsync一次（组提交）。
+// 日志中过期记录过多时，后台线程把有效记录复制到新文件，最后在锁内补上期间新写出的尾部、
+// 原子替换日志并修正索引偏移
+
+#define SAVE_RECORD_HEADER_SIZE 12
+
+typedef struct SaveIndexEntry {
+    char key[SAVE_KEY_MAX];      // 键，空串表示空槽
+    long long offset;            // 记录在日志中的逻辑偏移（>=fileSize时位于待写缓冲区）
+    unsigned int size;           // 数据字节数
+    unsigned int recordSize;     // 整条记录字节数
+} SaveIndexEntry;
+
+struct SaveStore {
+    char path[1024];             // 日志路径
+    FILE* file;                  // 日志文件（追加写，按偏移读）
+    long long fileSize;          // 已写出到文件的字节数
+    unsigned char* pending;      // 待写缓冲区
+    size_t pendingSize;
+    size_t pendingCapacity;
+    SaveIndexEntry* slots;       // 开放寻址哈希表
+    int capacity;                // 槽位数（2的幂）
+    int count;                   // 键数量
+    long long liveBytes;         // 有效记录总字节数
+    int compactions;             // 已完成的压缩次数
+    Mutex* lock;                 // 保护以上所有字段
+    Thread* compactor;           // 正在运行的压缩线程
+    atomic_bool compactDone;     // 压缩线程已完成，可以回收
+};
+
+static unsigned int saveChecksum(const char* key, size_t keyLength, const unsigned char* data, size_t size) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < keyLength; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 16777619u;
+    }
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void putU32(unsigned char* p, unsigned int value) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static unsigned int getU32(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned int hashSaveKey(const char* key) {
+    return saveChecksum(key, strlen(key), NULL, 0);
+}
+
+static SaveIndexEntry* findSaveEntry(SaveStore* store, const char* key) {
+    unsigned int mask = (unsigned int)store->capacity - 1;
+    for (unsigned int i = hashSaveKey(key) & mask; ; i = (i + 1) & mask) {
+        SaveIndexEntry* entry = &store->slots[i];
+        if (entry->key[0] == '\0') return NULL;
+        if (strcmp(entry->key, key) == 0) return entry;
+    }
+}
+
+// 查找或插入键；新键的offset为-1。装载率超过70%时扩容
+static SaveIndexEntry* insertSaveEntry(SaveStore* store, const char* key) {
+    if ((store->count + 1) * 10 > store->capacity * 7) {
+        int capacity = store->capacity * 2;
+        SaveIndexEntry* slots = (SaveIndexEntry*)calloc((size_t)capacity, sizeof(SaveIndexEntry));
+        if (!slots) return NULL;
+
+        SaveIndexEntry* old = store->slots;
+        int oldCapacity = store->capacity;
+        store->slots = slots;
+        store->capacity = capacity;
+        for (int i = 0; i < oldCapacity; i++) {
+            if (old[i].key[0] == '\0') continue;
+            unsigned int mask = (unsigned int)capacity - 1;
+            unsigned int j = hashSaveKey(old[i].key) & mask;
+            while (slots[j].key[0] != '\0') j = (j + 1) & mask;
+            slots[j] = old[i];
+        }
+        free(old);
+    }
+
+    unsigned int mask = (unsigned int)store->capacity - 1;
+    for (unsigned int i = hashSaveKey(key) & mask; ; i = (i + 1) & mask) {
+        SaveIndexEntry* entry = &store->slots[i];
+        if (entry->key[0] == '\0') {
+            snprintf(entry->key, SAVE_KEY_MAX, "%s", key);
+            entry->offset = -1;
+            store->count++;
+            return entry;
+        }
+        if (strcmp(entry->key, key) == 0) return entry;
+    }
+}
+
+// 记录一条记录的新位置，并更新有效字节数
+static void indexSaveRecord(SaveStore* store, SaveIndexEntry* entry, long long offset,
+                            unsigned int size, unsigned int recordSize) {
+    if (entry->offset >= 0) store->liveBytes -= entry->recordSize;
+    entry->offset = offset;
+    entry->size = size;
+    entry->recordSize = recordSize;
+    store->liveBytes += recordSize;
+}
+
+// 顺序重放日志，返回最后一条完整记录之后的偏移
+static long long replaySaveLog(SaveStore* store) {
+    unsigned char header[SAVE_RECORD_HEADER_SIZE];
+    unsigned char* body = (unsigned char*)malloc(SAVE_KEY_MAX + SAVE_MAX_SIZE);
+    long long offset = 0;
+    if (!body) return -1;
+
+    seekFile(store->file, 0, SEEK_SET);
+    while (fread(header, 1, sizeof(header), store->file) == sizeof(header)) {
+        unsigned int keyLength = getU32(header);
+        unsigned int size = getU32(header + 4);
+        if (keyLength == 0 || keyLength >= SAVE_KEY_MAX || size > SAVE_MAX_SIZE) break;
+        if (fread(body, 1, keyLength + size, store->file) != keyLength + size) break;
+        if (saveChecksum((const char*)body, keyLength, body + keyLength, size) != getU32(header + 8)) break;
+
+        char key[SAVE_KEY_MAX];
+        memcpy(key, body, keyLength);
+        key[keyLength] = '\0';
+        SaveIndexEntry* entry = insertSaveEntry(store, key);
+        if (!entry) {
+            free(body);
+            return -1;
+        }
+        unsigned int recordSize = SAVE_RECORD_HEADER_SIZE + keyLength + size;
+        indexSaveRecord(store, entry, offset, size, recordSize);
+        offset += recordSize;
+    }
+    free(body);
+    return offset;
+}
+
+SaveStore* openSaveStore(const char* path) {
+    if (!path || strlen(path) + 16 > sizeof(((SaveStore*)0)->path)) return NULL;
+
+    SaveStore* store = (SaveStore*)calloc(1, sizeof(SaveStore));
+    if (!store) return NULL;
+    snprintf(store->path, sizeof(store->path), "%s", path);
+    store->capacity = 256;
+    store->slots = (SaveIndexEntry*)calloc((size_t)store->capacity, sizeof(SaveIndexEntry));
+    store->lock = createMutex();
+    store->file = fopen(path, "a+b");
+    atomic_init(&store->compactDone, false);
+    if (!store->slots || !store->lock || !store->file) {
+        closeSaveStore(store);
+        return NULL;
+    }
+
+    long long validSize = replaySaveLog(store);
+    if (validSize < 0 || seekFile(store->file, 0, SEEK_END) != 0) {
+        closeSaveStore(store);
+        return NULL;
+    }
+    // 截掉上次崩溃留下的残缺尾部，之后的追加才能被正确重放
+    if (tellFile(store->file) != validSize && !truncateFile(store->file, validSize)) {
+        closeSaveStore(store);
+        return NULL;
+    }
+    store->fileSize = validSize;
+    return store;
+}
+
+int putSave(SaveStore* store, const char* key, const void* data, size_t size) {
+    if (!store || !key || (!data && size > 0)) return -1;
+    size_t keyLength = strlen(key);
+    if (keyLength == 0 || keyLength >= SAVE_KEY_MAX || size > SAVE_MAX_SIZE) return -1;
+
+    size_t recordSize = SAVE_RECORD_HEADER_SIZE + keyLength + size;
+    lockMutex(store->lock);
+
+    if (store->pendingSize + recordSize > store->pendingCapacity) {
+        size_t capacity = store->pendingCapacity > 0 ? store->pendingCapacity : 65536;
+        while (store->pendingSize + recordSize > capacity) capacity *= 2;
+        unsigned char* pending = (unsigned char*)realloc(store->pending, capacity);
+        if (!pending) {
+            unlockMutex(store->lock);
+            return -1;
+        }
+        store->pending = pending;
+        store->pendingCapacity = capacity;
+    }
+
+    SaveIndexEntry* entry = insertSaveEntry(store, key);
+    if (!entry) {
+        unlockMutex(store->lock);
+        return -1;
+    }
+
+    unsigned char* record = store->pending + store->pendingSize;
+    putU32(record, (unsigned int)keyLength);
+    putU32(record + 4, (unsigned int)size);
+    putU32(record + 8, saveChecksum(key, keyLength, (const unsigned char*)data, size));
+    memcpy(record + SAVE_RECORD_HEADER_SIZE, key, keyLength);
+    if (size > 0) memcpy(record + SAVE_RECORD_HEADER_SIZE + keyLength, data, size);
+
+    indexSaveRecord(store, entry, store->fileSize + (long long)store->pendingSize,
+                    (unsigned int)size, (unsigned int)recordSize);
+    store->pendingSize += recordSize;
+
+    unlockMutex(store->lock);
+    return 0;
+}
+
+int getSave(SaveStore* store, const char* key, char** data, size_t* size) {
+    if (!store || !key || !data) return -1;
+
+    lockMutex(store->lock);
+    SaveIndexEntry* entry = findSaveEntry(store, key);
+    if (!entry || !store->file) {
+        unlockMutex(store->lock);
+        return -1;
+    }
+
+    char* result = (char*)malloc(entry->size + 1);
+    long long dataOffset = entry->offset + SAVE_RECORD_HEADER_SIZE + (long long)strlen(entry->key);
+    bool ok = result != NULL;
+    if (ok && dataOffset >= store->fileSize) {
+        memcpy(result, store->pending + (dataOffset - store->fileSize), entry->size);
+    } else if (ok) {
+        // 追加模式的文件读之前要先定位；写入总是发生在文件末尾，不受这里的位置影响
+        ok = seekFile(store->file, dataOffset, SEEK_SET) == 0 &&
+             fread(result, 1, entry->size, store->file) == entry->size;
+    }
+    size_t resultSize = entry->size;
+    unlockMutex(store->lock);
+
+    if (!ok) {
+        free(result);
+        return -1;
+    }
+    result[resultSize] = '\0';
+    *data = result;
+    if (size) *size = resultSize;
+    return 0;
+}
+
+typedef struct SaveCompactItem {
+    char key[SAVE_KEY_MAX];
+    long long oldOffset;
+    long long newOffset;
+    unsigned int recordSize;
+} SaveCompactItem;
+
+static int compareCompactItems(const void* a, const void* b) {
+    const SaveCompactItem* itemA = (const SaveCompactItem*)a;
+    const SaveCompactItem* itemB = (const SaveCompactItem*)b;
+    return (itemA->oldOffset > itemB->oldOffset) - (itemA->oldOffset < itemB->oldOffset);
+}
+
+// 把[from, to)范围的日志内容复制到out
+static bool copyFileRange(FILE* in, long long from, long long to, FILE* out, unsigned char* buffer, size_t bufferSize) {
+    if (seekFile(in, from, SEEK_SET) != 0) return false;
+    while (from < to) {
+        size_t chunk = (size_t)(to - from < (long long)bufferSize ? to - from : (long long)bufferSize);
+        if (fread(buffer, 1, chunk, in) != chunk || fwrite(buffer, 1, chunk, out) != chunk) return false;
+        from += (long long)chunk;
+    }
+    return true;
+}
+
+static void compactSaveStore(void* context) {
+    SaveStore* store = (SaveStore*)context;
+    char compactPath[1040];
+    snprintf(compactPath, sizeof(compactPath), "%s.compact", store->path);
+
+    // 第一阶段（锁内）：记下已写出部分中的有效记录
+    lockMutex(store->lock);
+    long long cutoff = store->fileSize;
+    SaveCompactItem* items = (SaveCompactItem*)malloc((size_t)(store->count > 0 ? store->count : 1) * sizeof(SaveCompactItem));
+    int itemCount = 0;
+    for (int i = 0; items && i < store->capacity; i++) {
+        SaveIndexEntry* entry = &store->slots[i];
+        if (entry->key[0] == '\0' || entry->offset < 0 || entry->offset >= cutoff) continue;
+        SaveCompactItem* item = &items[itemCount++];
+        memcpy(item->key, entry->key, SAVE_KEY_MAX);
+        item->oldOffset = entry->offset;
+        item->recordSize = entry->recordSize;
+    }
+    unlockMutex(store->lock);
+
+    // 第二阶段（锁外）：按原顺序把有效记录复制到新文件，日志旧内容只读不变
+    unsigned char* buffer = (unsigned char*)malloc(SAVE_RECORD_HEADER_SIZE + SAVE_KEY_MAX + SAVE_MAX_SIZE);
+    FILE* in = fopen(store->path, "rb");
+    FILE* out = fopen(compactPath, "wb");
+    bool ok = items && buffer && in && out;
+    long long newSize = 0;
+    if (ok) qsort(items, (size_t)itemCount, sizeof(SaveCompactItem), compareCompactItems);
+    for (int i = 0; ok && i < itemCount; i++) {
+        items[i].newOffset = newSize;
+        ok = copyFileRange(in, items[i].oldOffset, items[i].oldOffset + items[i].recordSize, out,
+                           buffer, SAVE_RECORD_HEADER_SIZE + SAVE_KEY_MAX + SAVE_MAX_SIZE);
+        newSize += items[i].recordSize;
+    }
+    if (in) fclose(in);
+
+    // 第三阶段（锁内）：补上期间写出的尾部，替换日志并修正索引
+    lockMutex(store->lock);
+    long long delta = newSize - cutoff;
+    ok = ok && store->file &&
+         copyFileRange(store->file, cutoff, store->fileSize, out, buffer,
+                       SAVE_RECORD_HEADER_SIZE + SAVE_KEY_MAX + SAVE_MAX_SIZE) &&
+         syncFile(out);
+    if (out && fclose(out) != 0) ok = false;
+
+    if (ok) {
+        fclose(store->file);
+        ok = replaceFileDurable(compactPath, store->path);
+        // 替换失败时旧日志仍然完整，重新打开继续使用
+        store->file = fopen(store->path, "a+b");
+        if (ok && store->file) {
+            for (int i = 0; i < itemCount; i++) {
+                SaveIndexEntry* entry = findSaveEntry(store, items[i].key);
+                if (entry && entry->offset == items[i].oldOffset) entry->offset = items[i].newOffset;
+            }
+            for (int i = 0; i < store->capacity; i++) {
+                SaveIndexEntry* entry = &store->slots[i];
+                if (entry->key[0] != '\0' && entry->offset >= cutoff) entry->offset += delta;
+            }
+            store->fileSize += delta;
+            store->compactions++;
+        }
+    }
+    if (!ok) remove(compactPath);
+    unlockMutex(store->lock);
+
+    free(items);
+    free(buffer);
+    atomic_store(&store->compactDone, true);
+}
+
+int flushSaveStore(SaveStore* store) {
+    if (!store) return -1;
+
+    lockMutex(store->lock);
+    bool ok = store->file != NULL;
+    if (ok && store->pendingSize > 0) {
+        ok = fwrite(store->pending, 1, store->pendingSize, store->file) == store->pendingSize &&
+             syncFile(store->file);
+        if (ok) {
+            store->fileSize += (long long)store->pendingSize;
+            store->pendingSize = 0;
+        } else {
+            // 写了一半的记录会挡住以后的重放，退回到上次提交的位置，待写记录保留到下次重试
+            truncateFile(store->file, store->fileSize);
+        }
+    }
+
+    // 回收已结束的压缩线程；过期记录占比过高时启动新的压缩
+    if (store->compactor && atomic_load(&store->compactDone)) {
+        joinThread(store->compactor);
+        store->compactor = NULL;
+    }
+    if (ok && !store->compactor && store->fileSize >= SAVE_COMPACT_MIN_BYTES &&
+        store->fileSize > SAVE_COMPACT_RATIO * store->liveBytes) {
+        atomic_store(&store->compactDone, false);
+        store->compactor = startThread(compactSaveStore, store);
+    }
+    unlockMutex(store->lock);
+    return ok ? 0 : -1;
+}
+
+void closeSaveStore(SaveStore* store) {
+    if (!store) return;
+
+    if (store->lock) {
+        flushSaveStore(store);
+        joinThread(store->compactor);
+        destroyMutex(store->lock);
+    }
+    if (store->file) fclose(store->file);
+    free(store->pending);
+    free(store->slots);
+    free(store);
+}
+
+void getSaveStoreStats(SaveStore* store, SaveStoreStats* stats) {
+    if (!store || !stats) return;
+
+    lockMutex(store->lock);
+    stats->keys = store->count;
+    stats->logBytes = store->fileSize;
+    stats->liveBytes = store->liveBytes;
+    stats->pendingBytes = (long long)store->pendingSize;
+    stats->compactions = store->compactions;
+    stats->compacting = store->compactor != NULL && !atomic_load(&store->compactDone);
+    unlockMutex(store->lock);
+}
+
+// ==================== 数据压缩（DEFLATE）====================
+// LZ77（哈希链找最长匹配）加固定Huffman编码，整段输出为一个块。
+// 动态Huffman能再小一些，但世界JSON主要靠长重复串压缩，固定码表已足够，也不需要两遍扫描
+
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_HASH_SIZE (1 << DEFLATE_HASH_BITS)
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_MAX_CHAIN 64     // 每个位置最多比较的候选数，限制最坏情况的耗时
+
+static const unsigned short deflateLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned char deflateLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const unsigned short deflateDistanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned char deflateDistanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+typedef struct BitWriter {
+    unsigned char* out;
+    size_t pos;
+    unsigned long long bits;     // 尚未写出的位（低位在前）
+    int count;
+} BitWriter;
+
+static void writeBits(BitWriter* writer, unsigned int value, int count) {
+    writer->bits |= (unsigned long long)value << writer->count;
+    writer->count += count;
+    while (writer->count >= 8) {
+        writer->out[writer->pos++] = (unsigned char)(writer->bits & 0xFF);
+        writer->bits >>= 8;
+        writer->count -= 8;
+    }
+}
+
+// Huffman码从最高位开始写，而DEFLATE的位流从低位开始，所以要先反转
+static void writeHuffmanCode(BitWriter* writer, unsigned int code, int length) {
+    unsigned int reversed = 0;
+    for (int i = 0; i < length; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    writeBits(writer, reversed, length);
+}
+
+// 固定Huffman码表中的字面量/长度符号
+static void writeLiteralSymbol(BitWriter* writer, int symbol) {
+    if (symbol < 144) {
+        writeHuffmanCode(writer, 0x30 + (unsigned int)symbol, 8);
+    } else if (symbol < 256) {
+        writeHuffmanCode(writer, 0x190 + (unsigned int)(symbol - 144), 9);
+    } else if (symbol < 280) {
+        writeHuffmanCode(writer, (unsigned int)(symbol - 256), 7);
+    } else {
+        writeHuffmanCode(writer, 0xC0 + (unsigned int)(symbol - 280), 8);
+    }
+}
+
+static void writeMatch(BitWriter* writer, int length, int distance) {
+    int code = 28;
+    while (deflateLengthBase[code] > length) code--;
+    writeLiteralSymbol(writer, 257 + code);
+    writeBits(writer, (unsigned int)(length - deflateLengthBase[code]), deflateLengthExtra[code]);
+
+    code = 29;
+    while (deflateDistanceBase[code] > distance) code--;
+    writeHuffmanCode(writer, (unsigned int)code, 5);
+    writeBits(writer, (unsigned int)(distance - deflateDistanceBase[code]), deflateDistanceExtra[code]);
+}
+
+static unsigned int hashDeflateBytes(const unsigned char* p) {
+    unsigned int value = (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16);
+    return (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+// 输出原始DEFLATE流，返回写入的字节数；out至少要有getDeflateBound(length)字节
+static size_t deflateFixed(const unsigned char* data, size_t length, unsigned char* out,
+                           int* head, int* prev) {
+    BitWriter writer = {out, 0, 0, 0};
+    writeBits(&writer, 1, 1);    // BFINAL
+    writeBits(&writer, 1, 2);    // BTYPE=01，固定Huffman
+    for (int i = 0; i < DEFLATE_HASH_SIZE; i++) head[i] = -1;
+
+    size_t pos = 0;
+    while (pos < length) {
+        int bestLength = 0;
+        int bestDistance = 0;
+        if (pos + DEFLATE_MIN_MATCH <= length) {
+            unsigned int hash = hashDeflateBytes(data + pos);
+            size_t maxLength = length - pos < DEFLATE_MAX_MATCH ? length - pos : DEFLATE_MAX_MATCH;
+            int candidate = head[hash];
+            for (int chain = 0; candidate >= 0 && chain < DEFLATE_MAX_CHAIN; chain++) {
+                size_t distance = pos - (size_t)candidate;
+                if (distance > DEFLATE_WINDOW) break;
+                const unsigned char* a = data + candidate;
+                const unsigned char* b = data + pos;
+                if (a[bestLength] == b[bestLength]) {
+                    size_t matched = 0;
+                    while (matched < maxLength && a[matched] == b[matched]) matched++;
+                    if ((int)matched > bestLength) {
+                        bestLength = (int)matched;
+                        bestDistance = (int)distance;
+                        if (matched == maxLength) break;
+                    }
+                }
+                candidate = prev[candidate % DEFLATE_WINDOW];
+            }
+            prev[pos % DEFLATE_WINDOW] = head[hash];
+            head[hash] = (int)pos;
+        }
+
+        if (bestLength >= DEFLATE_MIN_MATCH) {
+            writeMatch(&writer, bestLength, bestDistance);
+            // 匹配覆盖的位置也要进哈希链，后面的匹配才能引用它们
+            size_t end = pos + (size_t)bestLength;
+            for (pos++; pos < end; pos++) {
+                if (pos + DEFLATE_MIN_MATCH > length) continue;
+                unsigned int hash = hashDeflateBytes(data + pos);
+                prev[pos % DEFLATE_WINDOW] = head[hash];
+                head[hash] = (int)pos;
+            }
+        } else {
+            writeLiteralSymbol(&writer, data[pos]);
+            pos++;
+        }
+    }
+    writeLiteralSymbol(&writer, 256);    // 块结束
+    if (writer.count > 0) writeBits(&writer, 0, 8 - writer.count);
+    return writer.pos;
+}
+
+// 固定码表下字面量最长9位，再加块头和结束符
+static size_t getDeflateBound(size_t length) {
+    return length + length / 8 + 16;
+}
+
+static unsigned int computeCRC32(const unsigned char* data, size_t length) {
+    static unsigned int table[256];
+    static atomic_bool tableReady = false;
+    if (!atomic_load_explicit(&tableReady, memory_order_acquire)) {
+        // 多个线程同时初始化时写入的值相同，无害
+        for (unsigned int i = 0; i < 256; i++) {
+            unsigned int c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        atomic_store_explicit(&tableReady, true, memory_order_release);
+    }
+    unsigned int crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static unsigned int computeAdler32(const unsigned char* data, size_t length) {
+    unsigned int a = 1;
+    unsigned int b = 0;
+    while (length > 0) {
+        size_t block = length < 5552 ? length : 5552;    // 保证累加不溢出的最大块长
+        length -= block;
+        while (block-- > 0) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+unsigned char* compressData(const void* data, size_t length, int format, size_t* compressedLength) {
+    if ((!data && length > 0) || !compressedLength ||
+        (format != COMPRESS_GZIP && format != COMPRESS_ZLIB)) {
+        return NULL;
+    }
+    const unsigned char* input = (const unsigned char*)data;
+    size_t headerSize = format == COMPRESS_GZIP ? 10 : 2;
+    size_t trailerSize = format == COMPRESS_GZIP ? 8 : 4;
+    unsigned char* out = (unsigned char*)malloc(headerSize + getDeflateBound(length) + trailerSize);
+    int* head = (int*)malloc(DEFLATE_HASH_SIZE * sizeof(int));
+    int* prev = (int*)malloc(DEFLATE_WINDOW * sizeof(int));
+    if (!out || !head || !prev) {
+        free(out);
+        free(head);
+        free(prev);
+        return NULL;
+    }
+
+    if (format == COMPRESS_GZIP) {
+        // ID1 ID2 CM=8 FLG=0 MTIME=0 XFL=0 OS=255（未知）
+        static const unsigned char gzipHeader[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+        memcpy(out, gzipHeader, sizeof(gzipHeader));
+    } else {
+        out[0] = 0x78;   // CM=8，32K窗口
+        out[1] = 0x01;   // 最快压缩级别，(0x7801 % 31) == 0
+    }
+    size_t pos = headerSize + deflateFixed(input, length, out + headerSize, head, prev);
+    free(head);
+    free(prev);
+
+    if (format == COMPRESS_GZIP) {
+        putU32(out + pos, computeCRC32(input, length));
+        putU32(out + pos + 4, (unsigned int)length);
+    } else {
+        unsigned int adler = computeAdler32(input, length);
+        for (int i = 0; i < 4; i++) out[pos + i] = (unsigned char)(adler >> (24 - 8 * i));
+    }
+    *compressedLength = pos + trailerSize;
+    return out;
+}
+
+// ==================== 玩家移动与输入重放 ====================
+// 输入序列中w/a/s/d（大小写均可）各移动一格，目标格不可通行的输入被忽略，其他字符也被忽略；
+// 每个字符都计入inputIndex，所以检查点位置与序列下标一一对应
+
+bool isWalkableTile(int tile) {
+    return tile == TILE_FLOOR || tile == TILE_ROOM || tile == TILE_CORRIDOR;
+}
+
+int initPlayerState(World* world, PlayerState* state) {
+    if (!world || !state) return -1;
+
+    // 与客户端开始游戏时一致：按行扫描第一个可通行的格子
+    for (int y = 0; y < world->height; y++) {
+        for (int x = 0; x < world->width; x++) {
+            if (isWalkableTile(world->tiles[y][x])) {
+                state->x = x;
+                state->y = y;
+                state->inputIndex = 0;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+long long applyInputs(World* world, PlayerState* state, const char* seq, size_t len) {
+    if (!world || !state || !seq) return 0;
+
+    int x = state->x;
+    int y = state->y;
+    int width = world->width;
+    int height = world->height;
+    long long moves = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        int nx = x, ny = y;
+        switch (seq[i]) {
+            case 'w': case 'W': ny--; break;
+            case 's': case 'S': ny++; break;
+            case 'a': case 'A': nx--; break;
+            case 'd': case 'D': nx++; break;
+            default: continue;
+        }
+        if ((unsigned)nx < (unsigned)width && (unsigned)ny < (unsigned)height &&
+            isWalkableTile(world->tiles[ny][nx])) {
+            x = nx;
+            y = ny;
+            moves++;
+        }
+    }
+
+    state->x = x;
+    state->y = y;
+    state->inputIndex += (long long)len;
+    return moves;
+}
+
+int replayInputs(World* world, PlayerState* state, const char* seq, size_t len,
+                 PlayerState* checkpoints, int maxCheckpoints) {
+    if (!world || !state || !seq || state->inputIndex < 0 || (size_t)state->inputIndex > len) return -1;
+
+    int count = 0;
+    while ((size_t)state->inputIndex < len) {
+        // 推进到下一个检查点边界（或序列末尾）
+        long long next = (state->inputIndex / REPLAY_CHECKPOINT_INTERVAL + 1) * REPLAY_CHECKPOINT_INTERVAL;
+        if ((size_t)next > len) next = (long long)len;
+        applyInputs(world, state, seq + state->inputIndex, (size_t)(next - state->inputIndex));
+
+        if (next % REPLAY_CHECKPOINT_INTERVAL == 0 && checkpoints && count < maxCheckpoints) {
+            checkpoints[count++] = *state;
+        }
+    }
+    return count;
+}
+
+// ==================== 视野与战争迷雾 ====================
+// 递归阴影投射：把视野分成8个八分区，每个八分区逐行向外扫描，遇到不可通行的瓦片时
+// 递归处理它之前的可见斜率区间，阴影部分直接跳过。移动时只清除上一个视野方块，
+// 瓦片变化时只重算包含它的八分区，代价都与视野半径有关，与地图大小无关
+
+// 八分区的坐标变换（局部坐标(dx, dy)到世界偏移）：xx, xy, yx, yy
+static const int fovOctants[8][4] = {
+    {1, 0, 0, 1}, {0, 1, 1, 0}, {0, -1, 1, 0}, {-1, 0, 0, 1},
+    {-1, 0, 0, -1}, {0, -1, -1, 0}, {0, 1, -1, 0}, {1, 0, 0, -1}
+};
+
+static int fovBit(int x, int y) {
+    return y * MAX_WORLD_WIDTH + x;
+}
+
+static bool testFovBit(const unsigned long long* bits, int x, int y) {
+    int bit = fovBit(x, y);
+    return (bits[bit >> 6] >> (bit & 63)) & 1;
+}
+
+static void setFovBit(unsigned long long* bits, int x, int y) {
+    int bit = fovBit(x, y);
+    bits[bit >> 6] |= 1ULL << (bit & 63);
+}
+
+static void clearFovBit(unsigned long long* bits, int x, int y) {
+    int bit = fovBit(x, y);
+    bits[bit >> 6] &= ~(1ULL << (bit & 63));
+}
+
+// 偏移(offsetX, offsetY)是否属于八分区octant（局部坐标满足 dy < 0 且 dy <= dx <= 0）
+static bool isInOctant(int octant, int offsetX, int offsetY) {
+    const int* t = fovOctants[octant];
+    int dx = offsetX * t[0] + offsetY * t[2];
+    int dy = offsetX * t[1] + offsetY * t[3];
+    return dy < 0 && dx <= 0 && dx >= dy;
+}
+
+typedef struct FovCast {
+    World* world;
+    FieldOfView* fov;
+    Point* revealed;
+    int maxRevealed;
+    int revealedCount;
+} FovCast;
+
+static void revealFovCell(FovCast* cast, int x, int y) {
+    FieldOfView* fov = cast->fov;
+    setFovBit(fov->visible, x, y);
+    if (testFovBit(fov->explored, x, y)) return;
+    setFovBit(fov->explored, x, y);
+    if (cast->revealed && cast->revealedCount < cast->maxRevealed) {
+        cast->revealed[cast->revealedCount].x = x;
+        cast->revealed[cast->revealedCount].y = y;
+    }
+    cast->revealedCount++;
+}
+
+static bool isFovOpaque(World* world, int x, int y) {
+    return !isValidPosition(world, x, y) || !isWalkableTile(world->tiles[y][x]);
+}
+
+// 扫描一个八分区中第row行开始、斜率在[end, start]之间的部分
+static void castFovLight(FovCast* cast, int octant, int row, double start, double end) {
+    if (start < end) return;
+
+    const int* t = fovOctants[octant];
+    FieldOfView* fov = cast->fov;
+    int radius = fov->radius;
+    double newStart = 0.0;
+
+    for (int j = row; j <= radius; j++) {
+        int dy = -j;
+        bool blocked = false;
+        for (int dx = -j; dx <= 0; dx++) {
+            double leftSlope = (dx - 0.5) / (dy + 0.5);
+            double rightSlope = (dx + 0.5) / (dy - 0.5);
+            if (start < rightSlope) continue;
+            if (end > leftSlope) break;
+
+            int x = fov->originX + dx * t[0] + dy * t[1];
+            int y = fov->originY + dx * t[2] + dy * t[3];
+            if (dx * dx + dy * dy <= radius * radius && isValidPosition(cast->world, x, y)) {
+                revealFovCell(cast, x, y);
+            }
+
+            bool opaque = isFovOpaque(cast->world, x, y);
+            if (blocked) {
+                if (opaque) {
+                    newStart = rightSlope;
+                } else {
+                    blocked = false;
+                    start = newStart;
+                }
+            } else if (opaque && j < radius) {
+                blocked = true;
+                castFovLight(cast, octant, j + 1, start, leftSlope);
+                newStart = rightSlope;
+            }
+        }
+        if (blocked) break;
+    }
+}
+
+// 清除以原点为中心的视野方块中属于octantMask（位掩码）内八分区的可见位；原点本身由调用者处理
+static void clearFovOctants(World* world, FieldOfView* fov, int octantMask) {
+    int radius = fov->radius;
+    for (int offsetY = -radius; offsetY <= radius; offsetY++) {
+        for (int offsetX = -radius; offsetX <= radius; offsetX++) {
+            int x = fov->originX + offsetX;
+            int y = fov->originY + offsetY;
+            if (!isValidPosition(world, x, y)) continue;
+            for (int octant = 0; octant < 8; octant++) {
+                if ((octantMask >> octant) & 1 && isInOctant(octant, offsetX, offsetY)) {
+                    clearFovBit(fov->visible, x, y);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void resetFieldOfView(FieldOfView* fov, int radius) {
+    if (!fov) return;
+    memset(fov->visible, 0, sizeof(fov->visible));
+    memset(fov->explored, 0, sizeof(fov->explored));
+    fov->originX = -1;
+    fov->originY = -1;
+    fov->radius = radius < 1 ? 1 : radius;
+}
+
+int updateFieldOfView(World* world, FieldOfView* fov, int x, int y, Point* revealed, int maxRevealed) {
+    if (!world || !fov || !isValidPosition(world, x, y)) return -1;
+    if (x == fov->originX && y == fov->originY) return 0;
+
+    // 旧视野只可能在上一个原点周围的方块内
+    if (fov->originX >= 0) {
+        clearFovOctants(world, fov, 0xFF);
+        clearFovBit(fov->visible, fov->originX, fov->originY);
+    }
+    fov->originX = x;
+    fov->originY = y;
+
+    FovCast cast = {world, fov, revealed, maxRevealed, 0};
+    revealFovCell(&cast, x, y);
+    for (int octant = 0; octant < 8; octant++) {
+        castFovLight(&cast, octant, 1, 1.0, 0.0);
+    }
+    return cast.revealedCount;
+}
+
+int refreshFieldOfViewTile(World* world, FieldOfView* fov, int tileX, int tileY,
+                           Point* revealed, int maxRevealed) {
+    if (!world || !fov || fov->originX < 0) return 0;
+    int offsetX = tileX - fov->originX;
+    int offsetY = tileY - fov->originY;
+    if (abs(offsetX) > fov->radius || abs(offsetY) > fov->radius) return 0;
+
+    int affected = 0;
+    for (int octant = 0; octant < 8; octant++) {
+        if (isInOctant(octant, offsetX, offsetY)) affected |= 1 << octant;
+    }
+    if (affected == 0) return 0;   // 原点自身的瓦片不影响视野
+
+    // 受影响八分区边界（坐标轴和对角线）上的格子也属于相邻八分区，
+    // 清除后要由相邻八分区一起重算，结果才与完整重算一致
+    int recast = affected;
+    static const int rays[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {1, -1}, {-1, 1}, {-1, -1}};
+    for (int i = 0; i < 8; i++) {
+        int sharing = 0;
+        for (int octant = 0; octant < 8; octant++) {
+            if (isInOctant(octant, rays[i][0], rays[i][1])) sharing |= 1 << octant;
+        }
+        if (sharing & affected) recast |= sharing;
+    }
+
+    clearFovOctants(world, fov, affected);
+    FovCast cast = {world, fov, revealed, maxRevealed, 0};
+    for (int octant = 0; octant < 8; octant++) {
+        if ((recast >> octant) & 1) castFovLight(&cast, octant, 1, 1.0, 0.0);
+    }
+    return cast.revealedCount;
+}
+
+bool isCellVisible(const FieldOfView* fov, int x, int y) {
+    if (!fov || x < 0 || x >= MAX_WORLD_WIDTH || y < 0 || y >= MAX_WORLD_HEIGHT) return false;
+    return testFovBit(fov->visible, x, y);
+}
+
+bool isCellExplored(const FieldOfView* fov, int x, int y) {
+    if (!fov || x < 0 || x >= MAX_WORLD_WIDTH || y < 0 || y >= MAX_WORLD_HEIGHT) return false;
+    return testFovBit(fov->explored, x, y);
 }
 
 // ==================== 连通性检查 ====================
 
 bool isWorldConnected(World* world) {
+    // 增删过房间或走廊后并查集不再准确，以动态连通性维护的分量数为准
+    if (world->connectivity) return world->connectivity->componentCount <= 1;
     if (world->roomCount == 0) return true;
     if (world->roomCount == 1) return true;
 
@@ -606,10 +4609,749 @@ int getTile(World* world, int x, int y) {
     return world->tiles[y][x];
 }
 
+int roomAt(World* world, int x, int y) {
+    if (!world || !isValidPosition(world, x, y)) return -1;
+    int owner = world->owner[y][x];
+    return owner >= 0 && owner < OWNER_CORRIDOR_BASE ? owner : -1;
+}
+
+int corridorAt(World* world, int x, int y) {
+    if (!world || !isValidPosition(world, x, y)) return -1;
+    int owner = world->owner[y][x];
+    return owner >= OWNER_CORRIDOR_BASE ? owner - OWNER_CORRIDOR_BASE : -1;
+}
+
+// 走廊路径（与绘制时相同的宽度和样式）是否经过(x, y)
+static bool corridorPathContains(const World* world, const Corridor* corridor, int x, int y) {
+    CorridorRect rects[3];
+    int count = getCorridorRects(corridor->start, corridor->end, world->corridorWidth, world->corridorStyle, rects);
+    for (int i = 0; i < count; i++) {
+        if (x >= rects[i].x0 && x <= rects[i].x1 && y >= rects[i].y0 && y <= rects[i].y1) return true;
+    }
+    return false;
+}
+
+// 走廊认领路径上所有无归属的格子
+static void claimCorridorPath(World* world, int corridorIndex) {
+    const Corridor* corridor = &world->corridors[corridorIndex];
+    short owner = (short)(OWNER_CORRIDOR_BASE + corridorIndex);
+
+    CorridorRect rects[3];
+    int count = getCorridorRects(corridor->start, corridor->end, world->corridorWidth, world->corridorStyle, rects);
+    for (int i = 0; i < count; i++) {
+        int x0 = rects[i].x0, y0 = rects[i].y0, x1 = rects[i].x1, y1 = rects[i].y1;
+        if (!clipRect(world, &x0, &y0, &x1, &y1)) continue;
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                if (world->owner[y][x] == OWNER_NONE && isWalkableTile(world->tiles[y][x])) {
+                    world->owner[y][x] = owner;
+                }
+            }
+        }
+    }
+}
+
+// 新变为可通行的格子按rebuildOwnership的规则取得归属：先是包含它的房间（洞穴/WFC的不规则房间
+// 只取已与该房间相邻的格子，近似其形状），再是下标最小的经过它的走廊，都没有时不归属
+static short findTileOwner(World* world, int x, int y) {
+    bool irregular = world->mode == GEN_MODE_CAVE || world->mode == GEN_MODE_WFC;
+    for (int i = 0; i < world->roomCount; i++) {
+        Room* room = &world->rooms[i];
+        if (!room->exists || x < room->x || x >= room->x + room->width ||
+            y < room->y || y >= room->y + room->height) continue;
+        if (!irregular) return (short)i;
+        static const int dx[4] = {1, -1, 0, 0};
+        static const int dy[4] = {0, 0, 1, -1};
+        for (int d = 0; d < 4; d++) {
+            if (isValidPosition(world, x + dx[d], y + dy[d]) && world->owner[y + dy[d]][x + dx[d]] == i) {
+                return (short)i;
+            }
+        }
+    }
+    for (int i = 0; i < world->corridorCount; i++) {
+        if (world->corridors[i].exists && corridorPathContains(world, &world->corridors[i], x, y)) {
+            return (short)(OWNER_CORRIDOR_BASE + i);
+        }
+    }
+    return OWNER_NONE;
+}
+
 void setTile(World* world, int x, int y, int tileType) {
     if (isValidPosition(world, x, y)) {
         world->tiles[y][x] = tileType;
+        // 归属只属于可通行的格子：变成墙时清除，新挖开的格子按重建归属的规则认领
+        if (!isWalkableTile(tileType)) {
+            world->owner[y][x] = OWNER_NONE;
+        } else if (world->owner[y][x] == OWNER_NONE) {
+            world->owner[y][x] = findTileOwner(world, x, y);
+        }
+        markDirtyRect(world, x, y, 1, 1);
+    }
+}
+
+int rebuildOwnership(World* world) {
+    if (!world) return -1;
+
+    // 洞穴区域的形状只在生成时可知：同样的种子、尺寸和模式重新生成一次，从中取房间格子。
+    // 之后新增的房间都是矩形，房间数可以多于生成时
+    World* reference = NULL;
+    if (world->mode == GEN_MODE_CAVE || world->mode == GEN_MODE_WFC) {
+        reference = generateWorldWithCorridors(world->seed, world->width, world->height, world->mode,
+                                               world->corridorWidth, world->corridorStyle);
+        if (!reference) return -1;
+        bool matches = reference->roomCount <= world->roomCount;
+        for (int i = 0; matches && i < reference->roomCount; i++) {
+            Room* a = &reference->rooms[i];
+            Room* b = &world->rooms[i];
+            matches = a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height;
+        }
+        if (!matches) {
+            destroyWorld(reference);
+            return -1;
+        }
+    }
+
+    // 按生成顺序先填房间，再按下标重放走廊。走廊只认领无归属的格子，
+    // 而生成时走廊路径上无归属的格子必然是被它挖开的墙，所以结果与生成时一致；
+    // 删除房间或走廊后释放的格子也按同样的规则改归下标最小的经过它的走廊。
+    // 墙不归属任何房间或走廊（setTile改成墙的格子随之清除归属）
+    memset(world->owner, 0xFF, sizeof(world->owner));
+    for (int i = 0; i < world->roomCount; i++) {
+        Room* room = &world->rooms[i];
+        if (!room->exists) continue;
+        int x0 = room->x, y0 = room->y;
+        int x1 = room->x + room->width - 1, y1 = room->y + room->height - 1;
+        if (!clipRect(world, &x0, &y0, &x1, &y1)) continue;
+        bool irregular = reference && i < reference->roomCount;
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                if (!isWalkableTile(world->tiles[y][x])) continue;
+                if (!irregular || reference->owner[y][x] == i) world->owner[y][x] = (short)i;
+            }
+        }
+    }
+    for (int i = 0; i < world->corridorCount; i++) {
+        if (world->corridors[i].exists) claimCorridorPath(world, i);
+    }
+
+    destroyWorld(reference);
+    return 0;
+}
+
+// 两个矩形的并集
+static DirtyRect unionDirtyRect(const DirtyRect* a, const DirtyRect* b) {
+    DirtyRect result;
+    result.x = a->x < b->x ? a->x : b->x;
+    result.y = a->y < b->y ? a->y : b->y;
+    int right = a->x + a->width > b->x + b->width ? a->x + a->width : b->x + b->width;
+    int bottom = a->y + a->height > b->y + b->height ? a->y + a->height : b->y + b->height;
+    result.width = right - result.x;
+    result.height = bottom - result.y;
+    return result;
+}
+
+// 相交或边相邻（玩家连续移动经过的格子会合并成一个矩形）
+static bool isDirtyRectTouching(const DirtyRect* a, const DirtyRect* b) {
+    return a->x <= b->x + b->width && b->x <= a->x + a->width &&
+           a->y <= b->y + b->height && b->y <= a->y + a->height;
+}
+
+void markDirtyRect(World* world, int x, int y, int width, int height) {
+    if (!world) return;
+
+    DirtyRect rect;
+    rect.x = x < 0 ? 0 : x;
+    rect.y = y < 0 ? 0 : y;
+    rect.width = (x + width > world->width ? world->width : x + width) - rect.x;
+    rect.height = (y + height > world->height ? world->height : y + height) - rect.y;
+    if (rect.width <= 0 || rect.height <= 0) return;
+
+    // 反复并入相交的矩形，直到新矩形与剩下的都不相交
+    for (int i = 0; i < world->dirtyCount; i++) {
+        if (isDirtyRectTouching(&rect, &world->dirtyRects[i])) {
+            rect = unionDirtyRect(&rect, &world->dirtyRects[i]);
+            world->dirtyRects[i] = world->dirtyRects[--world->dirtyCount];
+            i = -1;
+        }
+    }
+
+    if (world->dirtyCount == MAX_DIRTY_RECTS) {
+        int best = 0;
+        long long bestGrowth = -1;
+        for (int i = 0; i < world->dirtyCount; i++) {
+            DirtyRect merged = unionDirtyRect(&rect, &world->dirtyRects[i]);
+            long long growth = (long long)merged.width * merged.height -
+                               (long long)world->dirtyRects[i].width * world->dirtyRects[i].height;
+            if (bestGrowth < 0 || growth < bestGrowth) {
+                best = i;
+                bestGrowth = growth;
+            }
+        }
+        rect = unionDirtyRect(&rect, &world->dirtyRects[best]);
+        world->dirtyRects[best] = world->dirtyRects[--world->dirtyCount];
+    }
+    world->dirtyRects[world->dirtyCount++] = rect;
+}
+
+int takeDirtyRects(World* world, DirtyRect* rects) {
+    if (!world || !rects || world->dirtyCount == 0) return 0;
+
+    int count = world->dirtyCount;
+    memcpy(rects, world->dirtyRects, (size_t)count * sizeof(DirtyRect));
+    world->dirtyCount = 0;
+    world->version++;
+    return count;
+}
+
+// ==================== 动态连通性（链剪树）====================
+// 每条连接两个房间的走廊是一个带权结点，挂在两个房间结点之间，这样路径上的最大边就是
+// 路径上权值最大的结点。生成森林的边link进树，其余走廊记为非树边；删除树边后从非树边中
+// 找连接两侧的最短走廊补上。连通性结构在第一次增删时由走廊端点所在的房间（归属平面）建立
+
+#define LINK_CUT_NIL (-1)
+
+static bool isLinkCutRoot(const RoomConnectivity* rc, int x) {
+    int p = rc->nodes[x].parent;
+    return p == LINK_CUT_NIL || (rc->nodes[p].child[0] != x && rc->nodes[p].child[1] != x);
+}
+
+static void updateLinkCutNode(RoomConnectivity* rc, int x) {
+    LinkCutNode* node = &rc->nodes[x];
+    node->maxNode = x;
+    for (int d = 0; d < 2; d++) {
+        int c = node->child[d];
+        if (c != LINK_CUT_NIL && rc->nodes[rc->nodes[c].maxNode].weight > rc->nodes[node->maxNode].weight) {
+            node->maxNode = rc->nodes[c].maxNode;
+        }
+    }
+}
+
+static void pushLinkCutNode(RoomConnectivity* rc, int x) {
+    LinkCutNode* node = &rc->nodes[x];
+    if (!node->reversed) return;
+    int t = node->child[0];
+    node->child[0] = node->child[1];
+    node->child[1] = t;
+    for (int d = 0; d < 2; d++) {
+        if (node->child[d] != LINK_CUT_NIL) rc->nodes[node->child[d]].reversed ^= true;
+    }
+    node->reversed = false;
+}
+
+static void rotateLinkCut(RoomConnectivity* rc, int x) {
+    int p = rc->nodes[x].parent;
+    int g = rc->nodes[p].parent;
+    int d = rc->nodes[p].child[1] == x;
+    int b = rc->nodes[x].child[!d];
+
+    if (!isLinkCutRoot(rc, p)) {
+        rc->nodes[g].child[rc->nodes[g].child[1] == p] = x;
+    }
+    rc->nodes[x].parent = g;
+    rc->nodes[x].child[!d] = p;
+    rc->nodes[p].parent = x;
+    rc->nodes[p].child[d] = b;
+    if (b != LINK_CUT_NIL) rc->nodes[b].parent = p;
+
+    updateLinkCutNode(rc, p);
+    updateLinkCutNode(rc, x);
+}
+
+static void splayLinkCut(RoomConnectivity* rc, int x) {
+    // 自顶向下下放翻转标记（伸展树深度不超过结点数）
+    int stack[LINK_CUT_NODES];
+    int top = 0;
+    stack[top++] = x;
+    for (int y = x; !isLinkCutRoot(rc, y); y = rc->nodes[y].parent) {
+        stack[top++] = rc->nodes[y].parent;
+    }
+    while (top > 0) pushLinkCutNode(rc, stack[--top]);
+
+    while (!isLinkCutRoot(rc, x)) {
+        int p = rc->nodes[x].parent;
+        if (!isLinkCutRoot(rc, p)) {
+            int g = rc->nodes[p].parent;
+            bool zigzig = (rc->nodes[g].child[1] == p) == (rc->nodes[p].child[1] == x);
+            rotateLinkCut(rc, zigzig ? p : x);
+        }
+        rotateLinkCut(rc, x);
+    }
+}
+
+static void accessLinkCut(RoomConnectivity* rc, int x) {
+    int last = LINK_CUT_NIL;
+    for (int y = x; y != LINK_CUT_NIL; y = rc->nodes[y].parent) {
+        splayLinkCut(rc, y);
+        rc->nodes[y].child[1] = last;
+        updateLinkCutNode(rc, y);
+        last = y;
+    }
+    splayLinkCut(rc, x);
+}
+
+static void makeLinkCutRoot(RoomConnectivity* rc, int x) {
+    accessLinkCut(rc, x);
+    rc->nodes[x].reversed ^= true;
+}
+
+static int findLinkCutRoot(RoomConnectivity* rc, int x) {
+    accessLinkCut(rc, x);
+    for (;;) {
+        pushLinkCutNode(rc, x);
+        if (rc->nodes[x].child[0] == LINK_CUT_NIL) break;
+        x = rc->nodes[x].child[0];
+    }
+    splayLinkCut(rc, x);
+    return x;
+}
+
+static void linkLinkCut(RoomConnectivity* rc, int x, int y) {
+    makeLinkCutRoot(rc, x);
+    rc->nodes[x].parent = y;
+}
+
+static void cutLinkCut(RoomConnectivity* rc, int x, int y) {
+    makeLinkCutRoot(rc, x);
+    accessLinkCut(rc, y);
+    // 此时x是y在伸展树中的左孩子且没有右子树
+    rc->nodes[y].child[0] = LINK_CUT_NIL;
+    rc->nodes[x].parent = LINK_CUT_NIL;
+    updateLinkCutNode(rc, y);
+}
+
+static bool linkCutConnected(RoomConnectivity* rc, int x, int y) {
+    return x == y || findLinkCutRoot(rc, x) == findLinkCutRoot(rc, y);
+}
+
+// x到y（须连通）路径上权值最大的结点
+static int linkCutPathMax(RoomConnectivity* rc, int x, int y) {
+    makeLinkCutRoot(rc, x);
+    accessLinkCut(rc, y);
+    return rc->nodes[y].maxNode;
+}
+
+// 把走廊加入生成森林：走廊结点挂在两个房间之间
+static void linkCorridorEdge(RoomConnectivity* rc, int corridorIndex) {
+    int edge = MAX_ROOMS + corridorIndex;
+    linkLinkCut(rc, rc->edgeRooms[corridorIndex][0], edge);
+    linkLinkCut(rc, edge, rc->edgeRooms[corridorIndex][1]);
+    rc->edgeState[corridorIndex] = CORRIDOR_EDGE_TREE;
+    rc->componentCount--;
+}
+
+static void cutCorridorEdge(RoomConnectivity* rc, int corridorIndex) {
+    int edge = MAX_ROOMS + corridorIndex;
+    cutLinkCut(rc, rc->edgeRooms[corridorIndex][0], edge);
+    cutLinkCut(rc, edge, rc->edgeRooms[corridorIndex][1]);
+    rc->edgeState[corridorIndex] = CORRIDOR_EDGE_NONE;
+    rc->componentCount++;
+}
+
+// 登记一条连接roomA和roomB的走廊：两侧不连通时成为树边，否则作为非树边备用
+static void insertCorridorEdge(RoomConnectivity* rc, int corridorIndex, int roomA, int roomB, int weight) {
+    rc->edgeRooms[corridorIndex][0] = roomA;
+    rc->edgeRooms[corridorIndex][1] = roomB;
+    rc->nodes[MAX_ROOMS + corridorIndex].weight = weight;
+    rc->nodes[MAX_ROOMS + corridorIndex].maxNode = MAX_ROOMS + corridorIndex;
+
+    if (linkCutConnected(rc, roomA, roomB)) {
+        rc->edgeState[corridorIndex] = CORRIDOR_EDGE_EXTRA;
+    } else {
+        linkCorridorEdge(rc, corridorIndex);
+    }
+}
+
+// 房间内作为走廊端点的格子：优先取中心，中心不属于该房间（洞穴区域）时取第一个属于它的格子
+static bool getRoomAnchor(World* world, int roomId, Point* anchor) {
+    Room* room = &world->rooms[roomId];
+    anchor->x = room->x + room->width / 2;
+    anchor->y = room->y + room->height / 2;
+    if (roomAt(world, anchor->x, anchor->y) == roomId) return true;
+
+    for (int y = room->y; y < room->y + room->height; y++) {
+        for (int x = room->x; x < room->x + room->width; x++) {
+            if (roomAt(world, x, y) == roomId) {
+                anchor->x = x;
+                anchor->y = y;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static int corridorWeight(const Corridor* corridor) {
+    return anchorDistance(corridor->start, corridor->end);
+}
+
+static void insertRoomIntoGrid(RoomConnectivity* rc, int roomId) {
+    int* head = &rc->gridHead[rc->anchors[roomId].y / ROOM_GRID_CELL][rc->anchors[roomId].x / ROOM_GRID_CELL];
+    rc->gridNext[roomId] = *head;
+    *head = roomId;
+}
+
+static void removeRoomFromGrid(RoomConnectivity* rc, int roomId) {
+    int* link = &rc->gridHead[rc->anchors[roomId].y / ROOM_GRID_CELL][rc->anchors[roomId].x / ROOM_GRID_CELL];
+    while (*link >= 0 && *link != roomId) link = &rc->gridNext[*link];
+    if (*link == roomId) *link = rc->gridNext[roomId];
+}
+
+// 登记房间的走廊端点并放入空间索引；房间内没有属于它的格子时端点记为(-1, -1)
+static void indexRoom(World* world, RoomConnectivity* rc, int roomId) {
+    if (getRoomAnchor(world, roomId, &rc->anchors[roomId])) {
+        insertRoomIntoGrid(rc, roomId);
+    } else {
+        rc->anchors[roomId].x = -1;
+        rc->anchors[roomId].y = -1;
+    }
+}
+
+// 取得（必要时建立）动态连通性结构
+static RoomConnectivity* getConnectivity(World* world) {
+    if (world->connectivity) return world->connectivity;
+
+    RoomConnectivity* rc = (RoomConnectivity*)arenaAlloc(&world->arena, sizeof(RoomConnectivity));
+    if (!rc) return NULL;
+
+    for (int i = 0; i < LINK_CUT_NODES; i++) {
+        LinkCutNode* node = &rc->nodes[i];
+        node->child[0] = node->child[1] = LINK_CUT_NIL;
+        node->parent = LINK_CUT_NIL;
+        node->weight = -1;
+        node->maxNode = i;
+        node->reversed = false;
+    }
+    memset(rc->edgeState, CORRIDOR_EDGE_NONE, sizeof(rc->edgeState));
+    memset(rc->gridHead, 0xFF, sizeof(rc->gridHead));
+
+    rc->componentCount = 0;
+    for (int i = 0; i < world->roomCount; i++) {
+        if (!world->rooms[i].exists) continue;
+        rc->componentCount++;
+        indexRoom(world, rc, i);
+    }
+
+    // 走廊两端都落在房间内才是房间图的边（区块门户走廊有一端在边界上）
+    for (int i = 0; i < world->corridorCount; i++) {
+        Corridor* corridor = &world->corridors[i];
+        if (!corridor->exists) continue;
+        int a = roomAt(world, corridor->start.x, corridor->start.y);
+        int b = roomAt(world, corridor->end.x, corridor->end.y);
+        if (a < 0 || b < 0 || a == b) continue;
+        insertCorridorEdge(rc, i, a, b, corridorWeight(corridor));
+    }
+
+    world->connectivity = rc;
+    return rc;
+}
+
+// 从from的连接表中删去一个指向to的结点，结点放回空闲链表
+static void unlinkConnection(World* world, int from, int to) {
+    for (RoomConnection** link = &world->connections[from]; *link; link = &(*link)->next) {
+        if ((*link)->roomId == to) {
+            RoomConnection* removed = *link;
+            *link = removed->next;
+            releaseConnection(world, removed);
+            return;
+        }
+    }
+}
+
+// 空闲的走廊槽位：优先复用removeCorridor留下的空槽，没有时返回corridorCount，已满返回-1
+static int findFreeCorridorSlot(World* world) {
+    for (int i = 0; i < world->corridorCount; i++) {
+        if (!world->corridors[i].exists) return i;
+    }
+    return world->corridorCount < MAX_CORRIDORS ? world->corridorCount : -1;
+}
+
+// 空闲的房间槽位，规则同findFreeCorridorSlot
+static int findFreeRoomSlot(World* world) {
+    for (int i = 0; i < world->roomCount; i++) {
+        if (!world->rooms[i].exists) return i;
+    }
+    return world->roomCount < MAX_ROOMS ? world->roomCount : -1;
+}
+
+// 释放属于owner的格子：被其他现存走廊经过的改归下标最小的那条（并保持为走廊），
+// 其余恢复为墙，只检查[x0,x1]x[y0,y1]范围
+static void releaseOwnedCells(World* world, short owner, int x0, int y0, int x1, int y1) {
+    if (!clipRect(world, &x0, &y0, &x1, &y1)) return;
+
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            if (world->owner[y][x] != owner) continue;
+
+            int heir = -1;
+            for (int i = 0; i < world->corridorCount && heir < 0; i++) {
+                if (OWNER_CORRIDOR_BASE + i == owner || !world->corridors[i].exists) continue;
+                if (corridorPathContains(world, &world->corridors[i], x, y)) heir = i;
+            }
+            if (heir >= 0) {
+                world->owner[y][x] = (short)(OWNER_CORRIDOR_BASE + heir);
+                world->tiles[y][x] = TILE_CORRIDOR;
+            } else {
+                world->owner[y][x] = OWNER_NONE;
+                world->tiles[y][x] = TILE_WALL;
+            }
+            markDirtyRect(world, x, y, 1, 1);
+        }
+    }
+}
+
+int addCorridor(World* world, int roomA, int roomB) {
+    if (!world || roomA == roomB) return -1;
+    if (roomA < 0 || roomA >= world->roomCount || !world->rooms[roomA].exists) return -1;
+    if (roomB < 0 || roomB >= world->roomCount || !world->rooms[roomB].exists) return -1;
+    int index = findFreeCorridorSlot(world);
+    if (index < 0) return -1;
+
+    RoomConnectivity* rc = getConnectivity(world);
+    if (!rc || rc->anchors[roomA].x < 0 || rc->anchors[roomB].x < 0) return -1;
+    Point start = rc->anchors[roomA];
+    Point end = rc->anchors[roomB];
+
+    RoomConnection* conn1 = allocConnection(world, roomB, world->connections[roomA]);
+    if (!conn1) return -1;
+    RoomConnection* conn2 = allocConnection(world, roomA, world->connections[roomB]);
+    if (!conn2) {
+        releaseConnection(world, conn1);
+        return -1;
+    }
+    world->connections[roomA] = conn1;
+    world->connections[roomB] = conn2;
+
+    if (index == world->corridorCount) world->corridorCount++;
+    Corridor* corridor = &world->corridors[index];
+    corridor->id = index;
+    corridor->start = start;
+    corridor->end = end;
+    corridor->isTurning = (start.x != end.x && start.y != end.y);
+    corridor->exists = true;
+
+    drawOwnedCorridor(world, start, end, index);
+    int x0 = start.x < end.x ? start.x : end.x;
+    int y0 = start.y < end.y ? start.y : end.y;
+    markDirtyRect(world, x0, start.y, abs(end.x - start.x) + 1, 1);
+    markDirtyRect(world, end.x, y0, 1, abs(end.y - start.y) + 1);
+
+    unionSets(world->disjointSet, roomA, roomB);
+    insertCorridorEdge(rc, index, roomA, roomB, corridorWeight(corridor));
+    return index;
+}
+
+// 删除走廊；replace为true时若删的是树边，从非树边中找替代边
+static void detachCorridor(World* world, RoomConnectivity* rc, int corridorIndex, bool replace) {
+    int state = rc->edgeState[corridorIndex];
+    int roomA = rc->edgeRooms[corridorIndex][0];
+    int roomB = rc->edgeRooms[corridorIndex][1];
+    Corridor* corridor = &world->corridors[corridorIndex];
+    corridor->exists = false;
+    rc->edgeState[corridorIndex] = CORRIDOR_EDGE_NONE;
+
+    if (state == CORRIDOR_EDGE_TREE) {
+        cutCorridorEdge(rc, corridorIndex);
+    }
+    if (state == CORRIDOR_EDGE_TREE && replace) {
+        // 在非树边中找重新连接两侧的最短走廊
+        int best = -1;
+        for (int i = 0; i < world->corridorCount; i++) {
+            if (rc->edgeState[i] != CORRIDOR_EDGE_EXTRA) continue;
+            if (best >= 0 && rc->nodes[MAX_ROOMS + i].weight >= rc->nodes[MAX_ROOMS + best].weight) continue;
+            if (!linkCutConnected(rc, rc->edgeRooms[i][0], rc->edgeRooms[i][1])) best = i;
+        }
+        if (best >= 0) linkCorridorEdge(rc, best);
+    }
+    if (state != CORRIDOR_EDGE_NONE) {
+        unlinkConnection(world, roomA, roomB);
+        unlinkConnection(world, roomB, roomA);
+    }
+
+    CorridorRect rects[3];
+    int count = getCorridorRects(corridor->start, corridor->end, world->corridorWidth, world->corridorStyle, rects);
+    for (int i = 0; i < count; i++) {
+        releaseOwnedCells(world, (short)(OWNER_CORRIDOR_BASE + corridorIndex),
+                          rects[i].x0, rects[i].y0, rects[i].x1, rects[i].y1);
+    }
+}
+
+int removeCorridor(World* world, int corridorIndex) {
+    if (!world || corridorIndex < 0 || corridorIndex >= world->corridorCount) return -1;
+    if (!world->corridors[corridorIndex].exists) return -1;
+
+    RoomConnectivity* rc = getConnectivity(world);
+    if (!rc) return -1;
+
+    detachCorridor(world, rc, corridorIndex, true);
+    return 0;
+}
+
+int removeRoom(World* world, int roomId) {
+    if (!world || roomId < 0 || roomId >= world->roomCount || !world->rooms[roomId].exists) return -1;
+
+    RoomConnectivity* rc = getConnectivity(world);
+    if (!rc) return -1;
+
+    for (int i = 0; i < world->corridorCount; i++) {
+        if (rc->edgeState[i] == CORRIDOR_EDGE_NONE) continue;
+        if (rc->edgeRooms[i][0] == roomId || rc->edgeRooms[i][1] == roomId) {
+            removeCorridor(world, i);
+        }
+    }
+
+    // 所有边都已删去，房间是孤立的一个分量
+    Room* room = &world->rooms[roomId];
+    room->exists = false;
+    rc->componentCount--;
+    if (rc->anchors[roomId].x >= 0) removeRoomFromGrid(rc, roomId);
+    releaseOwnedCells(world, (short)roomId, room->x, room->y,
+                      room->x + room->width - 1, room->y + room->height - 1);
+    return 0;
+}
+
+bool roomsConnected(World* world, int roomA, int roomB) {
+    if (!world) return false;
+    if (roomA < 0 || roomA >= world->roomCount || !world->rooms[roomA].exists) return false;
+    if (roomB < 0 || roomB >= world->roomCount || !world->rooms[roomB].exists) return false;
+
+    RoomConnectivity* rc = getConnectivity(world);
+    return rc && linkCutConnected(rc, roomA, roomB);
+}
+
+// 候选边：新房间到一个近邻房间
+typedef struct MstCandidate {
+    int roomId;
+    int weight;
+} MstCandidate;
+
+// 在空间索引中找离point最近的至多k个房间（按距离升序），逐圈向外扫描网格，
+// 已找满k个且下一圈的最近可能距离超过第k个时停止
+static int findNearestRooms(RoomConnectivity* rc, Point point, int exclude, MstCandidate* result, int k) {
+    int count = 0;
+    int cellX = point.x / ROOM_GRID_CELL;
+    int cellY = point.y / ROOM_GRID_CELL;
+    int maxRing = ROOM_GRID_COLS > ROOM_GRID_ROWS ? ROOM_GRID_COLS : ROOM_GRID_ROWS;
+
+    for (int ring = 0; ring < maxRing; ring++) {
+        if (count == k && (ring - 1) * ROOM_GRID_CELL > result[k - 1].weight) break;
+
+        for (int gy = cellY - ring; gy <= cellY + ring; gy++) {
+            if (gy < 0 || gy >= ROOM_GRID_ROWS) continue;
+            for (int gx = cellX - ring; gx <= cellX + ring; gx++) {
+                if (gx < 0 || gx >= ROOM_GRID_COLS) continue;
+                if (gy != cellY - ring && gy != cellY + ring && gx != cellX - ring && gx != cellX + ring) continue;
+
+                for (int id = rc->gridHead[gy][gx]; id >= 0; id = rc->gridNext[id]) {
+                    if (id == exclude) continue;
+                    int weight = anchorDistance(point, rc->anchors[id]);
+                    if (count == k && weight >= result[k - 1].weight) continue;
+
+                    // 插入排序（k很小）
+                    int pos = count < k ? count++ : k - 1;
+                    while (pos > 0 && result[pos - 1].weight > weight) {
+                        result[pos] = result[pos - 1];
+                        pos--;
+                    }
+                    result[pos].roomId = id;
+                    result[pos].weight = weight;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+int addRoomIncremental(World* world, Room room) {
+    if (!world) return -1;
+    if (room.width < 1 || room.height < 1) return -1;
+
+    // 四周留一格墙
+    if (room.x < 1 || room.y < 1 || room.x + room.width > world->width - 1 ||
+        room.y + room.height > world->height - 1) return -1;
+    for (int i = 0; i < world->roomCount; i++) {
+        if (world->rooms[i].exists && roomsOverlap(&room, &world->rooms[i])) return -1;
+    }
+
+    int id = findFreeRoomSlot(world);
+    if (id < 0) return -1;
+    RoomConnectivity* rc = getConnectivity(world);
+    if (!rc) return -1;
+
+    if (id == world->roomCount) world->roomCount++;
+    room.id = id;
+    room.exists = true;
+    world->rooms[id] = room;
+    world->connections[id] = NULL;
+    rasterFillRect(world, room.x, room.y, room.width, room.height, TILE_ROOM, (short)id);
+    markDirtyRect(world, room.x, room.y, room.width, room.height);
+    rc->componentCount++;
+    indexRoom(world, rc, id);
+
+    MstCandidate candidates[INCREMENTAL_MST_NEIGHBOURS];
+    int candidateCount = findNearestRooms(rc, rc->anchors[id], id, candidates, INCREMENTAL_MST_NEIGHBOURS);
+
+    // 环性质：候选边按长度升序加入，成环时只有比环上最长走廊短才替换它。
+    // 先加新走廊（成环时它先作为非树边），成功后才删去被替换的走廊并把新走廊换进生成森林，
+    // 加不上时世界保持原样
+    int added = 0;
+    for (int i = 0; i < candidateCount; i++) {
+        int neighbor = candidates[i].roomId;
+        int heaviest = -1;
+        if (linkCutConnected(rc, id, neighbor)) {
+            heaviest = linkCutPathMax(rc, id, neighbor);
+            if (heaviest < MAX_ROOMS || rc->nodes[heaviest].weight <= candidates[i].weight) continue;
+        }
+        int index = addCorridor(world, id, neighbor);
+        if (index < 0) break;
+        added++;
+        if (heaviest >= 0) {
+            detachCorridor(world, rc, heaviest - MAX_ROOMS, false);
+            linkCorridorEdge(rc, index);
+        }
+    }
+
+    // 有可连接的房间却一条走廊也没加上：撤销这个房间
+    if (candidateCount > 0 && added == 0) {
+        removeRoom(world, id);
+        if (id == world->roomCount - 1) world->roomCount--;
+        return -1;
+    }
+    return id;
+}
+
+int repairConnectivity(World* world) {
+    if (!world) return -1;
+    RoomConnectivity* rc = getConnectivity(world);
+    if (!rc) return -1;
+
+    int added = 0;
+    while (rc->componentCount > 1) {
+        int roots[MAX_ROOMS];
+        for (int i = 0; i < world->roomCount; i++) {
+            roots[i] = -1;
+            if (world->rooms[i].exists && rc->anchors[i].x >= 0) {
+                roots[i] = findLinkCutRoot(rc, i);
+            }
+        }
+
+        // 不同分量之间最短的一对房间
+        int bestA = -1, bestB = -1, bestDist = INT_MAX;
+        for (int i = 0; i < world->roomCount; i++) {
+            if (roots[i] < 0) continue;
+            for (int j = i + 1; j < world->roomCount; j++) {
+                if (roots[j] < 0 || roots[j] == roots[i]) continue;
+                int dist = anchorDistance(rc->anchors[i], rc->anchors[j]);
+                if (dist < bestDist) {
+                    bestDist = dist;
+                    bestA = i;
+                    bestB = j;
+                }
+            }
+        }
+        if (bestA < 0 || addCorridor(world, bestA, bestB) < 0) return -1;
+        added++;
     }
+    return added;
 }
 
 // ==================== JSON输出函数 ====================
@@ -647,10 +5389,14 @@ int getCorridorsJSON(World* world, char* buffer, size_t bufferSize) {
     int pos = 0;
     if (bufAppend(buffer, bufferSize, &pos, "[") != 0) return -1;
 
+    bool first = true;
     for (int i = 0; i < world->corridorCount; i++) {
-        if (i > 0) {
+        if (!world->corridors[i].exists) continue;
+        if (!first) {
             if (bufAppend(buffer, bufferSize, &pos, ",") != 0) return -1;
         }
+        first = false;
+
         if (bufAppend(buffer, bufferSize, &pos,
             "{\"id\":%d,\"start\":{\"x\":%d,\"y\":%d},\"end\":{\"x\":%d,\"y\":%d},\"isTurning\":%s}",
             world->corridors[i].id,
@@ -691,13 +5437,22 @@ int getWorldMapJSON(World* world, char* buffer, size_t bufferSize) {
     return 0;
 }
 
-int getWorldJSON(World* world, char* buffer, size_t bufferSize) {
+// 非默认的走廊宽度和样式（默认宽度1、HV样式时不输出，JSON与之前逐字节相同）
+static int bufAppendCorridorShape(const World* world, char* buffer, size_t bufferSize, int* pos) {
+    if (world->corridorWidth == 1 && world->corridorStyle == CORRIDOR_STYLE_HV) return 0;
+    return bufAppend(buffer, bufferSize, pos, "\"corridorWidth\":%d,\"corridorStyle\":\"%s\",",
+                     world->corridorWidth, getCorridorStyleName(world->corridorStyle));
+}
+
+static int writeWorldJSON(World* world, char* buffer, size_t bufferSize) {
     if (!world || !buffer || bufferSize == 0) return -1;
 
     int pos = 0;
     if (bufAppend(buffer, bufferSize, &pos,
-        "{\"seed\":%ld,\"width\":%d,\"height\":%d,\"roomCount\":%d,\"corridorCount\":%d,",
-        world->seed, world->width, world->height, world->roomCount, world->corridorCount) != 0) return -1;
+        "{\"seed\":%ld,\"width\":%d,\"height\":%d,\"mode\":\"%s\",\"roomCount\":%d,\"corridorCount\":%d,",
+        world->seed, world->width, world->height, getGeneratorModeName(world->mode),
+        world->roomCount, world->corridorCount) != 0) return -1;
+    if (bufAppendCorridorShape(world, buffer, bufferSize, &pos) != 0) return -1;
 
     if (bufAppend(buffer, bufferSize, &pos, "\"rooms\":") != 0) return -1;
     char roomsBuffer[4096];
@@ -718,6 +5473,38 @@ int getWorldJSON(World* world, char* buffer, size_t bufferSize) {
     return 0;
 }
 
+int getWorldJSON(World* world, char* buffer, size_t bufferSize) {
+    TRACE_BEGIN(span);
+    int result = writeWorldJSON(world, buffer, bufferSize);
+    TRACE_END(span, "getWorldJSON");
+    return result;
+}
+
+int getChunkJSON(ChunkEntry* entry, char* buffer, size_t bufferSize) {
+    if (!entry || !entry->used || !buffer || bufferSize == 0) return -1;
+
+    static const char* edgeNames[4] = {"north", "east", "south", "west"};
+
+    int pos = 0;
+    if (bufAppend(buffer, bufferSize, &pos,
+        "{\"chunkX\":%d,\"chunkY\":%d,\"chunkSize\":%d,\"portals\":[",
+        entry->chunkX, entry->chunkY, CHUNK_SIZE) != 0) return -1;
+
+    for (int edge = 0; edge < 4; edge++) {
+        if (bufAppend(buffer, bufferSize, &pos,
+            "%s{\"edge\":\"%s\",\"x\":%d,\"y\":%d}",
+            edge > 0 ? "," : "", edgeNames[edge],
+            entry->portals[edge].x, entry->portals[edge].y) != 0) return -1;
+    }
+
+    if (bufAppend(buffer, bufferSize, &pos, "],\"world\":") != 0) return -1;
+    if (getWorldJSON(entry->world, buffer + pos, bufferSize - (size_t)pos) != 0) return -1;
+    pos += (int)strlen(buffer + pos);
+
+    if (bufAppend(buffer, bufferSize, &pos, "}") != 0) return -1;
+    return 0;
+}
+
 // ==================== 路径查找实现 ====================
 
 int findShortestPath(World* world, int startRoomId, int endRoomId,
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 // ==================== 常量定义 ====================
 
@@ -14,12 +15,109 @@
 #define MAX_CORRIDORS 100
 #define MAX_PATH_LEN 256
 
+// 无限区块世界
+#define CHUNK_SIZE 64              // 区块边长（瓦片）
+#define CHUNK_CACHE_CAPACITY 64    // 区块缓存容量
+#define CHUNK_VIEW_RADIUS 2        // 默认保留半径（以区块为单位）
+
+// 分区并行生成的超大世界
+#define REGION_SIZE 64             // 分区边长上限（瓦片）
+#define REGION_ROOMS 25            // 每个分区的房间生成参数（与普通世界一致）
+#define MAX_TILED_WORLD_SIZE 16384 // 分区世界的边长上限
+#define MAX_THREADS 64             // 并行任务的线程数上限
+
+// 种子搜索
+#define SEARCH_MAX_RESULTS 256     // 一次搜索最多返回的种子数
+#define SEARCH_BLOCK_SIZE 64       // 线程每次领取的连续种子数
+#define SEARCH_PROGRESS_INTERVAL 0.5 // 进度回调的最小间隔（秒）
+
+// 世界二进制序列化与数据集文件
+#define WORLD_RECORD_HEADER_SIZE 16   // 记录头：种子、尺寸、模式和各类数量
+#define WORLD_RECORD_MAX_SIZE (WORLD_RECORD_HEADER_SIZE + 3 * MAX_WORLD_WIDTH * MAX_WORLD_HEIGHT + \
+                               MAX_ROOMS * 5 + MAX_CORRIDORS * 5 + MAX_ROOMS + 2 * MAX_CORRIDORS)
+#define DATASET_WRITE_BUFFER (8 * 1024 * 1024) // 数据集写缓冲区（按大块写入文件）
+#define DATASET_BATCH_SIZE 1024       // 批量生成时每批并行生成的世界数
+
+// 存档存储
+#define SAVE_KEY_MAX 64                        // 存档键最大长度（含'\0'）
+#define SAVE_MAX_SIZE (1024 * 1024)            // 单个存档的最大字节数
+#define SAVE_COMPACT_MIN_BYTES (1024 * 1024)   // 日志小于该大小时不压缩
+#define SAVE_COMPACT_RATIO 2                   // 日志超过有效数据的该倍数时在后台压缩
+
+// 输入重放
+#define REPLAY_CHECKPOINT_INTERVAL 1024        // 每隔多少个输入记录一个检查点
+
+// 视野
+#define FOV_RADIUS 8                           // 默认视野半径（瓦片）
+#define FOV_MAX_REVEALED ((2 * FOV_RADIUS + 1) * (2 * FOV_RADIUS + 1)) // 一次更新最多新探索的格子数
+#define FOV_BITSET_WORDS ((MAX_WORLD_WIDTH * MAX_WORLD_HEIGHT + 63) / 64)
+
+// 世界内存池
+#define WORLD_ARENA_SIZE (16 * 1024)           // 与World一起分配的第一块大小，也是后续新块的最小容量
+
+// 动态连通性（链剪树）：结点0..MAX_ROOMS-1是房间，MAX_ROOMS+i是走廊i（边化为点，便于求路径最大边）
+#define LINK_CUT_NODES (MAX_ROOMS + MAX_CORRIDORS)
+#define CORRIDOR_EDGE_NONE 0   // 不连接两个房间，或已删除
+#define CORRIDOR_EDGE_TREE 1   // 生成森林中的边
+#define CORRIDOR_EDGE_EXTRA 2  // 非树边（删除树边时作为替代边的候选）
+#define ROOM_GRID_CELL 16      // 房间空间索引的网格边长（瓦片）
+#define ROOM_GRID_COLS ((MAX_WORLD_WIDTH + ROOM_GRID_CELL - 1) / ROOM_GRID_CELL)
+#define ROOM_GRID_ROWS ((MAX_WORLD_HEIGHT + ROOM_GRID_CELL - 1) / ROOM_GRID_CELL)
+#define INCREMENTAL_MST_NEIGHBOURS 4 // 新增房间时考虑的最近邻居数
+
+// 性能追踪：编译时加-DBYOW_TRACE=0可去掉所有追踪点
+#ifndef BYOW_TRACE
+#define BYOW_TRACE 1
+#endif
+#define TRACE_RING_SIZE 4096                   // 每个线程的环形缓冲区保留的最近事件数
+#define TRACE_MAX_THREADS 64                   // 同时记录事件的线程数上限（超出的线程不记录）
+
+// 延迟直方图（HDR风格，单位微秒）：小于128的值逐个计数，之后每翻一倍分64个桶，相对误差不超过1/64
+#define LATENCY_SUB_BUCKETS 128
+#define LATENCY_MAX_BITS 36                    // 可记录的最大值为2^36-1微秒（约19小时），更大的值记入最后一个桶
+#define LATENCY_BUCKETS (LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS / 2 * (LATENCY_MAX_BITS - 7))
+
+// 增量渲染
+#define MAX_DIRTY_RECTS 16                     // 每个版本最多保留的脏矩形数（超出时合并）
+
 // 瓦片类型
 #define TILE_FLOOR 0
 #define TILE_WALL 1
 #define TILE_ROOM 2
 #define TILE_CORRIDOR 3
 
+// 瓦片归属（World.owner）：房间ID、OWNER_CORRIDOR_BASE+走廊下标，或不属于任何房间/走廊
+#define OWNER_NONE -1
+#define OWNER_CORRIDOR_BASE MAX_ROOMS
+
+// 走廊样式
+#define CORRIDOR_STYLE_HV 0  // 先水平后垂直（默认）
+#define CORRIDOR_STYLE_VH 1  // 先垂直后水平
+#define CORRIDOR_STYLE_Z 2   // 水平-垂直-水平，在两端中点处转弯
+#define CORRIDOR_STYLE_COUNT 3
+#define MAX_CORRIDOR_WIDTH 5 // 生成世界时允许的最大走廊宽度
+
+// 世界生成模式
+#define GEN_MODE_ROOMS 0   // 随机放置房间（拒绝采样）
+#define GEN_MODE_BSP 1     // 二叉空间划分，每个叶子恰好一个房间
+#define GEN_MODE_CAVE 2    // 元胞自动机洞穴（地面为TILE_FLOOR）
+#define GEN_MODE_WFC 3     // 波函数坍缩（从样例学习相邻规则）
+
+// 洞穴生成参数
+#define CAVE_FILL_PERCENT 45       // 初始墙壁比例（%）
+#define CAVE_STEPS 5               // 元胞自动机迭代次数
+#define CAVE_MIN_REGION 8          // 小于该面积的洞穴区域被填平
+
+// 波函数坍缩参数
+#define WFC_MAX_PATTERNS 64        // 图案数量上限（每个格子的可能性用一个64位掩码表示）
+#define WFC_MAX_RESTARTS 8         // 回溯失败后的最大重启次数
+#define WFC_MAX_BACKTRACKS 1024    // 每次尝试的回溯次数上限，超出则重启
+#define WFC_MAX_SIZE 4096          // 输出边长上限
+
+// 压缩格式（compressData）
+#define COMPRESS_GZIP 0    // gzip封装（RFC 1952），HTTP的Content-Encoding: gzip
+#define COMPRESS_ZLIB 1    // zlib封装（RFC 1950），HTTP的Content-Encoding: deflate
+
 // ==================== 数据结构定义 ====================
 
 // 坐标点
@@ -42,6 +140,7 @@ typedef struct Corridor {
     Point start;        // 起点
     Point end;          // 终点
     bool isTurning;     // 是否是转弯走廊
+    bool exists;        // 是否存在（删除后槽位保留，下标即走廊ID）
 } Corridor;
 
 // 图的邻接表节点（房间连接）
@@ -70,10 +169,69 @@ typedef struct Queue {
     int size;
 } Queue;
 
+// 脏矩形（需要重绘的瓦片区域）
+typedef struct DirtyRect {
+    int x, y;            // 左上角
+    int width, height;   // 尺寸
+} DirtyRect;
+
+// 内存池块：块头之后紧跟capacity字节的数据区
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;   // 下一块（当前块之后的块都是空闲的，留待复用）
+    size_t capacity;           // 数据区字节数
+    size_t used;               // 已切分的字节数
+} ArenaBlock;
+
+// 世界内存池：连接表、并查集和生成时的临时缓冲区都从这里顺序切分，不单独释放。
+// 第一块与World在同一次malloc中分配；重置时回到第一块，向系统申请的块保留复用
+typedef struct Arena {
+    ArenaBlock* first;           // 第一块（紧跟在World之后）
+    ArenaBlock* current;         // 正在切分的块
+    size_t used;                 // 当前占用（字节）
+    size_t peak;                 // 历史最高占用
+    long long allocations;       // 累计分配次数
+    long long systemAllocations; // 向系统申请新块的次数
+    long long resets;            // 重置次数
+} Arena;
+
+// 内存池使用统计
+typedef struct ArenaStats {
+    size_t capacity;             // 所有块的总容量
+    size_t used;                 // 当前占用
+    size_t peak;                 // 历史最高占用
+    int blocks;                  // 块数（含第一块）
+    long long allocations;       // 累计分配次数
+    long long systemAllocations; // 向系统申请新块的次数
+    long long resets;            // 重置次数
+} ArenaStats;
+
+// 链剪树结点（伸展树表示的偏好路径）
+typedef struct LinkCutNode {
+    int child[2];        // 伸展树左右孩子，-1表示没有
+    int parent;          // 伸展树父结点或路径父结点，-1表示没有
+    int weight;          // 走廊结点为走廊长度，房间结点为-1
+    int maxNode;         // 子树中权值最大的结点
+    bool reversed;       // 子树翻转标记（换根）
+} LinkCutNode;
+
+// 房间图的动态连通性：用链剪树维护一棵生成森林，其余走廊作为非树边备用
+typedef struct RoomConnectivity {
+    LinkCutNode nodes[LINK_CUT_NODES];
+    int edgeRooms[MAX_CORRIDORS][2];          // 走廊连接的两个房间
+    unsigned char edgeState[MAX_CORRIDORS];   // CORRIDOR_EDGE_*
+    int componentCount;                       // 现存房间的连通分量数
+
+    // 空间索引：按走廊端点所在的网格分桶的房间链表，用于找新房间的近邻
+    Point anchors[MAX_ROOMS];                 // 房间的走廊端点
+    int gridHead[ROOM_GRID_ROWS][ROOM_GRID_COLS];
+    int gridNext[MAX_ROOMS];
+} RoomConnectivity;
+
 // 世界结构（核心数据结构）
 typedef struct World {
     // 地图数据
-    int tiles[MAX_WORLD_HEIGHT][MAX_WORLD_WIDTH];  // 瓦片地图
+    unsigned char tiles[MAX_WORLD_HEIGHT][MAX_WORLD_WIDTH];  // 瓦片地图（每格1字节，便于整行填充）
+    short owner[MAX_WORLD_HEIGHT][MAX_WORLD_WIDTH];          // 瓦片归属（OWNER_*），生成房间和走廊时填写
     
     // 房间和走廊
     Room rooms[MAX_ROOMS];           // 房间数组
@@ -83,16 +241,215 @@ typedef struct World {
     
     // 图结构（邻接表）
     RoomConnection* connections[MAX_ROOMS];  // 每个房间的连接列表
+    RoomConnection* freeConnections;         // 删除走廊后回收的连接表节点，分配时优先复用
     
     // 并查集（用于连通性检查）
     DisjointSet* disjointSet;
+
+    // 动态连通性：第一次增删房间或走廊时从内存池分配并建立，之后随增删维护；NULL表示尚未建立
+    RoomConnectivity* connectivity;
+
+    // 内存池：以上连接表节点、并查集和连通性结构都分配在这里，销毁世界时随World一次释放
+    Arena arena;
     
     // 世界属性
     int width, height;   // 世界尺寸
     long seed;           // 随机种子
+    long rngState;       // 随机数生成器状态（每个世界独立，互不干扰）
+    int mode;            // 生成模式（GEN_MODE_*）
+    int corridorWidth;   // 生成和增删走廊时使用的走廊宽度（默认1）
+    int corridorStyle;   // 走廊样式（CORRIDOR_STYLE_*，默认CORRIDOR_STYLE_HV）
     bool initialized;    // 是否已初始化
+
+    // 增量渲染：当前版本内变化的区域（setTile和玩家移动时标记）
+    unsigned int version;                  // 每取走一批脏矩形加一
+    DirtyRect dirtyRects[MAX_DIRTY_RECTS];
+    int dirtyCount;
 } World;
 
+// 区块边界方向（门户所在的边）
+#define CHUNK_EDGE_NORTH 0
+#define CHUNK_EDGE_EAST 1
+#define CHUNK_EDGE_SOUTH 2
+#define CHUNK_EDGE_WEST 3
+
+// 区块缓存项
+typedef struct ChunkEntry {
+    int chunkX, chunkY;  // 区块坐标
+    World* world;        // 区块内容（CHUNK_SIZE x CHUNK_SIZE）
+    Point portals[4];    // 四条边上的门户（区块内局部坐标）
+    bool used;           // 槽位是否被占用
+} ChunkEntry;
+
+// 区块缓存（有界，按玩家距离淘汰）
+typedef struct ChunkCache {
+    long seed;                                // 世界种子
+    ChunkEntry entries[CHUNK_CACHE_CAPACITY]; // 缓存槽位
+    int count;                                // 已缓存区块数量
+    int centerX, centerY;                     // 玩家当前所在区块
+    int viewRadius;                           // 保留半径，超出则淘汰
+} ChunkCache;
+
+// 分区（分区世界中的一块独立生成区域）
+typedef struct TiledRegion {
+    int x, y;               // 分区左上角（全局坐标）
+    int width, height;      // 分区尺寸
+    Room rooms[MAX_ROOMS];  // 分区内房间（全局坐标）
+    int roomCount;          // 房间数量
+} TiledRegion;
+
+// 相邻分区之间的候选连接（两侧边界上最近的一对房间）
+typedef struct TiledLink {
+    int regionA, roomA;     // 分区A及其房间下标
+    int regionB, roomB;     // 分区B及其房间下标
+    int distance;           // 房间距离（最小生成树的边权）
+    int order;              // 生成顺序，用于相同距离时的确定性排序
+} TiledLink;
+
+// 分区世界：各分区并行生成房间和局部MST，再由全局MST连接相邻分区
+typedef struct TiledWorld {
+    unsigned char* tiles;   // 瓦片地图（width * height，按行存储）
+    int width, height;      // 世界尺寸
+    long seed;              // 随机种子
+    TiledRegion* regions;   // 分区数组（regionsX * regionsY）
+    int regionsX, regionsY; // 分区行列数
+    TiledLink* links;       // 被全局MST选中的跨分区连接
+    int linkCount;          // 跨分区连接数量
+} TiledWorld;
+
+// 洞穴位图：每行按64位字存储，位为1表示墙，一次运算处理64个格子
+typedef struct CaveGrid {
+    unsigned long long* bits;     // 当前状态（height * wordsPerRow）
+    unsigned long long* scratch;  // 迭代用的后备缓冲区
+    int width, height;            // 网格尺寸
+    int wordsPerRow;              // 每行的64位字数
+} CaveGrid;
+
+// 波函数坍缩规则（重叠模型，N=2）：从样例中提取所有2x2图案，
+// 两个图案能否相邻取决于它们重叠的一列/一行是否一致
+typedef struct WfcRules {
+    int patternCount;                                  // 图案数量
+    unsigned char patternTile[WFC_MAX_PATTERNS];       // 图案左上角的瓦片（即输出值）
+    double weights[WFC_MAX_PATTERNS];                  // 图案在样例中出现的次数
+    unsigned long long compatible[4][WFC_MAX_PATTERNS]; // [方向][图案] -> 该方向邻居允许的图案掩码
+    // 按字节查表：support[方向][字节序号][字节值] = 这8个图案允许的邻居掩码之并
+    unsigned long long support[4][8][256];
+} WfcRules;
+
+// 玩家状态（也用作输入重放的检查点）
+typedef struct PlayerState {
+    int x, y;                // 玩家位置
+    long long inputIndex;    // 已处理的输入字符数
+} PlayerState;
+
+// 视野：当前可见和已探索过的格子（位图，下标为 y * MAX_WORLD_WIDTH + x）
+typedef struct FieldOfView {
+    unsigned long long visible[FOV_BITSET_WORDS];
+    unsigned long long explored[FOV_BITSET_WORDS];
+    int originX, originY;    // 视野原点，尚未计算时为-1
+    int radius;              // 视野半径
+} FieldOfView;
+
+// 世界布局统计（种子搜索按这些指标筛选）
+typedef struct WorldStats {
+    int roomCount;       // 房间数量
+    int corridorCount;   // 走廊数量
+    int mstDiameter;     // 房间连接图的直径（房间跳数；连接图是MST时即树的直径）
+    int longestPath;     // 任意两个房间之间最短步行路径的最大值（瓦片步数），未计算时为-1
+} WorldStats;
+
+// 种子搜索进度回调：已扫描种子数、扫描速度（种子/秒）、已找到的匹配数（近似）
+typedef void (*SeedSearchProgress)(long long scanned, double seedsPerSecond, int found, void* context);
+
+// 种子搜索：在[seedStart, seedStart + seedCount)中按种子顺序找出前maxResults个满足约束的种子。
+// 约束均为闭区间，initSeedSearch将其设为不限
+typedef struct SeedSearch {
+    long seedStart;                  // 起始种子
+    long long seedCount;             // 扫描的种子数量
+    int width, height;               // 世界尺寸
+    int mode;                        // 生成模式（GEN_MODE_*）
+    int minRooms, maxRooms;          // 房间数量范围
+    int minCorridors, maxCorridors;  // 走廊数量范围
+    int minDiameter, maxDiameter;    // 连接图直径范围
+    int minLongestPath, maxLongestPath; // 最长最短路径范围（仅在设置时才计算，代价较高）
+    int maxResults;                  // 需要的种子数K（不超过SEARCH_MAX_RESULTS）
+    int threadCount;                 // 线程数，<=0时使用CPU核数
+    SeedSearchProgress progress;     // 进度回调（可为NULL，在调用线程上执行）
+    void* progressContext;           // 传给进度回调的上下文
+
+    long results[SEARCH_MAX_RESULTS];           // 找到的种子（升序）
+    WorldStats resultStats[SEARCH_MAX_RESULTS]; // 对应的完整统计
+    int resultCount;                 // 找到的种子数
+    long long scanned;               // 实际生成过的种子数
+    double elapsed;                  // 耗时（秒）
+} SeedSearch;
+
+// 数据集索引项（按种子排序，文件末尾的索引直接映射为该结构的数组）
+typedef struct DatasetIndexEntry {
+    long long seed;              // 世界种子
+    unsigned long long offset;   // 记录在文件中的偏移
+    unsigned int size;           // 记录字节数
+    unsigned int reserved;       // 保留（对齐）
+} DatasetIndexEntry;
+
+// 数据集写入器：记录只追加；关闭时在末尾追加按种子排序的索引和尾部，
+// 重新打开已有文件会继续追加，新索引覆盖旧索引的作用（旧字节不被修改）
+typedef struct DatasetWriter {
+    FILE* file;                  // 以追加方式打开的文件
+    unsigned char* buffer;       // 写缓冲区（DATASET_WRITE_BUFFER字节）
+    size_t bufferUsed;           // 缓冲区已用字节数
+    unsigned long long fileSize; // 文件逻辑长度（含缓冲区中未写出的部分）
+    DatasetIndexEntry* index;    // 所有记录的索引（含打开前已有的记录）
+    long long count;             // 记录数量
+    long long capacity;          // 索引数组容量
+} DatasetWriter;
+
+// 数据集读取器：整个文件映射到内存，按种子二分查找索引后直接访问记录
+typedef struct DatasetReader {
+    const unsigned char* data;       // 映射的文件内容
+    size_t size;                     // 文件大小
+    const DatasetIndexEntry* index;  // 索引（指向映射区域）
+    long long count;                 // 记录数量
+} DatasetReader;
+
+// 并行任务函数：context为共享上下文，threadIndex为线程序号（0..threadCount-1）
+typedef void (*ParallelTask)(void* context, int threadIndex);
+
+// 线程函数
+typedef void (*ThreadFunc)(void* context);
+
+// 互斥锁和线程（平台相关，只通过指针使用）
+typedef struct Mutex Mutex;
+typedef struct Thread Thread;
+
+// 线程局部变量
+#ifdef _WIN32
+    #define THREAD_LOCAL __declspec(thread)
+#else
+    #define THREAD_LOCAL _Thread_local
+#endif
+
+// 延迟直方图：只有一个线程写入，其他线程可以随时读取（合并、求分位数）而不加锁
+typedef struct LatencyHistogram {
+    atomic_llong counts[LATENCY_BUCKETS];  // 各桶计数
+    atomic_llong total;                    // 记录次数
+    atomic_llong sum;                      // 所有值之和（微秒）
+    atomic_llong max;                      // 最大值（微秒）
+} LatencyHistogram;
+
+// 存档存储（只追加日志 + 内存索引，只通过指针使用）
+typedef struct SaveStore SaveStore;
+
+// 存档存储的统计信息
+typedef struct SaveStoreStats {
+    int keys;                // 存档键数量
+    long long logBytes;      // 已提交到日志的字节数
+    long long liveBytes;     // 有效记录字节数（含未提交的）
+    long long pendingBytes;  // 等待组提交的字节数
+    int compactions;         // 已完成的压缩次数
+    bool compacting;         // 是否正在后台压缩
+} SaveStoreStats;
+
 // ==================== 并查集操作接口 ====================
 
 /**
@@ -174,11 +531,18 @@ bool isEmptyQueue(Queue* queue);
 World* createWorld(long seed, int width, int height);
 
 /**
- * 销毁世界
+ * 销毁世界（World和内存池第一块是同一次分配，只有内存池扩容过时才需要额外释放）
  * @param world 世界指针
  */
 void destroyWorld(World* world);
 
+/**
+ * 获取世界内存池的使用统计
+ * @param world 世界指针
+ * @param stats 输出统计
+ */
+void getWorldArenaStats(World* world, ArenaStats* stats);
+
 /**
  * 生成随机房间
  * @param world 世界指针
@@ -189,6 +553,36 @@ void destroyWorld(World* world);
  */
 int generateRooms(World* world, int minSize, int maxSize, int maxRooms);
 
+/**
+ * 用二叉空间划分生成房间：递归切分地图，每个叶子放置恰好一个房间，
+ * 无需重叠检测和拒绝采样，耗时O(房间数)
+ * @param world 世界指针
+ * @param minSize 最小房间尺寸
+ * @param maxSize 最大房间尺寸
+ * @param maxRooms 最大房间数量（叶子数量上限）
+ * @return 成功返回0，失败返回-1
+ */
+int generateRoomsBSP(World* world, int minSize, int maxSize, int maxRooms);
+
+/**
+ * 绘制L型走廊（先水平后垂直，宽度1），只把墙壁改为走廊
+ * @param world 世界指针
+ * @param start 起点
+ * @param end 终点
+ */
+void drawCorridor(World* world, Point start, Point end);
+
+/**
+ * 按指定宽度和样式绘制走廊：每段走廊裁剪成矩形后整行写入，只把墙壁改为走廊。
+ * 宽度为1、样式为CORRIDOR_STYLE_HV时与drawCorridor完全一致
+ * @param world 世界指针
+ * @param start 起点
+ * @param end 终点
+ * @param width 走廊宽度（>=1）
+ * @param style 走廊样式（CORRIDOR_STYLE_*）
+ */
+void drawCorridorStyled(World* world, Point start, Point end, int width, int style);
+
 /**
  * 生成走廊连接房间
  * @param world 世界指针
@@ -219,6 +613,605 @@ bool isWorldConnected(World* world);
  */
 World* generateWorldFromSeed(long seed, int width, int height);
 
+/**
+ * 根据种子和生成模式生成完整世界
+ * @param seed 随机种子
+ * @param width 世界宽度
+ * @param height 世界高度
+ * @param mode 生成模式（GEN_MODE_*）
+ * @return 世界指针，失败返回NULL
+ */
+World* generateWorldFromSeedWithMode(long seed, int width, int height, int mode);
+
+/**
+ * 根据种子和生成模式生成完整世界，房间之间的走廊按指定宽度和样式绘制。
+ * 世界记住走廊的宽度和样式，之后addCorridor/addRoomIncremental新增的走廊也按它绘制；
+ * 宽度1、CORRIDOR_STYLE_HV时与generateWorldFromSeedWithMode完全相同
+ * @param seed 随机种子
+ * @param width 世界宽度
+ * @param height 世界高度
+ * @param mode 生成模式（GEN_MODE_*）
+ * @param corridorWidth 走廊宽度（1..MAX_CORRIDOR_WIDTH）
+ * @param corridorStyle 走廊样式（CORRIDOR_STYLE_*）
+ * @return 世界指针，参数无效或失败返回NULL
+ */
+World* generateWorldWithCorridors(long seed, int width, int height, int mode, int corridorWidth, int corridorStyle);
+
+/**
+ * 在已有的世界上原地重新生成（结果与generateWorldFromSeedWithMode相同）。
+ * 重置内存池并复用World本身和已申请的块，稳定状态下不调用系统分配器
+ * @param world 世界指针
+ * @param seed 随机种子
+ * @param width 世界宽度
+ * @param height 世界高度
+ * @param mode 生成模式（GEN_MODE_*）
+ * @return 成功返回0，尺寸无效返回-1（世界保持原样）
+ */
+int regenerateWorld(World* world, long seed, int width, int height, int mode);
+
+/**
+ * 在已有的世界上原地重新生成（结果与generateWorldWithCorridors相同）
+ * @param world 世界指针
+ * @param seed 随机种子
+ * @param width 世界宽度
+ * @param height 世界高度
+ * @param mode 生成模式（GEN_MODE_*）
+ * @param corridorWidth 走廊宽度（1..MAX_CORRIDOR_WIDTH）
+ * @param corridorStyle 走廊样式（CORRIDOR_STYLE_*）
+ * @return 成功返回0，参数无效返回-1（世界保持原样）
+ */
+int regenerateWorldWithCorridors(World* world, long seed, int width, int height, int mode,
+                                 int corridorWidth, int corridorStyle);
+
+/**
+ * 解析生成模式名称（如"rooms"、"bsp"）
+ * @param name 模式名称
+ * @return 生成模式，无法识别返回-1
+ */
+int parseGeneratorMode(const char* name);
+
+/**
+ * 获取生成模式名称
+ * @param mode 生成模式
+ * @return 模式名称
+ */
+const char* getGeneratorModeName(int mode);
+
+/**
+ * 解析走廊样式名称（"hv"、"vh"、"z"）
+ * @param name 样式名称
+ * @return 走廊样式，无法识别返回-1
+ */
+int parseCorridorStyle(const char* name);
+
+/**
+ * 获取走廊样式名称
+ * @param style 走廊样式
+ * @return 样式名称
+ */
+const char* getCorridorStyleName(int style);
+
+// ==================== 动态连通性接口 ====================
+// 房间图的连通性在链剪树上维护：加走廊、删非树边和连通查询都是O(log n)均摊，
+// 删除树边时在非树边中找最短的替代边（O(m log n)，m不超过MAX_CORRIDORS）。删除会把对应的格子恢复为墙，
+// 被其他走廊经过的格子改归那条走廊，不会切断别的走廊
+
+/**
+ * 在两个房间之间新建一条L型走廊（端点取房间内的格子），并更新连接表和连通性
+ * @param world 世界指针
+ * @param roomA 房间ID
+ * @param roomB 房间ID
+ * @return 新走廊的下标（优先复用已删除走廊的下标），失败返回-1
+ */
+int addCorridor(World* world, int roomA, int roomB);
+
+/**
+ * 删除走廊：恢复它独占的格子，从连接表中移除；是生成森林的边时自动换上替代边
+ * @param world 世界指针
+ * @param corridorIndex 走廊下标
+ * @return 成功返回0，失败返回-1
+ */
+int removeCorridor(World* world, int corridorIndex);
+
+/**
+ * 删除房间及与它相连的所有走廊，房间格子恢复为墙（其他走廊经过的格子保留为走廊）
+ * @param world 世界指针
+ * @param roomId 房间ID
+ * @return 成功返回0，失败返回-1
+ */
+int removeRoom(World* world, int roomId);
+
+/**
+ * 查询两个房间是否连通
+ * @param world 世界指针
+ * @param roomA 房间ID
+ * @param roomB 房间ID
+ * @return true表示连通（同一房间也算连通），房间不存在返回false
+ */
+bool roomsConnected(World* world, int roomA, int roomB);
+
+/**
+ * 增量加入一个房间并更新最小生成树：在空间索引中找最近的INCREMENTAL_MST_NEIGHBOURS个房间作为候选边，
+ * 按长度从短到长加入；成环时用链剪树取环上最长的走廊，比新边长就替换掉。
+ * 只绘制新走廊（被替换的走廊按removeCorridor的规则收回），O(k log n)
+ * @param world 世界指针
+ * @param room 新房间（使用其中的x, y, width, height）
+ * @return 新房间ID（优先复用已删除房间的ID）；越界、与已有房间重叠、房间已满，
+ *         或有可连接的房间却加不上任何走廊（走廊已满）时撤销该房间并返回-1
+ */
+int addRoomIncremental(World* world, Room room);
+
+/**
+ * 修复连通性：反复在不同连通分量之间加一条最短的走廊，直到所有房间连通
+ * @param world 世界指针
+ * @return 新建的走廊数，失败返回-1
+ */
+int repairConnectivity(World* world);
+
+// ==================== 无限区块世界接口 ====================
+
+/**
+ * 由世界种子和区块坐标派生区块种子
+ * @param seed 世界种子
+ * @param chunkX 区块X坐标（可为负）
+ * @param chunkY 区块Y坐标（可为负）
+ * @return 区块种子（非负）
+ */
+long getChunkSeed(long seed, int chunkX, int chunkY);
+
+/**
+ * 计算区块某条边上的门户位置，相邻区块在共享边上得到同一位置
+ * @param seed 世界种子
+ * @param chunkX 区块X坐标
+ * @param chunkY 区块Y坐标
+ * @param edge 边（CHUNK_EDGE_*）
+ * @return 门户在区块内的局部坐标
+ */
+Point getChunkPortal(long seed, int chunkX, int chunkY, int edge);
+
+/**
+ * 确定性生成单个区块，并用走廊把房间连到四条边的门户
+ * @param seed 世界种子
+ * @param chunkX 区块X坐标
+ * @param chunkY 区块Y坐标
+ * @return 区块世界指针，失败返回NULL
+ */
+World* generateChunk(long seed, int chunkX, int chunkY);
+
+/**
+ * 创建区块缓存
+ * @param seed 世界种子
+ * @param viewRadius 保留半径（区块），<=0时使用CHUNK_VIEW_RADIUS
+ * @return 缓存指针，失败返回NULL
+ */
+ChunkCache* createChunkCache(long seed, int viewRadius);
+
+/**
+ * 销毁区块缓存及其中所有区块
+ * @param cache 缓存指针
+ */
+void destroyChunkCache(ChunkCache* cache);
+
+/**
+ * 获取区块，未缓存时按需生成；缓存已满时淘汰离玩家最远的区块
+ * @param cache 缓存指针
+ * @param chunkX 区块X坐标
+ * @param chunkY 区块Y坐标
+ * @return 区块缓存项，失败返回NULL
+ */
+ChunkEntry* getChunk(ChunkCache* cache, int chunkX, int chunkY);
+
+/**
+ * 更新玩家所在区块，并淘汰超出保留半径的区块
+ * @param cache 缓存指针
+ * @param chunkX 玩家所在区块X坐标
+ * @param chunkY 玩家所在区块Y坐标
+ * @return 被淘汰的区块数量
+ */
+int updateChunkCenter(ChunkCache* cache, int chunkX, int chunkY);
+
+/**
+ * 获取区块信息（JSON格式，包含区块坐标、门户和世界数据）
+ * @param entry 区块缓存项
+ * @param buffer 输出缓冲区
+ * @param bufferSize 缓冲区大小
+ * @return 成功返回0，失败返回-1
+ */
+int getChunkJSON(ChunkEntry* entry, char* buffer, size_t bufferSize);
+
+// ==================== 洞穴生成接口 ====================
+
+/**
+ * 创建洞穴位图（初始全部为墙）
+ * @param width 宽度
+ * @param height 高度
+ * @return 位图指针，失败返回NULL
+ */
+CaveGrid* createCaveGrid(int width, int height);
+
+/**
+ * 销毁洞穴位图
+ * @param grid 位图指针
+ */
+void destroyCaveGrid(CaveGrid* grid);
+
+/**
+ * 按种子随机填充墙壁，每次生成64个格子
+ * @param grid 位图指针
+ * @param seed 随机种子
+ * @param fillPercent 墙壁比例（0-100）
+ */
+void seedCaveGrid(CaveGrid* grid, long seed, int fillPercent);
+
+/**
+ * 执行一步4-5元胞自动机规则：墙壁邻居>=4的墙保持为墙，墙壁邻居>=5的地面变为墙。
+ * 邻居数用位切片加法器按字并行计算，越界视为墙
+ * @param grid 位图指针
+ */
+void stepCaveGrid(CaveGrid* grid);
+
+/**
+ * 获取洞穴位图中指定格子是否为墙
+ * @param grid 位图指针
+ * @param x X坐标
+ * @param y Y坐标
+ * @return true表示墙（越界视为墙）
+ */
+bool isCaveWall(CaveGrid* grid, int x, int y);
+
+/**
+ * 在世界中生成洞穴：随机填充、迭代元胞自动机、标记洞穴区域，
+ * 再用并查集和走廊把所有区域连通。每个区域以其外接矩形登记为一个房间
+ * @param world 世界指针
+ * @param fillPercent 初始墙壁比例（0-100）
+ * @param steps 迭代次数
+ * @return 成功返回0，失败返回-1
+ */
+int generateCave(World* world, int fillPercent, int steps);
+
+// ==================== 波函数坍缩接口 ====================
+
+/**
+ * 从样例瓦片网格学习图案与相邻规则（样例按环绕处理）
+ * @param rules 输出规则
+ * @param sample 样例瓦片（width * height，按行存储，取值为TILE_*）
+ * @param width 样例宽度
+ * @param height 样例高度
+ * @return 成功返回0，图案数超过WFC_MAX_PATTERNS等失败返回-1
+ */
+int learnWfcRules(WfcRules* rules, const unsigned char* sample, int width, int height);
+
+/**
+ * 加载内置的地牢样例规则
+ * @param rules 输出规则
+ * @return 成功返回0，失败返回-1
+ */
+int loadDefaultWfcRules(WfcRules* rules);
+
+/**
+ * 运行波函数坍缩：最小熵堆选择格子，传播栈约束邻居，矛盾时沿有界的撤销日志回溯
+ * @param rules 规则
+ * @param seed 随机种子
+ * @param width 输出宽度（不超过WFC_MAX_SIZE）
+ * @param height 输出高度（不超过WFC_MAX_SIZE）
+ * @param out 输出瓦片（width * height，按行存储）
+ * @return 成功返回0，重启次数用尽返回-1
+ */
+int runWfc(const WfcRules* rules, long seed, int width, int height, unsigned char* out);
+
+/**
+ * 在世界中用波函数坍缩生成地图，并把互不连通的区域用走廊连通
+ * @param world 世界指针
+ * @return 成功返回0，失败返回-1
+ */
+int generateWfc(World* world);
+
+// ==================== 分区并行生成接口 ====================
+
+/**
+ * 并行生成超大世界：每个分区使用独立的随机数流生成房间和局部MST，
+ * 再用全局MST连接相邻分区。结果与线程数无关
+ * @param seed 随机种子
+ * @param width 世界宽度（不超过MAX_TILED_WORLD_SIZE）
+ * @param height 世界高度（不超过MAX_TILED_WORLD_SIZE）
+ * @param threadCount 线程数，<=0时使用CPU核数
+ * @return 分区世界指针，失败返回NULL
+ */
+TiledWorld* generateTiledWorld(long seed, int width, int height, int threadCount);
+
+/**
+ * 销毁分区世界
+ * @param world 分区世界指针
+ */
+void destroyTiledWorld(TiledWorld* world);
+
+/**
+ * 获取分区世界指定位置的瓦片类型
+ * @param world 分区世界指针
+ * @param x X坐标
+ * @param y Y坐标
+ * @return 瓦片类型，越界返回TILE_WALL
+ */
+int getTiledTile(TiledWorld* world, int x, int y);
+
+// ==================== 种子搜索接口 ====================
+
+/**
+ * 计算世界的布局统计（包括代价较高的最长最短路径）
+ * @param world 世界指针
+ * @param stats 输出统计
+ * @return 成功返回0，失败返回-1
+ */
+int getWorldStats(World* world, WorldStats* stats);
+
+/**
+ * 初始化种子搜索参数：默认尺寸、房间模式、所有约束不限、K=10、使用全部CPU核
+ * @param search 搜索参数
+ */
+void initSeedSearch(SeedSearch* search);
+
+/**
+ * 并行扫描种子范围，找出按种子顺序的前K个满足约束的种子。
+ * 已找到K个时提前结束，结果与线程数无关
+ * @param search 搜索参数（结果写回其中）
+ * @return 找到的种子数，失败返回-1
+ */
+int runSeedSearch(SeedSearch* search);
+
+// ==================== 文件工具接口 ====================
+
+/**
+ * 以只读方式把整个文件映射到内存
+ * @param path 文件路径
+ * @param size 输出文件大小
+ * @return 映射地址，失败（包括空文件）返回NULL
+ */
+const unsigned char* mapFileReadOnly(const char* path, size_t* size);
+
+/**
+ * 解除mapFileReadOnly建立的映射
+ * @param data 映射地址
+ * @param size 文件大小
+ */
+void unmapFile(const unsigned char* data, size_t size);
+
+/**
+ * 原子地替换文件：先写临时文件并fsync，再重命名覆盖目标，最后同步所在目录。
+ * 崩溃后目标文件要么是旧内容要么是完整的新内容
+ * @param path 目标文件路径
+ * @param data 文件内容
+ * @param size 内容字节数
+ * @return 成功返回0，失败返回-1
+ */
+int writeFileAtomic(const char* path, const void* data, size_t size);
+
+// ==================== 二进制序列化与数据集接口 ====================
+
+/**
+ * 把世界序列化为紧凑的二进制记录（瓦片、房间、走廊、连接表和游程编码的归属平面，整数按小端存储）
+ * @param world 世界指针
+ * @param buffer 输出缓冲区（WORLD_RECORD_MAX_SIZE字节总是足够）
+ * @param bufferSize 缓冲区大小
+ * @return 写入的字节数，失败返回-1
+ */
+int serializeWorld(World* world, unsigned char* buffer, size_t bufferSize);
+
+/**
+ * 从二进制记录还原世界（并查集根据连接表重建；不带归属平面的旧记录用rebuildOwnership还原归属）
+ * @param data 记录数据
+ * @param size 记录字节数
+ * @return 世界指针，记录无效返回NULL
+ */
+World* deserializeWorld(const unsigned char* data, size_t size);
+
+/**
+ * 打开数据集准备追加；文件不存在时新建，已存在时载入其索引
+ * @param path 文件路径
+ * @return 写入器指针，失败（包括已有文件不是有效数据集）返回NULL
+ */
+DatasetWriter* openDatasetWriter(const char* path);
+
+/**
+ * 追加一条记录（先写入缓冲区，满了才写文件）
+ * @param writer 写入器
+ * @param seed 世界种子
+ * @param data 记录数据
+ * @param size 记录字节数
+ * @return 成功返回0，失败返回-1
+ */
+int appendDatasetRecord(DatasetWriter* writer, long long seed, const unsigned char* data, size_t size);
+
+/**
+ * 写出缓冲区、追加索引和尾部并关闭文件（无论成败都会释放写入器）
+ * @param writer 写入器
+ * @return 成功返回0，失败返回-1
+ */
+int closeDatasetWriter(DatasetWriter* writer);
+
+/**
+ * 以内存映射方式打开数据集
+ * @param path 文件路径
+ * @return 读取器指针，失败返回NULL
+ */
+DatasetReader* openDatasetReader(const char* path);
+
+/**
+ * 关闭数据集读取器并解除映射
+ * @param reader 读取器
+ */
+void closeDatasetReader(DatasetReader* reader);
+
+/**
+ * 按种子查找记录（同一种子有多条记录时返回最后追加的一条）
+ * @param reader 读取器
+ * @param seed 世界种子
+ * @param size 输出记录字节数
+ * @return 指向映射区域中记录的指针，不存在返回NULL
+ */
+const unsigned char* findDatasetRecord(DatasetReader* reader, long long seed, size_t* size);
+
+/**
+ * 按种子载入数据集中的世界
+ * @param reader 读取器
+ * @param seed 世界种子
+ * @return 世界指针，不存在返回NULL
+ */
+World* loadDatasetWorld(DatasetReader* reader, long long seed);
+
+// ==================== 玩家移动与输入重放接口 ====================
+
+/**
+ * 检查瓦片是否可通行（地面、房间或走廊）
+ * @param tile 瓦片类型
+ * @return true表示可通行
+ */
+bool isWalkableTile(int tile);
+
+/**
+ * 初始化玩家状态：出生在按行扫描的第一个可通行格子，尚未处理任何输入
+ * @param world 世界指针
+ * @param state 输出玩家状态
+ * @return 成功返回0，世界中没有可通行格子返回-1
+ */
+int initPlayerState(World* world, PlayerState* state);
+
+/**
+ * 依次应用输入（w/a/s/d，大小写均可），撞墙或越界的输入被忽略
+ * @param world 世界指针
+ * @param state 玩家状态（原地更新，inputIndex增加len）
+ * @param seq 输入序列
+ * @param len 输入字符数
+ * @return 实际移动的步数
+ */
+long long applyInputs(World* world, PlayerState* state, const char* seq, size_t len);
+
+/**
+ * 从state->inputIndex处继续重放完整序列，每到REPLAY_CHECKPOINT_INTERVAL的整数倍时记录检查点
+ * @param world 世界指针
+ * @param state 玩家状态（起点为某个检查点或初始状态，结束时为最终状态）
+ * @param seq 完整输入序列
+ * @param len 序列长度（不小于state->inputIndex）
+ * @param checkpoints 输出检查点数组（可为NULL）
+ * @param maxCheckpoints 检查点数组容量
+ * @return 写入的检查点数，参数无效返回-1
+ */
+int replayInputs(World* world, PlayerState* state, const char* seq, size_t len,
+                 PlayerState* checkpoints, int maxCheckpoints);
+
+// ==================== 视野与战争迷雾接口 ====================
+
+/**
+ * 清空视野（可见和已探索的格子）
+ * @param fov 视野
+ * @param radius 视野半径
+ */
+void resetFieldOfView(FieldOfView* fov, int radius);
+
+/**
+ * 把视野原点移到(x, y)并用递归阴影投射重算可见区域，不可通行的瓦片遮挡视线。
+ * 只清除上一个原点周围的视野方块，代价与半径有关、与地图大小无关
+ * @param world 世界指针
+ * @param fov 视野
+ * @param x 新原点X坐标
+ * @param y 新原点Y坐标
+ * @param revealed 输出：本次新探索的格子（可为NULL）
+ * @param maxRevealed revealed容量（FOV_MAX_REVEALED足够）
+ * @return 新探索的格子数，原点无效返回-1
+ */
+int updateFieldOfView(World* world, FieldOfView* fov, int x, int y, Point* revealed, int maxRevealed);
+
+/**
+ * 瓦片(tileX, tileY)改变后更新视野：只重算包含该瓦片的八分区（以及与其共用边界的八分区）
+ * @param world 世界指针
+ * @param fov 视野
+ * @param tileX 改变的瓦片X坐标
+ * @param tileY 改变的瓦片Y坐标
+ * @param revealed 输出：因此新探索的格子（可为NULL）
+ * @param maxRevealed revealed容量
+ * @return 新探索的格子数
+ */
+int refreshFieldOfViewTile(World* world, FieldOfView* fov, int tileX, int tileY,
+                           Point* revealed, int maxRevealed);
+
+/**
+ * 格子当前是否可见
+ * @param fov 视野
+ * @param x X坐标
+ * @param y Y坐标
+ * @return 可见返回true
+ */
+bool isCellVisible(const FieldOfView* fov, int x, int y);
+
+/**
+ * 格子是否已被探索过（曾经可见）
+ * @param fov 视野
+ * @param x X坐标
+ * @param y Y坐标
+ * @return 已探索返回true
+ */
+bool isCellExplored(const FieldOfView* fov, int x, int y);
+
+// ==================== 存档存储接口 ====================
+
+/**
+ * 打开存档存储（日志不存在时新建），重放日志建立索引并截掉残缺的尾部
+ * @param path 日志文件路径
+ * @return 存档存储指针，失败返回NULL
+ */
+SaveStore* openSaveStore(const char* path);
+
+/**
+ * 写入存档：追加到内存缓冲区并更新索引，调用flushSaveStore后才落盘
+ * @param store 存档存储
+ * @param key 存档键（如"玩家/槽位"，长度小于SAVE_KEY_MAX）
+ * @param data 存档数据
+ * @param size 数据字节数（不超过SAVE_MAX_SIZE）
+ * @return 成功返回0，失败返回-1
+ */
+int putSave(SaveStore* store, const char* key, const void* data, size_t size);
+
+/**
+ * 读取存档（包括尚未提交的最新写入）
+ * @param store 存档存储
+ * @param key 存档键
+ * @param data 输出数据（malloc分配并以'\0'结尾，由调用者释放）
+ * @param size 输出数据字节数（可为NULL）
+ * @return 成功返回0，不存在或失败返回-1
+ */
+int getSave(SaveStore* store, const char* key, char** data, size_t* size);
+
+/**
+ * 组提交：一次写出所有待写记录并fsync一次；必要时启动后台压缩
+ * @param store 存档存储
+ * @return 成功返回0，失败返回-1（待写记录保留到下次重试）
+ */
+int flushSaveStore(SaveStore* store);
+
+/**
+ * 提交剩余记录、等待后台压缩结束并关闭存档存储
+ * @param store 存档存储
+ */
+void closeSaveStore(SaveStore* store);
+
+/**
+ * 获取存档存储的统计信息
+ * @param store 存档存储
+ * @param stats 输出统计
+ */
+void getSaveStoreStats(SaveStore* store, SaveStoreStats* stats);
+
+// ==================== 数据压缩接口 ====================
+
+/**
+ * 用DEFLATE压缩数据（固定Huffman编码的单个块）
+ * @param data 原始数据
+ * @param length 原始数据字节数
+ * @param format 封装格式（COMPRESS_GZIP或COMPRESS_ZLIB）
+ * @param compressedLength 输出压缩后的字节数
+ * @return 压缩数据（malloc分配，由调用者释放），失败返回NULL
+ */
+unsigned char* compressData(const void* data, size_t length, int format, size_t* compressedLength);
+
 // ==================== 世界查询接口 ====================
 
 /**
@@ -231,7 +1224,8 @@ World* generateWorldFromSeed(long seed, int width, int height);
 int getTile(World* world, int x, int y);
 
 /**
- * 设置指定位置的瓦片类型
+ * 设置指定位置的瓦片类型，并维护归属平面：改成墙时清除归属，
+ * 新变为可通行的格子按rebuildOwnership的规则归入包含它的房间或经过它的走廊
  * @param world 世界指针
  * @param x X坐标
  * @param y Y坐标
@@ -239,6 +1233,52 @@ int getTile(World* world, int x, int y);
  */
 void setTile(World* world, int x, int y, int tileType);
 
+/**
+ * 查询瓦片所属的房间（O(1)，查归属平面）。归属在生成时确定，setTile修改瓦片时随之更新
+ * @param world 世界指针
+ * @param x X坐标
+ * @param y Y坐标
+ * @return 房间ID，不在任何房间内（走廊、墙壁或越界）返回-1
+ */
+int roomAt(World* world, int x, int y);
+
+/**
+ * 查询瓦片所属的走廊（O(1)）。走廊穿过房间的部分仍归房间，
+ * 与更早的走廊重叠的部分归更早的走廊
+ * @param world 世界指针
+ * @param x X坐标
+ * @param y Y坐标
+ * @return 走廊下标，不在任何走廊上返回-1
+ */
+int corridorAt(World* world, int x, int y);
+
+/**
+ * 根据房间和走廊列表重建归属平面（反序列化不带归属平面的旧记录时调用）。
+ * 洞穴和波函数坍缩世界的房间是不规则区域，无法从包围盒还原，按种子重新生成一次取得归属
+ * @param world 世界指针
+ * @return 成功返回0，失败返回-1
+ */
+int rebuildOwnership(World* world);
+
+/**
+ * 把一个区域标记为需要重绘（裁剪到世界范围内）。与已有脏矩形相交或相邻时合并，
+ * 脏矩形已满时并入使面积增加最少的那个
+ * @param world 世界指针
+ * @param x 左上角X坐标
+ * @param y 左上角Y坐标
+ * @param width 宽度
+ * @param height 高度
+ */
+void markDirtyRect(World* world, int x, int y, int width, int height);
+
+/**
+ * 取走当前版本的脏矩形并清空；有脏矩形时版本号加一（world->version即这批矩形所属的版本）
+ * @param world 世界指针
+ * @param rects 输出数组，至少MAX_DIRTY_RECTS个元素
+ * @return 脏矩形数量
+ */
+int takeDirtyRects(World* world, DirtyRect* rects);
+
 /**
  * 获取房间列表（JSON格式）
  * @param world 世界指针
@@ -325,6 +1365,158 @@ bool isValidPosition(World* world, int x, int y);
  */
 int getRandom(World* world, int min, int max);
 
+/**
+ * 在多个线程上并行执行同一任务，全部完成后返回
+ * @param threadCount 线程数（夹紧到1..MAX_THREADS）
+ * @param task 任务函数，每个线程调用一次
+ * @param context 传给任务函数的共享上下文
+ * @return 实际使用的线程数
+ */
+int runParallel(int threadCount, ParallelTask task, void* context);
+
+/**
+ * 创建互斥锁
+ * @return 互斥锁指针，失败返回NULL
+ */
+Mutex* createMutex(void);
+
+/**
+ * 销毁互斥锁
+ * @param mutex 互斥锁
+ */
+void destroyMutex(Mutex* mutex);
+
+/**
+ * 加锁
+ * @param mutex 互斥锁
+ */
+void lockMutex(Mutex* mutex);
+
+/**
+ * 解锁
+ * @param mutex 互斥锁
+ */
+void unlockMutex(Mutex* mutex);
+
+/**
+ * 启动线程
+ * @param func 线程函数
+ * @param context 传给线程函数的上下文
+ * @return 线程指针，失败返回NULL
+ */
+Thread* startThread(ThreadFunc func, void* context);
+
+/**
+ * 等待线程结束并释放线程对象（thread为NULL时直接返回）
+ * @param thread 线程指针
+ */
+void joinThread(Thread* thread);
+
+/**
+ * 获取可用的CPU核数
+ * @return 核数，至少为1
+ */
+int getCpuCount(void);
+
+/**
+ * 获取单调时钟时间（秒），用于计时
+ * @return 时间（秒）
+ */
+double getMonotonicTime(void);
+
+// ==================== 延迟直方图接口 ====================
+
+/**
+ * 清空直方图
+ * @param histogram 直方图
+ */
+void resetLatencyHistogram(LatencyHistogram* histogram);
+
+/**
+ * 记录一个延迟（同一直方图只能由一个线程记录）
+ * @param histogram 直方图
+ * @param micros 延迟（微秒），负数按0记录
+ */
+void recordLatency(LatencyHistogram* histogram, long long micros);
+
+/**
+ * 把src累加到dst（dst只能由调用线程写入，src可以正在被其他线程记录）
+ * @param dst 目标直方图
+ * @param src 源直方图
+ */
+void mergeLatencyHistogram(LatencyHistogram* dst, const LatencyHistogram* src);
+
+/**
+ * 求分位数
+ * @param histogram 直方图
+ * @param percentile 百分位（0..100，如99.9）
+ * @return 该分位对应桶的上界（微秒，不超过最大值），没有记录时返回0
+ */
+long long getLatencyPercentile(const LatencyHistogram* histogram, double percentile);
+
+/**
+ * 统计不超过给定值的记录数（按桶上界判断）
+ * @param histogram 直方图
+ * @param micros 上界（微秒）
+ * @return 记录数
+ */
+long long countLatencyAtMost(const LatencyHistogram* histogram, long long micros);
+
+// ==================== 性能追踪接口 ====================
+// 用法：TRACE_BEGIN(span); ...; TRACE_END(span, "名字");
+// 区间结束时写入当前线程的环形缓冲区（名字须是静态字符串），提前返回的区间不记录
+
+#if BYOW_TRACE
+#define TRACE_BEGIN(span) long long span = traceTimestamp()
+#define TRACE_END(span, name) traceRecord((name), (span))
+#else
+#define TRACE_BEGIN(span) ((void)0)
+#define TRACE_END(span, name) ((void)0)
+#endif
+
+/**
+ * 开启或关闭追踪记录（默认关闭，关闭时追踪点只读一次标志）
+ * @param enabled 是否记录
+ */
+void setTraceEnabled(bool enabled);
+
+/**
+ * 追踪是否正在记录
+ * @return true表示正在记录
+ */
+bool isTraceEnabled(void);
+
+/**
+ * 追踪区间的开始时间
+ * @return 单调时钟纳秒数，未开启追踪时返回0
+ */
+long long traceTimestamp(void);
+
+/**
+ * 记录一个从start到现在的完整区间（start为0时忽略）
+ * @param name 区间名（静态字符串）
+ * @param start traceTimestamp()的返回值
+ */
+void traceRecord(const char* name, long long start);
+
+/**
+ * 导出所有线程缓冲区中的事件（Chrome trace_event格式的JSON）
+ * @return malloc分配的JSON字符串，调用者负责free，失败返回NULL
+ */
+char* getTraceJSON(void);
+
+/**
+ * 把追踪事件写入文件（可用chrome://tracing或Perfetto打开）
+ * @param path 文件路径
+ * @return 成功返回0，失败返回-1
+ */
+int writeTraceFile(const char* path);
+
+/**
+ * 丢弃已记录的事件（不影响正在写入的线程）
+ */
+void clearTrace(void);
+
 #endif // BYOW_H
 
 
@@ -0,0 +1,572 @@
+// BYOW 基准测试程序
+// 编译：gcc -O2 byow_bench.c byow.c -o byow_bench -lm -lpthread
+// 用法：byow_bench [--bench tiled|cave|wfc|owner|core] [--seed S] [--width W] [--height H] [--threads N]
+//                   [--trace FILE]
+//                   [--rounds R] [--warmup W] [--filter NAME] [--json FILE] [--baseline FILE] [--tolerance PCT]
+//   tiled（默认）：对分区并行生成在 1, 2, 4, ..., N 个线程下计时，报告相对单线程的加速比，
+//                  并校验不同线程数得到的地图完全一致
+//   cave：对 W x H 的洞穴位图计时（随机填充 + CAVE_STEPS 步元胞自动机）
+//   wfc：对 W x H 的波函数坍缩计时（内置样例规则）
+//   owner：在各生成模式的 W x H 世界上随机setTile，校验roomAt/corridorAt跟着瓦片变化
+//          （墙不归属，房间/BSP世界的归属平面与rebuildOwnership的结果一致），并报告setTile耗时
+//   core：核心库各操作（生成、房间、MST、寻路、JSON、连通性）在多种世界尺寸和房间数下的微基准，
+//         预热W个样本后采集R个样本（默认3和10）；--json写出结果，--baseline与之前的结果比较，
+//         中位数慢于基线超过PCT%（默认10）时退出码为3
+//   --trace：记录各生成阶段的耗时，结束时写入FILE（Chrome trace_event格式）
+
+#include "byow.h"
+#include <math.h>
+
+// FNV-1a 64位哈希，用于比较不同线程数下的地图是否一致
+static unsigned long long hashTiles(const TiledWorld* world) {
+    unsigned long long h = 1469598103934665603ULL;
+    size_t total = (size_t)world->width * world->height;
+    for (size_t i = 0; i < total; i++) {
+        h ^= world->tiles[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static double runTiled(long seed, int width, int height, int threads,
+                       unsigned long long* hash, int* linkCount) {
+    double start = getMonotonicTime();
+    TiledWorld* world = generateTiledWorld(seed, width, height, threads);
+    double elapsed = getMonotonicTime() - start;
+
+    if (!world) return -1.0;
+    *hash = hashTiles(world);
+    *linkCount = world->linkCount;
+    destroyTiledWorld(world);
+    return elapsed;
+}
+
+static int benchCave(long seed, int width, int height) {
+    const int rounds = 5;
+    double best = -1.0;
+
+    for (int i = 0; i < rounds; i++) {
+        double start = getMonotonicTime();
+        CaveGrid* grid = createCaveGrid(width, height);
+        if (!grid) {
+            fprintf(stderr, "Failed to create cave grid\n");
+            return 1;
+        }
+        seedCaveGrid(grid, seed, CAVE_FILL_PERCENT);
+        for (int step = 0; step < CAVE_STEPS; step++) {
+            stepCaveGrid(grid);
+        }
+        double elapsed = getMonotonicTime() - start;
+        destroyCaveGrid(grid);
+
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+
+    printf("Cave %dx%d, seed %ld, %d steps: best of %d = %.2f ms\n",
+           width, height, seed, CAVE_STEPS, rounds, best * 1000.0);
+    return 0;
+}
+
+static int benchWfc(long seed, int width, int height) {
+    const int rounds = 3;
+    double best = -1.0;
+
+    WfcRules* rules = (WfcRules*)malloc(sizeof(WfcRules));
+    unsigned char* out = (unsigned char*)malloc((size_t)width * height);
+    if (!rules || !out || loadDefaultWfcRules(rules) != 0) {
+        fprintf(stderr, "Failed to prepare WFC\n");
+        free(rules);
+        free(out);
+        return 1;
+    }
+
+    int failures = 0;
+    for (int i = 0; i < rounds; i++) {
+        double start = getMonotonicTime();
+        if (runWfc(rules, seed + i, width, height, out) != 0) failures++;
+        double elapsed = getMonotonicTime() - start;
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+
+    printf("WFC %dx%d, %d patterns: best of %d = %.2f ms, failures %d\n",
+           width, height, rules->patternCount, rounds, best * 1000.0, failures);
+    free(rules);
+    free(out);
+    return failures == rounds ? 1 : 0;
+}
+
+// 随机改写瓦片，每次改写后检查该格的归属，每批改写后把归属平面与rebuildOwnership重建的结果比较。
+// 洞穴/WFC的不规则房间重建时要按种子重新生成，setTile只能近似，这两种模式只检查墙不归属
+#define OWNER_EDITS 2000
+#define OWNER_BATCH 100
+
+static int benchOwner(long seed, int width, int height) {
+    static short expected[MAX_WORLD_HEIGHT][MAX_WORLD_WIDTH];
+    static const int modes[] = {GEN_MODE_ROOMS, GEN_MODE_BSP, GEN_MODE_CAVE, GEN_MODE_WFC};
+    int failures = 0;
+
+    for (int m = 0; m < (int)(sizeof(modes) / sizeof(modes[0])); m++) {
+        World* world = generateWorldFromSeedWithMode(seed, width, height, modes[m]);
+        if (!world) {
+            fprintf(stderr, "Failed to generate world\n");
+            return 1;
+        }
+        bool exact = modes[m] == GEN_MODE_ROOMS || modes[m] == GEN_MODE_BSP;
+        unsigned long long rng = (unsigned long long)seed * 2654435761ULL + 1;
+        int mismatches = 0;
+        double editTime = 0.0;
+
+        for (int i = 0; i < OWNER_EDITS; i++) {
+            rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            int x = (int)((rng >> 33) % (unsigned long long)world->width);
+            int y = (int)((rng >> 13) % (unsigned long long)world->height);
+            // 先把房间或走廊上的格子砌成墙，再挖开，检查归属随之清除和恢复
+            int before = roomAt(world, x, y);
+            int tile = (i & 1) ? TILE_WALL : TILE_ROOM;
+            double start = getMonotonicTime();
+            setTile(world, x, y, TILE_WALL);
+            if (roomAt(world, x, y) >= 0 || corridorAt(world, x, y) >= 0) mismatches++;
+            setTile(world, x, y, tile);
+            editTime += getMonotonicTime() - start;
+            if (tile == TILE_WALL && (roomAt(world, x, y) >= 0 || corridorAt(world, x, y) >= 0)) mismatches++;
+            if (exact && tile != TILE_WALL && before >= 0 && roomAt(world, x, y) != before) mismatches++;
+
+            if (exact && (i + 1) % OWNER_BATCH == 0) {
+                memcpy(expected, world->owner, sizeof(expected));
+                rebuildOwnership(world);
+                if (memcmp(expected, world->owner, sizeof(expected)) != 0) mismatches++;
+            }
+        }
+
+        printf("%-6s %dx%d: %d edits, setTile %.1f ns, mismatches %d\n", getGeneratorModeName(modes[m]),
+               world->width, world->height, OWNER_EDITS, editTime / (2.0 * OWNER_EDITS) * 1e9, mismatches);
+        failures += mismatches;
+        destroyWorld(world);
+    }
+
+    printf("Ownership follows tile edits: %s\n", failures == 0 ? "yes" : "NO");
+    return failures == 0 ? 0 : 2;
+}
+
+// ==================== 核心库微基准 ====================
+// 对每个操作 x 世界尺寸 x 房间数：先预热并据此确定每个样本的操作次数（使样本约CORE_SAMPLE_TIME秒），
+// 再采集若干样本，报告每次操作的最小值/中位数/均值/标准差/最大值。准备和清理不计时，
+// 只读操作每个样本只读一次时钟。
+// 每个样本从同一个种子开始，只读操作轮流作用于同一组CORE_WORLDS个世界，样本之间的工作量相同。
+// 与基线比较时以中位数为准，慢于基线超过容差视为回归
+
+#define CORE_SAMPLE_TIME 0.01   // 每个样本的目标计时时长（秒）
+#define CORE_MAX_SAMPLES 1000
+#define CORE_MAX_RESULTS 64
+#define CORE_JSON_SIZE 131072
+#define CORE_WORLDS 8           // 只读操作使用的世界数
+
+typedef struct CoreState {
+    long baseSeed;
+    long seed;
+    int width, height, rooms;
+    World* world;
+    char* json;
+    int path[MAX_PATH_LEN];
+} CoreState;
+
+typedef struct CoreOp {
+    const char* name;
+    bool sweepRooms;                     // 是否按房间数展开（否则固定为默认的25个）
+    bool mutates;                        // 操作会修改世界：每次操作前重新准备；否则预先准备CORE_WORLDS个世界
+    void (*setup)(CoreState* state);     // 不计时
+    void (*run)(CoreState* state);       // 计时
+} CoreOp;
+
+typedef struct CoreResult {
+    char name[64];
+    int width, height, rooms;
+    long long opsPerSample;
+    int samples;
+    double minNs, medianNs, meanNs, stddevNs, maxNs;
+} CoreResult;
+
+typedef struct CoreOptions {
+    int rounds;                // 计入统计的样本数
+    int warmup;                // 预热样本数
+    const char* filter;        // 只运行名字包含该子串的操作
+    const char* jsonPath;      // 结果写入的JSON文件
+    const char* baselinePath;  // 对比的基线JSON文件
+    double tolerance;          // 允许的变慢比例（百分比）
+} CoreOptions;
+
+static const int coreSizes[][2] = {{40, 25}, {80, 50}, {100, 100}};
+static const int coreRoomCounts[] = {10, 25, 50};
+static volatile long long benchSink;  // 防止结果被优化掉
+
+static void setupNothing(CoreState* state) {
+    state->world = NULL;
+}
+
+static void setupEmptyWorld(CoreState* state) {
+    state->world = createWorld(state->seed, state->width, state->height);
+}
+
+static void setupRoomsWorld(CoreState* state) {
+    setupEmptyWorld(state);
+    if (state->world) generateRooms(state->world, 3, 6, state->rooms);
+}
+
+static void setupConnectedWorld(CoreState* state) {
+    setupRoomsWorld(state);
+    if (state->world) connectRoomsWithMST(state->world);
+}
+
+static void runGenerateWorld(CoreState* state) {
+    state->world = generateWorldFromSeed(state->seed, state->width, state->height);
+}
+
+static void runGenerateRooms(CoreState* state) {
+    benchSink += generateRooms(state->world, 3, 6, state->rooms);
+}
+
+static void runConnectRooms(CoreState* state) {
+    benchSink += connectRoomsWithMST(state->world);
+}
+
+static void runFindPath(CoreState* state) {
+    benchSink += findShortestPath(state->world, 0, state->world->roomCount - 1, state->path, MAX_PATH_LEN);
+}
+
+static void runWorldJSON(CoreState* state) {
+    benchSink += getWorldJSON(state->world, state->json, CORE_JSON_SIZE);
+}
+
+static void runIsConnected(CoreState* state) {
+    benchSink += isWorldConnected(state->world);
+}
+
+static const CoreOp coreOps[] = {
+    {"generateWorldFromSeed", false, true, setupNothing, runGenerateWorld},
+    {"generateRooms", true, true, setupEmptyWorld, runGenerateRooms},
+    {"connectRoomsWithMST", true, true, setupRoomsWorld, runConnectRooms},
+    {"findShortestPath", true, false, setupConnectedWorld, runFindPath},
+    {"getWorldJSON", true, false, setupConnectedWorld, runWorldJSON},
+    {"isWorldConnected", true, false, setupConnectedWorld, runIsConnected},
+};
+
+// 采集一个样本：执行ops次操作，返回计时部分的总秒数。
+// 只读操作整批计时（一次读时钟约几十纳秒，与被测操作同一量级）；
+// 修改世界的操作每次都要重新准备，只能逐次计时以排除准备的耗时
+static double runCoreSample(const CoreOp* op, CoreState* state, World** worlds, long long ops) {
+    state->seed = state->baseSeed;
+    if (!op->mutates) {
+        double start = getMonotonicTime();
+        for (long long i = 0; i < ops; i++) {
+            state->world = worlds[i % CORE_WORLDS];
+            op->run(state);
+        }
+        double timed = getMonotonicTime() - start;
+        state->world = NULL;
+        return timed;
+    }
+
+    double timed = 0.0;
+    for (long long i = 0; i < ops; i++) {
+        op->setup(state);
+        double start = getMonotonicTime();
+        op->run(state);
+        timed += getMonotonicTime() - start;
+        destroyWorld(state->world);
+        state->world = NULL;
+        state->seed++;
+    }
+    return timed;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void runCoreCase(const CoreOp* op, CoreState* state, const CoreOptions* options, CoreResult* result) {
+    static double samples[CORE_MAX_SAMPLES];
+    World* worlds[CORE_WORLDS] = {NULL};
+
+    if (!op->mutates) {
+        for (int i = 0; i < CORE_WORLDS; i++) {
+            state->seed = state->baseSeed + i;
+            op->setup(state);
+            worlds[i] = state->world;
+        }
+    }
+
+    // 预热，同时按上一次的耗时调整每个样本的操作次数
+    long long ops = 1;
+    for (int i = 0; i < options->warmup || i == 0; i++) {
+        double timed = runCoreSample(op, state, worlds, ops);
+        double perOp = timed / (double)ops;
+        ops = perOp > 0 ? (long long)(CORE_SAMPLE_TIME / perOp) : 1000000;
+        if (ops < 1) ops = 1;
+        if (ops > 1000000) ops = 1000000;
+    }
+
+    int count = options->rounds;
+    double sum = 0.0;
+    for (int i = 0; i < count; i++) {
+        samples[i] = runCoreSample(op, state, worlds, ops) / (double)ops * 1e9;
+        sum += samples[i];
+    }
+    for (int i = 0; i < CORE_WORLDS; i++) destroyWorld(worlds[i]);
+    qsort(samples, (size_t)count, sizeof(double), compareDoubles);
+
+    double mean = sum / count;
+    double variance = 0.0;
+    for (int i = 0; i < count; i++) variance += (samples[i] - mean) * (samples[i] - mean);
+
+    snprintf(result->name, sizeof(result->name), "%s", op->name);
+    result->width = state->width;
+    result->height = state->height;
+    result->rooms = state->rooms;
+    result->opsPerSample = ops;
+    result->samples = count;
+    result->minNs = samples[0];
+    result->maxNs = samples[count - 1];
+    result->medianNs = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2.0;
+    result->meanNs = mean;
+    result->stddevNs = count > 1 ? sqrt(variance / (count - 1)) : 0.0;
+}
+
+static int writeCoreJSON(const char* path, const CoreResult* results, int count, const CoreOptions* options) {
+    size_t size = 256 + (size_t)count * 320;
+    char* json = (char*)malloc(size);
+    if (!json) return -1;
+
+    int pos = snprintf(json, size, "{\"suite\":\"core\",\"rounds\":%d,\"warmup\":%d,\"results\":[",
+                       options->rounds, options->warmup);
+    for (int i = 0; i < count; i++) {
+        const CoreResult* r = &results[i];
+        pos += snprintf(json + pos, size - (size_t)pos,
+            "%s{\"name\":\"%s\",\"width\":%d,\"height\":%d,\"rooms\":%d,\"opsPerSample\":%lld,\"samples\":%d,"
+            "\"minNs\":%.1f,\"medianNs\":%.1f,\"meanNs\":%.1f,\"stddevNs\":%.1f,\"maxNs\":%.1f}",
+            i > 0 ? "," : "", r->name, r->width, r->height, r->rooms, r->opsPerSample, r->samples,
+            r->minNs, r->medianNs, r->meanNs, r->stddevNs, r->maxNs);
+    }
+    pos += snprintf(json + pos, size - (size_t)pos, "]}\n");
+
+    int status = writeFileAtomic(path, json, (size_t)pos);
+    free(json);
+    return status;
+}
+
+// 从基线JSON（本程序--json的输出）中读出各结果的中位数
+static int readCoreBaseline(const char* path, CoreResult* baseline, int maxCount) {
+    size_t size = 0;
+    const unsigned char* data = mapFileReadOnly(path, &size);
+    char* text = data ? (char*)malloc(size + 1) : NULL;
+    if (!text) {
+        if (data) unmapFile(data, size);
+        return -1;
+    }
+    memcpy(text, data, size);
+    text[size] = '\0';
+    unmapFile(data, size);
+
+    int count = 0;
+    const char* p = text;
+    while (count < maxCount && (p = strstr(p, "{\"name\":\"")) != NULL) {
+        CoreResult* r = &baseline[count];
+        const char* median = strstr(p, "\"medianNs\":");
+        if (sscanf(p, "{\"name\":\"%63[^\"]\",\"width\":%d,\"height\":%d,\"rooms\":%d",
+                   r->name, &r->width, &r->height, &r->rooms) == 4 && median) {
+            r->medianNs = strtod(median + 11, NULL);
+            count++;
+        }
+        p++;
+    }
+    free(text);
+    return count;
+}
+
+// 与基线比较，返回回归的结果数
+static int compareCoreBaseline(const CoreResult* results, int count, const CoreResult* baseline,
+                               int baselineCount, double tolerance) {
+    int regressions = 0;
+    printf("\n%-22s %9s %5s %12s %12s %9s\n", "baseline", "size", "rooms", "base ns", "now ns", "change");
+    for (int i = 0; i < count; i++) {
+        const CoreResult* r = &results[i];
+        const CoreResult* b = NULL;
+        for (int j = 0; j < baselineCount && !b; j++) {
+            if (strcmp(baseline[j].name, r->name) == 0 && baseline[j].width == r->width &&
+                baseline[j].height == r->height && baseline[j].rooms == r->rooms) {
+                b = &baseline[j];
+            }
+        }
+        if (!b || b->medianNs <= 0) continue;
+
+        double change = (r->medianNs / b->medianNs - 1.0) * 100.0;
+        bool regressed = change > tolerance;
+        if (regressed) regressions++;
+        printf("%-22s %4dx%-4d %5d %12.1f %12.1f %+8.1f%%%s\n", r->name, r->width, r->height, r->rooms,
+               b->medianNs, r->medianNs, change, regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+static int benchCore(long seed, const CoreOptions* options) {
+    static CoreResult results[CORE_MAX_RESULTS];
+    static CoreResult baseline[CORE_MAX_RESULTS];
+    int count = 0;
+
+    if (options->rounds < 1 || options->rounds > CORE_MAX_SAMPLES || options->warmup < 0) {
+        fprintf(stderr, "--rounds must be 1..%d and --warmup at least 0\n", CORE_MAX_SAMPLES);
+        return 1;
+    }
+
+    CoreState state;
+    memset(&state, 0, sizeof(state));
+    state.json = (char*)malloc(CORE_JSON_SIZE);
+    if (!state.json) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    printf("Core library, seed %ld, %d rounds after %d warmup\n", seed, options->rounds, options->warmup);
+    printf("%-22s %9s %5s %10s %12s %12s %10s\n", "operation", "size", "rooms", "ops/sample",
+           "median ns", "mean ns", "stddev");
+
+    for (size_t o = 0; o < sizeof(coreOps) / sizeof(coreOps[0]); o++) {
+        const CoreOp* op = &coreOps[o];
+        if (options->filter && !strstr(op->name, options->filter)) continue;
+
+        for (size_t s = 0; s < sizeof(coreSizes) / sizeof(coreSizes[0]); s++) {
+            int roomVariants = op->sweepRooms ? (int)(sizeof(coreRoomCounts) / sizeof(coreRoomCounts[0])) : 1;
+            for (int r = 0; r < roomVariants && count < CORE_MAX_RESULTS; r++) {
+                state.baseSeed = seed;
+                state.width = coreSizes[s][0];
+                state.height = coreSizes[s][1];
+                state.rooms = op->sweepRooms ? coreRoomCounts[r] : 25;
+
+                CoreResult* result = &results[count++];
+                runCoreCase(op, &state, options, result);
+                printf("%-22s %4dx%-4d %5d %10lld %12.1f %12.1f %9.1f%%\n", result->name, result->width,
+                       result->height, result->rooms, result->opsPerSample, result->medianNs, result->meanNs,
+                       result->meanNs > 0 ? result->stddevNs / result->meanNs * 100.0 : 0.0);
+            }
+        }
+    }
+    free(state.json);
+
+    if (options->jsonPath && writeCoreJSON(options->jsonPath, results, count, options) != 0) {
+        fprintf(stderr, "Failed to write %s\n", options->jsonPath);
+        return 1;
+    }
+
+    if (options->baselinePath) {
+        int baselineCount = readCoreBaseline(options->baselinePath, baseline, CORE_MAX_RESULTS);
+        if (baselineCount < 0) {
+            fprintf(stderr, "Failed to read baseline %s\n", options->baselinePath);
+            return 1;
+        }
+        int regressions = compareCoreBaseline(results, count, baseline, baselineCount, options->tolerance);
+        printf("Regressions over %.1f%%: %d\n", options->tolerance, regressions);
+        if (regressions > 0) return 3;
+    }
+    return 0;
+}
+
+static int runBench(const char* bench, long seed, int width, int height, int maxThreads) {
+    if (strcmp(bench, "cave") == 0) {
+        return benchCave(seed, width > 0 ? width : 4096, height > 0 ? height : 4096);
+    }
+    if (strcmp(bench, "wfc") == 0) {
+        return benchWfc(seed, width > 0 ? width : 512, height > 0 ? height : 512);
+    }
+    if (strcmp(bench, "owner") == 0) {
+        return benchOwner(seed, width > 0 ? width : 80, height > 0 ? height : 50);
+    }
+    if (width <= 0) width = 10000;
+    if (height <= 0) height = 10000;
+
+    if (maxThreads < 1) maxThreads = 1;
+    if (maxThreads > MAX_THREADS) maxThreads = MAX_THREADS;
+
+    printf("Tiled world %dx%d, seed %ld, up to %d threads\n", width, height, seed, maxThreads);
+    printf("%8s %12s %10s %20s\n", "threads", "seconds", "speedup", "hash");
+
+    double baseTime = 0.0;
+    unsigned long long baseHash = 0;
+    bool deterministic = true;
+
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > maxThreads) threads = maxThreads;
+
+        unsigned long long hash = 0;
+        int linkCount = 0;
+        double elapsed = runTiled(seed, width, height, threads, &hash, &linkCount);
+        if (elapsed < 0) {
+            fprintf(stderr, "Failed to generate tiled world\n");
+            return 1;
+        }
+
+        if (threads == 1) {
+            baseTime = elapsed;
+            baseHash = hash;
+        } else if (hash != baseHash) {
+            deterministic = false;
+        }
+
+        printf("%8d %12.3f %9.2fx %20llx\n", threads, elapsed, baseTime / elapsed, hash);
+
+        if (threads == maxThreads) break;
+    }
+
+    printf("Deterministic across thread counts: %s\n", deterministic ? "yes" : "NO");
+    return deterministic ? 0 : 2;
+}
+
+int main(int argc, char** argv) {
+    long seed = 42;
+    int width = 0;   // 0表示使用各项测试的默认尺寸
+    int height = 0;
+    int maxThreads = getCpuCount();
+    const char* bench = "tiled";
+    const char* tracePath = NULL;
+    CoreOptions coreOptions = {10, 3, NULL, NULL, NULL, 10.0};
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            bench = argv[i + 1];
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            seed = strtol(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--width") == 0) {
+            width = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--height") == 0) {
+            height = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            maxThreads = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            tracePath = argv[i + 1];
+        } else if (strcmp(argv[i], "--rounds") == 0) {
+            coreOptions.rounds = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--warmup") == 0) {
+            coreOptions.warmup = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--filter") == 0) {
+            coreOptions.filter = argv[i + 1];
+        } else if (strcmp(argv[i], "--json") == 0) {
+            coreOptions.jsonPath = argv[i + 1];
+        } else if (strcmp(argv[i], "--baseline") == 0) {
+            coreOptions.baselinePath = argv[i + 1];
+        } else if (strcmp(argv[i], "--tolerance") == 0) {
+            coreOptions.tolerance = atof(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (tracePath) setTraceEnabled(true);
+    int status = strcmp(bench, "core") == 0 ? benchCore(seed, &coreOptions)
+                                            : runBench(bench, seed, width, height, maxThreads);
+    if (tracePath && writeTraceFile(tracePath) != 0) {
+        fprintf(stderr, "Failed to write trace %s\n", tracePath);
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,550 @@
+// BYOW 负载生成程序：对本机运行的byow_server打开N个长连接，按比例发送generate/world/map/path请求，
+// 报告吞吐量和p50/p99/p999延迟，并把响应与本地按种子生成的世界逐字节比较
+// 编译：gcc -O2 byow_loadgen.c byow.c -o byow_loadgen -lm -lpthread
+// 用法：byow_loadgen [--host H] [--port P] [--connections N] [--duration S] [--requests R]
+//                    [--mix generate=1,world=4,map=2,path=3] [--seeds K] [--seed-base B] [--generate-rate G]
+//   每个连接一个线程，同一时刻每个连接只有一个请求在途；--requests为0时按--duration计时
+//   所有连接合计每秒最多发出G个generate（默认16，低于服务端每个地址20/s的令牌速率），0表示不限速，
+//   额度不足时改发其他类型的请求；延迟只统计200响应，被429/503拒绝的请求只计数，不进入延迟分布
+//   generate使用种子B..B+K-1；world/map的响应必须等于其中某个种子的世界（测试期间不要用setTile修改世界）
+//   有不一致的响应时退出码为2
+
+#include "byow.h"
+#include <ctype.h>
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+    #define close closesocket
+#else
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <arpa/inet.h>
+    #include <unistd.h>
+    #include <signal.h>
+#endif
+
+#define LOADGEN_MAX_CONNECTIONS 1024
+#define LOADGEN_JSON_SIZE 131072       // 与服务端的世界JSON缓冲区一致
+#define LOADGEN_WIDTH 80               // 与服务端generate的默认尺寸一致
+#define LOADGEN_HEIGHT 50
+#define LOADGEN_GENERATE_RATE 16.0     // 默认的generate速率，服务端令牌桶为每个地址20/s
+
+// 请求类型
+#define REQ_GENERATE 0
+#define REQ_WORLD 1
+#define REQ_MAP 2
+#define REQ_PATH 3
+#define REQ_KINDS 4
+
+static const char* requestKindNames[REQ_KINDS] = {"generate", "world", "map", "path"};
+
+// 一个种子对应的预期响应
+typedef struct ExpectedWorld {
+    long seed;
+    char* worldJson;                // /api/generate和/api/world的响应
+    unsigned long long mapHash;     // /api/map响应的哈希
+} ExpectedWorld;
+
+typedef struct LoadConfig {
+    const char* host;
+    int port;
+    double duration;                // 秒，requests为0时使用
+    long long requests;             // 总请求数，0表示按时间
+    int weights[REQ_KINDS];
+    int weightTotal;
+    long seedBase;
+    int seedCount;
+    ExpectedWorld* expected;
+    atomic_llong issued;            // 已领取的请求数（按总数运行时）
+    double deadline;
+    double generateRate;            // 所有连接合计的generate速率（每秒），0表示不限速
+    atomic_llong generateSlot;      // 下一个generate可以发出的时间（相对startTime的微秒）
+    double startTime;
+} LoadConfig;
+
+typedef struct KindStats {
+    LatencyHistogram latency;       // 只记录200响应
+    long long count;
+    long long errors;               // 连接失败、非200或错误JSON
+    long long rejected;             // 被服务器准入控制拒绝（429/503）
+    long long mismatches;           // 与按种子生成的世界不一致
+} KindStats;
+
+typedef struct LoadConnection {
+    LoadConfig* config;
+    int index;
+    int socket;                     // -1表示需要重新连接
+    unsigned long long rng;
+    char* buffer;                   // 响应缓冲区
+    size_t capacity;
+    long long bytes;                // 收到的响应字节数
+    KindStats stats[REQ_KINDS];
+} LoadConnection;
+
+// FNV-1a 64位哈希
+static unsigned long long hashBytes(const char* data, size_t length) {
+    unsigned long long h = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static unsigned long long nextRandom(unsigned long long* state) {
+    unsigned long long x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// 预先生成种子池中每个世界的预期响应
+static bool prepareExpected(LoadConfig* config) {
+    config->expected = (ExpectedWorld*)calloc((size_t)config->seedCount, sizeof(ExpectedWorld));
+    char* mapBuffer = (char*)malloc(LOADGEN_JSON_SIZE);
+    if (!config->expected || !mapBuffer) {
+        free(mapBuffer);
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < config->seedCount && ok; i++) {
+        ExpectedWorld* expected = &config->expected[i];
+        expected->seed = config->seedBase + i;
+        expected->worldJson = (char*)malloc(LOADGEN_JSON_SIZE);
+        World* world = generateWorldFromSeedWithMode(expected->seed, LOADGEN_WIDTH, LOADGEN_HEIGHT, GEN_MODE_ROOMS);
+        ok = world && expected->worldJson &&
+             getWorldJSON(world, expected->worldJson, LOADGEN_JSON_SIZE) == 0 &&
+             getWorldMapJSON(world, mapBuffer, LOADGEN_JSON_SIZE) == 0;
+        if (ok) expected->mapHash = hashBytes(mapBuffer, strlen(mapBuffer));
+        destroyWorld(world);
+    }
+    free(mapBuffer);
+    return ok;
+}
+
+static void sleepMillis(int milliseconds) {
+    #ifdef _WIN32
+        Sleep((DWORD)milliseconds);
+    #else
+        usleep((useconds_t)milliseconds * 1000);
+    #endif
+}
+
+// 领取一个generate额度：上一个generate之后已过去1/generateRate秒时返回true
+// 额度不足的连接改发其他类型的请求，不阻塞等待，读请求的吞吐量不受限速影响
+static bool takeGenerateSlot(LoadConfig* config) {
+    if (config->generateRate <= 0) return true;
+    long long interval = (long long)(1e6 / config->generateRate);
+    long long now = (long long)((getMonotonicTime() - config->startTime) * 1e6);
+    long long slot = atomic_load(&config->generateSlot);
+    while (slot <= now) {
+        // 空闲时不积累额度：槽位落后于当前时间时从当前时间开始排
+        if (atomic_compare_exchange_weak(&config->generateSlot, &slot, now + interval)) return true;
+    }
+    return false;
+}
+
+static const ExpectedWorld* findExpected(const LoadConfig* config, long seed) {
+    long offset = seed - config->seedBase;
+    if (offset < 0 || offset >= config->seedCount) return NULL;
+    return &config->expected[offset];
+}
+
+static int connectServer(const char* host, int port) {
+    int sock = (int)socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1 ||
+        connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return -1;
+    }
+
+    // 请求很小，关闭Nagle算法避免等待合并
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+    return sock;
+}
+
+static bool sendAll(int sock, const char* data, size_t length) {
+    size_t sent = 0;
+    while (sent < length) {
+        int n = (int)send(sock, data + sent, (int)(length - sent), 0);
+        if (n <= 0) return false;
+        sent += (size_t)n;
+    }
+    return true;
+}
+
+// 在响应头中查找字段（name为小写并带冒号），返回值的开头，没有返回NULL
+static const char* findResponseHeader(const char* headers, const char* headerEnd, const char* name) {
+    const char* line = strstr(headers, "\r\n");
+    size_t nameLength = strlen(name);
+    while (line && line < headerEnd) {
+        line += 2;
+        size_t i = 0;
+        while (i < nameLength && tolower((unsigned char)line[i]) == name[i]) i++;
+        if (i == nameLength) {
+            line += i;
+            while (*line == ' ') line++;
+            return line;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return NULL;
+}
+
+// 读取一个完整响应，body指向conn->buffer中的响应体（以'\0'结尾）
+// 返回HTTP状态码，连接出错返回-1；服务端要求关闭时把keepAlive置为false
+static int readResponse(LoadConnection* conn, const char** body, size_t* bodyLength, bool* keepAlive) {
+    size_t length = 0;
+    size_t expected = 0;
+    size_t headerLength = 0;
+
+    for (;;) {
+        if (length + 1 >= conn->capacity) {
+            size_t grown = conn->capacity * 2;
+            char* larger = (char*)realloc(conn->buffer, grown);
+            if (!larger) return -1;
+            conn->buffer = larger;
+            conn->capacity = grown;
+        }
+
+        int n = (int)recv(conn->socket, conn->buffer + length, (int)(conn->capacity - length - 1), 0);
+        if (n <= 0) return -1;
+        length += (size_t)n;
+        conn->buffer[length] = '\0';
+
+        if (expected == 0) {
+            char* headerEnd = strstr(conn->buffer, "\r\n\r\n");
+            if (!headerEnd) continue;
+            headerLength = (size_t)(headerEnd + 4 - conn->buffer);
+            const char* contentLength = findResponseHeader(conn->buffer, headerEnd, "content-length:");
+            if (!contentLength) return -1;
+            expected = headerLength + (size_t)strtoull(contentLength, NULL, 10);
+
+            const char* connection = findResponseHeader(conn->buffer, headerEnd, "connection:");
+            *keepAlive = !(connection && tolower((unsigned char)connection[0]) == 'c');
+        }
+        if (length >= expected) break;
+    }
+
+    conn->bytes += (long long)length;
+    conn->buffer[expected] = '\0';
+    *body = conn->buffer + headerLength;
+    *bodyLength = expected - headerLength;
+    return atoi(conn->buffer + 9);  // "HTTP/1.1 200 OK"
+}
+
+// 按种子校验响应，返回true表示一致
+static bool checkResponse(const LoadConfig* config, int kind, long seed, const char* body, size_t bodyLength) {
+    switch (kind) {
+        case REQ_GENERATE: {
+            const ExpectedWorld* expected = findExpected(config, seed);
+            return expected && strcmp(body, expected->worldJson) == 0;
+        }
+        case REQ_WORLD: {
+            // 其他连接可能随时重新生成世界，只要求响应等于种子池中它自己声明的那个种子
+            const char* seedField = strstr(body, "\"seed\":");
+            if (!seedField) return false;
+            const ExpectedWorld* expected = findExpected(config, strtol(seedField + 7, NULL, 10));
+            return expected && strcmp(body, expected->worldJson) == 0;
+        }
+        case REQ_MAP: {
+            unsigned long long hash = hashBytes(body, bodyLength);
+            for (int i = 0; i < config->seedCount; i++) {
+                if (config->expected[i].mapHash == hash) return true;
+            }
+            return false;
+        }
+        default:
+            return true;
+    }
+}
+
+static int pickRequestKind(LoadConnection* conn) {
+    int roll = (int)(nextRandom(&conn->rng) % (unsigned long long)conn->config->weightTotal);
+    for (int kind = 0; kind < REQ_KINDS; kind++) {
+        roll -= conn->config->weights[kind];
+        if (roll < 0) return kind;
+    }
+    return REQ_WORLD;
+}
+
+static bool hasMoreRequests(LoadConfig* config) {
+    if (config->requests > 0) return atomic_fetch_add(&config->issued, 1) < config->requests;
+    return getMonotonicTime() < config->deadline;
+}
+
+// 在连接上发送一个请求并记录延迟和校验结果（连接断开时下次重新连接）
+static void issueRequest(LoadConnection* conn, int kind, long seed) {
+    LoadConfig* config = conn->config;
+    char request[256];
+    const char* path = "/api/world";
+    char target[128];
+    switch (kind) {
+        case REQ_GENERATE:
+            snprintf(target, sizeof(target), "/api/generate?seed=%ld&width=%d&height=%d",
+                     seed, LOADGEN_WIDTH, LOADGEN_HEIGHT);
+            path = target;
+            break;
+        case REQ_MAP:
+            path = "/api/map";
+            break;
+        case REQ_PATH:
+            path = "/api/path?start=0&end=1";
+            break;
+        default:
+            break;
+    }
+    int requestLength = snprintf(request, sizeof(request),
+                                 "GET %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: keep-alive\r\n\r\n",
+                                 path, config->host, config->port);
+
+    KindStats* stats = &conn->stats[kind];
+    double start = getMonotonicTime();
+    if (conn->socket < 0) conn->socket = connectServer(config->host, config->port);
+
+    const char* body = NULL;
+    size_t bodyLength = 0;
+    bool keepAlive = true;
+    int status = -1;
+    if (conn->socket >= 0 && sendAll(conn->socket, request, (size_t)requestLength)) {
+        status = readResponse(conn, &body, &bodyLength, &keepAlive);
+    }
+    long long elapsed = (long long)((getMonotonicTime() - start) * 1e6);
+    stats->count++;
+
+    if (status == 429 || status == 503) {
+        stats->rejected++;
+    } else if (status != 200 || strncmp(body, "{\"error\"", 8) == 0) {
+        stats->errors++;
+    } else {
+        recordLatency(&stats->latency, elapsed);
+        if (!checkResponse(config, kind, seed, body, bodyLength)) stats->mismatches++;
+    }
+    if ((status < 0 || !keepAlive) && conn->socket >= 0) {
+        close(conn->socket);
+        conn->socket = -1;
+    }
+}
+
+static void runConnection(void* context) {
+    LoadConnection* conn = (LoadConnection*)context;
+    LoadConfig* config = conn->config;
+
+    while (hasMoreRequests(config)) {
+        int kind = pickRequestKind(conn);
+        while (kind == REQ_GENERATE && !takeGenerateSlot(config)) {
+            // 只有generate时没有其他请求可发，稍等再领取
+            if (config->weights[REQ_GENERATE] == config->weightTotal) sleepMillis(1);
+            kind = pickRequestKind(conn);
+        }
+        long seed = config->seedBase + (long)(nextRandom(&conn->rng) % (unsigned long long)config->seedCount);
+        issueRequest(conn, kind, seed);
+    }
+    if (conn->socket >= 0) close(conn->socket);
+}
+
+// 解析"generate=1,world=4,map=2,path=3"，未出现的类型权重为0
+static bool parseMix(const char* text, int* weights) {
+    for (int kind = 0; kind < REQ_KINDS; kind++) weights[kind] = 0;
+    while (*text) {
+        const char* equals = strchr(text, '=');
+        if (!equals) return false;
+        int kind = 0;
+        while (kind < REQ_KINDS && (strlen(requestKindNames[kind]) != (size_t)(equals - text) ||
+                                    strncmp(text, requestKindNames[kind], (size_t)(equals - text)) != 0)) {
+            kind++;
+        }
+        if (kind == REQ_KINDS) return false;
+        char* end = NULL;
+        weights[kind] = (int)strtol(equals + 1, &end, 10);
+        if (end == equals + 1 || weights[kind] < 0) return false;
+        text = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') return false;
+    }
+    return true;
+}
+
+static void printKindRow(const char* name, const KindStats* stats) {
+    const LatencyHistogram* latency = &stats->latency;
+    printf("%-10s %9lld %8lld %8lld %9lld %9.3f %9.3f %9.3f %9.3f\n", name, stats->count, stats->errors,
+           stats->rejected, stats->mismatches, getLatencyPercentile(latency, 50.0) / 1000.0,
+           getLatencyPercentile(latency, 99.0) / 1000.0, getLatencyPercentile(latency, 99.9) / 1000.0,
+           atomic_load(&latency->max) / 1000.0);
+}
+
+int main(int argc, char** argv) {
+    static LoadConfig config;
+    config.host = "127.0.0.1";
+    config.port = 8082;
+    config.duration = 10.0;
+    config.requests = 0;
+    config.seedBase = 1;
+    config.seedCount = 16;
+    config.generateRate = LOADGEN_GENERATE_RATE;
+    int connections = 8;
+    const char* mix = "generate=1,world=4,map=2,path=3";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* key = argv[i];
+        const char* value = argv[i + 1];
+
+        if (strcmp(key, "--host") == 0) {
+            config.host = value;
+        } else if (strcmp(key, "--port") == 0) {
+            config.port = atoi(value);
+        } else if (strcmp(key, "--connections") == 0) {
+            connections = atoi(value);
+        } else if (strcmp(key, "--duration") == 0) {
+            config.duration = atof(value);
+        } else if (strcmp(key, "--requests") == 0) {
+            config.requests = strtoll(value, NULL, 10);
+        } else if (strcmp(key, "--mix") == 0) {
+            mix = value;
+        } else if (strcmp(key, "--seeds") == 0) {
+            config.seedCount = atoi(value);
+        } else if (strcmp(key, "--seed-base") == 0) {
+            config.seedBase = strtol(value, NULL, 10);
+        } else if (strcmp(key, "--generate-rate") == 0) {
+            config.generateRate = atof(value);
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", key);
+            return 1;
+        }
+    }
+
+    if (!parseMix(mix, config.weights)) {
+        fprintf(stderr, "Invalid mix: %s\n", mix);
+        return 1;
+    }
+    config.weightTotal = 0;
+    for (int kind = 0; kind < REQ_KINDS; kind++) config.weightTotal += config.weights[kind];
+    if (config.weightTotal <= 0 || connections < 1 || connections > LOADGEN_MAX_CONNECTIONS ||
+        config.seedCount < 1 || config.duration <= 0 || config.generateRate < 0) {
+        fprintf(stderr, "Usage: byow_loadgen [--host H] [--port P] [--connections N] [--duration S] "
+                        "[--requests R] [--mix generate=1,world=4,map=2,path=3] [--seeds K] [--seed-base B] "
+                        "[--generate-rate G]\n");
+        return 1;
+    }
+
+    #ifdef _WIN32
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+            fprintf(stderr, "WSAStartup failed\n");
+            return 1;
+        }
+    #else
+        signal(SIGPIPE, SIG_IGN);
+    #endif
+
+    if (!prepareExpected(&config)) {
+        fprintf(stderr, "Failed to generate expected worlds\n");
+        return 1;
+    }
+
+    LoadConnection* conns = (LoadConnection*)calloc((size_t)connections, sizeof(LoadConnection));
+    Thread** threads = (Thread**)calloc((size_t)connections, sizeof(Thread*));
+    if (!conns || !threads) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < connections; i++) {
+        LoadConnection* conn = &conns[i];
+        conn->config = &config;
+        conn->index = i;
+        conn->socket = -1;
+        conn->rng = 0x9E3779B97F4A7C15ULL * (unsigned long long)(i + 1);
+        conn->capacity = 65536;
+        conn->buffer = (char*)malloc(conn->capacity);
+        if (!conn->buffer) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+    }
+
+    // 先生成种子池中的一个世界，保证world/map从第一个请求起就能校验（不计入统计）
+    issueRequest(&conns[0], REQ_GENERATE, config.seedBase);
+    if (conns[0].stats[REQ_GENERATE].errors + conns[0].stats[REQ_GENERATE].rejected +
+        conns[0].stats[REQ_GENERATE].mismatches > 0) {
+        fprintf(stderr, "byow_server at %s:%d did not return the expected world\n", config.host, config.port);
+        return 1;
+    }
+    memset(conns[0].stats, 0, sizeof(conns[0].stats));
+    conns[0].bytes = 0;
+
+    atomic_init(&config.issued, 0);
+    atomic_init(&config.generateSlot, 0);
+    double startTime = getMonotonicTime();
+    config.startTime = startTime;
+    config.deadline = startTime + config.duration;
+    for (int i = 0; i < connections; i++) {
+        threads[i] = startThread(runConnection, &conns[i]);
+        if (!threads[i]) {
+            fprintf(stderr, "Failed to start connection %d\n", i);
+            return 1;
+        }
+    }
+    for (int i = 0; i < connections; i++) {
+        joinThread(threads[i]);
+    }
+    double elapsed = getMonotonicTime() - startTime;
+
+    // 合并各连接的统计
+    static KindStats totals[REQ_KINDS];
+    static KindStats all;
+    long long bytes = 0;
+    for (int i = 0; i < connections; i++) {
+        bytes += conns[i].bytes;
+        for (int kind = 0; kind < REQ_KINDS; kind++) {
+            const KindStats* stats = &conns[i].stats[kind];
+            mergeLatencyHistogram(&totals[kind].latency, &stats->latency);
+            mergeLatencyHistogram(&all.latency, &stats->latency);
+            totals[kind].count += stats->count;
+            totals[kind].errors += stats->errors;
+            totals[kind].rejected += stats->rejected;
+            totals[kind].mismatches += stats->mismatches;
+        }
+    }
+    for (int kind = 0; kind < REQ_KINDS; kind++) {
+        all.count += totals[kind].count;
+        all.errors += totals[kind].errors;
+        all.rejected += totals[kind].rejected;
+        all.mismatches += totals[kind].mismatches;
+    }
+
+    printf("%s:%d, %d connections, %.2f s: %lld requests, %.1f req/s, %.2f MB/s\n",
+           config.host, config.port, connections, elapsed, all.count,
+           elapsed > 0 ? (double)all.count / elapsed : 0.0,
+           elapsed > 0 ? (double)bytes / elapsed / (1024.0 * 1024.0) : 0.0);
+    printf("%-10s %9s %8s %8s %9s %9s %9s %9s %9s\n", "request", "count", "errors", "rejected", "mismatch",
+           "p50 ms", "p99 ms", "p999 ms", "max ms");
+    for (int kind = 0; kind < REQ_KINDS; kind++) {
+        if (totals[kind].count > 0) printKindRow(requestKindNames[kind], &totals[kind]);
+    }
+    printKindRow("all", &all);
+    printf("Deterministic: %s (%lld responses checked)\n", all.mismatches == 0 ? "yes" : "NO",
+           all.count - all.errors - all.rejected);
+
+    for (int i = 0; i < connections; i++) free(conns[i].buffer);
+    for (int i = 0; i < config.seedCount; i++) free(config.expected[i].worldJson);
+    free(config.expected);
+    free(conns);
+    free(threads);
+
+    #ifdef _WIN32
+        WSACleanup();
+    #endif
+    return all.mismatches > 0 ? 2 : 0;
+}
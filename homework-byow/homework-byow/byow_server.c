@@ -1,6 +1,11 @@
 #include "byow.h"
 #include <limits.h>
 #include <time.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <sys/stat.h>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -9,25 +14,146 @@
     #define close closesocket
 #else
     #include <sys/socket.h>
+    #include <sys/select.h>
     #include <netinet/in.h>
     #include <arpa/inet.h>
     #include <unistd.h>
+    #include <fcntl.h>
+    #include <signal.h>
 #endif
 
 #define PORT 8082
 #define BUFFER_SIZE 8192
 #define RESPONSE_BUFFER_SIZE 131072  // 128KB for large JSON responses
-#define SAVE_FILE "save-file.txt"
+#define SAVE_FILE "save-file.txt"      // 旧版单槽存档，启动时导入存档存储
+#define SAVE_STORE_FILE "byow-saves.log"
+#define SAVE_GROUP_MAX 64              // 一次组提交最多合并的存档请求数
+#define MAX_REQUEST_SIZE (SAVE_MAX_SIZE + BUFFER_SIZE)
+#define MAX_SAVE_CHECKPOINTS (SAVE_MAX_SIZE / REPLAY_CHECKPOINT_INTERVAL + 1)
+#define SNAPSHOT_FILE "byow-snapshot.bin"
+#define SNAPSHOT_INTERVAL 5.0  // 区块缓存变化后写快照的最小间隔（秒）
+#define LISTEN_BACKLOG 128     // 等待accept的连接队列长度
+#define COMPRESS_MIN_SIZE 1024 // 小于该字节数的响应不压缩
+#define HTTP_SEND_TIMEOUT 5.0  // 非阻塞socket发送缓冲区满时，等待其可写的最长时间（秒）
 
 // 全局世界实例
 static World* currentWorld = NULL;
 
+// 当前世界被setTile修改的次数；非0时存档重放改用按种子重新生成的世界
+static long long worldEdits = 0;
+
+// 无限区块世界的区块缓存（按种子重建）
+static ChunkCache* chunkCache = NULL;
+
+// 存档存储，以及等待组提交后才回复的存档请求
+static SaveStore* saveStore = NULL;
+static int pendingSaveSockets[SAVE_GROUP_MAX];
+static int pendingSaveCount = 0;
+
+// 当前线程正在处理的请求已发送的响应字节数、是否以错误回复（用于请求统计）
+static THREAD_LOCAL long long requestResponseBytes = 0;
+static THREAD_LOCAL bool requestFailed = false;
+
+// 当前请求回复后是否保持连接（决定响应头中的Connection）
+static THREAD_LOCAL bool requestKeepAlive = false;
+
+// 当前请求的客户端地址（IPv4，网络字节序），以及请求是否已转入生成队列稍后回复
+static THREAD_LOCAL unsigned long requestClientAddress = 0;
+static THREAD_LOCAL bool requestDeferred = false;
+
+// 当前请求接受的响应编码（COMPRESS_GZIP/COMPRESS_ZLIB），-1表示只接受原文
+static THREAD_LOCAL int requestEncoding = -1;
+
+// 排队的生成任务数，以及被准入控制拒绝的生成请求数（/api/metrics导出）
+#define ADMISSION_RATE_LIMITED 0
+#define ADMISSION_QUEUE_FULL 1
+static int generateQueueCount = 0;
+static long long generateRejected[2] = {0, 0};
+
 // ==================== HTTP响应函数 ====================
 
-void sendHttpResponse(int clientSocket, int statusCode, const char* contentType, 
-                      const char* body) {
-    size_t bodyLen = strlen(body);
-    size_t headerLen = 200;  // 足够大的头部空间
+static const char* getStatusText(int statusCode) {
+    switch (statusCode) {
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 429: return "Too Many Requests";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+    }
+}
+
+static const char* contentEncodingNames[2] = {"gzip", "deflate"};
+
+static bool setSocketNonBlocking(int clientSocket) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(clientSocket, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(clientSocket, F_GETFL, 0);
+    return flags >= 0 && fcntl(clientSocket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+static bool isWouldBlock(void) {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+// 在非阻塞socket上发完data：发送缓冲区满时等它可写，超过HTTP_SEND_TIMEOUT或出错时放弃
+// 返回实际发出的字节数
+static size_t sendAllData(int clientSocket, const char* data, size_t length) {
+    size_t sent = 0;
+    double deadline = getMonotonicTime() + HTTP_SEND_TIMEOUT;
+    while (sent < length) {
+        int n = (int)send(clientSocket, data + sent, (int)(length - sent), 0);
+        if (n > 0) {
+            sent += (size_t)n;
+            continue;
+        }
+        if (n == 0 || !isWouldBlock()) break;
+
+        double wait = deadline - getMonotonicTime();
+        if (wait <= 0) break;
+        fd_set writeSet;
+        FD_ZERO(&writeSet);
+        FD_SET(clientSocket, &writeSet);
+        struct timeval timeout;
+        timeout.tv_sec = (long)wait;
+        timeout.tv_usec = (long)((wait - (double)timeout.tv_sec) * 1000000.0);
+        if (select(clientSocket + 1, NULL, &writeSet, NULL, &timeout) <= 0) break;
+    }
+    return sent;
+}
+
+
+// 发送响应。extraHeaders为附加的响应头（每行以\r\n结尾），没有时传""；
+// encoded不为NULL时发送的是它（body按requestEncoding压缩后的结果）；
+// hasBody为false时（304）不带响应体，也不带Content-Type和Content-Length（contentType可为NULL）
+static void sendHttpBody(int clientSocket, int statusCode, const char* contentType, const char* extraHeaders,
+                         const char* body, size_t length, const unsigned char* encoded, size_t encodedLength,
+                         bool hasBody) {
+    // 可能压缩的响应都要带Vary，缓存才不会把压缩结果交给不支持的客户端
+    char encodingHeaders[96] = "";
+    if (length >= COMPRESS_MIN_SIZE) {
+        snprintf(encodingHeaders, sizeof(encodingHeaders), "%s%s%sVary: Accept-Encoding\r\n",
+                 encoded ? "Content-Encoding: " : "", encoded ? contentEncodingNames[requestEncoding] : "",
+                 encoded ? "\r\n" : "");
+    }
+    if (encoded) {
+        body = (const char*)encoded;
+        length = encodedLength;
+    }
+
+    size_t bodyLen = hasBody ? length : 0;
+    char entityHeaders[160] = "";
+    if (hasBody) {
+        snprintf(entityHeaders, sizeof(entityHeaders), "Content-Type: %s\r\nContent-Length: %zu\r\n",
+                 contentType, bodyLen);
+    }
+    size_t headerLen = 320 + strlen(extraHeaders) + strlen(encodingHeaders);  // 足够大的头部空间
     size_t totalLen = headerLen + bodyLen;
     
     // 如果响应太大，使用动态分配
@@ -51,31 +177,47 @@ void sendHttpResponse(int clientSocket, int statusCode, const char* contentType,
     
     // 构建HTTP头部
     int headerSize = snprintf(response, totalLen,
-        "HTTP/1.1 %d OK\r\n"
-        "Content-Type: %s\r\n"
-        "Content-Length: %zu\r\n"
+        "HTTP/1.1 %d %s\r\n"
+        "%s"
         "Access-Control-Allow-Origin: *\r\n"
         "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
         "Access-Control-Allow-Headers: Content-Type\r\n"
+        "Connection: %s\r\n"
+        "%s%s"
         "\r\n",
-        statusCode, contentType, bodyLen);
+        statusCode, getStatusText(statusCode), entityHeaders,
+        requestKeepAlive ? "keep-alive" : "close", encodingHeaders, extraHeaders);
     
     // 复制body
     memcpy(response + headerSize, body, bodyLen);
     
     // 发送响应
-    size_t sent = 0;
-    size_t toSend = headerSize + bodyLen;
+    size_t sent = sendAllData(clientSocket, response, headerSize + bodyLen);
+    requestResponseBytes += (long long)sent;
     
-    while (sent < toSend) {
-        ssize_t n = send(clientSocket, response + sent, toSend - sent, 0);
-        if (n < 0) {
-            break;  // 发送失败
+    free(response);
+}
+
+// 客户端接受压缩且body足够大时压缩后发送
+static void sendHttpResponseWithHeaders(int clientSocket, int statusCode, const char* contentType,
+                                        const char* extraHeaders, const char* body) {
+    size_t length = strlen(body);
+    size_t encodedLength = 0;
+    unsigned char* encoded = NULL;
+    if (requestEncoding >= 0 && length >= COMPRESS_MIN_SIZE) {
+        encoded = compressData(body, length, requestEncoding, &encodedLength);
+        if (encoded && encodedLength >= length) {
+            free(encoded);
+            encoded = NULL;
         }
-        sent += n;
     }
-    
-    free(response);
+    sendHttpBody(clientSocket, statusCode, contentType, extraHeaders, body, length, encoded, encodedLength, true);
+    free(encoded);
+}
+
+void sendHttpResponse(int clientSocket, int statusCode, const char* contentType, 
+                      const char* body) {
+    sendHttpResponseWithHeaders(clientSocket, statusCode, contentType, "", body);
 }
 
 void sendJsonResponse(int clientSocket, const char* json) {
@@ -83,211 +225,2360 @@ void sendJsonResponse(int clientSocket, const char* json) {
 }
 
 void sendErrorResponse(int clientSocket, const char* message) {
+    requestFailed = true;
     char errorJson[512];
     snprintf(errorJson, sizeof(errorJson), "{\"error\":\"%s\"}", message);
     sendJsonResponse(clientSocket, errorJson);
 }
 
-// ==================== API处理函数 ====================
+// 过载时的快速拒绝（429/503），retryAfter秒后可重试（同时写在响应体中，浏览器脚本读不到该响应头）
+static void sendRetryLaterResponse(int clientSocket, int statusCode, int retryAfter, const char* message) {
+    requestFailed = true;
+    char headers[64];
+    char errorJson[512];
+    snprintf(headers, sizeof(headers), "Retry-After: %d\r\n", retryAfter);
+    snprintf(errorJson, sizeof(errorJson), "{\"error\":\"%s\",\"retryAfter\":%d}", message, retryAfter);
+    sendHttpResponseWithHeaders(clientSocket, statusCode, "application/json", headers, errorJson);
+}
 
-void handleGenerateWorld(int clientSocket, const char* queryString) {
-    long seed = 0;
-    int width = 80;
-    int height = 50;
-    
-    // 解析查询参数
-    if (queryString) {
-        char* seedStr = strstr(queryString, "seed=");
-        char* widthStr = strstr(queryString, "width=");
-        char* heightStr = strstr(queryString, "height=");
-        
-        if (seedStr) {
-            seed = strtol(seedStr + 5, NULL, 10);
-        } else {
-            seed = time(NULL);  // 使用当前时间作为种子
+// ==================== 快照（重启后直接映射使用）====================
+// 快照保存当前世界（二进制记录 + 预渲染JSON）和区块缓存（预渲染JSON）。
+// 启动时只映射文件并校验头部和条目表，读请求直接返回映射区中的JSON，
+// 需要完整世界结构（房间、寻路等）时才反序列化，所以启动耗时与快照大小无关
+
+#define SNAPSHOT_MAGIC "BYOWSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MAX_ENTRIES (1 + CHUNK_CACHE_CAPACITY)
+#define SNAPSHOT_WORLD 0
+#define SNAPSHOT_CHUNK 1
+
+// 快照文件头（条目表紧随其后，数据块按8字节对齐）
+typedef struct SnapshotHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int entryCount;
+    long long chunkSeed;          // 区块条目所属的世界种子
+    long long worldEdits;         // 世界条目被setTile修改的次数（0表示与按种子生成的一致）
+} SnapshotHeader;
+
+typedef struct SnapshotEntry {
+    int kind;                     // SNAPSHOT_WORLD / SNAPSHOT_CHUNK
+    int chunkX, chunkY;           // 区块坐标（世界条目为0）
+    unsigned int recordSize;      // 世界二进制记录字节数（区块条目为0）
+    unsigned long long recordOffset;
+    unsigned long long jsonOffset; // 预渲染JSON（以'\0'结尾）
+    unsigned long long jsonSize;   // JSON长度（不含'\0'）
+} SnapshotEntry;
+
+static const unsigned char* snapshotData = NULL;
+static size_t snapshotSize = 0;
+static bool snapshotDirty = false;       // 区块缓存或世界瓦片有变化尚未写入快照
+static double lastSnapshotTime = 0.0;
+
+static const SnapshotHeader* getSnapshotHeader(void) {
+    return (const SnapshotHeader*)snapshotData;
+}
+
+static const SnapshotEntry* getSnapshotEntry(int index) {
+    return (const SnapshotEntry*)(snapshotData + sizeof(SnapshotHeader)) + index;
+}
+
+static const SnapshotEntry* findSnapshotEntry(int kind, int chunkX, int chunkY) {
+    if (!snapshotData) return NULL;
+    const SnapshotHeader* header = getSnapshotHeader();
+    for (unsigned int i = 0; i < header->entryCount; i++) {
+        const SnapshotEntry* entry = getSnapshotEntry((int)i);
+        if (entry->kind == kind && entry->chunkX == chunkX && entry->chunkY == chunkY) return entry;
+    }
+    return NULL;
+}
+
+static void unloadServerSnapshot(void) {
+    unmapFile(snapshotData, snapshotSize);
+    snapshotData = NULL;
+    snapshotSize = 0;
+}
+
+// 映射快照并校验条目范围；不合法的快照被忽略
+static bool loadServerSnapshot(void) {
+    size_t size = 0;
+    const unsigned char* data = mapFileReadOnly(SNAPSHOT_FILE, &size);
+    if (!data) return false;
+
+    const SnapshotHeader* header = (const SnapshotHeader*)data;
+    bool valid = size >= sizeof(SnapshotHeader) &&
+                 memcmp(header->magic, SNAPSHOT_MAGIC, 8) == 0 &&
+                 header->version == SNAPSHOT_VERSION &&
+                 header->entryCount <= SNAPSHOT_MAX_ENTRIES &&
+                 size >= sizeof(SnapshotHeader) + header->entryCount * sizeof(SnapshotEntry);
+
+    const SnapshotEntry* entries = (const SnapshotEntry*)(data + sizeof(SnapshotHeader));
+    for (unsigned int i = 0; valid && i < header->entryCount; i++) {
+        const SnapshotEntry* entry = &entries[i];
+        valid = entry->recordOffset <= size && entry->recordSize <= size - entry->recordOffset &&
+                entry->jsonOffset < size && entry->jsonSize < size - entry->jsonOffset &&
+                data[entry->jsonOffset + entry->jsonSize] == '\0';
+    }
+    if (!valid) {
+        unmapFile(data, size);
+        return false;
+    }
+
+    snapshotData = data;
+    snapshotSize = size;
+    return true;
+}
+
+typedef struct SnapshotBuilder {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} SnapshotBuilder;
+
+// 追加一块数据（8字节对齐），返回其偏移，失败返回0
+static unsigned long long appendSnapshotBlock(SnapshotBuilder* builder, const void* data, size_t size) {
+    size_t offset = (builder->size + 7) & ~(size_t)7;
+    if (offset + size > builder->capacity) {
+        size_t capacity = builder->capacity * 2;
+        while (offset + size > capacity) capacity *= 2;
+        unsigned char* grown = (unsigned char*)realloc(builder->data, capacity);
+        if (!grown) return 0;
+        builder->data = grown;
+        builder->capacity = capacity;
+    }
+    memset(builder->data + builder->size, 0, offset - builder->size);
+    memcpy(builder->data + offset, data, size);
+    builder->size = offset + size;
+    return offset;
+}
+
+// JSON连同结尾的'\0'一起写入
+static bool appendSnapshotJSON(SnapshotBuilder* builder, SnapshotEntry* entry, const char* json, size_t length) {
+    entry->jsonOffset = appendSnapshotBlock(builder, json, length + 1);
+    entry->jsonSize = length;
+    return entry->jsonOffset != 0;
+}
+
+static bool isChunkInCache(ChunkCache* cache, int chunkX, int chunkY) {
+    if (!cache) return false;
+    for (int i = 0; i < CHUNK_CACHE_CAPACITY; i++) {
+        ChunkEntry* entry = &cache->entries[i];
+        if (entry->used && entry->chunkX == chunkX && entry->chunkY == chunkY) return true;
+    }
+    return false;
+}
+
+// 重新生成快照并原子替换。新快照包含当前世界、区块缓存中的区块，
+// 以及旧快照中同一种子、尚未被缓存覆盖的区块（总数不超过缓存容量）
+static int writeServerSnapshot(void) {
+    SnapshotEntry entries[SNAPSHOT_MAX_ENTRIES];
+    int entryCount = 0;
+    int chunkCount = 0;
+    const SnapshotHeader* oldHeader = snapshotData ? getSnapshotHeader() : NULL;
+    long long chunkSeed = chunkCache ? chunkCache->seed : (oldHeader ? oldHeader->chunkSeed : 0);
+
+    SnapshotBuilder builder;
+    builder.capacity = 1 << 20;
+    builder.size = sizeof(SnapshotHeader) + sizeof(entries);
+    builder.data = (unsigned char*)calloc(1, builder.capacity);
+    char* json = (char*)malloc(RESPONSE_BUFFER_SIZE);
+    if (!builder.data || !json) {
+        free(builder.data);
+        free(json);
+        return -1;
+    }
+    bool ok = true;
+
+    const SnapshotEntry* oldWorld = findSnapshotEntry(SNAPSHOT_WORLD, 0, 0);
+    if (currentWorld) {
+        unsigned char record[WORLD_RECORD_MAX_SIZE];
+        SnapshotEntry* entry = &entries[entryCount++];
+        memset(entry, 0, sizeof(SnapshotEntry));
+        entry->kind = SNAPSHOT_WORLD;
+        int recordSize = serializeWorld(currentWorld, record, sizeof(record));
+        ok = recordSize > 0 && getWorldJSON(currentWorld, json, RESPONSE_BUFFER_SIZE) == 0;
+        if (ok) {
+            entry->recordSize = (unsigned int)recordSize;
+            entry->recordOffset = appendSnapshotBlock(&builder, record, (size_t)recordSize);
+            ok = entry->recordOffset != 0 && appendSnapshotJSON(&builder, entry, json, strlen(json));
         }
-        
-        if (widthStr) {
-            width = atoi(widthStr + 6);
-            if (width < 20) width = 20;
-            if (width > MAX_WORLD_WIDTH) width = MAX_WORLD_WIDTH;
+    } else if (oldWorld) {
+        SnapshotEntry* entry = &entries[entryCount++];
+        *entry = *oldWorld;
+        entry->recordOffset = appendSnapshotBlock(&builder, snapshotData + oldWorld->recordOffset,
+                                                  oldWorld->recordSize);
+        ok = entry->recordOffset != 0 &&
+             appendSnapshotJSON(&builder, entry, (const char*)snapshotData + oldWorld->jsonOffset,
+                                (size_t)oldWorld->jsonSize);
+    }
+
+    for (int i = 0; ok && chunkCache && i < CHUNK_CACHE_CAPACITY; i++) {
+        ChunkEntry* chunk = &chunkCache->entries[i];
+        if (!chunk->used || getChunkJSON(chunk, json, RESPONSE_BUFFER_SIZE) != 0) continue;
+
+        SnapshotEntry* entry = &entries[entryCount++];
+        memset(entry, 0, sizeof(SnapshotEntry));
+        entry->kind = SNAPSHOT_CHUNK;
+        entry->chunkX = chunk->chunkX;
+        entry->chunkY = chunk->chunkY;
+        ok = appendSnapshotJSON(&builder, entry, json, strlen(json));
+        chunkCount++;
+    }
+
+    if (oldHeader && oldHeader->chunkSeed == chunkSeed) {
+        for (unsigned int i = 0; ok && i < oldHeader->entryCount && chunkCount < CHUNK_CACHE_CAPACITY; i++) {
+            const SnapshotEntry* old = getSnapshotEntry((int)i);
+            if (old->kind != SNAPSHOT_CHUNK || isChunkInCache(chunkCache, old->chunkX, old->chunkY)) continue;
+
+            SnapshotEntry* entry = &entries[entryCount++];
+            *entry = *old;
+            ok = appendSnapshotJSON(&builder, entry, (const char*)snapshotData + old->jsonOffset,
+                                    (size_t)old->jsonSize);
+            chunkCount++;
         }
-        
-        if (heightStr) {
-            height = atoi(heightStr + 7);
-            if (height < 20) height = 20;
-            if (height > MAX_WORLD_HEIGHT) height = MAX_WORLD_HEIGHT;
+    }
+    free(json);
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+    header.version = SNAPSHOT_VERSION;
+    header.entryCount = (unsigned int)entryCount;
+    header.chunkSeed = chunkSeed;
+    header.worldEdits = currentWorld || !oldHeader ? worldEdits : oldHeader->worldEdits;
+    memcpy(builder.data, &header, sizeof(header));
+    memcpy(builder.data + sizeof(header), entries, (size_t)entryCount * sizeof(SnapshotEntry));
+
+    // 先解除旧映射再替换文件（Windows不允许重命名覆盖仍被映射的文件），失败时重新映射旧快照
+    if (ok) {
+        unloadServerSnapshot();
+        ok = writeFileAtomic(SNAPSHOT_FILE, builder.data, builder.size) == 0;
+        loadServerSnapshot();
+    }
+    free(builder.data);
+
+    lastSnapshotTime = getMonotonicTime();
+    if (ok) snapshotDirty = false;
+    return ok ? 0 : -1;
+}
+
+static int saveServerSnapshot(void) {
+    TRACE_BEGIN(span);
+    int result = writeServerSnapshot();
+    TRACE_END(span, "saveServerSnapshot");
+    return result;
+}
+
+// 当前世界：重启后首次需要完整结构时从快照记录还原
+static World* getCurrentWorld(void) {
+    if (!currentWorld) {
+        const SnapshotEntry* entry = findSnapshotEntry(SNAPSHOT_WORLD, 0, 0);
+        if (entry) currentWorld = deserializeWorld(snapshotData + entry->recordOffset, entry->recordSize);
+    }
+    return currentWorld;
+}
+
+// ==================== WebSocket增量推送 ====================
+// 客户端请求 /ws 升级为WebSocket后，服务端只推送变化：玩家位置、setTile修改的瓦片和世界版本号。
+// 变化先在服务端累积，每个tick编码成一个二进制帧，同一帧发给所有订阅者，
+// 移动一步只需要几个字节，不再重新拉取整张地图。消息中的整数均为小端序
+
+#define WS_PATH "/ws"
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_MAX_CLIENTS 64
+#define WS_TICK_INTERVAL 0.05        // 增量合并发送的间隔（秒）
+#define WS_MAX_PAYLOAD 1024          // 客户端单条消息的最大负载
+#define WS_MAX_BACKLOG (1 << 20)     // 单个连接积压的未发送字节上限，超过视为慢客户端并断开
+#define WS_MAX_TILE_DELTAS 4096      // 每个tick的瓦片增量上限，超出时改为推送版本号
+#define WS_DELTA_MAX_SIZE (5 + WS_MAX_CLIENTS * 3 + WS_MAX_TILE_DELTAS * 5 + WS_MAX_CLIENTS * 7 + \
+                           6 + MAX_DIRTY_RECTS * 8)
+
+// 服务端 -> 客户端消息
+#define WS_MSG_HELLO 0               // [0][u16 玩家编号][u32 世界版本]
+#define WS_MSG_VERSION 1             // [1][u32 世界版本]：世界已改变，客户端重新拉取 /api/world
+#define WS_MSG_PLAYER 2              // [2][u16 玩家编号][u16 x][u16 y]
+#define WS_MSG_TILE 3                // [3][u16 x][u16 y][u8 瓦片]
+#define WS_MSG_LEAVE 4               // [4][u16 玩家编号]：玩家断开，或世界重新生成后需要重新放置；迷雾会话中也表示玩家离开了视野
+#define WS_MSG_DIRTY 5               // [5][u32 瓦片版本][u8 数量][数量 x (u16 x, u16 y, u16 宽, u16 高)]：
+                                     // 本版本需要重绘的区域（瓦片修改和玩家移动经过的格子），放在帧的最后
+#define WS_MSG_REVEAL 6              // [6][u16 数量][数量 x (u16 x, u16 y, u8 瓦片)]：迷雾会话新探索的格子（单独发送）
+#define WS_MSG_VISIBLE 7             // [7][u16 原点x][u16 原点y][u8 半径][位图]：迷雾会话当前可见的格子，
+                                     // 位图按行覆盖以原点为中心、边长2*半径+1的方块
+
+// 客户端 -> 服务端消息
+#define WS_OP_MOVE 1                 // [1][wasd...]：按顺序移动，撞墙的一步跳过
+#define WS_OP_PLACE 2                // [2][u16 x][u16 y][u8 标志]：开始游戏或读档后放置玩家（必须是可通行瓦片），
+                                     // x为0xFFFF时放在出生点；标志WS_PLACE_FOG表示战争迷雾会话
+#define WS_OP_SET_TILE 3             // [3][u16 x][u16 y][u8 瓦片]
+#define WS_PLACE_FOG 1
+#define WS_PLACE_SPAWN 0xFFFF
+
+typedef struct WebSocketClient {
+    int socket;                               // -1表示空闲槽位，槽位下标即玩家编号
+    PlayerState player;                       // x < 0 表示尚未放置
+    bool moved;                               // 本tick内位置有变化
+    bool fog;                                 // 战争迷雾会话：只下发已探索的瓦片
+    FieldOfView* fov;                         // 迷雾会话的视野（首次以迷雾模式放置时分配）
+    Point* revealed;                          // 本tick内新探索、或已探索但被修改的格子（不重复）
+    int revealedCount;
+    int revealedCapacity;
+    unsigned long long* queued;               // revealed中已有的格子（位图，与fov一起分配）
+    Point known[WS_MAX_CLIENTS];              // 已告知该客户端的各玩家位置，x < 0 表示未告知或已让它删除
+    bool visibleChanged;                      // 本tick内可见区域有变化
+    unsigned char input[WS_MAX_PAYLOAD + 8];  // 尚未收完的客户端帧
+    size_t inputLength;
+    unsigned char* output;                    // 尚未发出的数据
+    size_t outputLength;
+    size_t outputCapacity;
+} WebSocketClient;
+
+typedef struct TileDelta {
+    unsigned short x, y;
+    unsigned char tile;
+} TileDelta;
+
+static WebSocketClient wsClients[WS_MAX_CLIENTS];
+static bool playerLeft[WS_MAX_CLIENTS];        // 本tick内离开的玩家
+static TileDelta tileDeltas[WS_MAX_TILE_DELTAS];
+static int tileDeltaCount = 0;
+static unsigned int worldVersion = 0;
+static bool versionChanged = false;
+static double lastBroadcastTime = 0.0;
+
+static void initWebSockets(void) {
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        wsClients[i].socket = -1;
+    }
+}
+
+static bool isWebSocketClient(int clientSocket) {
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (wsClients[i].socket == clientSocket) return true;
+    }
+    return false;
+}
+
+static void putLE16(unsigned char* p, unsigned int value) {
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+}
+
+static void putLE32(unsigned char* p, unsigned int value) {
+    putLE16(p, value & 0xFFFF);
+    putLE16(p + 2, value >> 16);
+}
+
+static unsigned int getLE16(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+#define ROTATE_LEFT(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+// SHA-1（只用于握手时计算Sec-WebSocket-Accept）
+static void sha1(const unsigned char* data, size_t length, unsigned char digest[20]) {
+    unsigned int h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    size_t total = (length + 8) / 64 * 64 + 64;   // 补位后的总长度
+    unsigned long long bitLength = (unsigned long long)length * 8;
+
+    for (size_t offset = 0; offset < total; offset += 64) {
+        unsigned int w[80];
+        for (int i = 0; i < 64; i++) {
+            size_t index = offset + (size_t)i;
+            unsigned int byte;
+            if (index < length) {
+                byte = data[index];
+            } else if (index == length) {
+                byte = 0x80;
+            } else if (index >= total - 8) {
+                byte = (unsigned int)(bitLength >> (8 * (total - 1 - index))) & 0xFF;
+            } else {
+                byte = 0;
+            }
+            if (i % 4 == 0) w[i / 4] = 0;
+            w[i / 4] |= byte << (8 * (3 - i % 4));
+        }
+        for (int i = 16; i < 80; i++) {
+            unsigned int value = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = ROTATE_LEFT(value, 1);
+        }
+
+        unsigned int a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            unsigned int f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            unsigned int temp = ROTATE_LEFT(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = ROTATE_LEFT(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    for (int i = 0; i < 20; i++) {
+        digest[i] = (unsigned char)(h[i / 4] >> (8 * (3 - i % 4)));
+    }
+}
+
+// Base64编码，output至少需要 4 * ((length + 2) / 3) + 1 字节
+static void base64Encode(const unsigned char* data, size_t length, char* output) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t pos = 0;
+    for (size_t i = 0; i < length; i += 3) {
+        unsigned int value = (unsigned int)data[i] << 16;
+        if (i + 1 < length) value |= (unsigned int)data[i + 1] << 8;
+        if (i + 2 < length) value |= data[i + 2];
+        output[pos++] = table[(value >> 18) & 63];
+        output[pos++] = table[(value >> 12) & 63];
+        output[pos++] = i + 1 < length ? table[(value >> 6) & 63] : '=';
+        output[pos++] = i + 2 < length ? table[value & 63] : '=';
+    }
+    output[pos] = '\0';
+}
+
+// 请求头中字段的值（name为小写并带冒号，如"content-length:"，字段名不区分大小写），没有返回NULL
+static const char* findHeaderValue(const char* request, const char* name) {
+    const char* line = strstr(request, "\r\n");
+    while (line && line[2] != '\r' && line[2] != '\0') {
+        line += 2;
+        size_t i = 0;
+        while (name[i] && tolower((unsigned char)line[i]) == name[i]) i++;
+        if (name[i] == '\0') {
+            line += i;
+            while (*line == ' ' || *line == '\t') line++;
+            return line;
         }
+        line = strstr(line, "\r\n");
+    }
+    return NULL;
+}
+
+// 字段值是否以expected开头（expected为小写，不区分大小写），value为NULL时返回false
+static bool headerValueStartsWith(const char* value, const char* expected) {
+    if (!value) return false;
+    size_t i = 0;
+    while (expected[i] && tolower((unsigned char)value[i]) == expected[i]) i++;
+    return expected[i] == '\0';
+}
+
+// 把一条消息封装成WebSocket帧（服务端帧不加掩码）追加到发送缓冲区，积压过多时返回false
+static bool queueWebSocketFrame(WebSocketClient* client, int opcode, const unsigned char* payload, size_t length) {
+    unsigned char header[10];
+    size_t headerLength = 2;
+    header[0] = (unsigned char)(0x80 | opcode);
+    if (length < 126) {
+        header[1] = (unsigned char)length;
+    } else if (length < 65536) {
+        header[1] = 126;
+        header[2] = (unsigned char)(length >> 8);
+        header[3] = (unsigned char)length;
+        headerLength = 4;
     } else {
-        seed = time(NULL);
+        header[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            header[2 + i] = (unsigned char)((unsigned long long)length >> (56 - 8 * i));
+        }
+        headerLength = 10;
     }
-    
-    // 销毁旧世界
-    if (currentWorld) {
-        destroyWorld(currentWorld);
+
+    size_t needed = client->outputLength + headerLength + length;
+    if (needed > WS_MAX_BACKLOG) return false;
+    if (needed > client->outputCapacity) {
+        size_t capacity = client->outputCapacity ? client->outputCapacity * 2 : 4096;
+        while (capacity < needed) capacity *= 2;
+        unsigned char* grown = (unsigned char*)realloc(client->output, capacity);
+        if (!grown) return false;
+        client->output = grown;
+        client->outputCapacity = capacity;
     }
-    
-    // 生成新世界
-    currentWorld = generateWorldFromSeed(seed, width, height);
-    
-    if (!currentWorld) {
-        sendErrorResponse(clientSocket, "Failed to generate world");
+    memcpy(client->output + client->outputLength, header, headerLength);
+    memcpy(client->output + client->outputLength + headerLength, payload, length);
+    client->outputLength = needed;
+    return true;
+}
+
+// 尽量发出积压的数据（非阻塞，发不完的留到socket可写时），连接出错返回false
+static bool flushWebSocketClient(WebSocketClient* client) {
+    size_t sent = 0;
+    while (sent < client->outputLength) {
+        int n = (int)send(client->socket, (const char*)client->output + sent,
+                          (int)(client->outputLength - sent), 0);
+        if (n < 0 && isWouldBlock()) break;
+        if (n <= 0) return false;
+        sent += (size_t)n;
+    }
+    memmove(client->output, client->output + sent, client->outputLength - sent);
+    client->outputLength -= sent;
+    return true;
+}
+
+static void closeWebSocketClient(WebSocketClient* client) {
+    close(client->socket);
+    free(client->output);
+    free(client->fov);
+    free(client->queued);
+    free(client->revealed);
+    if (client->player.x >= 0) {
+        playerLeft[client - wsClients] = true;
+        markDirtyRect(currentWorld, client->player.x, client->player.y, 1, 1);
+    }
+    memset(client, 0, sizeof(WebSocketClient));
+    client->socket = -1;
+}
+
+// 记录迷雾会话需要下发的格子（瓦片值在发送时读取）；同一格子在一个tick内只记录一次，
+// 所以revealedCount不会超过世界的格子数
+static void addRevealedCells(WebSocketClient* client, const Point* cells, int count) {
+    if (!client->queued) return;
+    if (client->revealedCount + count > client->revealedCapacity) {
+        int capacity = client->revealedCapacity ? client->revealedCapacity * 2 : FOV_MAX_REVEALED;
+        while (capacity < client->revealedCount + count) capacity *= 2;
+        Point* grown = (Point*)realloc(client->revealed, (size_t)capacity * sizeof(Point));
+        if (!grown) return;
+        client->revealed = grown;
+        client->revealedCapacity = capacity;
+    }
+    for (int i = 0; i < count; i++) {
+        int bit = cells[i].y * MAX_WORLD_WIDTH + cells[i].x;
+        unsigned long long mask = 1ULL << (bit & 63);
+        if (client->queued[bit >> 6] & mask) continue;
+        client->queued[bit >> 6] |= mask;
+        client->revealed[client->revealedCount++] = cells[i];
+    }
+}
+
+// 清空待下发的格子（只清除位图里对应的位）
+static void clearRevealedCells(WebSocketClient* client) {
+    for (int i = 0; i < client->revealedCount && client->queued; i++) {
+        int bit = client->revealed[i].y * MAX_WORLD_WIDTH + client->revealed[i].x;
+        client->queued[bit >> 6] &= ~(1ULL << (bit & 63));
+    }
+    client->revealedCount = 0;
+}
+
+// 世界版本号加一。regenerated为true表示重新生成了世界：所有玩家离开，由客户端重新放置
+static void bumpWorldVersion(bool regenerated) {
+    worldVersion++;
+    versionChanged = true;
+    tileDeltaCount = 0;   // 客户端收到版本号后会整体重新拉取世界
+    if (!regenerated) return;
+
+    worldEdits = 0;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        WebSocketClient* client = &wsClients[i];
+        if (client->socket < 0) continue;
+        if (client->fov) resetFieldOfView(client->fov, FOV_RADIUS);
+        clearRevealedCells(client);
+        client->visibleChanged = false;
+        if (client->player.x < 0) continue;
+        client->player.x = -1;
+        client->player.y = -1;
+        client->moved = false;
+        playerLeft[i] = true;
+    }
+}
+
+// 迷雾会话的视野跟随玩家，只下发新探索的格子
+static void updateClientView(WebSocketClient* client, World* world) {
+    if (!client->fov || client->player.x < 0) return;
+    Point revealed[FOV_MAX_REVEALED];
+    int count = updateFieldOfView(world, client->fov, client->player.x, client->player.y,
+                                  revealed, FOV_MAX_REVEALED);
+    if (count < 0) return;
+    addRevealedCells(client, revealed, count < FOV_MAX_REVEALED ? count : FOV_MAX_REVEALED);
+    client->visibleChanged = true;
+}
+
+// 修改当前世界的瓦片并记录增量（越界、非法瓦片或没有变化时忽略）
+static void setWorldTile(World* world, int x, int y, int tile) {
+    if (!isValidPosition(world, x, y) || tile < TILE_FLOOR || tile > TILE_CORRIDOR ||
+        getTile(world, x, y) == tile) {
         return;
     }
-    
-    // 返回世界JSON（使用更大的缓冲区）
-    char jsonBuffer[131072];  // 128KB
-    int result = getWorldJSON(currentWorld, jsonBuffer, sizeof(jsonBuffer));
-    if (result != 0) {
-        sendErrorResponse(clientSocket, "Failed to generate JSON");
+    setTile(world, x, y, tile);
+    worldEdits++;
+    snapshotDirty = true;
+
+    // 迷雾会话收不到广播的瓦片增量：已探索的格子单独重发，视野内的变化只重算相关八分区
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        WebSocketClient* client = &wsClients[i];
+        if (client->socket < 0 || !client->fov) continue;
+        Point cell = {x, y};
+        if (isCellExplored(client->fov, x, y)) addRevealedCells(client, &cell, 1);
+
+        Point revealed[FOV_MAX_REVEALED];
+        int count = refreshFieldOfViewTile(world, client->fov, x, y, revealed, FOV_MAX_REVEALED);
+        addRevealedCells(client, revealed, count < FOV_MAX_REVEALED ? count : FOV_MAX_REVEALED);
+        if (client->fov->originX >= 0 && abs(x - client->fov->originX) <= client->fov->radius &&
+            abs(y - client->fov->originY) <= client->fov->radius) {
+            client->visibleChanged = true;
+        }
+    }
+
+    if (tileDeltaCount == WS_MAX_TILE_DELTAS) {
+        bumpWorldVersion(false);
+        return;
+    }
+    TileDelta* delta = &tileDeltas[tileDeltaCount++];
+    delta->x = (unsigned short)x;
+    delta->y = (unsigned short)y;
+    delta->tile = (unsigned char)tile;
+}
+
+static void handleWebSocketMessage(WebSocketClient* client, const unsigned char* payload, size_t length) {
+    World* world = getCurrentWorld();
+    if (!world || length == 0) return;
+
+    if (payload[0] == WS_OP_MOVE) {
+        if (client->player.x < 0) return;
+        // 逐步移动并标记经过的格子，连续的路径会合并成一个脏矩形
+        for (size_t i = 1; i < length; i++) {
+            int oldX = client->player.x;
+            int oldY = client->player.y;
+            applyInputs(world, &client->player, (const char*)payload + i, 1);
+            if (client->player.x == oldX && client->player.y == oldY) continue;
+            markDirtyRect(world, oldX, oldY, 1, 1);
+            markDirtyRect(world, client->player.x, client->player.y, 1, 1);
+            client->moved = true;
+            updateClientView(client, world);
+        }
+    } else if (payload[0] == WS_OP_PLACE && length >= 5) {
+        PlayerState spawn;
+        int x = (int)getLE16(payload + 1);
+        int y = (int)getLE16(payload + 3);
+        if (x == WS_PLACE_SPAWN) {
+            if (initPlayerState(world, &spawn) != 0) return;
+            x = spawn.x;
+            y = spawn.y;
+        }
+        if (!isWalkableTile(getTile(world, x, y))) return;
+        if (client->player.x >= 0) markDirtyRect(world, client->player.x, client->player.y, 1, 1);
+        markDirtyRect(world, x, y, 1, 1);
+        client->player.x = x;
+        client->player.y = y;
+        client->player.inputIndex = 0;
+        client->moved = true;
+
+        client->fog = length >= 6 && (payload[5] & WS_PLACE_FOG);
+        if (client->fog && !client->fov) {
+            client->fov = (FieldOfView*)malloc(sizeof(FieldOfView));
+            client->queued = (unsigned long long*)calloc(FOV_BITSET_WORDS, sizeof(unsigned long long));
+            if (client->fov && client->queued) {
+                resetFieldOfView(client->fov, FOV_RADIUS);
+            } else {
+                free(client->fov);
+                free(client->queued);
+                client->fov = NULL;
+                client->queued = NULL;
+            }
+        } else if (!client->fog) {
+            clearRevealedCells(client);
+            free(client->fov);
+            free(client->queued);
+            client->fov = NULL;
+            client->queued = NULL;
+            client->visibleChanged = false;
+        }
+        updateClientView(client, world);
+    } else if (payload[0] == WS_OP_SET_TILE && length >= 6) {
+        setWorldTile(world, (int)getLE16(payload + 1), (int)getLE16(payload + 3), payload[5]);
+    }
+}
+
+// 读取并处理客户端帧，连接关闭或协议错误返回false
+static bool readWebSocketClient(WebSocketClient* client) {
+    int n = (int)recv(client->socket, (char*)client->input + client->inputLength,
+                      (int)(sizeof(client->input) - client->inputLength), 0);
+    if (n < 0 && isWouldBlock()) return true;
+    if (n <= 0) return false;
+    client->inputLength += (size_t)n;
+
+    while (client->inputLength >= 2) {
+        unsigned char* frame = client->input;
+        int opcode = frame[0] & 0x0F;
+        size_t length = frame[1] & 0x7F;
+        size_t headerLength = 2;
+
+        // RFC 6455 5.5：控制帧不能分片且负载不超过125字节，违反时以1002（协议错误）关闭
+        if ((opcode & 0x8) && (!(frame[0] & 0x80) || length > 125)) {
+            static const unsigned char protocolError[2] = {0x03, 0xEA};
+            queueWebSocketFrame(client, 0x8, protocolError, sizeof(protocolError));
+            flushWebSocketClient(client);
+            return false;
+        }
+        // 消息都很短：不接受分片帧、64位长度和未加掩码的客户端帧
+        if (!(frame[0] & 0x80) || !(frame[1] & 0x80) || length == 127) return false;
+        if (length == 126) {
+            if (client->inputLength < 4) break;
+            length = ((size_t)frame[2] << 8) | frame[3];
+            headerLength = 4;
+        }
+        if (length > WS_MAX_PAYLOAD) return false;
+        if (client->inputLength < headerLength + 4 + length) break;
+
+        const unsigned char* mask = frame + headerLength;
+        unsigned char* payload = frame + headerLength + 4;
+        for (size_t i = 0; i < length; i++) {
+            payload[i] ^= mask[i & 3];
+        }
+
+        if (opcode == 0x8) {
+            // 关闭：回一个关闭帧后断开
+            queueWebSocketFrame(client, 0x8, payload, length < 2 ? length : 2);
+            flushWebSocketClient(client);
+            return false;
+        } else if (opcode == 0x9) {
+            if (!queueWebSocketFrame(client, 0xA, payload, length)) return false;
+        } else if (opcode == 0x1 || opcode == 0x2) {
+            TRACE_BEGIN(span);
+            handleWebSocketMessage(client, payload, length);
+            TRACE_END(span, "handleWebSocketMessage");
+        }
+
+        size_t frameLength = headerLength + 4 + length;
+        memmove(frame, frame + frameLength, client->inputLength - frameLength);
+        client->inputLength -= frameLength;
+    }
+    return flushWebSocketClient(client);
+}
+
+// 升级为WebSocket：完成握手，把连接登记为订阅者并发送玩家编号、世界版本和已放置玩家的位置
+void handleWebSocketUpgrade(int clientSocket, const char* request) {
+    const char* upgrade = findHeaderValue(request, "upgrade:");
+    const char* key = findHeaderValue(request, "sec-websocket-key:");
+    size_t keyLength = key ? strcspn(key, " \t\r\n") : 0;
+    if (!headerValueStartsWith(upgrade, "websocket") || keyLength == 0 || keyLength > 64) {
+        sendErrorResponse(clientSocket, "Expected WebSocket upgrade");
+        return;
+    }
+
+    int id = 0;
+    while (id < WS_MAX_CLIENTS && wsClients[id].socket >= 0) id++;
+    if (id == WS_MAX_CLIENTS) {
+        sendErrorResponse(clientSocket, "Too many WebSocket clients");
+        return;
+    }
+
+    // Sec-WebSocket-Accept = Base64(SHA-1(key + GUID))
+    char keyAndGuid[128];
+    unsigned char digest[20];
+    char accept[32];
+    snprintf(keyAndGuid, sizeof(keyAndGuid), "%.*s%s", (int)keyLength, key, WS_GUID);
+    sha1((const unsigned char*)keyAndGuid, strlen(keyAndGuid), digest);
+    base64Encode(digest, sizeof(digest), accept);
+
+    char response[256];
+    int responseLength = snprintf(response, sizeof(response),
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %s\r\n"
+        "\r\n", accept);
+    if (sendAllData(clientSocket, response, (size_t)responseLength) < (size_t)responseLength) return;
+
+    WebSocketClient* client = &wsClients[id];
+    memset(client, 0, sizeof(WebSocketClient));
+    client->socket = clientSocket;
+    client->player.x = -1;
+    client->player.y = -1;
+    for (int other = 0; other < WS_MAX_CLIENTS; other++) {
+        client->known[other].x = -1;
+    }
+
+    unsigned char hello[7 + WS_MAX_CLIENTS * 7];
+    size_t length = 0;
+    hello[length++] = WS_MSG_HELLO;
+    putLE16(hello + length, (unsigned int)id);
+    putLE32(hello + length + 2, worldVersion);
+    length += 6;
+    for (int other = 0; other < WS_MAX_CLIENTS; other++) {
+        PlayerState* player = &wsClients[other].player;
+        if (wsClients[other].socket < 0 || player->x < 0) continue;
+        hello[length++] = WS_MSG_PLAYER;
+        putLE16(hello + length, (unsigned int)other);
+        putLE16(hello + length + 2, (unsigned int)player->x);
+        putLE16(hello + length + 4, (unsigned int)player->y);
+        length += 6;
+        client->known[other].x = player->x;
+        client->known[other].y = player->y;
+    }
+    if (!queueWebSocketFrame(client, 0x2, hello, length) || !flushWebSocketClient(client)) {
+        closeWebSocketClient(client);
+    }
+}
+
+static bool hasWebSocketDeltas(void) {
+    if (versionChanged || tileDeltaCount > 0 || (currentWorld && currentWorld->dirtyCount > 0)) return true;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        WebSocketClient* client = &wsClients[i];
+        if (playerLeft[i]) return true;
+        if (client->socket >= 0 && (client->moved || client->revealedCount > 0 || client->visibleChanged)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 迷雾会话的单独帧：新探索的格子和当前可见区域
+static bool queueClientView(WebSocketClient* client) {
+    FieldOfView* fov = client->fov;
+    int side = 2 * FOV_RADIUS + 1;
+    size_t chunks = ((size_t)client->revealedCount + 0xFFFE) / 0xFFFF;
+    size_t capacity = chunks * 3 + (size_t)client->revealedCount * 5 + 6 + (size_t)(side * side + 7) / 8;
+    unsigned char* message = (unsigned char*)malloc(capacity);
+    if (!message) return false;
+
+    size_t length = 0;
+    for (int start = 0; start < client->revealedCount; start += 0xFFFF) {
+        int count = client->revealedCount - start < 0xFFFF ? client->revealedCount - start : 0xFFFF;
+        message[length++] = WS_MSG_REVEAL;
+        putLE16(message + length, (unsigned int)count);
+        length += 2;
+        for (int i = start; i < start + count; i++) {
+            Point* cell = &client->revealed[i];
+            putLE16(message + length, (unsigned int)cell->x);
+            putLE16(message + length + 2, (unsigned int)cell->y);
+            message[length + 4] = (unsigned char)getTile(currentWorld, cell->x, cell->y);
+            length += 5;
+        }
+    }
+
+    if (client->visibleChanged && fov && fov->originX >= 0) {
+        message[length++] = WS_MSG_VISIBLE;
+        putLE16(message + length, (unsigned int)fov->originX);
+        putLE16(message + length + 2, (unsigned int)fov->originY);
+        message[length + 4] = (unsigned char)fov->radius;
+        length += 5;
+        memset(message + length, 0, (size_t)(side * side + 7) / 8);
+        for (int i = 0; i < side * side; i++) {
+            int x = fov->originX - fov->radius + i % side;
+            int y = fov->originY - fov->radius + i / side;
+            if (isCellVisible(fov, x, y)) message[length + i / 8] |= (unsigned char)(1 << (i % 8));
+        }
+        length += (size_t)(side * side + 7) / 8;
+    }
+
+    clearRevealedCells(client);
+    client->visibleChanged = false;
+    bool ok = length == 0 || queueWebSocketFrame(client, 0x2, message, length);
+    free(message);
+    return ok;
+}
+
+// 脏矩形是否覆盖了迷雾会话当前可见的格子（只需检查视野方块内的部分）
+static bool isRectVisible(const FieldOfView* fov, const DirtyRect* rect) {
+    if (!fov || fov->originX < 0) return false;
+    int left = rect->x > fov->originX - fov->radius ? rect->x : fov->originX - fov->radius;
+    int top = rect->y > fov->originY - fov->radius ? rect->y : fov->originY - fov->radius;
+    int right = rect->x + rect->width - 1 < fov->originX + fov->radius ?
+                rect->x + rect->width - 1 : fov->originX + fov->radius;
+    int bottom = rect->y + rect->height - 1 < fov->originY + fov->radius ?
+                 rect->y + rect->height - 1 : fov->originY + fov->radius;
+    for (int y = top; y <= bottom; y++) {
+        for (int x = left; x <= right; x++) {
+            if (isCellVisible(fov, x, y)) return true;
+        }
+    }
+    return false;
+}
+
+// 迷雾会话的增量帧：去掉瓦片增量（已探索的瓦片只通过WS_MSG_REVEAL下发），其他玩家只在可见时下发位置，
+// 离开视野时发送WS_MSG_LEAVE让客户端删除；脏矩形只保留与视野相交的，但总会带上版本号以免客户端整体重绘。
+// 新探索和被修改的格子由WS_MSG_REVEAL自行标记重绘
+static size_t buildFogDeltas(WebSocketClient* client, unsigned char* message, const unsigned char* prefix,
+                             size_t prefixLength, const bool* moved, const DirtyRect* rects, int rectCount,
+                             bool hasDirty) {
+    const FieldOfView* fov = client->fov;
+    int self = (int)(client - wsClients);
+    size_t length = prefixLength;
+    memcpy(message, prefix, prefixLength);
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        PlayerState* player = &wsClients[i].player;
+        Point* known = &client->known[i];
+        bool placed = wsClients[i].socket >= 0 && player->x >= 0;
+        bool visible = i == self ? moved[i] : placed && isCellVisible(fov, player->x, player->y);
+        if (visible && (i == self || known->x != player->x || known->y != player->y)) {
+            message[length++] = WS_MSG_PLAYER;
+            putLE16(message + length, (unsigned int)i);
+            putLE16(message + length + 2, (unsigned int)player->x);
+            putLE16(message + length + 4, (unsigned int)player->y);
+            length += 6;
+            known->x = player->x;
+            known->y = player->y;
+        } else if (!visible && i != self && known->x >= 0) {
+            message[length++] = WS_MSG_LEAVE;
+            putLE16(message + length, (unsigned int)i);
+            length += 2;
+            known->x = -1;
+        }
+    }
+
+    if (hasDirty) {
+        message[length++] = WS_MSG_DIRTY;
+        putLE32(message + length, currentWorld->version);
+        size_t countOffset = length + 4;
+        length += 5;
+        int count = 0;
+        for (int i = 0; i < rectCount; i++) {
+            if (!isRectVisible(fov, &rects[i])) continue;
+            putLE16(message + length, (unsigned int)rects[i].x);
+            putLE16(message + length + 2, (unsigned int)rects[i].y);
+            putLE16(message + length + 4, (unsigned int)rects[i].width);
+            putLE16(message + length + 6, (unsigned int)rects[i].height);
+            length += 8;
+            count++;
+        }
+        message[countOffset] = (unsigned char)count;
+    }
+    return length;
+}
+
+// 距离下一次推送的秒数；没有待推送的变化时返回-1
+static double getWebSocketWait(void) {
+    if (!hasWebSocketDeltas()) return -1.0;
+    double wait = lastBroadcastTime + WS_TICK_INTERVAL - getMonotonicTime();
+    return wait > 0 ? wait : 0.0;
+}
+
+// 把本tick累积的变化编码成一个二进制帧，追加给所有订阅者
+static void broadcastWebSocketDeltas(void) {
+    static unsigned char message[WS_DELTA_MAX_SIZE];
+    size_t length = 0;
+
+    if (versionChanged) {
+        message[length++] = WS_MSG_VERSION;
+        putLE32(message + length, worldVersion);
+        length += 4;
+    }
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (!playerLeft[i]) continue;
+        message[length++] = WS_MSG_LEAVE;
+        putLE16(message + length, (unsigned int)i);
+        length += 2;
+    }
+    size_t prefixLength = length;
+    for (int i = 0; i < tileDeltaCount; i++) {
+        message[length++] = WS_MSG_TILE;
+        putLE16(message + length, tileDeltas[i].x);
+        putLE16(message + length + 2, tileDeltas[i].y);
+        message[length + 4] = tileDeltas[i].tile;
+        length += 5;
+    }
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        WebSocketClient* client = &wsClients[i];
+        if (client->socket < 0 || !client->moved) continue;
+        message[length++] = WS_MSG_PLAYER;
+        putLE16(message + length, (unsigned int)i);
+        putLE16(message + length + 2, (unsigned int)client->player.x);
+        putLE16(message + length + 4, (unsigned int)client->player.y);
+        length += 6;
+    }
+
+    // 世界重新生成时客户端会整体重绘，不需要脏矩形
+    DirtyRect rects[MAX_DIRTY_RECTS];
+    int rectCount = currentWorld ? takeDirtyRects(currentWorld, rects) : 0;
+    bool hasDirty = rectCount > 0 && !versionChanged;
+    if (hasDirty) {
+        message[length++] = WS_MSG_DIRTY;
+        putLE32(message + length, currentWorld->version);
+        message[length + 4] = (unsigned char)rectCount;
+        length += 5;
+        for (int i = 0; i < rectCount; i++) {
+            putLE16(message + length, (unsigned int)rects[i].x);
+            putLE16(message + length + 2, (unsigned int)rects[i].y);
+            putLE16(message + length + 4, (unsigned int)rects[i].width);
+            putLE16(message + length + 6, (unsigned int)rects[i].height);
+            length += 8;
+        }
+    }
+
+    // 发送过程中断开的连接要留到下一tick通知，先取出本tick的离开和移动标记
+    bool left[WS_MAX_CLIENTS];
+    bool moved[WS_MAX_CLIENTS];
+    memcpy(left, playerLeft, sizeof(left));
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        moved[i] = wsClients[i].moved;
+        wsClients[i].moved = false;
+    }
+    versionChanged = false;
+    tileDeltaCount = 0;
+    memset(playerLeft, 0, sizeof(playerLeft));
+    lastBroadcastTime = getMonotonicTime();
+
+    static unsigned char fogMessage[WS_DELTA_MAX_SIZE];
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        WebSocketClient* client = &wsClients[i];
+        if (client->socket < 0) continue;
+        for (int other = 0; other < WS_MAX_CLIENTS; other++) {
+            if (left[other]) client->known[other].x = -1;
+        }
+        const unsigned char* payload = message;
+        size_t payloadLength = length;
+        if (client->fog) {
+            payload = fogMessage;
+            payloadLength = buildFogDeltas(client, fogMessage, message, prefixLength, moved,
+                                           rects, rectCount, hasDirty);
+        } else {
+            for (int other = 0; other < WS_MAX_CLIENTS; other++) {
+                if (!moved[other]) continue;
+                client->known[other].x = wsClients[other].player.x;
+                client->known[other].y = wsClients[other].player.y;
+            }
+        }
+        bool ok = payloadLength == 0 || queueWebSocketFrame(client, 0x2, payload, payloadLength);
+        if (ok && client->fog) {
+            ok = queueClientView(client);
+        } else {
+            clearRevealedCells(client);
+            client->visibleChanged = false;
+        }
+        if (!ok || !flushWebSocketClient(client)) {
+            closeWebSocketClient(client);
+        }
+    }
+}
+
+// 把订阅者加入select集合（有积压数据的同时等待可写），返回最大的描述符
+static int addWebSocketSockets(fd_set* readSet, fd_set* writeSet, int maxSocket) {
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        WebSocketClient* client = &wsClients[i];
+        if (client->socket < 0) continue;
+        FD_SET(client->socket, readSet);
+        if (client->outputLength > 0) FD_SET(client->socket, writeSet);
+        if (client->socket > maxSocket) maxSocket = client->socket;
+    }
+    return maxSocket;
+}
+
+static void processWebSocketClients(fd_set* readSet, fd_set* writeSet) {
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        WebSocketClient* client = &wsClients[i];
+        if (client->socket < 0) continue;
+        bool ok = true;
+        if (FD_ISSET(client->socket, readSet)) ok = readWebSocketClient(client);
+        if (ok && FD_ISSET(client->socket, writeSet)) ok = flushWebSocketClient(client);
+        if (!ok) closeWebSocketClient(client);
+    }
+}
+
+// ==================== 响应缓存 ====================
+// 世界JSON和地图JSON是最大的响应，按(世界版本号, 编辑次数)缓存渲染结果，
+// 压缩后的各编码版本放在原文旁边，同一版本的世界只渲染、压缩一次
+
+#define RESPONSE_WORLD 0
+#define RESPONSE_MAP 1
+#define RESPONSE_KINDS 2
+
+typedef struct CachedResponse {
+    bool valid;
+    unsigned int version;            // 渲染时的worldVersion
+    long long edits;                 // 渲染时的worldEdits（setTile修改不一定改变版本号）
+    char* body;
+    size_t length;
+    unsigned char* encoded[2];       // 按COMPRESS_GZIP/COMPRESS_ZLIB压缩的body，用到时才压缩
+    size_t encodedLength[2];
+} CachedResponse;
+
+static CachedResponse responseCache[RESPONSE_KINDS];
+
+static void clearCachedResponse(CachedResponse* entry) {
+    free(entry->body);
+    free(entry->encoded[COMPRESS_GZIP]);
+    free(entry->encoded[COMPRESS_ZLIB]);
+    memset(entry, 0, sizeof(CachedResponse));
+}
+
+static void clearResponseCache(void) {
+    for (int i = 0; i < RESPONSE_KINDS; i++) clearCachedResponse(&responseCache[i]);
+}
+
+// 与当前世界一致的缓存项，没有返回NULL
+static CachedResponse* findCachedResponse(int kind) {
+    CachedResponse* entry = &responseCache[kind];
+    if (!entry->valid || entry->version != worldVersion || entry->edits != worldEdits) return NULL;
+    return entry;
+}
+
+static void sendCachedResponse(int clientSocket, CachedResponse* entry) {
+    int encoding = requestEncoding;
+    if (encoding >= 0 && entry->length >= COMPRESS_MIN_SIZE && !entry->encoded[encoding]) {
+        entry->encoded[encoding] = compressData(entry->body, entry->length, encoding,
+                                                &entry->encodedLength[encoding]);
+    }
+    const unsigned char* encoded = encoding >= 0 ? entry->encoded[encoding] : NULL;
+    if (encoded && entry->encodedLength[encoding] >= entry->length) encoded = NULL;
+    sendHttpBody(clientSocket, 200, "application/json", "", entry->body, entry->length,
+                 encoded, encoded ? entry->encodedLength[encoding] : 0, true);
+}
+
+// 缓存当前世界的JSON并回复；缓存失败时直接回复
+static void sendCachedJson(int clientSocket, int kind, const char* json) {
+    CachedResponse* entry = &responseCache[kind];
+    clearCachedResponse(entry);
+    entry->length = strlen(json);
+    entry->body = (char*)malloc(entry->length + 1);
+    if (!entry->body) {
+        sendJsonResponse(clientSocket, json);
+        return;
+    }
+    memcpy(entry->body, json, entry->length + 1);
+    entry->version = worldVersion;
+    entry->edits = worldEdits;
+    entry->valid = true;
+    sendCachedResponse(clientSocket, entry);
+}
+
+// 从Accept-Encoding中选择响应编码（优先gzip），都不接受时返回-1
+static int getAcceptedEncoding(const char* request) {
+    const char* value = findHeaderValue(request, "accept-encoding:");
+    bool gzip = false;
+    bool deflate = false;
+    while (value && *value != '\r' && *value != '\0') {
+        while (*value == ' ' || *value == '\t' || *value == ',') value++;
+        const char* token = value;
+        while (*value != ',' && *value != ';' && *value != '\r' && *value != '\0') value++;
+        size_t tokenLength = (size_t)(value - token);
+        while (tokenLength > 0 && (token[tokenLength - 1] == ' ' || token[tokenLength - 1] == '\t')) tokenLength--;
+
+        // q=0表示明确拒绝该编码
+        bool refused = false;
+        if (*value == ';') {
+            const char* q = value + 1;
+            while (*q == ' ') q++;
+            if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=') refused = strtod(q + 2, NULL) <= 0.0;
+            while (*value != ',' && *value != '\r' && *value != '\0') value++;
+        }
+        if (!refused && tokenLength == 4 && headerValueStartsWith(token, "gzip")) gzip = true;
+        if (!refused && tokenLength == 7 && headerValueStartsWith(token, "deflate")) deflate = true;
+    }
+    if (gzip) return COMPRESS_GZIP;
+    if (deflate) return COMPRESS_ZLIB;
+    return -1;
+}
+
+// ==================== 静态资源 ====================
+// 前端页面由服务器直接提供，页面和API同源，共用一条长连接，也不再需要CORS预检。
+// 文件用mapFileReadOnly映射后直接发送，压缩版本在映射时生成一次；
+// ETag是内容的哈希（强校验），浏览器带If-None-Match重新验证时回复304
+
+#define STATIC_CACHE_CONTROL "public, max-age=86400"
+#define STATIC_CHECK_INTERVAL 1.0    // 检查文件是否被修改的最小间隔（秒）
+
+typedef struct StaticAsset {
+    const char* path;                // URL路径
+    const char* alias;               // 同一文件的另一个路径（可为NULL）
+    const char* file;                // 相对于工作目录的文件名
+    const char* contentType;
+    const unsigned char* data;       // 文件映射，未加载时为NULL
+    size_t size;
+    time_t modified;                 // 映射时文件的修改时间
+    double checkedAt;                // 上次检查文件的时间
+    char etag[24];                   // 带引号的内容哈希
+    unsigned char* encoded[2];       // 按COMPRESS_GZIP/COMPRESS_ZLIB压缩的内容
+    size_t encodedLength[2];
+} StaticAsset;
+
+static StaticAsset staticAssets[] = {
+    {"/", "/byow.html", "byow.html", "text/html; charset=utf-8", NULL, 0, 0, 0.0, "", {NULL, NULL}, {0, 0}},
+};
+#define STATIC_ASSET_COUNT ((int)(sizeof(staticAssets) / sizeof(staticAssets[0])))
+
+static StaticAsset* findStaticAsset(const char* path) {
+    for (int i = 0; i < STATIC_ASSET_COUNT; i++) {
+        if (strcmp(path, staticAssets[i].path) == 0) return &staticAssets[i];
+        if (staticAssets[i].alias && strcmp(path, staticAssets[i].alias) == 0) return &staticAssets[i];
+    }
+    return NULL;
+}
+
+static void unloadStaticAsset(StaticAsset* asset) {
+    unmapFile(asset->data, asset->size);
+    free(asset->encoded[COMPRESS_GZIP]);
+    free(asset->encoded[COMPRESS_ZLIB]);
+    asset->data = NULL;
+    asset->size = 0;
+    asset->encoded[COMPRESS_GZIP] = NULL;
+    asset->encoded[COMPRESS_ZLIB] = NULL;
+}
+
+// 保证映射是文件的当前内容：首次访问时加载，之后每隔一段时间检查修改时间和大小，变化时重新加载
+static bool loadStaticAsset(StaticAsset* asset) {
+    double now = getMonotonicTime();
+    if (asset->data && now - asset->checkedAt < STATIC_CHECK_INTERVAL) return true;
+    asset->checkedAt = now;
+
+    struct stat st;
+    if (stat(asset->file, &st) != 0) {
+        unloadStaticAsset(asset);
+        return false;
+    }
+    if (asset->data && st.st_mtime == asset->modified && (size_t)st.st_size == asset->size) return true;
+
+    unloadStaticAsset(asset);
+    asset->data = mapFileReadOnly(asset->file, &asset->size);
+    if (!asset->data) return false;
+    asset->modified = st.st_mtime;
+
+    // FNV-1a 64位
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < asset->size; i++) {
+        hash ^= asset->data[i];
+        hash *= 1099511628211ULL;
+    }
+    snprintf(asset->etag, sizeof(asset->etag), "\"%016llx\"", hash);
+
+    for (int format = COMPRESS_GZIP; format <= COMPRESS_ZLIB; format++) {
+        asset->encoded[format] = compressData(asset->data, asset->size, format, &asset->encodedLength[format]);
+        if (asset->encoded[format] && asset->encodedLength[format] >= asset->size) {
+            free(asset->encoded[format]);
+            asset->encoded[format] = NULL;
+        }
+    }
+    return true;
+}
+
+// If-None-Match中是否有etag（或"*"）；按弱比较，W/前缀不影响结果
+static bool matchesIfNoneMatch(const char* request, const char* etag) {
+    const char* value = findHeaderValue(request, "if-none-match:");
+    if (!value) return false;
+    size_t etagLength = strlen(etag);
+    for (const char* p = value; *p != '\r' && *p != '\0'; p++) {
+        if (*p == '*') return true;
+        if (strncmp(p, etag, etagLength) == 0) return true;
+    }
+    return false;
+}
+
+void handleStaticAsset(int clientSocket, const char* request, StaticAsset* asset) {
+    if (!loadStaticAsset(asset)) {
+        sendErrorResponse(clientSocket, "Not found");
+        return;
+    }
+
+    // 同一资源的不同编码是不同的字节，强ETag也要不同
+    int encoding = requestEncoding >= 0 && asset->encoded[requestEncoding] ? requestEncoding : -1;
+    char etag[40];
+    if (encoding >= 0) {
+        snprintf(etag, sizeof(etag), "%.*s-%s\"", (int)strlen(asset->etag) - 1, asset->etag,
+                 contentEncodingNames[encoding]);
+    } else {
+        snprintf(etag, sizeof(etag), "%s", asset->etag);
+    }
+
+    char headers[160];
+    snprintf(headers, sizeof(headers), "ETag: %s\r\nCache-Control: %s\r\n", etag, STATIC_CACHE_CONTROL);
+    if (matchesIfNoneMatch(request, etag)) {
+        // 304不带响应体（Content-Length若写0会与200的长度不一致），sendHttpBody不会自动加Vary
+        snprintf(headers + strlen(headers), sizeof(headers) - strlen(headers), "Vary: Accept-Encoding\r\n");
+        sendHttpBody(clientSocket, 304, NULL, headers, "", 0, NULL, 0, false);
+        return;
+    }
+    sendHttpBody(clientSocket, 200, asset->contentType, headers, (const char*)asset->data, asset->size,
+                 encoding >= 0 ? asset->encoded[encoding] : NULL, encoding >= 0 ? asset->encodedLength[encoding] : 0,
+                 true);
+}
+
+// ==================== API处理函数 ====================
+
+// 读取查询参数的字符串值（到'&'或结尾为止），不存在返回false
+static bool getQueryValue(const char* queryString, const char* key, char* value, size_t valueSize) {
+    if (!queryString || !key || !value || valueSize == 0) return false;
+
+    const char* found = strstr(queryString, key);
+    if (!found) return false;
+    found += strlen(key);
+
+    size_t len = 0;
+    while (found[len] != '\0' && found[len] != '&' && len < valueSize - 1) {
+        value[len] = found[len];
+        len++;
+    }
+    value[len] = '\0';
+    return true;
+}
+
+// 是否请求战争迷雾模式（fog=1）
+static bool isFogRequested(const char* queryString) {
+    char value[4];
+    return getQueryValue(queryString, "fog=", value, sizeof(value)) && strcmp(value, "1") == 0;
+}
+
+// 非默认的走廊宽度和样式写成JSON字段（以逗号结尾），默认时为空串，与getWorldJSON一致
+static void formatCorridorShape(int corridorWidth, int corridorStyle, char* out, size_t size) {
+    out[0] = '\0';
+    if (corridorWidth != 1 || corridorStyle != CORRIDOR_STYLE_HV) {
+        snprintf(out, size, "\"corridorWidth\":%d,\"corridorStyle\":\"%s\",",
+                 corridorWidth, getCorridorStyleName(corridorStyle));
+    }
+}
+
+// 战争迷雾模式下的世界信息：不含地图、房间和走廊，瓦片只按探索进度通过WebSocket下发
+static void sendFogWorldResponse(int clientSocket, World* world) {
+    char json[320];
+    char shape[64];
+    formatCorridorShape(world->corridorWidth, world->corridorStyle, shape, sizeof(shape));
+    snprintf(json, sizeof(json),
+        "{\"seed\":%ld,\"width\":%d,\"height\":%d,\"mode\":\"%s\",\"roomCount\":%d,\"corridorCount\":%d,%s\"fog\":true}",
+        world->seed, world->width, world->height, getGeneratorModeName(world->mode),
+        world->roomCount, world->corridorCount, shape);
+    sendJsonResponse(clientSocket, json);
+}
+
+void handleGenerateWorld(int clientSocket, const char* queryString) {
+    long seed = 0;
+    int width = 80;
+    int height = 50;
+    int mode = GEN_MODE_ROOMS;
+    int corridorWidth = 1;
+    int corridorStyle = CORRIDOR_STYLE_HV;
+    
+    // 解析查询参数
+    if (queryString) {
+        char* seedStr = strstr(queryString, "seed=");
+        char* widthStr = strstr(queryString, "width=");
+        char* heightStr = strstr(queryString, "height=");
+        
+        if (seedStr) {
+            seed = strtol(seedStr + 5, NULL, 10);
+        } else {
+            seed = time(NULL);  // 使用当前时间作为种子
+        }
+        
+        if (widthStr) {
+            width = atoi(widthStr + 6);
+            if (width < 20) width = 20;
+            if (width > MAX_WORLD_WIDTH) width = MAX_WORLD_WIDTH;
+        }
+        
+        if (heightStr) {
+            height = atoi(heightStr + 7);
+            if (height < 20) height = 20;
+            if (height > MAX_WORLD_HEIGHT) height = MAX_WORLD_HEIGHT;
+        }
+        
+        char modeName[32];
+        if (getQueryValue(queryString, "mode=", modeName, sizeof(modeName))) {
+            mode = parseGeneratorMode(modeName);
+            if (mode < 0) {
+                sendErrorResponse(clientSocket, "Unknown generator mode");
+                return;
+            }
+        }
+
+        // 可选的走廊宽度和样式，默认1和hv（与不带参数时生成的世界完全相同）
+        char shapeValue[16];
+        if (getQueryValue(queryString, "corridorWidth=", shapeValue, sizeof(shapeValue))) {
+            corridorWidth = atoi(shapeValue);
+            if (corridorWidth < 1 || corridorWidth > MAX_CORRIDOR_WIDTH) {
+                sendErrorResponse(clientSocket, "Invalid corridor width");
+                return;
+            }
+        }
+        if (getQueryValue(queryString, "corridorStyle=", shapeValue, sizeof(shapeValue))) {
+            corridorStyle = parseCorridorStyle(shapeValue);
+            if (corridorStyle < 0) {
+                sendErrorResponse(clientSocket, "Unknown corridor style");
+                return;
+            }
+        }
+    } else {
+        seed = time(NULL);
+    }
+    
+    // 已有世界时原地重新生成，复用World和它的内存池，不经过系统分配器
+    if (currentWorld) {
+        if (regenerateWorldWithCorridors(currentWorld, seed, width, height, mode, corridorWidth, corridorStyle) != 0) {
+            destroyWorld(currentWorld);
+            currentWorld = NULL;
+        }
+    } else {
+        currentWorld = generateWorldWithCorridors(seed, width, height, mode, corridorWidth, corridorStyle);
+    }
+    
+    if (!currentWorld) {
+        clearResponseCache();
+        sendErrorResponse(clientSocket, "Failed to generate world");
+        return;
+    }
+    bumpWorldVersion(true);
+    
+    // 新世界立即写入快照，重启后可直接恢复；后面还有排队的生成时只标记，由最后一个或定时写入
+    if (generateQueueCount > 0) {
+        snapshotDirty = true;
+    } else if (saveServerSnapshot() != 0) {
+        printf("Failed to write snapshot %s\n", SNAPSHOT_FILE);
+    }
+
+    if (isFogRequested(queryString)) {
+        sendFogWorldResponse(clientSocket, currentWorld);
+        return;
+    }
+
+    // 返回世界JSON（使用更大的缓冲区）
+    char jsonBuffer[131072];  // 128KB
+    int result = getWorldJSON(currentWorld, jsonBuffer, sizeof(jsonBuffer));
+    if (result != 0) {
+        sendErrorResponse(clientSocket, "Failed to generate JSON");
+        return;
+    }
+    sendCachedJson(clientSocket, RESPONSE_WORLD, jsonBuffer);
+}
+
+void handleGetWorld(int clientSocket, const char* queryString) {
+    if (isFogRequested(queryString)) {
+        if (getCurrentWorld()) {
+            sendFogWorldResponse(clientSocket, currentWorld);
+        } else {
+            sendErrorResponse(clientSocket, "No world generated yet");
+        }
+        return;
+    }
+
+    // 重启后尚未还原世界时，直接返回快照中的预渲染JSON
+    const SnapshotEntry* snapshotWorld = findSnapshotEntry(SNAPSHOT_WORLD, 0, 0);
+    if (!currentWorld && snapshotWorld) {
+        sendJsonResponse(clientSocket, (const char*)snapshotData + snapshotWorld->jsonOffset);
+        return;
+    }
+    if (!currentWorld) {
+        sendErrorResponse(clientSocket, "No world generated yet");
+        return;
+    }
+    CachedResponse* cached = findCachedResponse(RESPONSE_WORLD);
+    if (cached) {
+        sendCachedResponse(clientSocket, cached);
+        return;
+    }
+    
+    char jsonBuffer[131072];  // 128KB
+    int result = getWorldJSON(currentWorld, jsonBuffer, sizeof(jsonBuffer));
+    if (result != 0) {
+        sendErrorResponse(clientSocket, "Failed to generate JSON");
+        return;
+    }
+    sendCachedJson(clientSocket, RESPONSE_WORLD, jsonBuffer);
+}
+
+void handleGetRooms(int clientSocket) {
+    if (!getCurrentWorld()) {
+        sendErrorResponse(clientSocket, "No world generated yet");
+        return;
+    }
+    
+    char jsonBuffer[8192];
+    getRoomsJSON(currentWorld, jsonBuffer, sizeof(jsonBuffer));
+    sendJsonResponse(clientSocket, jsonBuffer);
+}
+
+void handleGetCorridors(int clientSocket) {
+    if (!getCurrentWorld()) {
+        sendErrorResponse(clientSocket, "No world generated yet");
+        return;
+    }
+    
+    char jsonBuffer[8192];
+    getCorridorsJSON(currentWorld, jsonBuffer, sizeof(jsonBuffer));
+    sendJsonResponse(clientSocket, jsonBuffer);
+}
+
+void handleGetMap(int clientSocket) {
+    if (!getCurrentWorld()) {
+        sendErrorResponse(clientSocket, "No world generated yet");
+        return;
+    }
+    
+    CachedResponse* cached = findCachedResponse(RESPONSE_MAP);
+    if (cached) {
+        sendCachedResponse(clientSocket, cached);
+        return;
+    }
+    
+    char jsonBuffer[16384];
+    getWorldMapJSON(currentWorld, jsonBuffer, sizeof(jsonBuffer));
+    sendCachedJson(clientSocket, RESPONSE_MAP, jsonBuffer);
+}
+
+void handleFindPath(int clientSocket, const char* queryString) {
+    if (!getCurrentWorld()) {
+        sendErrorResponse(clientSocket, "No world generated yet");
+        return;
+    }
+    
+    int startRoomId = -1;
+    int endRoomId = -1;
+    
+    // 解析查询参数：start/end为房间ID，也可以用fromX/fromY/toX/toY给出坐标，按归属平面换成房间
+    if (queryString) {
+        char* startStr = strstr(queryString, "start=");
+        char* endStr = strstr(queryString, "end=");
+        char* fromXStr = strstr(queryString, "fromX=");
+        char* fromYStr = strstr(queryString, "fromY=");
+        char* toXStr = strstr(queryString, "toX=");
+        char* toYStr = strstr(queryString, "toY=");
+        
+        if (startStr) startRoomId = atoi(startStr + 6);
+        if (endStr) endRoomId = atoi(endStr + 4);
+        if (fromXStr && fromYStr) startRoomId = roomAt(currentWorld, atoi(fromXStr + 6), atoi(fromYStr + 6));
+        if (toXStr && toYStr) endRoomId = roomAt(currentWorld, atoi(toXStr + 4), atoi(toYStr + 4));
+    }
+    
+    if (startRoomId < 0 || endRoomId < 0 || 
+        startRoomId >= currentWorld->roomCount || 
+        endRoomId >= currentWorld->roomCount) {
+        sendErrorResponse(clientSocket, "Invalid room IDs");
+        return;
+    }
+    
+    int path[MAX_ROOMS];
+    int pathLength = findShortestPath(currentWorld, startRoomId, endRoomId, path, MAX_ROOMS);
+    
+    if (pathLength < 0) {
+        sendErrorResponse(clientSocket, "Path not found");
+        return;
+    }
+    
+    // 构建JSON响应
+    char jsonBuffer[2048];
+    int pos = snprintf(jsonBuffer, sizeof(jsonBuffer), "{\"path\":[");
+    for (int i = 0; i < pathLength; i++) {
+        if (i > 0) pos += snprintf(jsonBuffer + pos, sizeof(jsonBuffer) - pos, ",");
+        pos += snprintf(jsonBuffer + pos, sizeof(jsonBuffer) - pos, "%d", path[i]);
+    }
+    pos += snprintf(jsonBuffer + pos, sizeof(jsonBuffer) - pos, "],\"length\":%d}", pathLength);
+    sendJsonResponse(clientSocket, jsonBuffer);
+}
+
+// 查询格子归属：/api/roomAt?x=&y=，room/corridor为-1表示不在房间/走廊内
+void handleRoomAt(int clientSocket, const char* queryString) {
+    if (!getCurrentWorld()) {
+        sendErrorResponse(clientSocket, "No world generated yet");
+        return;
+    }
+
+    int x = -1;
+    int y = -1;
+    if (queryString) {
+        char* xStr = strstr(queryString, "x=");
+        char* yStr = strstr(queryString, "y=");
+        if (xStr) x = atoi(xStr + 2);
+        if (yStr) y = atoi(yStr + 2);
+    }
+
+    if (!isValidPosition(currentWorld, x, y)) {
+        sendErrorResponse(clientSocket, "Invalid position");
+        return;
+    }
+
+    char jsonBuffer[128];
+    snprintf(jsonBuffer, sizeof(jsonBuffer), "{\"x\":%d,\"y\":%d,\"tile\":%d,\"room\":%d,\"corridor\":%d}",
+             x, y, getTile(currentWorld, x, y), roomAt(currentWorld, x, y), corridorAt(currentWorld, x, y));
+    sendJsonResponse(clientSocket, jsonBuffer);
+}
+
+// 当前世界内存池的使用统计：/api/arena
+void handleGetArena(int clientSocket) {
+    if (!getCurrentWorld()) {
+        sendErrorResponse(clientSocket, "No world generated yet");
+        return;
+    }
+
+    ArenaStats stats;
+    getWorldArenaStats(currentWorld, &stats);
+
+    char jsonBuffer[256];
+    snprintf(jsonBuffer, sizeof(jsonBuffer),
+             "{\"capacity\":%zu,\"used\":%zu,\"peak\":%zu,\"blocks\":%d,"
+             "\"allocations\":%lld,\"systemAllocations\":%lld,\"resets\":%lld}",
+             stats.capacity, stats.used, stats.peak, stats.blocks,
+             stats.allocations, stats.systemAllocations, stats.resets);
+    sendJsonResponse(clientSocket, jsonBuffer);
+}
+
+// 导出追踪事件：/api/trace[?enable=0|1][&clear=1]
+// 返回Chrome trace_event格式，保存为文件后可用chrome://tracing或Perfetto打开；
+// enable开启或关闭记录，clear在导出后丢弃已导出的事件
+void handleGetTrace(int clientSocket, const char* queryString) {
+    char value[4];
+    char* json = getTraceJSON();
+    if (!json) {
+        sendErrorResponse(clientSocket, "Failed to export trace");
+        return;
+    }
+    sendJsonResponse(clientSocket, json);
+    free(json);
+
+    if (getQueryValue(queryString, "clear=", value, sizeof(value)) && strcmp(value, "1") == 0) {
+        clearTrace();
+    }
+    if (getQueryValue(queryString, "enable=", value, sizeof(value))) {
+        setTraceEnabled(strcmp(value, "0") != 0);
+    }
+}
+
+// 获取无限世界中的区块：/api/chunk?seed=&cx=&cy=[&px=&py=]
+// px/py为玩家所在区块，提供时淘汰离玩家过远的区块
+void handleGetChunk(int clientSocket, const char* queryString) {
+    World* world = getCurrentWorld();
+    long seed = world ? world->seed : 0;
+    int chunkX = 0;
+    int chunkY = 0;
+
+    if (queryString) {
+        char* seedStr = strstr(queryString, "seed=");
+        char* cxStr = strstr(queryString, "cx=");
+        char* cyStr = strstr(queryString, "cy=");
+
+        if (seedStr) seed = strtol(seedStr + 5, NULL, 10);
+        if (cxStr) chunkX = atoi(cxStr + 3);
+        if (cyStr) chunkY = atoi(cyStr + 3);
+    }
+
+    // 种子变化时整个缓存失效
+    if (chunkCache && chunkCache->seed != seed) {
+        destroyChunkCache(chunkCache);
+        chunkCache = NULL;
+    }
+    if (!chunkCache) {
+        chunkCache = createChunkCache(seed, CHUNK_VIEW_RADIUS);
+        if (!chunkCache) {
+            sendErrorResponse(clientSocket, "Failed to create chunk cache");
+            return;
+        }
+    }
+
+    if (queryString) {
+        char* pxStr = strstr(queryString, "px=");
+        char* pyStr = strstr(queryString, "py=");
+        if (pxStr && pyStr) {
+            updateChunkCenter(chunkCache, atoi(pxStr + 3), atoi(pyStr + 3));
+        }
+    }
+
+    // 缓存中没有、但快照里有的区块直接返回快照中的JSON，不再生成
+    const SnapshotEntry* snapshotChunk = findSnapshotEntry(SNAPSHOT_CHUNK, chunkX, chunkY);
+    if (snapshotChunk && getSnapshotHeader()->chunkSeed == seed &&
+        !isChunkInCache(chunkCache, chunkX, chunkY)) {
+        sendJsonResponse(clientSocket, (const char*)snapshotData + snapshotChunk->jsonOffset);
+        return;
+    }
+
+    if (!isChunkInCache(chunkCache, chunkX, chunkY)) snapshotDirty = true;
+    ChunkEntry* entry = getChunk(chunkCache, chunkX, chunkY);
+    if (!entry) {
+        sendErrorResponse(clientSocket, "Failed to generate chunk");
+        return;
+    }
+
+    char jsonBuffer[65536];
+    if (getChunkJSON(entry, jsonBuffer, sizeof(jsonBuffer)) != 0) {
+        sendErrorResponse(clientSocket, "Failed to generate JSON");
+        return;
+    }
+    sendJsonResponse(clientSocket, jsonBuffer);
+}
+
+// 获取POST请求体（请求头之后的部分）
+static const char* getPostBody(const char* request) {
+    const char* bodyStart = strstr(request, "\r\n\r\n");
+    return bodyStart ? bodyStart + 4 : "";
+}
+
+// 由查询参数player和slot组成存档键，只允许字母、数字、'-'和'_'
+static bool getSaveKey(const char* queryString, char* key, size_t keySize) {
+    char player[32] = "local";
+    char slot[16] = "1";
+    getQueryValue(queryString, "player=", player, sizeof(player));
+    getQueryValue(queryString, "slot=", slot, sizeof(slot));
+
+    const char* parts[2] = {player, slot};
+    for (int i = 0; i < 2; i++) {
+        if (parts[i][0] == '\0') return false;
+        for (const char* c = parts[i]; *c; c++) {
+            if (!isalnum((unsigned char)*c) && *c != '-' && *c != '_') return false;
+        }
+    }
+    snprintf(key, keySize, "%s/%s", player, slot);
+    return true;
+}
+
+// 存档内容：世界参数和输入序列（inputs指向原JSON内部，不以'\0'结尾）
+typedef struct SaveGameInfo {
+    long seed;
+    int width, height, mode;
+    const char* inputs;
+    size_t inputLength;
+    int corridorWidth, corridorStyle; // 生成世界时的走廊宽度和样式，没有时为1和hv
+    int playerX, playerY;            // 客户端报告的位置，没有时为-1
+} SaveGameInfo;
+
+// 定位JSON字段 "key": 之后的值（允许冒号两侧有空白）
+static const char* findJsonValue(const char* json, const char* key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char* found = strstr(json, pattern);
+    if (!found) return NULL;
+    found += strlen(pattern);
+    while (isspace((unsigned char)*found)) found++;
+    if (*found != ':') return NULL;
+    found++;
+    while (isspace((unsigned char)*found)) found++;
+    return found;
+}
+
+// 读取JSON中的数值字段 "key":123
+static bool getJsonNumber(const char* json, const char* key, long long* value) {
+    const char* found = findJsonValue(json, key);
+    if (!found) return false;
+    *value = strtoll(found, NULL, 10);
+    return true;
+}
+
+// 读取JSON中的字符串字段 "key":"..."（不处理转义），返回内容起点
+static const char* getJsonString(const char* json, const char* key, size_t* length) {
+    const char* found = findJsonValue(json, key);
+    if (!found || *found != '"') return NULL;
+    found++;
+    const char* end = strchr(found, '"');
+    if (!end) return NULL;
+    *length = (size_t)(end - found);
+    return found;
+}
+
+static bool parseSaveGame(const char* json, SaveGameInfo* info) {
+    long long value;
+    if (!getJsonNumber(json, "seed", &value)) return false;
+    info->seed = (long)value;
+    info->width = getJsonNumber(json, "width", &value) ? (int)value : 80;
+    info->height = getJsonNumber(json, "height", &value) ? (int)value : 50;
+
+    size_t modeLength = 0;
+    const char* modeName = getJsonString(json, "mode", &modeLength);
+    char mode[16] = "rooms";
+    if (modeName && modeLength < sizeof(mode)) {
+        memcpy(mode, modeName, modeLength);
+        mode[modeLength] = '\0';
+    }
+    info->mode = parseGeneratorMode(mode);
+    if (info->mode < 0) return false;
+
+    info->corridorWidth = getJsonNumber(json, "corridorWidth", &value) ? (int)value : 1;
+    if (info->corridorWidth < 1 || info->corridorWidth > MAX_CORRIDOR_WIDTH) return false;
+    size_t styleLength = 0;
+    const char* styleName = getJsonString(json, "corridorStyle", &styleLength);
+    char style[8] = "hv";
+    if (styleName && styleLength < sizeof(style)) {
+        memcpy(style, styleName, styleLength);
+        style[styleLength] = '\0';
+    }
+    info->corridorStyle = parseCorridorStyle(style);
+    if (info->corridorStyle < 0) return false;
+
+    info->playerX = getJsonNumber(json, "playerX", &value) ? (int)value : -1;
+    info->playerY = getJsonNumber(json, "playerY", &value) ? (int)value : -1;
+
+    info->inputs = getJsonString(json, "inputSequence", &info->inputLength);
+    if (!info->inputs) {
+        info->inputs = "";
+        info->inputLength = 0;
+    }
+    // 只接受移动键，保证写回存档时不需要转义
+    for (size_t i = 0; i < info->inputLength; i++) {
+        if (!strchr("wasdWASD", info->inputs[i])) return false;
+    }
+    return true;
+}
+
+// 读取存档中的检查点 "checkpoints":[[下标,x,y],...]
+static int parseSaveCheckpoints(const char* json, PlayerState* checkpoints, int maxCheckpoints) {
+    const char* p = strstr(json, "\"checkpoints\":[");
+    if (!p) return 0;
+    p += strlen("\"checkpoints\":[");
+
+    int count = 0;
+    while (*p == '[' && count < maxCheckpoints) {
+        char* end;
+        PlayerState* checkpoint = &checkpoints[count];
+        checkpoint->inputIndex = strtoll(p + 1, &end, 10);
+        if (*end != ',') break;
+        checkpoint->x = (int)strtol(end + 1, &end, 10);
+        if (*end != ',') break;
+        checkpoint->y = (int)strtol(end + 1, &end, 10);
+        if (*end != ']') break;
+        count++;
+        p = end + 1;
+        if (*p == ',') p++;
+    }
+    return count;
+}
+
+// 重放用的世界：与当前世界参数一致且未被修改时直接使用，否则临时生成（*temporary置为true）。
+// 存档只记录种子和输入，读档时客户端也按种子重新生成世界，所以总是在未修改的地形上重放
+static World* getReplayWorld(const SaveGameInfo* info, bool* temporary) {
+    World* world = getCurrentWorld();
+    *temporary = false;
+    if (world && worldEdits == 0 && world->seed == info->seed && world->width == info->width &&
+        world->height == info->height && world->mode == info->mode &&
+        world->corridorWidth == info->corridorWidth && world->corridorStyle == info->corridorStyle) {
+        return world;
+    }
+    *temporary = true;
+    return generateWorldWithCorridors(info->seed, info->width, info->height, info->mode,
+                                      info->corridorWidth, info->corridorStyle);
+}
+
+// 从不晚于输入末尾的最后一个检查点恢复（没有检查点时从出生点开始），重放剩余输入
+static bool resumeFromCheckpoint(World* world, const SaveGameInfo* info,
+                                 const PlayerState* checkpoints, int count, PlayerState* state) {
+    while (count > 0 && checkpoints[count - 1].inputIndex > (long long)info->inputLength) count--;
+    if (count > 0) {
+        *state = checkpoints[count - 1];
+    } else if (initPlayerState(world, state) != 0) {
+        return false;
+    }
+    applyInputs(world, state, info->inputs + state->inputIndex, info->inputLength - (size_t)state->inputIndex);
+    return true;
+}
+
+// 保存游戏：由服务端重放输入并生成检查点（新序列延续上一份存档时从其最后一个检查点继续），
+// 追加到存档存储后暂不回复，由主循环在组提交（一次fsync）之后统一回复
+void handleSaveGame(int clientSocket, const char* queryString, const char* requestBody) {
+    char key[SAVE_KEY_MAX];
+    SaveGameInfo info;
+    if (!getSaveKey(queryString, key, sizeof(key))) {
+        sendErrorResponse(clientSocket, "Invalid player or slot");
+        return;
+    }
+    if (!saveStore || !parseSaveGame(requestBody, &info)) {
+        sendErrorResponse(clientSocket, "Invalid save data");
+        return;
+    }
+
+    bool temporary;
+    World* world = getReplayWorld(&info, &temporary);
+    PlayerState* checkpoints = (PlayerState*)malloc(MAX_SAVE_CHECKPOINTS * sizeof(PlayerState));
+    PlayerState state;
+    if (!world || !checkpoints || initPlayerState(world, &state) != 0) {
+        if (temporary) destroyWorld(world);
+        free(checkpoints);
+        sendErrorResponse(clientSocket, "Failed to replay inputs");
+        return;
+    }
+
+    int count = 0;
+    char* previous = NULL;
+    SaveGameInfo previousInfo;
+    if (getSave(saveStore, key, &previous, NULL) == 0 && parseSaveGame(previous, &previousInfo) &&
+        previousInfo.seed == info.seed && previousInfo.width == info.width &&
+        previousInfo.height == info.height && previousInfo.mode == info.mode &&
+        previousInfo.corridorWidth == info.corridorWidth && previousInfo.corridorStyle == info.corridorStyle &&
+        previousInfo.inputLength <= info.inputLength &&
+        memcmp(previousInfo.inputs, info.inputs, previousInfo.inputLength) == 0) {
+        count = parseSaveCheckpoints(previous, checkpoints, MAX_SAVE_CHECKPOINTS);
+        while (count > 0 && checkpoints[count - 1].inputIndex > (long long)previousInfo.inputLength) count--;
+        if (count > 0) state = checkpoints[count - 1];
+    }
+    free(previous);
+    count += replayInputs(world, &state, info.inputs, info.inputLength,
+                          checkpoints + count, MAX_SAVE_CHECKPOINTS - count);
+    if (temporary) destroyWorld(world);
+
+    // 玩家走过被setTile修改的格子时，按种子重放得到的位置与客户端不同，这样的存档读回来不对，拒绝
+    if (info.playerX >= 0 && (state.x != info.playerX || state.y != info.playerY)) {
+        free(checkpoints);
+        sendErrorResponse(clientSocket, "Save does not match the generated world (tiles were edited)");
+        return;
+    }
+
+    size_t recordSize = 256 + info.inputLength + (size_t)count * 48;
+    char* record = (char*)malloc(recordSize);
+    int pos = 0;
+    int status = record ? 0 : -1;
+    char shape[64];
+    formatCorridorShape(info.corridorWidth, info.corridorStyle, shape, sizeof(shape));
+    if (status == 0) {
+        status = snprintf(record, recordSize,
+            "{\"seed\":%ld,\"width\":%d,\"height\":%d,\"mode\":\"%s\",%s\"inputCount\":%zu,\"inputSequence\":\"%.*s\",\"checkpoints\":[",
+            info.seed, info.width, info.height, getGeneratorModeName(info.mode), shape, info.inputLength,
+            (int)info.inputLength, info.inputs) < (int)recordSize ? 0 : -1;
+        pos = (int)strlen(record);
+    }
+    for (int i = 0; status == 0 && i < count; i++) {
+        pos += snprintf(record + pos, recordSize - pos, "%s[%lld,%d,%d]", i > 0 ? "," : "",
+                        checkpoints[i].inputIndex, checkpoints[i].x, checkpoints[i].y);
+    }
+    if (status == 0) pos += snprintf(record + pos, recordSize - pos, "]}");
+    free(checkpoints);
+
+    if (status != 0 || putSave(saveStore, key, record, (size_t)pos) != 0) {
+        free(record);
+        sendErrorResponse(clientSocket, "Failed to write save");
+        return;
+    }
+    free(record);
+    pendingSaveSockets[pendingSaveCount++] = clientSocket;
+}
+
+// 组提交所有待确认的存档，然后逐个回复并关闭连接
+static void commitPendingSaves(void) {
+    bool ok = flushSaveStore(saveStore) == 0;
+    requestKeepAlive = false;
+    for (int i = 0; i < pendingSaveCount; i++) {
+        if (ok) {
+            sendJsonResponse(pendingSaveSockets[i], "{\"status\":\"saved\"}");
+        } else {
+            sendErrorResponse(pendingSaveSockets[i], "Failed to write save");
+        }
+        close(pendingSaveSockets[i]);
+    }
+    pendingSaveCount = 0;
+}
+
+// 加载游戏：从最后一个检查点恢复并重放剩余输入，只返回最终状态（客户端不再逐步重放）。
+// 输入序列由客户端在保存时自己留一份；本地没有副本时带inputs=1再取一次
+void handleLoadGame(int clientSocket, const char* queryString) {
+    char key[SAVE_KEY_MAX];
+    if (!getSaveKey(queryString, key, sizeof(key))) {
+        sendErrorResponse(clientSocket, "Invalid player or slot");
+        return;
+    }
+
+    char* data = NULL;
+    if (!saveStore || getSave(saveStore, key, &data, NULL) != 0) {
+        sendErrorResponse(clientSocket, "No save file found");
+        return;
+    }
+
+    SaveGameInfo info;
+    bool temporary = false;
+    World* world = NULL;
+    PlayerState* checkpoints = (PlayerState*)malloc(MAX_SAVE_CHECKPOINTS * sizeof(PlayerState));
+    PlayerState state;
+    bool ok = checkpoints && parseSaveGame(data, &info) && (world = getReplayWorld(&info, &temporary)) != NULL &&
+              resumeFromCheckpoint(world, &info, checkpoints,
+                                   parseSaveCheckpoints(data, checkpoints, MAX_SAVE_CHECKPOINTS), &state);
+    if (temporary) destroyWorld(world);
+    free(checkpoints);
+
+    char includeInputs[4] = "";
+    getQueryValue(queryString, "inputs=", includeInputs, sizeof(includeInputs));
+    size_t inputLength = strcmp(includeInputs, "1") == 0 ? info.inputLength : 0;
+    size_t responseSize = ok ? 256 + inputLength : 0;
+    char* response = ok ? (char*)malloc(responseSize) : NULL;
+    if (!response) {
+        free(data);
+        sendErrorResponse(clientSocket, "Failed to load save");
         return;
     }
-    sendJsonResponse(clientSocket, jsonBuffer);
+    char shape[64];
+    formatCorridorShape(info.corridorWidth, info.corridorStyle, shape, sizeof(shape));
+    int pos = snprintf(response, responseSize,
+        "{\"seed\":%ld,\"width\":%d,\"height\":%d,\"mode\":\"%s\",%s\"playerX\":%d,\"playerY\":%d,\"inputCount\":%zu",
+        info.seed, info.width, info.height, getGeneratorModeName(info.mode), shape, state.x, state.y, info.inputLength);
+    if (inputLength > 0) {
+        pos += snprintf(response + pos, responseSize - (size_t)pos, ",\"inputSequence\":\"%.*s\"",
+                        (int)inputLength, info.inputs);
+    }
+    snprintf(response + pos, responseSize - (size_t)pos, "}");
+    sendJsonResponse(clientSocket, response);
+    free(response);
+    free(data);
 }
 
-void handleGetWorld(int clientSocket) {
-    if (!currentWorld) {
-        sendErrorResponse(clientSocket, "No world generated yet");
+// 把旧版单槽存档文件导入为默认槽位（仅当默认槽位还没有存档时）
+static void importLegacySave(void) {
+    char* existing = NULL;
+    if (getSave(saveStore, "local/1", &existing, NULL) == 0) {
+        free(existing);
         return;
     }
-    
-    char jsonBuffer[131072];  // 128KB
-    int result = getWorldJSON(currentWorld, jsonBuffer, sizeof(jsonBuffer));
-    if (result != 0) {
-        sendErrorResponse(clientSocket, "Failed to generate JSON");
-        return;
+
+    FILE* file = fopen(SAVE_FILE, "rb");
+    if (!file) return;
+    char* data = (char*)malloc(SAVE_MAX_SIZE);
+    size_t len = data ? fread(data, 1, SAVE_MAX_SIZE, file) : 0;
+    fclose(file);
+    if (len > 0 && putSave(saveStore, "local/1", data, len) == 0 && flushSaveStore(saveStore) == 0) {
+        printf("Imported %s into slot local/1\n", SAVE_FILE);
     }
-    sendJsonResponse(clientSocket, jsonBuffer);
+    free(data);
 }
 
-void handleGetRooms(int clientSocket) {
-    if (!currentWorld) {
-        sendErrorResponse(clientSocket, "No world generated yet");
-        return;
+// ==================== 请求统计 ====================
+// 每个处理请求的线程写自己的分片（无锁，只有该线程写入），/api/metrics抓取时合并所有分片
+
+#define METRICS_MAX_SHARDS 64  // 记录统计的线程数上限（超出的线程不记录）
+
+// 路由表：别名计入同一路由；追踪区间以处理函数命名
+typedef struct HttpRoute {
+    const char* path;
+    const char* alias;    // 旧路径，没有为NULL
+    const char* handler;
+} HttpRoute;
+
+static const HttpRoute httpRoutes[] = {
+    {"/api/generate", "/api/generateWorld", "handleGenerateWorld"},
+    {"/api/world", "/api/getWorld", "handleGetWorld"},
+    {"/api/rooms", NULL, "handleGetRooms"},
+    {"/api/corridors", NULL, "handleGetCorridors"},
+    {"/api/map", NULL, "handleGetMap"},
+    {"/api/path", "/api/findPath", "handleFindPath"},
+    {"/api/roomAt", NULL, "handleRoomAt"},
+    {"/api/arena", NULL, "handleGetArena"},
+    {"/api/trace", NULL, "handleGetTrace"},
+    {"/api/metrics", NULL, "handleGetMetrics"},
+    {"/api/chunk", NULL, "handleGetChunk"},
+    {"/api/save", NULL, "handleSaveGame"},
+    {"/api/load", NULL, "handleLoadGame"},
+    {"/", "/byow.html", "handleStaticAsset"},
+    {WS_PATH, NULL, "handleWebSocketUpgrade"},
+    {"other", NULL, "handleNotFound"},  // 未知路径
+};
+#define HTTP_ROUTE_COUNT ((int)(sizeof(httpRoutes) / sizeof(httpRoutes[0])))
+
+// 直方图桶的上界（微秒），导出为Prometheus的le标签（秒）
+static const long long metricsBucketLimits[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000
+};
+
+typedef struct RouteMetrics {
+    LatencyHistogram latency;   // 处理耗时（微秒）
+    atomic_llong requests;
+    atomic_llong errors;        // 以错误JSON回复的请求
+    atomic_llong requestBytes;
+    atomic_llong responseBytes;
+} RouteMetrics;
+
+typedef struct MetricsShard {
+    RouteMetrics routes[HTTP_ROUTE_COUNT];
+} MetricsShard;
+
+static MetricsShard* _Atomic metricsShards[METRICS_MAX_SHARDS];
+static atomic_int metricsShardCount = 0;
+static THREAD_LOCAL MetricsShard* localMetricsShard = NULL;
+static THREAD_LOCAL bool localMetricsRefused = false;
+
+static int findHttpRoute(const char* path) {
+    for (int i = 0; i < HTTP_ROUTE_COUNT - 1; i++) {
+        if (strcmp(path, httpRoutes[i].path) == 0) return i;
+        if (httpRoutes[i].alias && strcmp(path, httpRoutes[i].alias) == 0) return i;
     }
-    
-    char jsonBuffer[8192];
-    getRoomsJSON(currentWorld, jsonBuffer, sizeof(jsonBuffer));
-    sendJsonResponse(clientSocket, jsonBuffer);
+    return HTTP_ROUTE_COUNT - 1;
 }
 
-void handleGetCorridors(int clientSocket) {
-    if (!currentWorld) {
-        sendErrorResponse(clientSocket, "No world generated yet");
-        return;
+static MetricsShard* getMetricsShard(void) {
+    if (localMetricsShard || localMetricsRefused) return localMetricsShard;
+
+    int index = atomic_fetch_add(&metricsShardCount, 1);
+    // 清零的内存即所有计数为0的分片
+    MetricsShard* shard = index < METRICS_MAX_SHARDS ? (MetricsShard*)calloc(1, sizeof(MetricsShard)) : NULL;
+    if (!shard) {
+        localMetricsRefused = true;
+        return NULL;
     }
-    
-    char jsonBuffer[8192];
-    getCorridorsJSON(currentWorld, jsonBuffer, sizeof(jsonBuffer));
-    sendJsonResponse(clientSocket, jsonBuffer);
+    atomic_store(&metricsShards[index], shard);
+    localMetricsShard = shard;
+    return shard;
 }
 
-void handleGetMap(int clientSocket) {
-    if (!currentWorld) {
-        sendErrorResponse(clientSocket, "No world generated yet");
-        return;
+static void addCounter(atomic_llong* counter, long long value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+static void recordHttpRequest(int route, size_t requestBytes, long long micros) {
+    MetricsShard* shard = getMetricsShard();
+    if (!shard) return;
+
+    RouteMetrics* metrics = &shard->routes[route];
+    recordLatency(&metrics->latency, micros);
+    addCounter(&metrics->requests, 1);
+    if (requestFailed) addCounter(&metrics->errors, 1);
+    addCounter(&metrics->requestBytes, (long long)requestBytes);
+    addCounter(&metrics->responseBytes, requestResponseBytes);
+}
+
+static bool appendMetrics(char* buffer, size_t size, size_t* pos, const char* fmt, ...) {
+    if (*pos >= size) return false;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buffer + *pos, size - *pos, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= size - *pos) {
+        *pos = size;
+        return false;
     }
-    
-    char jsonBuffer[16384];
-    getWorldMapJSON(currentWorld, jsonBuffer, sizeof(jsonBuffer));
-    sendJsonResponse(clientSocket, jsonBuffer);
+    *pos += (size_t)n;
+    return true;
 }
 
-void handleFindPath(int clientSocket, const char* queryString) {
-    if (!currentWorld) {
-        sendErrorResponse(clientSocket, "No world generated yet");
+// 一个计数器指标（按路由）
+static void appendRouteCounter(char* buffer, size_t size, size_t* pos, const RouteMetrics* totals,
+                               const char* name, const char* help, size_t offset) {
+    appendMetrics(buffer, size, pos, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (int r = 0; r < HTTP_ROUTE_COUNT; r++) {
+        const atomic_llong* counter = (const atomic_llong*)((const char*)&totals[r] + offset);
+        appendMetrics(buffer, size, pos, "%s{route=\"%s\"} %lld\n", name, httpRoutes[r].path,
+                      atomic_load_explicit(counter, memory_order_relaxed));
+    }
+}
+
+// 请求统计（Prometheus文本格式）：/api/metrics
+void handleGetMetrics(int clientSocket) {
+    RouteMetrics* totals = (RouteMetrics*)calloc(HTTP_ROUTE_COUNT, sizeof(RouteMetrics));
+    size_t size = 256 * 1024;
+    char* text = (char*)malloc(size);
+    if (!totals || !text) {
+        free(totals);
+        free(text);
+        sendErrorResponse(clientSocket, "Out of memory");
         return;
     }
-    
-    int startRoomId = -1;
-    int endRoomId = -1;
-    
-    // 解析查询参数
-    if (queryString) {
-        char* startStr = strstr(queryString, "start=");
-        char* endStr = strstr(queryString, "end=");
-        
-        if (startStr) startRoomId = atoi(startStr + 6);
-        if (endStr) endRoomId = atoi(endStr + 4);
+
+    int shardCount = atomic_load(&metricsShardCount);
+    if (shardCount > METRICS_MAX_SHARDS) shardCount = METRICS_MAX_SHARDS;
+    for (int s = 0; s < shardCount; s++) {
+        MetricsShard* shard = atomic_load(&metricsShards[s]);
+        if (!shard) continue;  // 分片正在创建
+        for (int r = 0; r < HTTP_ROUTE_COUNT; r++) {
+            RouteMetrics* src = &shard->routes[r];
+            RouteMetrics* dst = &totals[r];
+            mergeLatencyHistogram(&dst->latency, &src->latency);
+            addCounter(&dst->requests, atomic_load_explicit(&src->requests, memory_order_relaxed));
+            addCounter(&dst->errors, atomic_load_explicit(&src->errors, memory_order_relaxed));
+            addCounter(&dst->requestBytes, atomic_load_explicit(&src->requestBytes, memory_order_relaxed));
+            addCounter(&dst->responseBytes, atomic_load_explicit(&src->responseBytes, memory_order_relaxed));
+        }
     }
-    
-    if (startRoomId < 0 || endRoomId < 0 || 
-        startRoomId >= currentWorld->roomCount || 
-        endRoomId >= currentWorld->roomCount) {
-        sendErrorResponse(clientSocket, "Invalid room IDs");
-        return;
+
+    size_t pos = 0;
+    appendRouteCounter(text, size, &pos, totals, "byow_http_requests_total",
+                       "HTTP requests handled.", offsetof(RouteMetrics, requests));
+    appendRouteCounter(text, size, &pos, totals, "byow_http_errors_total",
+                       "HTTP requests answered with an error.", offsetof(RouteMetrics, errors));
+    appendRouteCounter(text, size, &pos, totals, "byow_http_request_bytes_total",
+                       "Bytes received in HTTP requests.", offsetof(RouteMetrics, requestBytes));
+    appendRouteCounter(text, size, &pos, totals, "byow_http_response_bytes_total",
+                       "Bytes sent in HTTP responses.", offsetof(RouteMetrics, responseBytes));
+
+    // 直方图的桶按HDR桶上界累计，边界附近的误差在1/64以内
+    appendMetrics(text, size, &pos,
+                  "# HELP byow_http_request_duration_seconds HTTP request handling time.\n"
+                  "# TYPE byow_http_request_duration_seconds histogram\n");
+    for (int r = 0; r < HTTP_ROUTE_COUNT; r++) {
+        const LatencyHistogram* latency = &totals[r].latency;
+        for (size_t b = 0; b < sizeof(metricsBucketLimits) / sizeof(metricsBucketLimits[0]); b++) {
+            appendMetrics(text, size, &pos, "byow_http_request_duration_seconds_bucket{route=\"%s\",le=\"%g\"} %lld\n",
+                          httpRoutes[r].path, (double)metricsBucketLimits[b] / 1e6,
+                          countLatencyAtMost(latency, metricsBucketLimits[b]));
+        }
+        long long count = atomic_load_explicit(&latency->total, memory_order_relaxed);
+        double sum = (double)atomic_load_explicit(&latency->sum, memory_order_relaxed) / 1e6;
+        appendMetrics(text, size, &pos,
+                      "byow_http_request_duration_seconds_bucket{route=\"%s\",le=\"+Inf\"} %lld\n"
+                      "byow_http_request_duration_seconds_sum{route=\"%s\"} %.6f\n"
+                      "byow_http_request_duration_seconds_count{route=\"%s\"} %lld\n",
+                      httpRoutes[r].path, count, httpRoutes[r].path, sum, httpRoutes[r].path, count);
     }
-    
-    int path[MAX_ROOMS];
-    int pathLength = findShortestPath(currentWorld, startRoomId, endRoomId, path, MAX_ROOMS);
-    
-    if (pathLength < 0) {
-        sendErrorResponse(clientSocket, "Path not found");
-        return;
+
+    // 分位数直接取自HDR直方图，用于p99等告警
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    appendMetrics(text, size, &pos,
+                  "# HELP byow_http_request_latency_seconds HTTP request handling time quantiles.\n"
+                  "# TYPE byow_http_request_latency_seconds summary\n");
+    for (int r = 0; r < HTTP_ROUTE_COUNT; r++) {
+        const LatencyHistogram* latency = &totals[r].latency;
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            appendMetrics(text, size, &pos, "byow_http_request_latency_seconds{route=\"%s\",quantile=\"%g\"} %.6f\n",
+                          httpRoutes[r].path, quantiles[q],
+                          (double)getLatencyPercentile(latency, quantiles[q] * 100.0) / 1e6);
+        }
+        appendMetrics(text, size, &pos,
+                      "byow_http_request_latency_seconds_sum{route=\"%s\"} %.6f\n"
+                      "byow_http_request_latency_seconds_count{route=\"%s\"} %lld\n",
+                      httpRoutes[r].path, (double)atomic_load_explicit(&latency->sum, memory_order_relaxed) / 1e6,
+                      httpRoutes[r].path, atomic_load_explicit(&latency->total, memory_order_relaxed));
     }
-    
-    // 构建JSON响应
-    char jsonBuffer[2048];
-    int pos = snprintf(jsonBuffer, sizeof(jsonBuffer), "{\"path\":[");
-    for (int i = 0; i < pathLength; i++) {
-        if (i > 0) pos += snprintf(jsonBuffer + pos, sizeof(jsonBuffer) - pos, ",");
-        pos += snprintf(jsonBuffer + pos, sizeof(jsonBuffer) - pos, "%d", path[i]);
+
+    appendMetrics(text, size, &pos,
+                  "# HELP byow_generate_queue_depth Generate requests waiting to run.\n"
+                  "# TYPE byow_generate_queue_depth gauge\n"
+                  "byow_generate_queue_depth %d\n"
+                  "# HELP byow_admission_rejected_total Generate requests rejected by admission control.\n"
+                  "# TYPE byow_admission_rejected_total counter\n"
+                  "byow_admission_rejected_total{reason=\"rate_limited\"} %lld\n"
+                  "byow_admission_rejected_total{reason=\"queue_full\"} %lld\n",
+                  generateQueueCount, generateRejected[ADMISSION_RATE_LIMITED],
+                  generateRejected[ADMISSION_QUEUE_FULL]);
+
+    if (pos >= size) {
+        sendErrorResponse(clientSocket, "Metrics too large");
+    } else {
+        sendHttpResponse(clientSocket, 200, "text/plain; version=0.0.4", text);
     }
-    pos += snprintf(jsonBuffer + pos, sizeof(jsonBuffer) - pos, "],\"length\":%d}", pathLength);
-    sendJsonResponse(clientSocket, jsonBuffer);
+    free(text);
+    free(totals);
 }
 
-// 解析POST请求体
-void parsePostBody(const char* request, char* body, size_t bodySize) {
-    const char* bodyStart = strstr(request, "\r\n\r\n");
-    if (bodyStart) {
-        bodyStart += 4;  // 跳过 "\r\n\r\n"
-        strncpy(body, bodyStart, bodySize - 1);
-        body[bodySize - 1] = '\0';
-    } else {
-        body[0] = '\0';
+// ==================== 生成任务队列与准入控制 ====================
+// 生成世界比读请求贵得多（生成、渲染JSON、写快照）。生成请求先按客户端地址过令牌桶，
+// 再进入有界队列，由主循环在处理完已就绪的读请求之后逐个执行，读请求不会排在一串生成后面。
+// 超出速率的客户端立即得到429，队列满时立即得到503，都带Retry-After
+
+#define GENERATE_QUEUE_CAPACITY 16
+#define GENERATE_MAX_DEFER 0.05      // 读请求不断时，生成任务最多推迟的时间（秒），避免饿死
+#define GENERATE_RATE 20.0           // 每个客户端每秒补充的生成令牌数
+#define GENERATE_BURST 40.0          // 令牌桶容量（允许的突发生成数）
+#define CLIENT_BUCKETS 256           // 令牌桶表大小（按客户端地址开放寻址）
+#define CLIENT_BUCKET_PROBES 8       // 查找时最多探测的槽位数，找不到时复用其中最久未用的
+
+typedef struct GenerateJob {
+    int socket;
+    bool keepAlive;                  // 回复后连接是否回到等待集合
+    int encoding;                    // 接受的响应编码
+    unsigned long address;           // 客户端地址
+    char queryString[256];
+    size_t requestBytes;
+    double queuedAt;
+    char* pending;                   // 连接上已读到的后续请求数据，回复后随连接交回
+    size_t pendingLength;
+} GenerateJob;
+
+typedef struct ClientBucket {
+    unsigned long address;
+    bool used;
+    double tokens;
+    double updated;                  // 上次补充令牌的时间
+} ClientBucket;
+
+static GenerateJob generateQueue[GENERATE_QUEUE_CAPACITY];
+static int generateQueueHead = 0;
+static ClientBucket clientBuckets[CLIENT_BUCKETS];
+
+static ClientBucket* findClientBucket(unsigned long address, double now) {
+    unsigned long hash = (address * 2654435761UL) % CLIENT_BUCKETS;
+    ClientBucket* oldest = NULL;
+    for (int i = 0; i < CLIENT_BUCKET_PROBES; i++) {
+        ClientBucket* bucket = &clientBuckets[(hash + (unsigned long)i) % CLIENT_BUCKETS];
+        if (bucket->used && bucket->address == address) return bucket;
+        // 优先空槽，其次最久未用的槽
+        if (!oldest || (oldest->used && (!bucket->used || bucket->updated < oldest->updated))) {
+            oldest = bucket;
+        }
     }
+    // 被挤掉的客户端下次以满桶重新开始
+    oldest->used = true;
+    oldest->address = address;
+    oldest->tokens = GENERATE_BURST;
+    oldest->updated = now;
+    return oldest;
 }
 
-// 保存游戏
-void handleSaveGame(int clientSocket, const char* requestBody) {
-    FILE* file = fopen(SAVE_FILE, "w");
-    if (!file) {
-        sendErrorResponse(clientSocket, "Failed to open save file");
-        return;
+// 取一个生成令牌；没有令牌时返回false，retryAfter为补满一个令牌还需的秒数
+static bool takeGenerateToken(unsigned long address, int* retryAfter) {
+    double now = getMonotonicTime();
+    ClientBucket* bucket = findClientBucket(address, now);
+    bucket->tokens += (now - bucket->updated) * GENERATE_RATE;
+    if (bucket->tokens > GENERATE_BURST) bucket->tokens = GENERATE_BURST;
+    bucket->updated = now;
+
+    if (bucket->tokens >= 1.0) {
+        bucket->tokens -= 1.0;
+        return true;
     }
-    
-    fprintf(file, "%s", requestBody);
-    fclose(file);
-    
-    sendJsonResponse(clientSocket, "{\"status\":\"saved\"}");
+    *retryAfter = (int)((1.0 - bucket->tokens) / GENERATE_RATE) + 1;
+    return false;
 }
 
-// 加载游戏
-void handleLoadGame(int clientSocket) {
-    FILE* file = fopen(SAVE_FILE, "r");
-    if (!file) {
-        sendErrorResponse(clientSocket, "No save file found");
+// 生成请求的准入：通过时入队（请求延后完成），否则立即回复429或503
+static void admitGenerateRequest(int clientSocket, const char* queryString, size_t requestBytes) {
+    int retryAfter = 1;
+    if (!takeGenerateToken(requestClientAddress, &retryAfter)) {
+        generateRejected[ADMISSION_RATE_LIMITED]++;
+        sendRetryLaterResponse(clientSocket, 429, retryAfter, "Too many generate requests");
         return;
     }
-    
-    char buffer[4096];
-    size_t len = fread(buffer, 1, sizeof(buffer) - 1, file);
-    buffer[len] = '\0';
-    fclose(file);
-    
-    sendJsonResponse(clientSocket, buffer);
+    if (generateQueueCount == GENERATE_QUEUE_CAPACITY) {
+        generateRejected[ADMISSION_QUEUE_FULL]++;
+        sendRetryLaterResponse(clientSocket, 503, 1, "Server busy");
+        return;
+    }
+
+    GenerateJob* job = &generateQueue[(generateQueueHead + generateQueueCount) % GENERATE_QUEUE_CAPACITY];
+    job->socket = clientSocket;
+    job->keepAlive = requestKeepAlive;
+    job->encoding = requestEncoding;
+    job->address = requestClientAddress;
+    snprintf(job->queryString, sizeof(job->queryString), "%s", queryString);
+    job->requestBytes = requestBytes;
+    job->queuedAt = getMonotonicTime();
+    job->pending = NULL;
+    job->pendingLength = 0;
+    generateQueueCount++;
+    requestDeferred = true;
+}
+
+// 把连接上多读到的后续请求数据交给刚入队的生成任务（接管pending）
+static void attachGeneratePending(char* pending, size_t pendingLength) {
+    GenerateJob* job = &generateQueue[(generateQueueHead + generateQueueCount - 1) % GENERATE_QUEUE_CAPACITY];
+    job->pending = pending;
+    job->pendingLength = pendingLength;
+}
+
+// 是否该执行排队的生成任务：没有等待中的读请求，或最早的任务已推迟太久
+static bool shouldRunGenerateJob(bool requestWaiting) {
+    if (generateQueueCount == 0) return false;
+    if (!requestWaiting) return true;
+    return getMonotonicTime() - generateQueue[generateQueueHead].queuedAt >= GENERATE_MAX_DEFER;
+}
+
+// 执行队首的生成任务并回复，finished返回该任务（连接由调用者处理）
+static void runGenerateJob(GenerateJob* finished) {
+    *finished = generateQueue[generateQueueHead];
+    generateQueueHead = (generateQueueHead + 1) % GENERATE_QUEUE_CAPACITY;
+    generateQueueCount--;
+
+    requestResponseBytes = 0;
+    requestFailed = false;
+    requestKeepAlive = finished->keepAlive;
+    requestEncoding = finished->encoding;
+    TRACE_BEGIN(span);
+    handleGenerateWorld(finished->socket, finished->queryString);
+    TRACE_END(span, "handleGenerateWorld");
+
+    // 延迟从入队算起，包含排队时间
+    recordHttpRequest(findHttpRoute("/api/generate"), finished->requestBytes,
+                      (long long)((getMonotonicTime() - finished->queuedAt) * 1e6));
 }
 
 // ==================== HTTP请求解析 ====================
 
 void handleHttpRequest(int clientSocket, const char* request) {
-    char method[16];
-    char path[256];
+    char method[16] = {0};
+    char path[256] = {0};
     char queryString[256] = {0};
+    requestDeferred = false;
+    requestEncoding = getAcceptedEncoding(request);
     
     // 解析请求行
-    sscanf(request, "%s %s", method, path);
+    sscanf(request, "%15s %255s", method, path);
     
     // 提取查询字符串
     char* queryStart = strchr(path, '?');
@@ -303,15 +2594,20 @@ void handleHttpRequest(int clientSocket, const char* request) {
     }
     
     // 路由处理
+    int route = findHttpRoute(path);
+    requestResponseBytes = 0;
+    requestFailed = false;
+    double startTime = getMonotonicTime();
+    TRACE_BEGIN(span);
     if (strcmp(path, "/api/generate") == 0 || strcmp(path, "/api/generateWorld") == 0) {
         if (strcmp(method, "GET") == 0 || strcmp(method, "POST") == 0) {
-            handleGenerateWorld(clientSocket, queryString);
+            admitGenerateRequest(clientSocket, queryString, strlen(request));
         } else {
             sendErrorResponse(clientSocket, "Method not allowed");
         }
     } else if (strcmp(path, "/api/world") == 0 || strcmp(path, "/api/getWorld") == 0) {
         if (strcmp(method, "GET") == 0) {
-            handleGetWorld(clientSocket);
+            handleGetWorld(clientSocket, queryString);
         } else {
             sendErrorResponse(clientSocket, "Method not allowed");
         }
@@ -339,23 +2635,340 @@ void handleHttpRequest(int clientSocket, const char* request) {
         } else {
             sendErrorResponse(clientSocket, "Method not allowed");
         }
+    } else if (strcmp(path, "/api/roomAt") == 0) {
+        if (strcmp(method, "GET") == 0) {
+            handleRoomAt(clientSocket, queryString);
+        } else {
+            sendErrorResponse(clientSocket, "Method not allowed");
+        }
+    } else if (strcmp(path, "/api/arena") == 0) {
+        if (strcmp(method, "GET") == 0) {
+            handleGetArena(clientSocket);
+        } else {
+            sendErrorResponse(clientSocket, "Method not allowed");
+        }
+    } else if (strcmp(path, "/api/trace") == 0) {
+        if (strcmp(method, "GET") == 0) {
+            handleGetTrace(clientSocket, queryString);
+        } else {
+            sendErrorResponse(clientSocket, "Method not allowed");
+        }
+    } else if (strcmp(path, "/api/metrics") == 0) {
+        if (strcmp(method, "GET") == 0) {
+            handleGetMetrics(clientSocket);
+        } else {
+            sendErrorResponse(clientSocket, "Method not allowed");
+        }
+    } else if (strcmp(path, "/api/chunk") == 0) {
+        if (strcmp(method, "GET") == 0) {
+            handleGetChunk(clientSocket, queryString);
+        } else {
+            sendErrorResponse(clientSocket, "Method not allowed");
+        }
     } else if (strcmp(path, "/api/save") == 0) {
         if (strcmp(method, "POST") == 0) {
-            char body[4096];
-            parsePostBody(request, body, sizeof(body));
-            handleSaveGame(clientSocket, body);
+            handleSaveGame(clientSocket, queryString, getPostBody(request));
         } else {
             sendErrorResponse(clientSocket, "Method not allowed");
         }
     } else if (strcmp(path, "/api/load") == 0) {
         if (strcmp(method, "GET") == 0) {
-            handleLoadGame(clientSocket);
+            handleLoadGame(clientSocket, queryString);
+        } else {
+            sendErrorResponse(clientSocket, "Method not allowed");
+        }
+    } else if (strcmp(path, WS_PATH) == 0) {
+        if (strcmp(method, "GET") == 0) {
+            handleWebSocketUpgrade(clientSocket, request);
+        } else {
+            sendErrorResponse(clientSocket, "Method not allowed");
+        }
+    } else if (findStaticAsset(path)) {
+        if (strcmp(method, "GET") == 0) {
+            handleStaticAsset(clientSocket, request, findStaticAsset(path));
         } else {
             sendErrorResponse(clientSocket, "Method not allowed");
         }
     } else {
         sendErrorResponse(clientSocket, "Not found");
     }
+    // 转入生成队列的请求在执行完后才记录
+    if (!requestDeferred) {
+        TRACE_END(span, httpRoutes[route].handler);
+        recordHttpRequest(route, strlen(request), (long long)((getMonotonicTime() - startTime) * 1e6));
+    }
+}
+
+// 请求头中的Content-Length（不区分大小写），没有时为0
+static long getContentLength(const char* request) {
+    const char* value = findHeaderValue(request, "content-length:");
+    return value ? strtol(value, NULL, 10) : 0;
+}
+
+// data（以'\0'结尾）开头第一个完整请求的长度：请求头以及Content-Length指定的请求体。
+// 还没收全时返回0，请求过大或Content-Length无效时返回-1
+static long getHttpRequestLength(const char* data, size_t length) {
+    const char* headerEnd = strstr(data, "\r\n\r\n");
+    if (!headerEnd) return length >= MAX_REQUEST_SIZE ? -1 : 0;
+    long contentLength = getContentLength(data);
+    if (contentLength < 0 || contentLength > SAVE_MAX_SIZE) return -1;
+    size_t total = (size_t)(headerEnd + 4 - data) + (size_t)contentLength;
+    return length >= total ? (long)total : 0;
+}
+
+// ==================== HTTP长连接 ====================
+// HTTP/1.1默认保持连接（请求带Connection: close，或HTTP/1.0没有带keep-alive时除外）。
+// 保持的连接放进select集合等待下一个请求，空闲超过HTTP_KEEP_ALIVE_TIMEOUT后关闭。
+// socket是非阻塞的：可读时把收到的数据追加到pending，收齐一个完整请求才处理，
+// 只发了半个请求的客户端不会卡住主循环，超过HTTP_READ_TIMEOUT还没收齐就关闭。
+// 客户端连发的流水线请求留在pending里，下一轮不等select直接处理，按顺序回复
+
+#define HTTP_MAX_CLIENTS 256
+#define HTTP_KEEP_ALIVE_TIMEOUT 30.0  // 空闲连接保留的时间（秒）
+#define HTTP_READ_TIMEOUT 10.0        // 收齐一个请求的最长时间（秒），从收到它的第一个字节算起
+
+typedef struct HttpClient {
+    int socket;
+    unsigned long address;  // 客户端地址（用于准入控制）
+    double lastActive;      // 上一个请求处理完的时间
+    char* pending;          // 已收到、尚未处理的请求数据（以'\0'结尾），没有时为NULL
+    size_t pendingLength;
+    double requestStarted;  // 收到未完成请求第一个字节的时间，pending中没有未完成请求时为0
+    bool peerClosed;        // 对端已关闭写方向，处理完pending中的完整请求后关闭
+} HttpClient;
+
+static HttpClient httpClients[HTTP_MAX_CLIENTS];
+static int httpClientCount = 0;
+
+static void closeHttpClient(HttpClient* client) {
+    close(client->socket);
+    free(client->pending);
+    client->pending = NULL;
+    client->pendingLength = 0;
+}
+
+// pending中已有完整的请求，不必等socket可读
+static bool hasPendingRequest(const HttpClient* client) {
+    return client->pending && getHttpRequestLength(client->pending, client->pendingLength) > 0;
+}
+
+// pending中有收到一部分的请求时记下开始时间（用于读取超时）
+static void updateRequestStarted(HttpClient* client, double now) {
+    if (client->pendingLength == 0 || hasPendingRequest(client)) {
+        client->requestStarted = 0;
+    } else if (client->requestStarted == 0) {
+        client->requestStarted = now;
+    }
+}
+
+// socket可读时把能读到的数据都追加到pending（不阻塞），连接出错或请求过大时返回false
+static bool readHttpClient(HttpClient* client) {
+    for (;;) {
+        if (client->pendingLength >= MAX_REQUEST_SIZE) {
+            // 已攒够最大的请求，先处理掉再读；攒满了也不是完整请求时拒绝
+            return hasPendingRequest(client);
+        }
+        size_t capacity = client->pendingLength + BUFFER_SIZE;
+        char* grown = (char*)realloc(client->pending, capacity + 1);
+        if (!grown) return false;
+        client->pending = grown;
+
+        int bytesRead = (int)recv(client->socket, client->pending + client->pendingLength, BUFFER_SIZE, 0);
+        if (bytesRead < 0 && isWouldBlock()) break;
+        if (bytesRead <= 0) {
+            if (bytesRead < 0) return false;
+            client->peerClosed = true;
+            break;
+        }
+        client->pendingLength += (size_t)bytesRead;
+        client->pending[client->pendingLength] = '\0';
+    }
+    if (client->pendingLength == 0) {
+        free(client->pending);
+        client->pending = NULL;
+    } else {
+        client->pending[client->pendingLength] = '\0';
+    }
+    return getHttpRequestLength(client->pending ? client->pending : "", client->pendingLength) >= 0;
+}
+
+// 从pending中取出第一个完整请求（malloc分配，以'\0'结尾），剩下的数据留在pending
+static char* takeHttpRequest(HttpClient* client) {
+    long length = getHttpRequestLength(client->pending, client->pendingLength);
+    if (length <= 0) return NULL;
+    char* request = client->pending;
+    size_t rest = client->pendingLength - (size_t)length;
+    client->pending = NULL;
+    client->pendingLength = 0;
+    if (rest > 0) {
+        client->pending = (char*)malloc(rest + 1);
+        if (!client->pending) {
+            free(request);
+            return NULL;
+        }
+        memcpy(client->pending, request + length, rest + 1);
+        client->pendingLength = rest;
+    }
+    request[length] = '\0';
+    return request;
+}
+
+static bool wantsKeepAlive(const char* request) {
+    const char* lineEnd = strstr(request, "\r\n");
+    const char* version = strstr(request, "HTTP/1.0");
+    bool http10 = version && (!lineEnd || version < lineEnd);
+
+    const char* connection = findHeaderValue(request, "connection:");
+    if (headerValueStartsWith(connection, "close")) return false;
+    if (headerValueStartsWith(connection, "keep-alive")) return true;
+    return !http10;
+}
+
+// 处理pending中的第一个完整请求，返回连接是否继续保持
+// （否则已关闭，或交给了生成队列/存档组提交/WebSocket）
+static bool serveHttpRequest(HttpClient* client) {
+    int clientSocket = client->socket;
+    char* request = takeHttpRequest(client);
+    if (!request) {
+        closeHttpClient(client);
+        return false;
+    }
+    requestKeepAlive = wantsKeepAlive(request);
+    requestClientAddress = client->address;
+    handleHttpRequest(clientSocket, request);
+    free(request);
+
+    // 后续的流水线请求跟着生成任务走，回复后随连接回到等待集合
+    if (requestDeferred) {
+        attachGeneratePending(client->pending, client->pendingLength);
+        client->pending = NULL;
+        client->pendingLength = 0;
+        return false;
+    }
+
+    // 生成请求执行完后连接再回到等待集合；存档请求在组提交后才回复，回复后关闭；
+    // 升级为WebSocket的连接保持打开
+    bool deferred = (pendingSaveCount > 0 && pendingSaveSockets[pendingSaveCount - 1] == clientSocket) ||
+                    isWebSocketClient(clientSocket);
+    if (deferred || !requestKeepAlive) {
+        // 交给存档组提交/WebSocket的连接不再按HTTP读取，多读到的数据丢弃
+        if (deferred) {
+            free(client->pending);
+            client->pending = NULL;
+            client->pendingLength = 0;
+        } else {
+            closeHttpClient(client);
+        }
+        return false;
+    }
+    return true;
+}
+
+// 连接加入等待集合（新连接，或生成请求回复后的连接），请求留到可读时再读；
+// 已满时关闭空闲最久的连接（只发了半个请求的连接一直没有处理过请求，会先被挤掉）腾出位置
+// pending为连接上已读到的后续请求数据（接管），没有时传NULL
+static void addHttpClient(int clientSocket, unsigned long address, char* pending, size_t pendingLength) {
+    if (!setSocketNonBlocking(clientSocket)) {
+        close(clientSocket);
+        free(pending);
+        return;
+    }
+    int slot = httpClientCount;
+    if (httpClientCount == HTTP_MAX_CLIENTS) {
+        slot = 0;
+        for (int i = 1; i < httpClientCount; i++) {
+            if (httpClients[i].lastActive < httpClients[slot].lastActive) slot = i;
+        }
+        closeHttpClient(&httpClients[slot]);
+    } else {
+        httpClientCount++;
+    }
+    httpClients[slot].socket = clientSocket;
+    httpClients[slot].address = address;
+    httpClients[slot].lastActive = getMonotonicTime();
+    httpClients[slot].pending = pending;
+    httpClients[slot].pendingLength = pendingLength;
+    httpClients[slot].requestStarted = 0;
+    httpClients[slot].peerClosed = false;
+    updateRequestStarted(&httpClients[slot], httpClients[slot].lastActive);
+}
+
+// 执行一个排队的生成任务，回复后保持的连接回到等待集合
+static void runQueuedGenerate(void) {
+    GenerateJob job;
+    runGenerateJob(&job);
+    if (job.keepAlive) {
+        addHttpClient(job.socket, job.address, job.pending, job.pendingLength);
+    } else {
+        close(job.socket);
+        free(job.pending);
+    }
+}
+
+static int addHttpClientSockets(fd_set* readSet, int maxSocket) {
+    for (int i = 0; i < httpClientCount; i++) {
+        if (httpClients[i].peerClosed) continue;  // 已读到EOF，socket会一直可读
+        FD_SET(httpClients[i].socket, readSet);
+        if (httpClients[i].socket > maxSocket) maxSocket = httpClients[i].socket;
+    }
+    return maxSocket;
+}
+
+// 连接的超时时刻：收到一部分的请求按读取超时，否则按空闲超时
+static double getHttpClientDeadline(const HttpClient* client) {
+    if (client->requestStarted > 0) return client->requestStarted + HTTP_READ_TIMEOUT;
+    return client->lastActive + HTTP_KEEP_ALIVE_TIMEOUT;
+}
+
+// 距离最早的连接超时还有多久（秒），有待处理的流水线请求时返回0，没有连接时返回-1
+static double getHttpClientWait(void) {
+    if (httpClientCount == 0) return -1;
+    double earliest = getHttpClientDeadline(&httpClients[0]);
+    for (int i = 0; i < httpClientCount; i++) {
+        if (hasPendingRequest(&httpClients[i]) || httpClients[i].peerClosed) return 0;
+        double deadline = getHttpClientDeadline(&httpClients[i]);
+        if (deadline < earliest) earliest = deadline;
+    }
+    double wait = earliest - getMonotonicTime();
+    return wait > 0 ? wait : 0;
+}
+
+static void processHttpClients(fd_set* readSet) {
+    double now = getMonotonicTime();
+    int kept = 0;
+    for (int i = 0; i < httpClientCount; i++) {
+        HttpClient client = httpClients[i];
+        bool open = true;
+        if (!client.peerClosed && FD_ISSET(client.socket, readSet) && !readHttpClient(&client)) {
+            closeHttpClient(&client);
+            open = false;
+        } else if (hasPendingRequest(&client)) {
+            open = serveHttpRequest(&client);
+            client.lastActive = getMonotonicTime();
+        } else if (client.peerClosed || now >= getHttpClientDeadline(&client)) {
+            // 对端已关闭且没有完整的请求，或请求迟迟收不齐/空闲太久
+            closeHttpClient(&client);
+            open = false;
+        }
+        if (open) {
+            updateRequestStarted(&client, now);
+            httpClients[kept++] = client;
+        }
+    }
+    httpClientCount = kept;
+}
+
+// 是否还有请求在等待（新连接或保持的连接上的下一个请求，用于决定是否继续攒批）
+static bool isRequestWaiting(int serverSocket) {
+    for (int i = 0; i < httpClientCount; i++) {
+        if (hasPendingRequest(&httpClients[i])) return true;
+    }
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(serverSocket, &readSet);
+    int maxSocket = addHttpClientSockets(&readSet, serverSocket);
+    struct timeval timeout = {0, 0};
+    return select(maxSocket + 1, &readSet, NULL, NULL, &timeout) > 0;
 }
 
 // ==================== 主函数 ====================
@@ -367,6 +2980,8 @@ int main(void) {
             printf("WSAStartup failed\n");
             return 1;
         }
+    #else
+        signal(SIGPIPE, SIG_IGN);  // 对端已关闭时send返回错误，而不是终止进程
     #endif
     
     int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
@@ -394,34 +3009,100 @@ int main(void) {
         return 1;
     }
     
-    if (listen(serverSocket, 5) < 0) {
+    if (listen(serverSocket, LISTEN_BACKLOG) < 0) {
         perror("Listen failed");
         close(serverSocket);
         return 1;
     }
     
+    double loadStart = getMonotonicTime();
+    if (loadServerSnapshot()) {
+        worldEdits = getSnapshotHeader()->worldEdits;
+        printf("Loaded snapshot %s: %u entries in %.3f ms\n", SNAPSHOT_FILE,
+               getSnapshotHeader()->entryCount, (getMonotonicTime() - loadStart) * 1000.0);
+    }
+    initWebSockets();
+    setTraceEnabled(true);  // 记录线上请求，通过/api/trace导出
+
+    saveStore = openSaveStore(SAVE_STORE_FILE);
+    if (saveStore) {
+        importLegacySave();
+    } else {
+        printf("Failed to open save store %s\n", SAVE_STORE_FILE);
+    }
+
     printf("BYOW Server running on port %d\n", PORT);
     printf("Open http://localhost:%d in your browser\n", PORT);
     
     while (1) {
-        struct sockaddr_in clientAddr;
-        socklen_t clientLen = sizeof(clientAddr);
-        int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientLen);
-        
-        if (clientSocket < 0) {
-            perror("Accept failed");
+        fd_set readSet;
+        fd_set writeSet;
+        FD_ZERO(&readSet);
+        FD_ZERO(&writeSet);
+        FD_SET(serverSocket, &readSet);
+        int maxSocket = addWebSocketSockets(&readSet, &writeSet, serverSocket);
+        maxSocket = addHttpClientSockets(&readSet, maxSocket);
+
+        // 有待推送的增量、待写的快照或将要超时的空闲连接时最多等到对应时刻，否则一直等待新连接或客户端消息
+        double wait = getWebSocketWait();
+        double httpWait = getHttpClientWait();
+        if (httpWait >= 0 && (wait < 0 || httpWait < wait)) wait = httpWait;
+        if (generateQueueCount > 0) wait = 0;  // 有排队的生成任务时只检查就绪的请求，不阻塞
+        if (snapshotDirty) {
+            double snapshotWait = lastSnapshotTime + SNAPSHOT_INTERVAL - getMonotonicTime();
+            if (snapshotWait < 0) snapshotWait = 0;
+            if (wait < 0 || snapshotWait < wait) wait = snapshotWait;
+        }
+        struct timeval timeout;
+        timeout.tv_sec = (long)wait;
+        timeout.tv_usec = (long)((wait - (double)timeout.tv_sec) * 1000000.0);
+        int ready = select(maxSocket + 1, &readSet, &writeSet, NULL, wait >= 0 ? &timeout : NULL);
+        if (ready < 0) {
+            perror("Select failed");
             continue;
         }
-        
-        char buffer[BUFFER_SIZE];
-        int bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-        
-        if (bytesRead > 0) {
-            buffer[bytesRead] = '\0';
-            handleHttpRequest(clientSocket, buffer);
+
+        if (ready > 0 && FD_ISSET(serverSocket, &readSet)) {
+            struct sockaddr_in clientAddr;
+            socklen_t clientLen = sizeof(clientAddr);
+            int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientLen);
+
+            if (clientSocket < 0) {
+                perror("Accept failed");
+            } else {
+                addHttpClient(clientSocket, (unsigned long)clientAddr.sin_addr.s_addr, NULL, 0);
+            }
+        }
+
+        if (ready > 0) {
+            processWebSocketClients(&readSet, &writeSet);
+        }
+        processHttpClients(&readSet);
+
+        // 已就绪的读请求处理完后再执行生成任务
+        if (shouldRunGenerateJob(generateQueueCount > 0 && isRequestWaiting(serverSocket))) {
+            runQueuedGenerate();
+        }
+
+        // 每个tick把累积的变化合并成一帧推送给所有订阅者
+        if (getWebSocketWait() == 0) {
+            TRACE_BEGIN(span);
+            broadcastWebSocketDeltas();
+            TRACE_END(span, "broadcastWebSocketDeltas");
+        }
+
+        // 没有更多排队的连接（或批次已满）时，一次fsync提交这一批存档
+        if (pendingSaveCount > 0 &&
+            (pendingSaveCount == SAVE_GROUP_MAX || !isRequestWaiting(serverSocket))) {
+            TRACE_BEGIN(span);
+            commitPendingSaves();
+            TRACE_END(span, "commitPendingSaves");
+        }
+
+        // 区块缓存的变化按间隔批量写入快照
+        if (snapshotDirty && getMonotonicTime() - lastSnapshotTime >= SNAPSHOT_INTERVAL) {
+            saveServerSnapshot();
         }
-        
-        close(clientSocket);
     }
     
     close(serverSocket);
@@ -431,9 +3112,22 @@ int main(void) {
     #endif
     
     // 清理
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (wsClients[i].socket >= 0) closeWebSocketClient(&wsClients[i]);
+    }
+    for (int i = 0; i < httpClientCount; i++) {
+        closeHttpClient(&httpClients[i]);
+    }
     if (currentWorld) {
         destroyWorld(currentWorld);
     }
+    destroyChunkCache(chunkCache);
+    clearResponseCache();
+    for (int i = 0; i < STATIC_ASSET_COUNT; i++) {
+        unloadStaticAsset(&staticAssets[i]);
+    }
+    unloadServerSnapshot();
+    closeSaveStore(saveStore);
     
     return 0;
 }